@@ -13,7 +13,8 @@ NOTES
 
 - The comments next to the function declarations below serve as documentation.
 - All angles are expected to be in radians.
-- All matrices are expected to be 4x4 matrices in row-major order.
+- All matrices are expected to be 4x4 matrices in row-major order, except
+  for the homography helpers, which work on 3x3 ones.
 - OpenGL likes column major MVP matrices. Don't forget to transpose!
 
 EXAMPLE
@@ -104,6 +105,15 @@ SGVGLM_DEF void sgv_glm_look_at(float* res,
 SGVGLM_DEF void sgv_glm_perspective(float* res, float fov_y, float aspect,
                                     float near_z, float far_z);
 
+/* res = the 3x3 homography taking the four points (src[2*i], src[2*i+1]) to
+   (dst[2*i], dst[2*i+1]), scaled so that res[8] = 1. Returns -1, leaving res
+   as it was, if three of the points are on a line. */
+SGVGLM_DEF int sgv_glm_homography(float* res, float* src, float* dst);
+
+/* res = m^-1 for the 3x3 matrix m (res may be m). Returns -1, leaving res as
+   it was, if m is singular. */
+SGVGLM_DEF int sgv_glm_inverse3(float* res, float* m);
+
 #ifdef __cplusplus
 }
 #endif
@@ -334,4 +344,93 @@ SGVGLM_DEF void sgv_glm_perspective(float* res, float fov_y, float aspect,
     sgv_glm_premul(res, p);
 }
 
+#define SGVP_GLM_ABS(x) ((x) < 0 ? -(x) : (x))
+
+SGVGLM_DEF int sgv_glm_homography(float* res, float* src, float* dst)
+{
+    /* With h[8] = 1, each pair (x, y) -> (u, v) gives two equations in the
+       other eight entries:
+            x*h0 + y*h1 + h2 - u*x*h6 - u*y*h7 = u
+            x*h3 + y*h4 + h5 - v*x*h6 - v*y*h7 = v
+       Solved by Gaussian elimination with partial pivoting, in double. */
+    double a[8][9], t, big;
+    int i, j, k, p;
+
+    for(i = 0; i < 4; i++)
+    {
+        double x = src[2*i], y = src[2*i+1], u = dst[2*i], v = dst[2*i+1];
+        double r0[9], r1[9];
+        r0[0] = x; r0[1] = y; r0[2] = 1; r0[3] = 0; r0[4] = 0; r0[5] = 0;
+        r0[6] = -u*x; r0[7] = -u*y; r0[8] = u;
+        r1[0] = 0; r1[1] = 0; r1[2] = 0; r1[3] = x; r1[4] = y; r1[5] = 1;
+        r1[6] = -v*x; r1[7] = -v*y; r1[8] = v;
+        for(j = 0; j < 9; j++)
+        {
+            a[2*i][j] = r0[j];
+            a[2*i+1][j] = r1[j];
+        }
+    }
+
+    big = 0;
+    for(i = 0; i < 8; i++)
+        for(j = 0; j < 8; j++)
+            big = SGVP_GLM_ABS(a[i][j]) > big ? SGVP_GLM_ABS(a[i][j]) : big;
+
+    for(k = 0; k < 8; k++)
+    {
+        p = k;
+        for(i = k+1; i < 8; i++)
+            if(SGVP_GLM_ABS(a[i][k]) > SGVP_GLM_ABS(a[p][k]))
+                p = i;
+        if(!(SGVP_GLM_ABS(a[p][k]) > 1e-9 * big))
+            return -1;
+        for(j = 0; j < 9; j++)
+        {
+            t = a[k][j]; a[k][j] = a[p][j]; a[p][j] = t;
+        }
+        for(i = k+1; i < 8; i++)
+        {
+            t = a[i][k] / a[k][k];
+            for(j = k; j < 9; j++)
+                a[i][j] -= t * a[k][j];
+        }
+    }
+    for(k = 7; k >= 0; k--)
+    {
+        t = a[k][8];
+        for(j = k+1; j < 8; j++)
+            t -= a[k][j] * a[j][8];
+        a[k][8] = t / a[k][k];
+    }
+
+    for(i = 0; i < 8; i++)
+        res[i] = (float)a[i][8];
+    res[8] = 1.0f;
+    return 0;
+}
+
+SGVGLM_DEF int sgv_glm_inverse3(float* res, float* m)
+{
+    double c[9], det;
+    int i;
+
+    /* cofactors, transposed */
+    c[0] = (double)m[4]*m[8] - (double)m[5]*m[7];
+    c[1] = (double)m[2]*m[7] - (double)m[1]*m[8];
+    c[2] = (double)m[1]*m[5] - (double)m[2]*m[4];
+    c[3] = (double)m[5]*m[6] - (double)m[3]*m[8];
+    c[4] = (double)m[0]*m[8] - (double)m[2]*m[6];
+    c[5] = (double)m[2]*m[3] - (double)m[0]*m[5];
+    c[6] = (double)m[3]*m[7] - (double)m[4]*m[6];
+    c[7] = (double)m[1]*m[6] - (double)m[0]*m[7];
+    c[8] = (double)m[0]*m[4] - (double)m[1]*m[3];
+
+    det = m[0]*c[0] + m[1]*c[3] + m[2]*c[6];
+    if(det == 0)
+        return -1;
+    for(i = 0; i < 9; i++)
+        res[i] = (float)(c[i] / det);
+    return 0;
+}
+
 #endif
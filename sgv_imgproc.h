@@ -17,6 +17,35 @@ When #including this file along with the implementation,
   #define SGV_IMGP_ASSERT(x) before #including this file.
 - If you dont want <math.h>, #define SGV_IMGP_FABS(x) and SGV_IMGP_EXP(x)
   before #including this file.
+- If sgv_imgp_crop_rescale must give the same output as older versions
+  (which supersampled), #define SGV_IMGP_LEGACY_RESCALE before #including
+  this file.
+- If you want the built-in thread pool (sgv_imgp_start_threads), #define
+  SGV_IMGP_THREADS before #including this file and link with pthreads.
+
+THREADS
+-------
+
+By default every routine runs on the calling thread. Once a parallel-for is set
+with sgv_imgp_set_parallel_for (or the built-in pool is started), conv, the
+fused conv, make_fimg, add_bias, relu, maxpool (and their quantized, half
+precision and batched versions), affine_transform, perspective_transform,
+crop_rescale and blit split their output into bands of rows (and the convs into
+blocks of channels) and run them on it. Every output value is computed the same
+way whichever band it falls in, so the results do not depend on the number of
+threads. The pool is shared, so calls from several threads at once take turns.
+
+VIEWS
+-----
+
+Every routine taking images has a _view version that takes views into
+larger buffers instead (sgv_img_view, sgv_fimg_view, sgv_iimg_view and
+sgv_himg_view): point data at the top-left pixel and set stride to the row
+length of the buffer, in elements. A crop, a tile of a frame or the inside
+of a padded tensor is then passed without a copy, and outputs written into
+a view leave the rest of the buffer alone. The channels of a pixel must
+still be next to each other. The routines on sgv_img and the other packed
+structs read and write rows back to back.
 
 LICENSE
 -------
@@ -57,11 +86,80 @@ typedef struct {
     int w, h, d;
 } sgv_iimg;
 
+/* Views, for the _view versions of the routines: row y starts stride
+   elements after row y-1, so a crop, a tile or the inside of a padded
+   buffer is just data pointing into it with a larger stride. stride == 0
+   means packed rows (w*d). */
+typedef struct {
+    unsigned char* data; /* top-left pixel, in HWC format */
+    int w, h, d;
+    int stride; /* elements from one row to the next, 0 if w*d */
+} sgv_img_view;
+
+typedef struct {
+    float* data;
+    int w, h, d;
+    int stride;
+} sgv_fimg_view;
+
+typedef struct {
+    int* data;
+    int w, h, d;
+    int stride;
+} sgv_iimg_view;
+
 typedef struct {
     float* data; /*[filter_height, filter_width, in_channels, out_channels]*/
     int w, h, ind, outd;
 } sgv_filt;
 
+/* A 3x3 filter transformed for Winograd convolution, see sgv_make_wfilt */
+typedef struct {
+    float* data; /*[16, in_channels, out_channels]*/
+    int ind, outd;
+} sgv_wfilt;
+
+/* Quantization of an 8-bit image: value = scale*(q - zero). The bytes of
+   an sgv_img with scale 2/255 and zero 128 are, to within half a step,
+   what sgv_make_fimg makes of them. */
+typedef struct {
+    float scale;
+    int zero;
+} sgv_imgp_quant;
+
+/* An int8 filter, symmetric: value = scales[c]*q for output channel c, or
+   scales[0] for all of them if per_channel is 0. See sgv_make_qfilt. */
+typedef struct {
+    signed char* data; /*[filter_height, filter_width, in_channels, out_channels]*/
+    float* scales;
+    int w, h, ind, outd, per_channel;
+} sgv_qfilt;
+
+/* Formats of half precision values: 16 bits each, widened to float to be
+   worked on. fp16 keeps more precision, bfloat16 (the top half of a float)
+   the range of a float. */
+#define SGV_IMGP_F16  0
+#define SGV_IMGP_BF16 1
+
+typedef struct {
+    unsigned short* data; /* in HWC format */
+    int w, h, d;
+    int format; /* SGV_IMGP_F16 or SGV_IMGP_BF16 */
+} sgv_himg;
+
+typedef struct {
+    unsigned short* data;
+    int w, h, d;
+    int stride;
+    int format;
+} sgv_himg_view;
+
+typedef struct {
+    unsigned short* data; /*[filter_height, filter_width, in_channels, out_channels]*/
+    int w, h, ind, outd;
+    int format;
+} sgv_hfilt;
+
 typedef struct {
     int x, y;
 } sgv_imgp_i2;
@@ -74,6 +172,32 @@ typedef struct {
     int x, y, z, w;
 } sgv_imgp_i4;
 
+/* Calls task(ctx, i) for every i in [0, n). Tasks may run concurrently and
+   in any order; the call returns once all of them are done. */
+typedef void (*sgv_imgp_task)(void* ctx, int i);
+typedef void (*sgv_imgp_parallel_for)(void* user, int n,
+                                      sgv_imgp_task task, void* ctx);
+
+/* Runs the routines of this lib on pfor, which is called with user and
+   has about nthreads threads (used to pick how finely to split the work).
+   pfor == 0 runs everything on the calling thread again. */
+SGVIMGP_DEF void sgv_imgp_set_parallel_for(sgv_imgp_parallel_for pfor,
+                                           void* user, int nthreads);
+
+#ifdef SGV_IMGP_THREADS
+/* Starts a work-stealing pool of nthreads threads (counting the caller)
+   and sets it as the parallel-for. Returns 0, or -1 if not even one more
+   thread could be started. The convs need ~200 KB of stack per thread, so
+   the workers get at least 512 KB whatever the default of the platform;
+   the calling thread needs as much. */
+SGVIMGP_DEF int sgv_imgp_start_threads(int nthreads);
+
+/* Stops the pool; the routines run on the calling thread again. Waits
+   for a call that is running on the pool to finish, so it may be called
+   while other threads use this lib. sgv_imgp_start_threads may not. */
+SGVIMGP_DEF void sgv_imgp_stop_threads(void);
+#endif
+
 /* Copy in to out. [0-255] in 'in' will be [-1.0, 1.0] in 'out' */
 SGVIMGP_DEF void sgv_make_fimg(sgv_img in, sgv_fimg out);
 
@@ -96,9 +220,34 @@ SGVIMGP_DEF void sgv_draw_quadrilateral(sgv_img img,
                                         sgv_imgp_i2 p3, sgv_imgp_i2 p4,
                                         sgv_imgp_i3 color, int thickness);
 
-/* 2D convolution */
+/* 2D convolution. Runs as a cache blocked matrix product with SSE/AVX/FMA
+   where the compiler targets them, 3x3 filters on 8 or more channels with
+   Winograd (see below). Takes up to ~100 KB of stack. */
 SGVIMGP_DEF void sgv_conv2d_valid(sgv_fimg img, sgv_filt filt, sgv_fimg out);
 
+/* Transforms a 3x3 filter once, so that sgv_conv2d_valid_wfilt does not
+   have to on every call. out.data must hold 16*filt.ind*filt.outd floats. */
+SGVIMGP_DEF void sgv_make_wfilt(sgv_filt filt, sgv_wfilt out);
+
+/* sgv_conv2d_valid with a 3x3 filter made by sgv_make_wfilt. Winograd
+   F(2x2, 3x3): 16 multiplications per 2x2 outputs instead of 36. */
+SGVIMGP_DEF void sgv_conv2d_valid_wfilt(sgv_fimg img, sgv_wfilt filt,
+                                        sgv_fimg out);
+
+/* sgv_conv2d_valid, sgv_add_bias, sgv_relu and sgv_maxpool2 in one pass.
+   The convolution is done a strip at a time into a buffer that stays in
+   cache, and only the pooled result is written to out, so
+   out.w == conv_w/2 and out.h == conv_h/2. len(biases) == filt.outd.
+   Takes up to ~170 KB of stack. */
+SGVIMGP_DEF void sgv_conv2d_bias_relu_maxpool2(sgv_fimg img, sgv_filt filt,
+                                               float* biases, sgv_fimg out);
+
+/* sgv_conv2d_bias_relu_maxpool2 with a filter made by sgv_make_wfilt */
+SGVIMGP_DEF void sgv_conv2d_bias_relu_maxpool2_wfilt(sgv_fimg img,
+                                                     sgv_wfilt filt,
+                                                     float* biases,
+                                                     sgv_fimg out);
+
 /* Add a bias to all pixels each channel. len(biases) == img.d */
 SGVIMGP_DEF void sgv_add_bias(sgv_fimg img, float* biases);
 
@@ -108,20 +257,124 @@ SGVIMGP_DEF void sgv_relu(sgv_fimg in, sgv_fimg out);
 /* Max pool 2x2. */
 SGVIMGP_DEF void sgv_maxpool2(sgv_fimg in, sgv_fimg out);
 
+/* The above on a batch of n images of the same size (NHWC): w, h and d are
+   those of one image, and image b starts b*h rows after data. So a batch
+   is also an image n*h tall, which is how sgv_add_bias takes it. The conv
+   packs (or transforms) each block of the filter once and runs it over
+   the same rows of every image, so small images cost less each in bigger
+   batches. */
+SGVIMGP_DEF void sgv_conv2d_valid_batch(sgv_fimg img, int n, sgv_filt filt,
+                                        sgv_fimg out);
+SGVIMGP_DEF void sgv_conv2d_valid_wfilt_batch(sgv_fimg img, int n,
+                                              sgv_wfilt filt, sgv_fimg out);
+SGVIMGP_DEF void sgv_relu_batch(sgv_fimg in, int n, sgv_fimg out);
+SGVIMGP_DEF void sgv_maxpool2_batch(sgv_fimg in, int n, sgv_fimg out);
+
+/* Quantizes filt to out, with the scales that map the largest magnitude of
+   each output channel (or of all of them, if out.per_channel is 0) to 127.
+   out.data must hold as many values as filt, out.scales one per output
+   channel (or 1). */
+SGVIMGP_DEF void sgv_make_qfilt(sgv_filt filt, sgv_qfilt out);
+
+/* sgv_conv2d_valid on 8-bit images, e.g. straight from the camera, without
+   going through floats: int8 x uint8 products summed in 32 bits, with
+   SSE2/AVX2 where the compiler targets them. Then the filt.outd biases (0
+   for none) are added and the sums requantized to qout, saturating. Takes
+   up to ~60 KB of stack. */
+SGVIMGP_DEF void sgv_qconv2d_valid(sgv_img img, sgv_imgp_quant qin,
+                                   sgv_qfilt filt, float* biases,
+                                   sgv_img out, sgv_imgp_quant qout);
+
+/* sgv_qconv2d_valid without the epilogue: out gets the 32-bit sums, with
+   the zero of qin taken out, so value = qin.scale*filt.scales[c]*out */
+SGVIMGP_DEF void sgv_qconv2d_valid_acc(sgv_img img, sgv_imgp_quant qin,
+                                       sgv_qfilt filt, sgv_iimg out);
+
+/* sgv_add_bias on a quantized image, saturating */
+SGVIMGP_DEF void sgv_qadd_bias(sgv_img img, sgv_imgp_quant q, float* biases);
+
+/* sgv_relu on a quantized image: everything below q.zero becomes q.zero */
+SGVIMGP_DEF void sgv_qrelu(sgv_img in, sgv_imgp_quant q, sgv_img out);
+
+/* sgv_maxpool2 on a quantized image (the quantization is kept) */
+SGVIMGP_DEF void sgv_qmaxpool2(sgv_img in, sgv_img out);
+
+/* out = q.scale*(in - q.zero), e.g. for the scores before sgv_softmax */
+SGVIMGP_DEF void sgv_dequantize(sgv_img in, sgv_imgp_quant q, sgv_fimg out);
+
+/* Rounds in to half precision (to nearest, ties to even), with F16C or
+   AVX-512 BF16 where the compiler targets them. bfloat16 flushes values
+   below 2^-126 to zero, as AVX-512 BF16 does. */
+SGVIMGP_DEF void sgv_make_himg(sgv_fimg in, sgv_himg out);
+
+/* Widens a half precision image back to floats, exactly */
+SGVIMGP_DEF void sgv_himg_to_fimg(sgv_himg in, sgv_fimg out);
+
+/* Rounds filt to half precision. out.data must hold as many values. */
+SGVIMGP_DEF void sgv_make_hfilt(sgv_filt filt, sgv_hfilt out);
+
+/* sgv_conv2d_valid on half precision images and filter, which may be of
+   different formats: the same matrix product (or Winograd), widening the
+   input and the filter as it packs them and summing in floats, a strip of
+   output at a time that is rounded to out while in cache. Half the memory
+   traffic of sgv_conv2d_valid. Takes up to ~140 KB of stack. */
+SGVIMGP_DEF void sgv_hconv2d_valid(sgv_himg img, sgv_hfilt filt,
+                                   sgv_himg out);
+
+/* sgv_add_bias, sgv_relu and sgv_maxpool2 on half precision images. relu
+   and maxpool give the exact values of the input when out has its format,
+   and round them to out otherwise. */
+SGVIMGP_DEF void sgv_hadd_bias(sgv_himg img, float* biases);
+SGVIMGP_DEF void sgv_hrelu(sgv_himg in, sgv_himg out);
+SGVIMGP_DEF void sgv_hmaxpool2(sgv_himg in, sgv_himg out);
+
 /* convert scores to probabilities */
 SGVIMGP_DEF void sgv_softmax(float* scores_in, int n, float* probs_out);
 
+/* sgv_softmax on each of n rows of 'classes' scores, one after another */
+SGVIMGP_DEF void sgv_softmax_batch(float* scores_in, int n, int classes,
+                                   float* probs_out);
+
 /* Apply affine transform. in_offset is the offset in the input image for the
    the transform operation. So, out[0, 0] == in[in_offset.x, in_offset.y].
-   theta is the 2x2 transform matrix */
+   theta is the 2x2 transform matrix. Bilinear in fixed point, with parts
+   off the image black. */
 SGVIMGP_DEF void sgv_imgp_affine_transform(sgv_img in, sgv_imgp_i2 in_offset,
                                            float* theta,
                                            sgv_img out, sgv_imgp_i2 out_offset);
 
-/* Crop and rescale the image */
+/* Apply the 3x3 homography h (row-major): output pixel (x, y) is taken from
+   the input at (h0*x + h1*y + h2, h3*x + h4*y + h5)/(h6*x + h7*y + h8), with
+   pixel centres at +0.5 in both images. So h maps output to input; make it
+   with sgv_glm_homography(h, out_corners, in_corners) from sgv_glmath.h, or
+   invert one the other way with sgv_glm_inverse3. Bilinear in fixed point,
+   with parts off the image (or behind the horizon) black. */
+SGVIMGP_DEF void sgv_imgp_perspective_transform(sgv_img in, float* h,
+                                                sgv_img out);
+
+/* Filters for sgv_imgp_crop_rescale_filter */
+#define SGV_IMGP_RESCALE_AUTO     0 /* area to shrink, bilinear to enlarge */
+#define SGV_IMGP_RESCALE_BILINEAR 1
+#define SGV_IMGP_RESCALE_BICUBIC  2
+#define SGV_IMGP_RESCALE_LEGACY   3 /* supersampling of older versions */
+
+/* Crop and rescale the image, with SGV_IMGP_RESCALE_AUTO (or _LEGACY if
+   SGV_IMGP_LEGACY_RESCALE is defined) */
 SGVIMGP_DEF void sgv_imgp_crop_rescale(sgv_img in, sgv_imgp_i2 in_left_top,
                                       sgv_imgp_i2 crop_size, sgv_img out);
 
+/* Crop and rescale the image with the given filter. Except for _LEGACY,
+   the filter is applied to rows and then columns in 16-bit fixed point,
+   with the weights worked out once per row and column. The bilinear and
+   bicubic filters are widened when shrinking so they do not alias. Parts
+   of the crop off the image are black. Ratios too big for its buffers
+   (shrinking by more than about 250x, 500x bilinear or 1000x area, less
+   with many channels) fall back to _LEGACY. Takes up to ~90 KB of stack. */
+SGVIMGP_DEF void sgv_imgp_crop_rescale_filter(sgv_img in,
+                                              sgv_imgp_i2 in_left_top,
+                                              sgv_imgp_i2 crop_size,
+                                              sgv_img out, int filter);
+
 /* Finds the threshold that minimizes intra-class variance (Otsu threshold) */
 SGVIMGP_DEF unsigned char sgv_imgp_otsu(sgv_img img);
 
@@ -131,6 +384,84 @@ SGVIMGP_DEF void sgv_imgp_enhance_contrast(sgv_img in, sgv_img out);
 /* Blit src image to dst image (alpha of src is kept) */
 SGVIMGP_DEF void sgv_blit(sgv_img dst, sgv_img src, sgv_imgp_i2 offset);
 
+/* The routines above on views (see VIEWS) */
+SGVIMGP_DEF void sgv_make_fimg_view(sgv_img_view in, sgv_fimg_view out);
+SGVIMGP_DEF void sgv_grey_to_rgb_view(sgv_img_view grey, sgv_img_view out_rgb);
+SGVIMGP_DEF void sgv_draw_line_view(sgv_img_view img, sgv_imgp_i2 p1,
+                                    sgv_imgp_i2 p2, sgv_imgp_i3 color,
+                                    int thickness);
+SGVIMGP_DEF void sgv_draw_rect_view(sgv_img_view img, sgv_imgp_i2 p_lt,
+                                    sgv_imgp_i2 p_rb, sgv_imgp_i3 color,
+                                    int thickness);
+SGVIMGP_DEF void sgv_draw_quadrilateral_view(sgv_img_view img, sgv_imgp_i2 p1,
+                                             sgv_imgp_i2 p2, sgv_imgp_i2 p3,
+                                             sgv_imgp_i2 p4, sgv_imgp_i3 color,
+                                             int thickness);
+SGVIMGP_DEF void sgv_conv2d_valid_view(sgv_fimg_view img, sgv_filt filt,
+                                       sgv_fimg_view out);
+SGVIMGP_DEF void sgv_conv2d_valid_wfilt_view(sgv_fimg_view img, sgv_wfilt filt,
+                                             sgv_fimg_view out);
+SGVIMGP_DEF void sgv_conv2d_bias_relu_maxpool2_view(sgv_fimg_view img,
+                                                    sgv_filt filt,
+                                                    float* biases,
+                                                    sgv_fimg_view out);
+SGVIMGP_DEF void sgv_conv2d_bias_relu_maxpool2_wfilt_view(sgv_fimg_view img,
+                                                          sgv_wfilt filt,
+                                                          float* biases,
+                                                          sgv_fimg_view out);
+SGVIMGP_DEF void sgv_add_bias_view(sgv_fimg_view img, float* biases);
+SGVIMGP_DEF void sgv_relu_view(sgv_fimg_view in, sgv_fimg_view out);
+SGVIMGP_DEF void sgv_maxpool2_view(sgv_fimg_view in, sgv_fimg_view out);
+SGVIMGP_DEF void sgv_conv2d_valid_batch_view(sgv_fimg_view img, int n,
+                                             sgv_filt filt, sgv_fimg_view out);
+SGVIMGP_DEF void sgv_conv2d_valid_wfilt_batch_view(sgv_fimg_view img, int n,
+                                                   sgv_wfilt filt,
+                                                   sgv_fimg_view out);
+SGVIMGP_DEF void sgv_relu_batch_view(sgv_fimg_view in, int n,
+                                     sgv_fimg_view out);
+SGVIMGP_DEF void sgv_maxpool2_batch_view(sgv_fimg_view in, int n,
+                                         sgv_fimg_view out);
+SGVIMGP_DEF void sgv_qconv2d_valid_view(sgv_img_view img, sgv_imgp_quant qin,
+                                        sgv_qfilt filt, float* biases,
+                                        sgv_img_view out, sgv_imgp_quant qout);
+SGVIMGP_DEF void sgv_qconv2d_valid_acc_view(sgv_img_view img,
+                                            sgv_imgp_quant qin, sgv_qfilt filt,
+                                            sgv_iimg_view out);
+SGVIMGP_DEF void sgv_qadd_bias_view(sgv_img_view img, sgv_imgp_quant q,
+                                    float* biases);
+SGVIMGP_DEF void sgv_qrelu_view(sgv_img_view in, sgv_imgp_quant q,
+                                sgv_img_view out);
+SGVIMGP_DEF void sgv_qmaxpool2_view(sgv_img_view in, sgv_img_view out);
+SGVIMGP_DEF void sgv_dequantize_view(sgv_img_view in, sgv_imgp_quant q,
+                                     sgv_fimg_view out);
+SGVIMGP_DEF void sgv_make_himg_view(sgv_fimg_view in, sgv_himg_view out);
+SGVIMGP_DEF void sgv_himg_to_fimg_view(sgv_himg_view in, sgv_fimg_view out);
+SGVIMGP_DEF void sgv_hconv2d_valid_view(sgv_himg_view img, sgv_hfilt filt,
+                                        sgv_himg_view out);
+SGVIMGP_DEF void sgv_hadd_bias_view(sgv_himg_view img, float* biases);
+SGVIMGP_DEF void sgv_hrelu_view(sgv_himg_view in, sgv_himg_view out);
+SGVIMGP_DEF void sgv_hmaxpool2_view(sgv_himg_view in, sgv_himg_view out);
+SGVIMGP_DEF void sgv_imgp_affine_transform_view(sgv_img_view in,
+                                                sgv_imgp_i2 in_offset,
+                                                float* theta, sgv_img_view out,
+                                                sgv_imgp_i2 out_offset);
+SGVIMGP_DEF void sgv_imgp_perspective_transform_view(sgv_img_view in, float* h,
+                                                     sgv_img_view out);
+SGVIMGP_DEF void sgv_imgp_crop_rescale_view(sgv_img_view in,
+                                            sgv_imgp_i2 in_left_top,
+                                            sgv_imgp_i2 crop_size,
+                                            sgv_img_view out);
+SGVIMGP_DEF void sgv_imgp_crop_rescale_filter_view(sgv_img_view in,
+                                                   sgv_imgp_i2 in_left_top,
+                                                   sgv_imgp_i2 crop_size,
+                                                   sgv_img_view out,
+                                                   int filter);
+SGVIMGP_DEF unsigned char sgv_imgp_otsu_view(sgv_img_view img);
+SGVIMGP_DEF void sgv_imgp_enhance_contrast_view(sgv_img_view in,
+                                                sgv_img_view out);
+SGVIMGP_DEF void sgv_blit_view(sgv_img_view dst, sgv_img_view src,
+                               sgv_imgp_i2 offset);
+
 #ifdef __cplusplus
 }
 #endif
@@ -139,7 +470,9 @@ SGVIMGP_DEF void sgv_blit(sgv_img dst, sgv_img src, sgv_imgp_i2 offset);
 
 /*****************************************************************************
 ****************************** Implementation********************************/
-#ifdef SGV_IMGP_IMPLEMENTATION
+/* once, even if the header is included again (e.g. by sgv_nnet.h) */
+#if defined(SGV_IMGP_IMPLEMENTATION) && !defined(SGVP_IMGP_IMPLEMENTED)
+#define SGVP_IMGP_IMPLEMENTED
 
 #define SGV_IMGP_ABS(x) ((x > 0) ? x : -(x))
 
@@ -149,26 +482,330 @@ SGVIMGP_DEF void sgv_blit(sgv_img dst, sgv_img src, sgv_imgp_i2 offset);
 #define SGV_IMGP_EXP(x) exp(x)
 #endif
 
+#include <string.h>
+
 #ifndef SGV_IMGP_ASSERT
 #include <assert.h>
 #define SGV_IMGP_ASSERT(x) assert(x)
 #endif
 
-SGVIMGP_DEF void sgv_make_fimg(sgv_img in, sgv_fimg out)
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define SGVP_IMGP_SSE2
+#endif
+
+/* 4 bytes at p in an SSE register */
+#define SGVP_IMGP_LOAD4(p) _mm_cvtsi32_si128(sgvp_imgp_load4(p))
+
+#define SGVP_IMGP_MIN(a, b) ((a) < (b) ? (a) : (b))
+
+/* Elements from one row of img to the next */
+#define SGVP_IMGP_LD(img) ((img).stride ? (img).stride : (img).w*(img).d)
+
+static sgv_imgp_parallel_for sgvp_imgp_pfor;
+static void* sgvp_imgp_pfor_user;
+static int sgvp_imgp_nthreads = 1;
+
+/* Arguments of a routine split into tasks. Task i of a routine works on
+   band i/chunks of rows and chunk i%chunks of its blocks of channels. */
+typedef struct {
+    sgv_img_view a, b;
+    sgv_fimg_view fa, fb;
+    sgv_iimg_view ia;
+    sgv_himg_view ha, hb;
+    sgv_filt filt;
+    sgv_qfilt qfilt;
+    sgv_hfilt hfilt;
+    sgv_imgp_quant qa, qb;
+    const float* wf;
+    float *biases, *theta;
+    sgv_imgp_i2 p, q, r;
+    int batch; /* no. of images, see sgvp_imgp_region */
+    int rows, bands, chunks;
+} sgvp_imgp_job;
+
+/* Rows [y0, y1) of band i */
+#define SGVP_IMGP_BAND(job, i, y0, y1) \
+    y0 = (job)->rows*((i)/(job)->chunks)/(job)->bands; \
+    y1 = (job)->rows*((i)/(job)->chunks + 1)/(job)->bands
+
+/* Blocks [b0, b1) of chunk i out of blocks */
+#define SGVP_IMGP_CHUNK(job, i, blocks, b0, b1) \
+    b0 = (blocks)*((i)%(job)->chunks)/(job)->chunks; \
+    b1 = (blocks)*((i)%(job)->chunks + 1)/(job)->chunks
+
+/* Below this many operations a routine is not worth splitting */
+#define SGVP_IMGP_GRAIN (1 << 15)
+
+/* Runs task over bands of rows and, if there are too few rows to keep
+   the threads busy, chunks of blocks. Each row costs about work operations
+   per block. */
+static void sgvp_imgp_run(sgvp_imgp_job* job, sgv_imgp_task task,
+                          int rows, int blocks, double work)
 {
-    int x, y, d;
-    SGV_IMGP_ASSERT(in.w == out.w && in.h == out.h && in.d == out.d);
-    for(y = 0; y < in.h; y++) {
+    int i, n, want = 4*sgvp_imgp_nthreads;
+
+    job->rows = rows;
+    job->bands = job->chunks = 1;
+    if(sgvp_imgp_pfor && rows*work*blocks >= SGVP_IMGP_GRAIN) {
+        job->bands = SGVP_IMGP_MIN(rows, want);
+        job->chunks = SGVP_IMGP_MIN(blocks, (want + job->bands - 1)/job->bands);
+    }
+    n = rows > 0 ? job->bands*job->chunks : 0;
+    if(n > 1) {
+        sgvp_imgp_pfor(sgvp_imgp_pfor_user, n, task, job);
+    } else {
+        for(i = 0; i < n; i++) {
+            task(job, i);
+        }
+    }
+}
+
+SGVIMGP_DEF void sgv_imgp_set_parallel_for(sgv_imgp_parallel_for pfor,
+                                           void* user, int nthreads)
+{
+    sgvp_imgp_pfor = pfor;
+    sgvp_imgp_pfor_user = user;
+    sgvp_imgp_nthreads = nthreads > 1 ? nthreads : 1;
+}
+
+#ifdef SGV_IMGP_THREADS
+
+#include <pthread.h>
+
+#define SGVP_IMGP_MAX_THREADS 64
+
+/* Stack of the workers: the convs take up to ~200 KB */
+#define SGVP_IMGP_STACK (512*1024)
+
+/* Tasks [lo, hi) still to run, taken by the owner from the front and by
+   other threads from the back */
+typedef struct {
+    pthread_mutex_t lock;
+    int lo, hi;
+} sgvp_imgp_deque;
+
+static pthread_mutex_t sgvp_imgp_pool_run = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t sgvp_imgp_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sgvp_imgp_pool_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t sgvp_imgp_pool_done = PTHREAD_COND_INITIALIZER;
+
+static struct {
+    pthread_t threads[SGVP_IMGP_MAX_THREADS];
+    sgvp_imgp_deque q[SGVP_IMGP_MAX_THREADS];
+    sgv_imgp_task task;
+    void* ctx;
+    int n, gen, busy, quit;
+} sgvp_imgp_pool;
+
+/* Runs the tasks of deque w, then steals half of what is left in the
+   others until they are all empty */
+static void sgvp_imgp_work(int w)
+{
+    sgvp_imgp_deque *own = sgvp_imgp_pool.q + w, *v;
+    int i, j, lo, hi;
+
+    for(;;) {
+        pthread_mutex_lock(&own->lock);
+        i = own->lo < own->hi ? own->lo++ : -1;
+        pthread_mutex_unlock(&own->lock);
+
+        for(j = 1; i < 0 && j < sgvp_imgp_pool.n; j++) {
+            v = sgvp_imgp_pool.q + (w + j) % sgvp_imgp_pool.n;
+            pthread_mutex_lock(&v->lock);
+            lo = v->lo + (v->hi - v->lo)/2;
+            hi = v->hi;
+            if(lo < hi) {
+                v->hi = lo;
+            }
+            pthread_mutex_unlock(&v->lock);
+
+            /* own is empty until now, so nothing is lost in between */
+            if(lo < hi) {
+                i = lo;
+                pthread_mutex_lock(&own->lock);
+                own->lo = lo + 1;
+                own->hi = hi;
+                pthread_mutex_unlock(&own->lock);
+            }
+        }
+        if(i < 0) {
+            return;
+        }
+        sgvp_imgp_pool.task(sgvp_imgp_pool.ctx, i);
+    }
+}
+
+static void* sgvp_imgp_worker(void* arg)
+{
+    int w = (int)(size_t)arg, gen = 0, quit;
+
+    for(;;) {
+        pthread_mutex_lock(&sgvp_imgp_pool_lock);
+        while(sgvp_imgp_pool.gen == gen && !sgvp_imgp_pool.quit) {
+            pthread_cond_wait(&sgvp_imgp_pool_wake, &sgvp_imgp_pool_lock);
+        }
+        gen = sgvp_imgp_pool.gen;
+        quit = sgvp_imgp_pool.quit;
+        pthread_mutex_unlock(&sgvp_imgp_pool_lock);
+        if(quit) {
+            return 0;
+        }
+
+        sgvp_imgp_work(w);
+
+        pthread_mutex_lock(&sgvp_imgp_pool_lock);
+        if(--sgvp_imgp_pool.busy == 0) {
+            pthread_cond_signal(&sgvp_imgp_pool_done);
+        }
+        pthread_mutex_unlock(&sgvp_imgp_pool_lock);
+    }
+}
+
+static void sgvp_imgp_pool_for(void* user, int n, sgv_imgp_task task,
+                               void* ctx)
+{
+    int w, nt;
+
+    (void)user;
+    pthread_mutex_lock(&sgvp_imgp_pool_run);
+    nt = sgvp_imgp_pool.n;
+    if(nt < 2) {
+        /* stopped */
+        pthread_mutex_unlock(&sgvp_imgp_pool_run);
+        for(w = 0; w < n; w++) {
+            task(ctx, w);
+        }
+        return;
+    }
+    for(w = 0; w < nt; w++) {
+        sgvp_imgp_pool.q[w].lo = n*w/nt;
+        sgvp_imgp_pool.q[w].hi = n*(w + 1)/nt;
+    }
+    sgvp_imgp_pool.task = task;
+    sgvp_imgp_pool.ctx = ctx;
+
+    pthread_mutex_lock(&sgvp_imgp_pool_lock);
+    sgvp_imgp_pool.busy = nt;
+    sgvp_imgp_pool.gen++;
+    pthread_cond_broadcast(&sgvp_imgp_pool_wake);
+    pthread_mutex_unlock(&sgvp_imgp_pool_lock);
+
+    sgvp_imgp_work(0);
+
+    /* the deques must not be refilled while a worker may still look at
+       them, so wait for every worker, not just for the tasks */
+    pthread_mutex_lock(&sgvp_imgp_pool_lock);
+    sgvp_imgp_pool.busy--;
+    while(sgvp_imgp_pool.busy > 0) {
+        pthread_cond_wait(&sgvp_imgp_pool_done, &sgvp_imgp_pool_lock);
+    }
+    pthread_mutex_unlock(&sgvp_imgp_pool_lock);
+    pthread_mutex_unlock(&sgvp_imgp_pool_run);
+}
+
+/* Joins the workers. Called with sgvp_imgp_pool_run held, so a call still
+   running on the pool finishes first. */
+static void sgvp_imgp_pool_stop(void)
+{
+    int w;
+
+    pthread_mutex_lock(&sgvp_imgp_pool_lock);
+    sgvp_imgp_pool.quit = 1;
+    pthread_cond_broadcast(&sgvp_imgp_pool_wake);
+    pthread_mutex_unlock(&sgvp_imgp_pool_lock);
+    for(w = 1; w < sgvp_imgp_pool.n; w++) {
+        pthread_join(sgvp_imgp_pool.threads[w], 0);
+    }
+    for(w = 0; w < sgvp_imgp_pool.n; w++) {
+        pthread_mutex_destroy(&sgvp_imgp_pool.q[w].lock);
+    }
+    sgvp_imgp_pool.n = 0;
+}
+
+SGVIMGP_DEF int sgv_imgp_start_threads(int nthreads)
+{
+    pthread_attr_t attr;
+    size_t stack = 0;
+    int w;
+
+    pthread_mutex_lock(&sgvp_imgp_pool_run);
+    sgvp_imgp_pool_stop();
+    nthreads = SGVP_IMGP_MIN(nthreads, SGVP_IMGP_MAX_THREADS);
+    if(nthreads < 1) {
+        nthreads = 1; /* q[0] is the caller's, so it is always set up */
+    }
+    for(w = 0; w < nthreads; w++) {
+        pthread_mutex_init(&sgvp_imgp_pool.q[w].lock, 0);
+    }
+    sgvp_imgp_pool.gen = 0;
+    sgvp_imgp_pool.quit = 0;
+
+    /* the default can be as small as 128 KB (musl) */
+    pthread_attr_init(&attr);
+    pthread_attr_getstacksize(&attr, &stack);
+    if(stack < SGVP_IMGP_STACK) {
+        pthread_attr_setstacksize(&attr, SGVP_IMGP_STACK);
+    }
+    for(w = 1; w < nthreads; w++) {
+        if(pthread_create(sgvp_imgp_pool.threads + w, &attr, sgvp_imgp_worker,
+                          (void*)(size_t)w)) {
+            break;
+        }
+    }
+    pthread_attr_destroy(&attr);
+    sgvp_imgp_pool.n = w;
+    for(; w < nthreads; w++) { /* the queues of workers that did not start */
+        pthread_mutex_destroy(&sgvp_imgp_pool.q[w].lock);
+    }
+    w = sgvp_imgp_pool.n;
+    pthread_mutex_unlock(&sgvp_imgp_pool_run);
+    if(w <= 1) {
+        return -1;
+    }
+    sgv_imgp_set_parallel_for(sgvp_imgp_pool_for, 0, w);
+    return 0;
+}
+
+SGVIMGP_DEF void sgv_imgp_stop_threads(void)
+{
+    /* the parallel-for is left as is, since calls on other threads may
+       be reading it; without workers it runs the tasks in place */
+    pthread_mutex_lock(&sgvp_imgp_pool_run);
+    sgvp_imgp_pool_stop();
+    pthread_mutex_unlock(&sgvp_imgp_pool_run);
+}
+
+#endif
+
+static void sgvp_imgp_make_fimg_task(void* ctx, int i)
+{
+    sgvp_imgp_job* job = (sgvp_imgp_job*)ctx;
+    sgv_img_view in = job->a;
+    sgv_fimg_view out = job->fb;
+    int x, y, d, y0, y1, ldi = SGVP_IMGP_LD(in), ldo = SGVP_IMGP_LD(out);
+
+    SGVP_IMGP_BAND(job, i, y0, y1);
+    for(y = y0; y < y1; y++) {
         for(x = 0; x < in.w; x++) {
             for(d = 0; d < in.d; d++) {
-                float v = (in.data[in.w*in.d*y + in.d*x + d] - 127.0f)/128.0f;
-                out.data[in.w*in.d*y + in.d*x + d] = v;
+                float v = (in.data[ldi*y + in.d*x + d] - 127.0f)/128.0f;
+                out.data[ldo*y + in.d*x + d] = v;
             }
         }
     }
 }
 
-SGVIMGP_DEF void sgv_grey_to_rgb(sgv_img grey, sgv_img out)
+SGVIMGP_DEF void sgv_make_fimg_view(sgv_img_view in, sgv_fimg_view out)
+{
+    sgvp_imgp_job job;
+    SGV_IMGP_ASSERT(in.w == out.w && in.h == out.h && in.d == out.d);
+    job.a = in;
+    job.fb = out;
+    sgvp_imgp_run(&job, sgvp_imgp_make_fimg_task, in.h, 1, in.w*in.d);
+}
+
+SGVIMGP_DEF void sgv_grey_to_rgb_view(sgv_img_view grey, sgv_img_view out)
 {
     int x, y, d;
     SGV_IMGP_ASSERT(grey.w == out.w && grey.h == out.h);
@@ -177,13 +814,14 @@ SGVIMGP_DEF void sgv_grey_to_rgb(sgv_img grey, sgv_img out)
     for(y = 0; y < grey.h; y++) {
         for(x = 0; x < grey.w; x++) {
             for(d = 0; d < 3; d++) {
-                out.data[3*(y*out.w + x) + d] = grey.data[y*grey.w + x];
+                out.data[y*SGVP_IMGP_LD(out) + 3*x + d] =
+                    grey.data[y*SGVP_IMGP_LD(grey) + x];
             }
         }
     }
 }
 
-SGVIMGP_DEF void sgvp_draw_line_prim(sgv_img img,
+SGVIMGP_DEF void sgvp_draw_line_prim(sgv_img_view img,
                                      int x0, int y0, int x1, int y1,
                                      sgv_imgp_i3 color)
 {
@@ -207,26 +845,25 @@ SGVIMGP_DEF void sgvp_draw_line_prim(sgv_img img,
     for(i = 0; i < steps; i++) {
         px = (int)x, py = (int)y;
         if(px >= 0 && py >= 0 && px < img.w && py < img.h) {
-            img.data[img.d*img.w*py + img.d*px + 0] = color.x;
+            img.data[SGVP_IMGP_LD(img)*py + img.d*px + 0] = color.x;
 
             if(img.d > 1)
-                img.data[img.d*img.w*py + img.d*px + 1] = color.y;
+                img.data[SGVP_IMGP_LD(img)*py + img.d*px + 1] = color.y;
             else
-                img.data[img.d*img.w*py + img.d*px + 1] = 0;
+                img.data[SGVP_IMGP_LD(img)*py + img.d*px + 1] = 0;
 
             if(img.d > 2)
-                img.data[img.d*img.w*py + img.d*px + 2] = color.z;
+                img.data[SGVP_IMGP_LD(img)*py + img.d*px + 2] = color.z;
             else
-                img.data[img.d*img.w*py + img.d*px + 2] = 0;
+                img.data[SGVP_IMGP_LD(img)*py + img.d*px + 2] = 0;
         }
         x += x_inc;
         y += y_inc;
     }
 }
 
-SGVIMGP_DEF void sgv_draw_line(sgv_img img,
-                               sgv_imgp_i2 p1, sgv_imgp_i2 p2,
-                               sgv_imgp_i3 color, int t)
+SGVIMGP_DEF void sgv_draw_line_view(sgv_img_view img, sgv_imgp_i2 p1,
+                                    sgv_imgp_i2 p2, sgv_imgp_i3 color, int t)
 {
     int d;
     for(d = -t/2; d <= t/2; d++) {
@@ -235,80 +872,340 @@ SGVIMGP_DEF void sgv_draw_line(sgv_img img,
     }
 }
 
-SGVIMGP_DEF void sgv_draw_rect(sgv_img img,
-                               sgv_imgp_i2 p_lt, sgv_imgp_i2 p_rb,
-                               sgv_imgp_i3 color, int thickness)
+SGVIMGP_DEF void sgv_draw_rect_view(sgv_img_view img, sgv_imgp_i2 p_lt,
+                                    sgv_imgp_i2 p_rb, sgv_imgp_i3 color,
+                                    int thickness)
 {
     sgv_imgp_i2 p_rt = {p_rb.x, p_lt.y};
     sgv_imgp_i2 p_lb = {p_lt.x, p_rb.y};
-    sgv_draw_quadrilateral(img, p_lt, p_rt, p_rb, p_lb, color, thickness);
+    sgv_draw_quadrilateral_view(img, p_lt, p_rt, p_rb, p_lb, color, thickness);
 }
 
-SGVIMGP_DEF void sgv_draw_quadrilateral(sgv_img img,
-                                        sgv_imgp_i2 p1, sgv_imgp_i2 p2,
-                                        sgv_imgp_i2 p3, sgv_imgp_i2 p4,
-                                        sgv_imgp_i3 color, int t)
+SGVIMGP_DEF void sgv_draw_quadrilateral_view(sgv_img_view img, sgv_imgp_i2 p1,
+                                             sgv_imgp_i2 p2, sgv_imgp_i2 p3,
+                                             sgv_imgp_i2 p4, sgv_imgp_i3 color,
+                                             int t)
 {
-    sgv_draw_line(img, p1, p2, color, t);
-    sgv_draw_line(img, p2, p3, color, t);
-    sgv_draw_line(img, p3, p4, color, t);
-    sgv_draw_line(img, p4, p1, color, t);
+    sgv_draw_line_view(img, p1, p2, color, t);
+    sgv_draw_line_view(img, p2, p3, color, t);
+    sgv_draw_line_view(img, p3, p4, color, t);
+    sgv_draw_line_view(img, p4, p1, color, t);
 }
 
-SGVIMGP_DEF void sgv_imgp_affine_transform(sgv_img in, sgv_imgp_i2 in_offset,
-                                           float* theta, sgv_img out, sgv_imgp_i2 out_offset)
+/* The bilinear sample of channels [0, d) at p (stride bytes per row) into
+   dst, with Q7 fractions fx, fy: the four weights are Q14 and fit 16 bits */
+static void sgvp_imgp_bilinear(const unsigned char* p, int stride, int d,
+                               int fx, int fy, unsigned char* dst)
+{
+    int c, w0 = (128 - fx)*(128 - fy), w1 = fx*(128 - fy);
+    int w2 = (128 - fx)*fy, w3 = fx*fy;
+
+    for(c = 0; c < d; c++) {
+        dst[c] = (unsigned char)((w0*p[c] + w1*p[d + c] + w2*p[stride + c] +
+                                  w3*p[stride + d + c] + (1 << 13)) >> 14);
+    }
+}
+
+#ifdef SGVP_IMGP_SSE2
+static int sgvp_imgp_load4(const unsigned char* p)
+{
+    int v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+/* sgvp_imgp_bilinear of 3 or 4 channels, all at once with pmaddwd. It loads
+   4 bytes of each pixel, so with 3 the bottom right one must not be the
+   last of the image. */
+static void sgvp_imgp_bilinear_sse2(const unsigned char* p, int stride,
+                                    int d, int fx, int fy, unsigned char* dst)
+{
+    __m128i t, u, zero = _mm_setzero_si128();
+    int v;
+
+    /* (left, right) pairs of each channel, top and bottom */
+    t = _mm_unpacklo_epi8(SGVP_IMGP_LOAD4(p), SGVP_IMGP_LOAD4(p + d));
+    u = _mm_unpacklo_epi8(SGVP_IMGP_LOAD4(p + stride),
+                          SGVP_IMGP_LOAD4(p + stride + d));
+    t = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi8(t, zero),
+                                     _mm_set1_epi32((128 - fx)*(128 - fy) |
+                                                    fx*(128 - fy) << 16)),
+                      _mm_madd_epi16(_mm_unpacklo_epi8(u, zero),
+                                     _mm_set1_epi32((128 - fx)*fy |
+                                                    fx*fy << 16)));
+    t = _mm_srai_epi32(_mm_add_epi32(t, _mm_set1_epi32(1 << 13)), 14);
+    t = _mm_packs_epi32(t, t);
+    v = _mm_cvtsi128_si32(_mm_packus_epi16(t, t));
+    if(d == 4) {
+        memcpy(dst, &v, 4);
+    } else {
+        dst[0] = (unsigned char)v;
+        dst[1] = (unsigned char)(v >> 8);
+        dst[2] = (unsigned char)(v >> 16);
+    }
+}
+#endif
+
+/* The bilinear sample of channels [0, d) at source point (x, y) into dst,
+   in fixed point: Q7 fractions, so the four weights are Q14 and fit 16 bits.
+   Pixels off the image count as black. */
+static void sgvp_imgp_affine_px(sgv_img_view in, float x, float y,
+                                unsigned char* dst, int d)
+{
+    int x0 = (int)x, y0 = (int)y, fx, fy, w[4], c, k, acc, xk, yk;
+    const unsigned char* p;
+
+    x0 -= x0 > x;
+    y0 -= y0 > y;
+    fx = (int)((x - x0)*128 + 0.5f);
+    fy = (int)((y - y0)*128 + 0.5f);
+    w[0] = (128 - fx)*(128 - fy);
+    w[1] = fx*(128 - fy);
+    w[2] = (128 - fx)*fy;
+    w[3] = fx*fy;
+    for(c = 0; c < d; c++) {
+        acc = 1 << 13;
+        for(k = 0; k < 4; k++) {
+            xk = x0 + (k & 1);
+            yk = y0 + (k >> 1);
+            if(xk >= 0 && yk >= 0 && xk < in.w && yk < in.h) {
+                p = in.data + yk*SGVP_IMGP_LD(in) + xk*in.d;
+                acc += w[k]*p[c];
+            }
+        }
+        dst[c] = (unsigned char)(acc >> 14);
+    }
+}
+
+/* Narrows [*lo, *hi) to the ix where 0 <= b + ix*a < n - 1, so that both
+   pixels of a bilinear tap along this axis are on the image */
+static void sgvp_imgp_affine_span(float a, float b, int n, int* lo, int* hi)
+{
+    float t0, t1, v;
+
+    if(a == 0) {
+        if(!(b >= 0 && b < n - 1)) {
+            *hi = *lo;
+        }
+        return;
+    }
+    t0 = -b/a;
+    t1 = (n - 1 - b)/a;
+    if(t0 > t1) {
+        v = t0; t0 = t1; t1 = v;
+    }
+    /* a bit inside, then fixed up exactly at both ends */
+    if(t0 > *lo) {
+        *lo = t0 < *hi ? (int)t0 : *hi;
+    }
+    if(t1 + 1 < *hi) {
+        *hi = t1 + 1 > *lo ? (int)(t1 + 1) : *lo;
+    }
+    while(*lo < *hi && !(b + *lo*a >= 0 && b + *lo*a < n - 1)) {
+        (*lo)++;
+    }
+    while(*hi > *lo && !(b + (*hi - 1)*a >= 0 && b + (*hi - 1)*a < n - 1)) {
+        (*hi)--;
+    }
+}
+
+/* Output pixels [ix0, ix1) of a row whose taps are all on the image */
+static void sgvp_imgp_affine_run(sgv_img_view in, float ax, float ay, float bx,
+                                 float by, int ix0, int ix1,
+                                 unsigned char* dst, int dd)
 {
-    float x, y, xt, yt, alpha, beta, temp;
-    int ix, iy, c, xo_a, yo_a, xo_b, yo_b;
+    int ix, x0, y0;
+    float x, y;
+
+    for(ix = ix0; ix < ix1; ix++) {
+        x = bx + ix*ax;
+        y = by + ix*ay;
+        x0 = (int)x;
+        y0 = (int)y;
+        sgvp_imgp_bilinear(in.data + y0*SGVP_IMGP_LD(in) + x0*in.d, SGVP_IMGP_LD(in), in.d,
+                           (int)((x - x0)*128 + 0.5f),
+                           (int)((y - y0)*128 + 0.5f), dst + ix*dd);
+    }
+}
+
+/* Source point of output pixel (ix, iy) is (bx + ix*ax, by + ix*ay), bx and
+   by set per row. Output pixels whose four taps are all on the image (a
+   span of each row) are done without checks. With 3 or 4 channels that is
+   four pixels at a time with SSE2: coordinates and weights across the
+   pixels, then each pixel's bilinear sum across its channels. */
+static void sgvp_imgp_affine_task(void* ctx, int i)
+{
+    sgvp_imgp_job* job = (sgvp_imgp_job*)ctx;
+    sgv_img_view in = job->a, out = job->b;
+    sgv_imgp_i2 in_offset = job->p, out_offset = job->q;
+    float* theta = job->theta;
+    float ax, ay, bx, by, y;
+    int ix, iy, y0, y1, lo, hi, d = in.d;
+    unsigned char* dst;
+#ifdef SGVP_IMGP_SSE2
+    int lo4, hi4, k, stride = SGVP_IMGP_LD(in);
+    int xi[4], yi[4], fx[4], fy[4];
+    __m128 axv, ayv, bxv, byv, xv, yv, lane = _mm_set_ps(3, 2, 1, 0);
+    __m128 q7 = _mm_set1_ps(128), half = _mm_set1_ps(0.5f);
+    __m128i t, u;
+#endif
 
-    for(iy = 0; iy < out.h; iy++) {
-        for(ix = 0; ix < out.w; ix++) {
-            x = (ix + out_offset.x + 0.5f) / out.w;
-            y = (iy + out_offset.y + 0.5f) / out.h;
+    ax = theta[0]*in.w/out.w;
+    ay = theta[2]*in.h/out.w;
 
-            xt = theta[0]*x + theta[1]*y + (in_offset.x + 0.5f)/in.w;
-            yt = theta[2]*x + theta[3]*y + (in_offset.y + 0.5f)/in.h;
+    SGVP_IMGP_BAND(job, i, y0, y1);
+    for(iy = y0; iy < y1; iy++) {
+        y = (iy + out_offset.y + 0.5f)/out.h;
+        bx = ax*(out_offset.x + 0.5f) + theta[1]*in.w*y + in_offset.x;
+        by = ay*(out_offset.x + 0.5f) + theta[3]*in.h*y + in_offset.y;
+        dst = out.data + iy*SGVP_IMGP_LD(out);
 
-            xo_a = xt*in.w - 0.5f, xo_b = xo_a+1; alpha = xo_a + 1.5f - xt*in.w;
-            yo_a = yt*in.h - 0.5f, yo_b = yo_a+1; beta = yo_a + 1.5f - yt*in.h;
+        lo = 0;
+        hi = out.w;
+        sgvp_imgp_affine_span(ax, bx, in.w, &lo, &hi);
+        sgvp_imgp_affine_span(ay, by, in.h, &lo, &hi);
 
-            for(c = 0; c < in.d; c++) {
-                temp = 0;
+        for(ix = 0; ix < lo; ix++) {
+            sgvp_imgp_affine_px(in, bx + ix*ax, by + ix*ay, dst + ix*out.d, d);
+        }
 
-                if(xo_a >= 0 && yo_a >= 0 && xo_a < in.w && yo_a < in.h)
-                    temp += alpha * beta * in.data[in.w*in.d*yo_a + in.d*xo_a + c];
-                if(xo_b >= 0 && yo_a >= 0 && xo_b < in.w && yo_a < in.h)
-                    temp += (1-alpha) * beta * in.data[in.w*in.d*yo_a + in.d*xo_b + c];
-                if(xo_a >= 0 && yo_b >= 0 && xo_a < in.w && yo_b < in.h)
-                    temp += alpha * (1-beta) * in.data[in.w*in.d*yo_b + in.d*xo_a + c];
-                if(xo_b >= 0 && yo_b >= 0 && xo_b < in.w && yo_b < in.h)
-                    temp += (1-alpha) * (1-beta) * in.data[in.w*in.d*yo_b + in.d*xo_b + c];
+        ix = lo;
+#ifdef SGVP_IMGP_SSE2
+        lo4 = lo;
+        hi4 = hi;
+        if(d == 3) {
+            /* the loads take a byte of the next pixel, which the last one
+               of the image does not have */
+            sgvp_imgp_affine_span(ay, by, in.h - 1, &lo4, &hi4);
+        }
+        if((d == 3 || d == 4) && d == out.d) {
+            sgvp_imgp_affine_run(in, ax, ay, bx, by, lo, lo4, dst, d);
+            axv = _mm_set1_ps(ax);
+            ayv = _mm_set1_ps(ay);
+            bxv = _mm_set1_ps(bx);
+            byv = _mm_set1_ps(by);
+            for(ix = lo4; ix + 4 <= hi4; ix += 4) {
+                xv = _mm_add_ps(_mm_set1_ps((float)ix), lane);
+                yv = _mm_add_ps(byv, _mm_mul_ps(xv, ayv));
+                xv = _mm_add_ps(bxv, _mm_mul_ps(xv, axv));
+                t = _mm_cvttps_epi32(xv);
+                u = _mm_cvttps_epi32(yv);
+                _mm_storeu_si128((__m128i*)xi, t);
+                _mm_storeu_si128((__m128i*)yi, u);
+                /* rounded half up like the scalar path, not to even */
+                xv = _mm_mul_ps(_mm_sub_ps(xv, _mm_cvtepi32_ps(t)), q7);
+                yv = _mm_mul_ps(_mm_sub_ps(yv, _mm_cvtepi32_ps(u)), q7);
+                xv = _mm_add_ps(xv, half);
+                yv = _mm_add_ps(yv, half);
+                _mm_storeu_si128((__m128i*)fx, _mm_cvttps_epi32(xv));
+                _mm_storeu_si128((__m128i*)fy, _mm_cvttps_epi32(yv));
+
+                for(k = 0; k < 4; k++) {
+                    sgvp_imgp_bilinear_sse2(in.data + yi[k]*stride + xi[k]*d,
+                                            stride, d, fx[k], fy[k],
+                                            dst + (ix + k)*d);
+                }
+            }
+        }
+#endif
+        sgvp_imgp_affine_run(in, ax, ay, bx, by, ix, hi, dst, out.d);
+
+        for(ix = hi; ix < out.w; ix++) {
+            sgvp_imgp_affine_px(in, bx + ix*ax, by + ix*ay, dst + ix*out.d, d);
+        }
+    }
+}
+
+SGVIMGP_DEF void sgv_imgp_affine_transform_view(sgv_img_view in,
+                                                sgv_imgp_i2 in_offset,
+                                                float* theta, sgv_img_view out,
+                                                sgv_imgp_i2 out_offset)
+{
+    sgvp_imgp_job job;
+
+    job.a = in;
+    job.b = out;
+    job.p = in_offset;
+    job.q = out_offset;
+    job.theta = theta;
+    sgvp_imgp_run(&job, sgvp_imgp_affine_task, out.h, 1, 16.0*out.w*out.d);
+}
 
-                out.data[out.d*(out.w*iy + ix) + c] = temp;
+/* Numerators and denominator of the source point step by h[0], h[3], h[6]
+   along a row, and each pixel takes one reciprocal. Pixels with all taps on
+   the image skip the checks, the rest are checked or, far off, black. */
+static void sgvp_imgp_perspective_task(void* ctx, int i)
+{
+    sgvp_imgp_job* job = (sgvp_imgp_job*)ctx;
+    sgv_img_view in = job->a, out = job->b;
+    const float* h = job->theta;
+    float nx, ny, nw, r, x, y;
+    int ix, iy, y0, y1, x0, yi, c, d = in.d, stride = SGVP_IMGP_LD(in);
+    unsigned char *dst, *last = in.data + (in.h - 1)*stride + (in.w - 1)*d;
+    const unsigned char* p;
+
+    SGVP_IMGP_BAND(job, i, y0, y1);
+    for(iy = y0; iy < y1; iy++) {
+        nx = 0.5f*h[0] + (iy + 0.5f)*h[1] + h[2];
+        ny = 0.5f*h[3] + (iy + 0.5f)*h[4] + h[5];
+        nw = 0.5f*h[6] + (iy + 0.5f)*h[7] + h[8];
+        dst = out.data + iy*SGVP_IMGP_LD(out);
+        for(ix = 0; ix < out.w; ix++, dst += out.d) {
+            /* source pixel centres are at +0.5 too */
+            r = 1.0f/(nw + ix*h[6]);
+            x = (nx + ix*h[0])*r - 0.5f;
+            y = (ny + ix*h[3])*r - 0.5f;
+            if(x >= 0 && y >= 0 && x < in.w - 1 && y < in.h - 1 && r > 0) {
+                x0 = (int)x;
+                yi = (int)y;
+                p = in.data + yi*stride + x0*d;
+#ifdef SGVP_IMGP_SSE2
+                if((d == 3 || d == 4) && d == out.d && p + stride + d != last) {
+                    sgvp_imgp_bilinear_sse2(p, stride, d,
+                                            (int)((x - x0)*128 + 0.5f),
+                                            (int)((y - yi)*128 + 0.5f), dst);
+                    continue;
+                }
+#endif
+                sgvp_imgp_bilinear(p, stride, d, (int)((x - x0)*128 + 0.5f),
+                                   (int)((y - yi)*128 + 0.5f), dst);
+            } else if(x > -1 && y > -1 && x < in.w && y < in.h && r > 0) {
+                sgvp_imgp_affine_px(in, x, y, dst, d);
+            } else {
+                for(c = 0; c < d; c++) {
+                    dst[c] = 0;
+                }
             }
         }
     }
 }
 
-SGVIMGP_DEF void sgv_imgp_crop_rescale(sgv_img in, sgv_imgp_i2 in_left_top,
-                                       sgv_imgp_i2 crop_size, sgv_img out)
+SGVIMGP_DEF void sgv_imgp_perspective_transform_view(sgv_img_view in, float* h,
+                                                     sgv_img_view out)
 {
-    int x, y, c, temp, x1, y1, enlarged_w, enlarged_h;
-    int dsf; /* down scale factor */
-    int ds_factor_w, ds_factor_h;
-    float xi, yi, alpha, beta;
-    int xo_a, yo_a, xo_b, yo_b;
+    sgvp_imgp_job job;
 
-    SGV_IMGP_ASSERT(in.d == out.d);
+    job.a = in;
+    job.b = out;
+    job.theta = h;
+    sgvp_imgp_run(&job, sgvp_imgp_perspective_task, out.h, 1, 20.0*out.w*out.d);
+}
 
-    ds_factor_w = (crop_size.x+out.w-1)/out.w;
-    ds_factor_h = (crop_size.y+out.h-1)/out.h;
-    dsf = ds_factor_w > ds_factor_h ? ds_factor_w : ds_factor_h;
+static void sgvp_imgp_crop_rescale_legacy_task(void* ctx, int i)
+{
+    sgvp_imgp_job* job = (sgvp_imgp_job*)ctx;
+    sgv_img_view in = job->a, out = job->b;
+    sgv_imgp_i2 in_left_top = job->p, crop_size = job->q;
+    int x, y, c, temp, x1, y1, enlarged_w, enlarged_h, y0, yn;
+    int dsf = job->r.x; /* down scale factor */
+    float xi, yi, alpha, beta;
+    int xo_a, yo_a, xo_b, yo_b;
 
     enlarged_w = out.w * dsf;
     enlarged_h = out.h * dsf;
 
-    for(y = 0; y < out.h; y++) {
+    SGVP_IMGP_BAND(job, i, y0, yn);
+    for(y = y0; y < yn; y++) {
         for(x = 0; x < out.w; x++) {
             for(c = 0; c < out.d; c++) {
                 temp = 0;
@@ -324,108 +1221,2095 @@ SGVIMGP_DEF void sgv_imgp_crop_rescale(sgv_img in, sgv_imgp_i2 in_left_top,
                         beta = yo_a - in_left_top.y + 1.5f - yi*crop_size.y;
 
                         if(xo_a >= 0 && yo_a >= 0 && xo_a < in.w && yo_a < in.h)
-                            temp += alpha * beta * in.data[in.w*in.d*yo_a + in.d*xo_a + c];
+                            temp += alpha * beta * in.data[SGVP_IMGP_LD(in)*yo_a + in.d*xo_a + c];
                         if(xo_b >= 0 && yo_a >= 0 && xo_b < in.w && yo_a < in.h)
-                            temp += (1-alpha) * beta * in.data[in.w*in.d*yo_a + in.d*xo_b + c];
+                            temp += (1-alpha) * beta * in.data[SGVP_IMGP_LD(in)*yo_a + in.d*xo_b + c];
                         if(xo_a >= 0 && yo_b >= 0 && xo_a < in.w && yo_b < in.h)
-                            temp += alpha * (1-beta) * in.data[in.w*in.d*yo_b + in.d*xo_a + c];
+                            temp += alpha * (1-beta) * in.data[SGVP_IMGP_LD(in)*yo_b + in.d*xo_a + c];
                         if(xo_b >= 0 && yo_b >= 0 && xo_b < in.w && yo_b < in.h)
-                            temp += (1-alpha) * (1-beta) * in.data[in.w*in.d*yo_b + in.d*xo_b + c];
+                            temp += (1-alpha) * (1-beta) * in.data[SGVP_IMGP_LD(in)*yo_b + in.d*xo_b + c];
                     }
                 }
-                out.data[out.w*out.d*y + out.d*x + c] = temp/(dsf*dsf);
+                out.data[SGVP_IMGP_LD(out)*y + out.d*x + c] = temp/(dsf*dsf);
             }
         }
     }
 }
 
-SGVIMGP_DEF void sgv_conv2d_valid(sgv_fimg in, sgv_filt filt, sgv_fimg out)
+/* Limits of the separable resampler: 16-bit elements of filtered rows
+   kept, weights of a strip of columns, taps per output pixel and columns
+   per strip */
+#define SGVP_IMGP_RS_RING 16384
+#define SGVP_IMGP_RS_TAB 16384
+#define SGVP_IMGP_RS_TAPS 1024
+#define SGVP_IMGP_RS_COLS 512
+
+/* Radius in input pixels of the filter for one axis scaled by s */
+static float sgvp_imgp_rs_radius(float s, int filter)
 {
-    float tmp, fv;
-    int xi, yi, ci, xo, yo, co, xf, yf;
+    float f = s > 1 ? s : 1;
 
-    SGV_IMGP_ASSERT(filt.ind == in.d && filt.outd == out.d);
-    SGV_IMGP_ASSERT(out.w == (in.w - filt.w + 1));
-    SGV_IMGP_ASSERT(out.h == (in.h - filt.h + 1));
+    if(filter == SGV_IMGP_RESCALE_BICUBIC) {
+        return 2*f;
+    }
+    if(filter == SGV_IMGP_RESCALE_BILINEAR || s <= 1) {
+        return f;
+    }
+    return s/2;
+}
 
-    for(yo = 0; yo < out.h; yo++) {
-        for(xo = 0; xo < out.w; xo++) {
-            for(co = 0; co < out.d; co++) {
-                tmp = 0;
-                for(yi = yo, yf = 0; yi < yo + filt.h; yi++, yf++) {
-                    for(xi = xo, xf = 0; xi < xo + filt.w; xi++, xf++) {
-                        for(ci = 0; ci < in.d; ci++) {
-                            fv = filt.data[((yf*filt.w + xf)*in.d + ci)*out.d + co];
-                            tmp += in.data[in.w*in.d*yi + in.d*xi + ci] * fv;
-                        }
-                    }
-                }
-                out.data[(yo*out.w + xo)*out.d + co] = tmp;
-            }
-        }
+/* Most taps an output pixel of an axis with this radius can have */
+#define SGVP_IMGP_RS_NTAPS(r) ((int)(2*(r)) + 3)
+
+/* Columns per strip for the separable resampler, with the taps of the two
+   axes in *th and *tv. 0 if even one column does not fit its buffers. */
+static int sgvp_imgp_rs_cols(int d, sgv_imgp_i2 crop, sgv_img_view out,
+                             int filter, int* th, int* tv)
+{
+    float sx = (float)crop.x/out.w;
+    int cols;
+
+    *th = SGVP_IMGP_RS_NTAPS(sgvp_imgp_rs_radius(sx, filter));
+    *tv = SGVP_IMGP_RS_NTAPS(sgvp_imgp_rs_radius((float)crop.y/out.h, filter));
+    if(*th > SGVP_IMGP_RS_TAPS || *tv > SGVP_IMGP_RS_TAPS) {
+        return 0;
     }
+    cols = SGVP_IMGP_MIN(SGVP_IMGP_RS_COLS, SGVP_IMGP_RS_TAB/(*th));
+    if(crop.y > out.h) {
+        /* the input columns of a strip must fit the ring */
+        cols = SGVP_IMGP_MIN(cols, (int)((SGVP_IMGP_RS_RING/d - *th)/(sx > 1 ? sx : 1)));
+    } else {
+        cols = SGVP_IMGP_MIN(cols, SGVP_IMGP_RS_RING/(*tv*d));
+    }
+    return cols > 0 ? cols : 0;
 }
 
-SGVIMGP_DEF void sgv_add_bias(sgv_fimg img, float* biases)
+/* Weights (Q14, summing to 1) of input pixels [*start, *start + n) for
+   output pixel o of one axis, n returned. Taps off the image are folded
+   into the edge pixel; if the centre of o itself is off the image, n is 0
+   and the pixel is black. */
+static int sgvp_imgp_rs_taps(int o, int n_out, int left, int crop, int n_in,
+                             int filter, short* w, int* start)
 {
-    int x, y, c;
-    for(y = 0; y < img.h; y++) {
-        for(x = 0; x < img.w; x++) {
-            for(c = 0; c < img.d; c++) {
-                img.data[img.w*img.d*y + img.d*x + c] += biases[c];
-            }
+    float tmp[SGVP_IMGP_RS_TAPS];
+    float s = (float)crop/n_out, sx = left + (o + 0.5f)*s;
+    float f = s > 1 ? s : 1, r = sgvp_imgp_rs_radius(s, filter);
+    float t, v, sum;
+    int lo, hi, i, k, n, big, total;
+
+    if(sx < 0 || sx >= n_in) {
+        return 0;
+    }
+    lo = (int)(sx - r);
+    lo = lo > sx - r ? lo - 1 : lo; /* floor */
+    hi = (int)(sx + r);
+    *start = lo > 0 ? lo : 0;
+    n = (hi < n_in - 1 ? hi : n_in - 1) - *start + 1;
+    SGV_IMGP_ASSERT(n <= SGVP_IMGP_RS_TAPS);
+
+    for(k = 0; k < n; k++) {
+        tmp[k] = 0;
+    }
+    for(i = lo; i <= hi; i++) {
+        t = i + 0.5f - sx;
+        t = (t > 0 ? t : -t)/f;
+        if(filter == SGV_IMGP_RESCALE_BICUBIC) {
+            v = t < 1 ? (1.5f*t - 2.5f)*t*t + 1 :
+                t < 2 ? ((-0.5f*t + 2.5f)*t - 4)*t + 2 : 0;
+        } else if(filter == SGV_IMGP_RESCALE_BILINEAR || s <= 1) {
+            v = t < 1 ? 1 - t : 0;
+        } else {
+            /* overlap of [i, i+1] and [sx - r, sx + r] */
+            v = (i + 1 < sx + r ? i + 1 : sx + r) - (i > sx - r ? i : sx - r);
+            v = v > 0 ? v : 0;
         }
+        k = (i < 0 ? 0 : i >= n_in ? n_in - 1 : i) - *start;
+        tmp[k] += v;
     }
+
+    sum = 0;
+    for(k = 0; k < n; k++) {
+        sum += tmp[k];
+    }
+    total = big = 0;
+    for(k = 0; k < n; k++) {
+        v = tmp[k]/sum*16384;
+        w[k] = (short)(v >= 0 ? v + 0.5f : v - 0.5f);
+        total += w[k];
+        big = w[k] > w[big] ? k : big;
+    }
+    w[big] += 16384 - total;
+    return n;
 }
 
-SGVIMGP_DEF void sgv_relu(sgv_fimg in, sgv_fimg out)
-{
-    int x, y, c;
-    float val;
+/* Filters sw pixels of d channels along a row: pixel x is the sum of
+   w[x*th + k]*src[(s[x] + k)*d + c] over k < n[x], rounded by shift. p is
+   a pointer of the type of src. Three channels get their own loop, as that
+   is most images. */
+#define SGVP_IMGP_RS_ROW(src, p, dst, T, shift, sw, d, w, th, s, n) \
+    for(x = 0; x < sw; x++) { \
+        wk = w + x*th; \
+        p = src + s[x]*d; \
+        if(d == 3) { \
+            a0 = a1 = a2 = 1 << (shift - 1); \
+            for(k = 0; k < n[x]; k++, p += 3) { \
+                a0 += wk[k]*p[0]; \
+                a1 += wk[k]*p[1]; \
+                a2 += wk[k]*p[2]; \
+            } \
+            dst[x*3] = T(a0 >> shift); \
+            dst[x*3 + 1] = T(a1 >> shift); \
+            dst[x*3 + 2] = T(a2 >> shift); \
+        } else { \
+            for(c = 0; c < d; c++) { \
+                a0 = 1 << (shift - 1); \
+                for(k = 0; k < n[x]; k++) { \
+                    a0 += wk[k]*p[k*d + c]; \
+                } \
+                dst[x*d + c] = T(a0 >> shift); \
+            } \
+        } \
+    }
 
-    SGV_IMGP_ASSERT(in.w == out.w && in.h == out.h && in.d == out.d);
+#define SGVP_IMGP_RS_Q6(v) (short)(v)
+#define SGVP_IMGP_RS_U8(v) \
+    (unsigned char)((v) < 0 ? 0 : (v) > 255 ? 255 : (v))
 
-    for(y = 0; y < in.h; y++) {
-        for(x = 0; x < in.w; x++) {
-            for(c = 0; c < in.d; c++) {
-                val = in.data[in.w*in.d*y + in.d*x + c];
-                out.data[in.w*in.d*y + in.d*x + c] = (val > 0) ? val : 0;
-            }
+/* Sums nv rows of n 16-bit (Q6) values weighted by w into 8-bit dst */
+static void sgvp_imgp_rs_col_q6(short** rp, const short* w, int nv, int n,
+                                unsigned char* dst)
+{
+    int j = 0, k, acc;
+#ifdef SGVP_IMGP_SSE2
+    __m128i a, b, lo, hi, wv, round = _mm_set1_epi32(1 << 19);
+
+    for(; j + 8 <= n; j += 8) {
+        lo = hi = _mm_setzero_si128();
+        for(k = 0; k < nv; k += 2) {
+            a = _mm_loadu_si128((const __m128i*)(rp[k] + j));
+            b = k + 1 < nv ? _mm_loadu_si128((const __m128i*)(rp[k + 1] + j)) :
+                             _mm_setzero_si128();
+            wv = _mm_set1_epi32((w[k] & 0xffff) | (k + 1 < nv ? w[k + 1] : 0)*65536);
+            lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), wv));
+            hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), wv));
+        }
+        lo = _mm_srai_epi32(_mm_add_epi32(lo, round), 20);
+        hi = _mm_srai_epi32(_mm_add_epi32(hi, round), 20);
+        a = _mm_packs_epi32(lo, hi);
+        _mm_storel_epi64((__m128i*)(dst + j), _mm_packus_epi16(a, a));
+    }
+#endif
+    for(; j < n; j++) {
+        acc = 1 << 19;
+        for(k = 0; k < nv; k++) {
+            acc += w[k]*rp[k][j];
         }
+        acc >>= 20;
+        dst[j] = SGVP_IMGP_RS_U8(acc);
     }
 }
 
-SGVIMGP_DEF void sgv_maxpool2(sgv_fimg in, sgv_fimg out)
+/* Sums nv rows of n 8-bit values weighted by w into 16-bit (Q6) dst */
+static void sgvp_imgp_rs_col_u8(unsigned char** rp, const short* w, int nv,
+                                int n, short* dst)
 {
-    int x, y, c, x1, y1;
-    float val, new_val;
+    int j = 0, k, acc;
+#ifdef SGVP_IMGP_SSE2
+    __m128i a, b, lo, hi, wv, zero = _mm_setzero_si128();
+    __m128i round = _mm_set1_epi32(1 << 7);
+
+    for(; j + 8 <= n; j += 8) {
+        lo = hi = zero;
+        for(k = 0; k < nv; k += 2) {
+            a = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(rp[k] + j)), zero);
+            b = k + 1 < nv ?
+                _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(rp[k + 1] + j)), zero) :
+                zero;
+            wv = _mm_set1_epi32((w[k] & 0xffff) | (k + 1 < nv ? w[k + 1] : 0)*65536);
+            lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), wv));
+            hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), wv));
+        }
+        lo = _mm_srai_epi32(_mm_add_epi32(lo, round), 8);
+        hi = _mm_srai_epi32(_mm_add_epi32(hi, round), 8);
+        _mm_storeu_si128((__m128i*)(dst + j), _mm_packs_epi32(lo, hi));
+    }
+#endif
+    for(; j < n; j++) {
+        acc = 1 << 7;
+        for(k = 0; k < nv; k++) {
+            acc += w[k]*rp[k][j];
+        }
+        dst[j] = (short)(acc >> 8);
+    }
+}
 
-    SGV_IMGP_ASSERT(in.w/2 == out.w && in.h/2 == out.h && in.d == out.d);
+/* Output rows of band i, a strip of columns at a time, in 16-bit fixed
+   point (pixels in Q6, weights in Q14). The pass that shrinks goes first:
+   when enlarging vertically, the input rows a strip needs are filtered
+   along x into a ring of rows that the output rows sum along y; when
+   shrinking, the input rows of each output row are summed along y and the
+   sum filtered along x. */
+static void sgvp_imgp_rescale_task(void* ctx, int i)
+{
+    sgvp_imgp_job* job = (sgvp_imgp_job*)ctx;
+    sgv_img_view in = job->a, out = job->b;
+    sgv_imgp_i2 lt = job->p, crop = job->q;
+    int filter = job->r.x, d = in.d, vfirst = crop.y > out.h;
+    short ring[SGVP_IMGP_RS_RING], hw[SGVP_IMGP_RS_TAB];
+    short vw[SGVP_IMGP_RS_TAPS];
+    unsigned char* rb[SGVP_IMGP_RS_TAPS];
+    short* rs[SGVP_IMGP_RS_TAPS];
+    int hs[SGVP_IMGP_RS_COLS], hn[SGVP_IMGP_RS_COLS];
+    int th, tv, cols, x0, sw, n, x, oy, y0, y1, ys, nv, next, k, c, j, xs, xe;
+    int a0, a1, a2;
+    unsigned char *src, *dst, *p;
+    short *row, *q, *wk;
+
+    cols = sgvp_imgp_rs_cols(d, crop, out, filter, &th, &tv);
+    SGV_IMGP_ASSERT(cols > 0);
+
+    SGVP_IMGP_BAND(job, i, y0, y1);
+    for(x0 = 0; x0 < out.w; x0 += cols) {
+        sw = SGVP_IMGP_MIN(cols, out.w - x0);
+        n = sw*d;
+        xs = in.w;
+        xe = 0;
+        for(x = 0; x < sw; x++) {
+            hn[x] = sgvp_imgp_rs_taps(x0 + x, out.w, lt.x, crop.x, in.w,
+                                      filter, hw + x*th, hs + x);
+            if(hn[x]) {
+                xs = SGVP_IMGP_MIN(xs, hs[x]);
+                xe = hs[x] + hn[x] > xe ? hs[x] + hn[x] : xe;
+            } else {
+                hs[x] = 0;
+            }
+        }
+        if(vfirst) {
+            for(x = 0; x < sw; x++) {
+                hs[x] = hn[x] ? hs[x] - xs : 0;
+            }
+        }
 
-    for(y = 0; y < out.w; y++) {
-        for(x = 0; x < out.w; x++) {
-            for(c = 0; c < out.d; c++) {
-                val = in.data[in.w*in.d*(2*y) + in.d*(2*x) + c];
-                for(y1 = 2*y; y1 < 2*(y+1); y1++) {
-                    for(x1 = 2*x; x1 < 2*(x+1); x1++) {
-                        new_val = in.data[in.w*in.d*y1 + in.d*x1 + c];
-                        if(new_val > val) {
-                            val = new_val;
-                        }
-                    }
+        next = 0;
+        for(oy = y0; oy < y1; oy++) {
+            dst = out.data + oy*SGVP_IMGP_LD(out) + x0*d;
+            nv = sgvp_imgp_rs_taps(oy, out.h, lt.y, crop.y, in.h, filter,
+                                   vw, &ys);
+            if(nv == 0 || xs >= xe) {
+                for(j = 0; j < n; j++) {
+                    dst[j] = 0;
+                }
+                continue;
+            }
+
+            if(vfirst) {
+                for(k = 0; k < nv; k++) {
+                    rb[k] = in.data + (ys + k)*SGVP_IMGP_LD(in) + xs*d;
                 }
-                out.data[out.w*out.d*y + out.d*x + c] = val;
+                sgvp_imgp_rs_col_u8(rb, vw, nv, (xe - xs)*d, ring);
+                SGVP_IMGP_RS_ROW(ring, q, dst, SGVP_IMGP_RS_U8, 20, sw, d, hw, th, hs, hn)
+                continue;
+            }
+
+            /* rows ys.. only move forward, so the ring has all of them */
+            next = next > ys ? next : ys;
+            for(; next < ys + nv; next++) {
+                src = in.data + next*SGVP_IMGP_LD(in);
+                row = ring + (next % tv)*n;
+                SGVP_IMGP_RS_ROW(src, p, row, SGVP_IMGP_RS_Q6, 8, sw, d, hw, th, hs, hn)
+            }
+            for(k = 0; k < nv; k++) {
+                rs[k] = ring + ((ys + k) % tv)*n;
             }
+            sgvp_imgp_rs_col_q6(rs, vw, nv, n, dst);
         }
     }
 }
 
-SGVIMGP_DEF void sgv_softmax(float* scores_in, int n, float* probs_out)
+SGVIMGP_DEF void sgv_imgp_crop_rescale_filter_view(sgv_img_view in,
+                                                   sgv_imgp_i2 in_left_top,
+                                                   sgv_imgp_i2 crop_size,
+                                                   sgv_img_view out, int filter)
 {
-    int i;
-    float max_score, sum;
+    sgvp_imgp_job job;
+    int ds_factor_w, ds_factor_h, th, tv;
 
-    max_score = scores_in[0];
+    SGV_IMGP_ASSERT(in.d == out.d);
+
+    job.a = in;
+    job.b = out;
+    job.p = in_left_top;
+    job.q = crop_size;
+    /* ratios too big for the buffers of the separable filters go to the
+       supersampling, which averages the whole area too */
+    if(filter == SGV_IMGP_RESCALE_LEGACY ||
+       sgvp_imgp_rs_cols(in.d, crop_size, out, filter, &th, &tv) == 0) {
+        ds_factor_w = (crop_size.x+out.w-1)/out.w;
+        ds_factor_h = (crop_size.y+out.h-1)/out.h;
+        job.r.x = ds_factor_w > ds_factor_h ? ds_factor_w : ds_factor_h;
+        sgvp_imgp_run(&job, sgvp_imgp_crop_rescale_legacy_task, out.h, 1,
+                      16.0*out.w*out.d*job.r.x*job.r.x);
+    } else {
+        job.r.x = filter;
+        sgvp_imgp_run(&job, sgvp_imgp_rescale_task, out.h, 1,
+                      4.0*out.w*out.d*(2 + (crop_size.x + crop_size.y)/out.h));
+    }
+}
+
+SGVIMGP_DEF void sgv_imgp_crop_rescale_view(sgv_img_view in,
+                                            sgv_imgp_i2 in_left_top,
+                                            sgv_imgp_i2 crop_size,
+                                            sgv_img_view out)
+{
+#ifdef SGV_IMGP_LEGACY_RESCALE
+    sgv_imgp_crop_rescale_filter_view(in, in_left_top, crop_size, out,
+                                      SGV_IMGP_RESCALE_LEGACY);
+#else
+    sgv_imgp_crop_rescale_filter_view(in, in_left_top, crop_size, out,
+                                      SGV_IMGP_RESCALE_AUTO);
+#endif
+}
+
+/* Half precision values are widened to float to be worked on and rounded
+   back to be stored, 8 at a time with F16C (fp16) and AVX-512 BF16 (the
+   rounding to bfloat16) where the compiler targets them. The plain C
+   conversions give the same results. */
+#if defined(__F16C__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(__AVX512BF16__) && defined(__AVX512VL__)
+#include <immintrin.h>
+#define SGVP_IMGP_AVX512BF16
+#endif
+
+static float sgvp_imgp_h2f(unsigned short h, int format)
+{
+    unsigned int x;
+    float f;
+
+    if(format == SGV_IMGP_BF16) {
+        x = (unsigned int)h << 16;
+    } else if((h & 0x7c00) == 0x7c00) {
+        /* inf, NaN */
+        x = (unsigned int)(h & 0x8000) << 16 | 0x7f800000 |
+            (unsigned int)(h & 0x3ff) << 13;
+    } else if(h & 0x7c00) {
+        /* the exponent rebiased from 15 to 127 */
+        x = (unsigned int)(h & 0x8000) << 16 |
+            ((unsigned int)(h & 0x7fff) + (112 << 10)) << 13;
+    } else {
+        /* zero or subnormal, (h & 0x3ff)*2^-24 */
+        f = (h & 0x3ff)*(1.0f/16777216);
+        return (h & 0x8000) ? -f : f;
+    }
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+static unsigned short sgvp_imgp_f2h(float f, int format)
+{
+    unsigned int x, sign, m, r, half;
+    int shift;
+
+    memcpy(&x, &f, sizeof(x));
+    if(format == SGV_IMGP_BF16) {
+        if((x & 0x7fffffff) > 0x7f800000) {
+            return (unsigned short)(x >> 16 | 0x40); /* NaN, quieted */
+        }
+        if((x & 0x7f800000) == 0) {
+            return (unsigned short)(x >> 16 & 0x8000);
+        }
+        return (unsigned short)((x + 0x7fff + (x >> 16 & 1)) >> 16);
+    }
+
+    sign = x >> 16 & 0x8000;
+    x &= 0x7fffffff;
+    if(x > 0x7f800000) {
+        return (unsigned short)(sign | 0x7e00 | (x >> 13 & 0x3ff));
+    }
+    if(x >= 0x477ff000) {
+        return (unsigned short)(sign | 0x7c00); /* 65520 and up round to inf */
+    }
+    if(x >= 0x38800000) {
+        /* normal: rebias the exponent, round off 13 bits of mantissa */
+        x -= 112u << 23;
+        return (unsigned short)(sign | (x + 0xfff + (x >> 13 & 1)) >> 13);
+    }
+    if(x <= 0x33000000) {
+        return (unsigned short)sign; /* 2^-25 and below round to 0 */
+    }
+    /* subnormal: the mantissa with its leading 1, in units of 2^-24 */
+    m = (x & 0x7fffff) | 0x800000;
+    shift = 126 - (int)(x >> 23);
+    r = m >> shift;
+    half = 1u << (shift - 1);
+    m &= (half << 1) - 1;
+    if(m > half || (m == half && (r & 1))) {
+        r++;
+    }
+    return (unsigned short)(sign | r);
+}
+
+/* n values of the given format at src to floats at dst */
+static void sgvp_imgp_widen(const unsigned short* src, int format, float* dst,
+                            int n)
+{
+    unsigned int x;
+    int k = 0;
+
+#ifdef __F16C__
+    if(format == SGV_IMGP_F16) {
+        for(; k + 8 <= n; k += 8) {
+            _mm256_storeu_ps(dst + k, _mm256_cvtph_ps(
+                _mm_loadu_si128((const __m128i*)(src + k))));
+        }
+    }
+#endif
+    if(format == SGV_IMGP_BF16) {
+#ifdef __AVX2__
+        for(; k + 8 <= n; k += 8) {
+            _mm256_storeu_si256((__m256i*)(dst + k), _mm256_slli_epi32(
+                _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(src + k))), 16));
+        }
+#endif
+        for(; k < n; k++) {
+            x = (unsigned int)src[k] << 16;
+            memcpy(dst + k, &x, sizeof(x));
+        }
+    }
+    for(; k < n; k++) {
+        dst[k] = sgvp_imgp_h2f(src[k], format);
+    }
+}
+
+/* n floats at src rounded to the given format at dst */
+static void sgvp_imgp_narrow(const float* src, int format, unsigned short* dst,
+                             int n)
+{
+    int k = 0;
+
+#ifdef __F16C__
+    if(format == SGV_IMGP_F16) {
+        for(; k + 8 <= n; k += 8) {
+            _mm_storeu_si128((__m128i*)(dst + k), _mm256_cvtps_ph(
+                _mm256_loadu_ps(src + k), _MM_FROUND_TO_NEAREST_INT));
+        }
+    }
+#endif
+#ifdef SGVP_IMGP_AVX512BF16
+    if(format == SGV_IMGP_BF16) {
+        for(; k + 8 <= n; k += 8) {
+            _mm_storeu_si128((__m128i*)(dst + k),
+                             (__m128i)_mm256_cvtneps_pbh(_mm256_loadu_ps(src + k)));
+        }
+    }
+#endif
+    for(; k < n; k++) {
+        dst[k] = sgvp_imgp_f2h(src[k], format);
+    }
+}
+
+/* The convolution is a matrix product, out = A*B with one row of A per output
+   pixel (its receptive field, filt.h runs of filt.w*in.d floats in the input)
+   and B the filter as it is stored, filt.h*filt.w*in.d rows of out.d floats.
+   A is never built: the receptive fields are gathered straight from the input
+   while packing (implicit im2col). Panels of A and B small enough to stay in
+   the cache are packed on the stack and multiplied by a micro-kernel that
+   keeps an MR x NR block of the output in registers. */
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SGVP_IMGP_VEC __m256
+#define SGVP_IMGP_W 8
+#define SGVP_IMGP_LOAD(p) _mm256_loadu_ps(p)
+#define SGVP_IMGP_STORE(p, v) _mm256_storeu_ps(p, v)
+#define SGVP_IMGP_BCAST(p) _mm256_broadcast_ss(p)
+#define SGVP_IMGP_ZERO() _mm256_setzero_ps()
+#define SGVP_IMGP_SET1(x) _mm256_set1_ps(x)
+#define SGVP_IMGP_ADD(a, b) _mm256_add_ps(a, b)
+#define SGVP_IMGP_MUL(a, b) _mm256_mul_ps(a, b)
+#define SGVP_IMGP_SUB(a, b) _mm256_sub_ps(a, b)
+#ifdef __FMA__
+#define SGVP_IMGP_MADD(a, b, c) _mm256_fmadd_ps(a, b, c)
+#else
+#define SGVP_IMGP_MADD(a, b, c) _mm256_add_ps(_mm256_mul_ps(a, b), c)
+#endif
+#elif defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64)
+#include <xmmintrin.h>
+#define SGVP_IMGP_VEC __m128
+#define SGVP_IMGP_W 4
+#define SGVP_IMGP_LOAD(p) _mm_loadu_ps(p)
+#define SGVP_IMGP_STORE(p, v) _mm_storeu_ps(p, v)
+#define SGVP_IMGP_BCAST(p) _mm_loadu_ps(p)
+#define SGVP_IMGP_ZERO() _mm_setzero_ps()
+#define SGVP_IMGP_SET1(x) _mm_set1_ps(x)
+#define SGVP_IMGP_ADD(a, b) _mm_add_ps(a, b)
+#define SGVP_IMGP_MUL(a, b) _mm_mul_ps(a, b)
+#define SGVP_IMGP_SUB(a, b) _mm_sub_ps(a, b)
+#define SGVP_IMGP_MADD(a, b, c) _mm_add_ps(_mm_mul_ps(a, b), c)
+/* SSE has no broadcast from memory, the packed A holds 4 copies of each
+   value instead (a plain load is cheaper than a load and a shuffle) */
+#define SGVP_IMGP_AW 4
+#endif
+
+#ifndef SGVP_IMGP_AW
+#define SGVP_IMGP_AW 1   /* copies of each value in the packed A */
+#endif
+
+#define SGVP_IMGP_MR 6   /* output pixels per micro-kernel call */
+#ifdef SGVP_IMGP_VEC
+#define SGVP_IMGP_NR (2*SGVP_IMGP_W) /* output channels per call */
+#else
+#define SGVP_IMGP_NR 8
+#endif
+#define SGVP_IMGP_KC 128 /* depth of the packed panels */
+#define SGVP_IMGP_NC 64  /* output channels per packed filter block */
+
+#ifdef SGVP_IMGP_VEC
+#define SGVP_IMGP_ROW(r) \
+    x = SGVP_IMGP_BCAST(a + r*SGVP_IMGP_AW); \
+    c##r##0 = SGVP_IMGP_MADD(x, b0, c##r##0); \
+    c##r##1 = SGVP_IMGP_MADD(x, b1, c##r##1)
+#define SGVP_IMGP_GET(r) \
+    c##r##0 = acc ? SGVP_IMGP_LOAD(c + r*ldc) : SGVP_IMGP_ZERO(); \
+    c##r##1 = acc ? SGVP_IMGP_LOAD(c + r*ldc + SGVP_IMGP_W) : SGVP_IMGP_ZERO()
+#define SGVP_IMGP_PUT(r) \
+    SGVP_IMGP_STORE(c + r*ldc, c##r##0); \
+    SGVP_IMGP_STORE(c + r*ldc + SGVP_IMGP_W, c##r##1)
+#endif
+
+/* c[MR x NR] (row stride ldc) = a*b, plus c if 'acc'. a holds kc columns
+   of MR (times AW) floats, b kc rows of NR floats (row stride ldb). */
+static void sgvp_imgp_kernel(int kc, const float* a, const float* b, int ldb,
+                             float* c, int ldc, int acc)
+{
+#ifdef SGVP_IMGP_VEC
+    SGVP_IMGP_VEC c00, c01, c10, c11, c20, c21, c30, c31, c40, c41, c50, c51;
+    SGVP_IMGP_VEC b0, b1, x;
+    int k;
+
+    SGVP_IMGP_GET(0); SGVP_IMGP_GET(1); SGVP_IMGP_GET(2);
+    SGVP_IMGP_GET(3); SGVP_IMGP_GET(4); SGVP_IMGP_GET(5);
+    for(k = 0; k < kc; k++, a += SGVP_IMGP_MR*SGVP_IMGP_AW, b += ldb) {
+        b0 = SGVP_IMGP_LOAD(b);
+        b1 = SGVP_IMGP_LOAD(b + SGVP_IMGP_W);
+        SGVP_IMGP_ROW(0); SGVP_IMGP_ROW(1); SGVP_IMGP_ROW(2);
+        SGVP_IMGP_ROW(3); SGVP_IMGP_ROW(4); SGVP_IMGP_ROW(5);
+    }
+    SGVP_IMGP_PUT(0); SGVP_IMGP_PUT(1); SGVP_IMGP_PUT(2);
+    SGVP_IMGP_PUT(3); SGVP_IMGP_PUT(4); SGVP_IMGP_PUT(5);
+#else
+    float t[SGVP_IMGP_MR*SGVP_IMGP_NR];
+    int k, r, j;
+
+    for(r = 0; r < SGVP_IMGP_MR; r++) {
+        for(j = 0; j < SGVP_IMGP_NR; j++) {
+            t[r*SGVP_IMGP_NR + j] = acc ? c[r*ldc + j] : 0.0f;
+        }
+    }
+    for(k = 0; k < kc; k++, a += SGVP_IMGP_MR, b += ldb) {
+        for(r = 0; r < SGVP_IMGP_MR; r++) {
+            for(j = 0; j < SGVP_IMGP_NR; j++) {
+                t[r*SGVP_IMGP_NR + j] += a[r] * b[j];
+            }
+        }
+    }
+    for(r = 0; r < SGVP_IMGP_MR; r++) {
+        for(j = 0; j < SGVP_IMGP_NR; j++) {
+            c[r*ldc + j] = t[r*SGVP_IMGP_NR + j];
+        }
+    }
+#endif
+}
+
+/* A rectangle of the convolution output, w x h pixels from (x0, y0) and
+   channels [n0, n0+nc), in each of nb images. The input images are in.h
+   rows apart. Pixel (x0+x, y0+y), channel n0+j of image b is written to
+   dst[b*ldb + y*ldr + x*ldd + j]. The images go through the product
+   together, so each block of the filter is packed once for all of them. */
+typedef struct {
+    int x0, y0, w, h;
+    int n0, nc;
+    float* dst;
+    int ldd, ldr;
+    int nb, ldb;
+} sgvp_imgp_region;
+
+/* The half precision input and filter of sgv_hconv2d_valid, read in place
+   of in.data and filt.data (in and filt give their shapes) */
+typedef struct {
+    const unsigned short *in, *filt;
+    int in_format, filt_format;
+} sgvp_imgp_half;
+
+/* Computes the region with the implicit im2col matrix product, reading
+   half precision values from hs if it is not 0 */
+static void sgvp_imgp_conv_gemm(sgv_fimg_view in, sgv_filt filt,
+                                const sgvp_imgp_half* hs,
+                                const sgvp_imgp_region* rg)
+{
+    float bp[SGVP_IMGP_KC*SGVP_IMGP_NC];
+    float ap[SGVP_IMGP_KC*SGVP_IMGP_MR*SGVP_IMGP_AW];
+    float tile[SGVP_IMGP_MR*SGVP_IMGP_NR], wide[SGVP_IMGP_KC];
+    const float *rows[SGVP_IMGP_MR];
+    const unsigned short *hrows[SGVP_IMGP_MR];
+    float *c, *cr[SGVP_IMGP_MR], *p;
+    int K = filt.h*filt.w*in.d, P = rg->w*rg->h, M = rg->nb*P, ldc = rg->ldd;
+    int seg = filt.w*in.d, stride = SGVP_IMGP_LD(in);
+    int k0, kc, n0, nc, m, mr, n, nr, r, j, k, i, run, yf, x, direct;
+    long o;
+    float v;
+
+    for(k0 = 0; k0 < K; k0 += kc) {
+        kc = SGVP_IMGP_MIN(SGVP_IMGP_KC, K - k0);
+        for(n0 = 0; n0 < rg->nc; n0 += nc) {
+            nc = SGVP_IMGP_MIN(SGVP_IMGP_NC, rg->nc - n0);
+
+            /* filter rows [k0, k0+kc), NR channels per panel, zero padded */
+            for(n = 0; n < nc; n += SGVP_IMGP_NR) {
+                nr = SGVP_IMGP_MIN(SGVP_IMGP_NR, nc - n);
+                for(k = 0; k < kc; k++) {
+                    o = (long)(k0 + k)*filt.outd + rg->n0 + n0 + n;
+                    p = bp + n*kc + k*SGVP_IMGP_NR;
+                    if(hs) {
+                        sgvp_imgp_widen(hs->filt + o, hs->filt_format, p, nr);
+                    } else {
+                        for(j = 0; j < nr; j++) {
+                            p[j] = filt.data[o + j];
+                        }
+                    }
+                    for(j = nr; j < SGVP_IMGP_NR; j++) {
+                        p[j] = 0.0f;
+                    }
+                }
+            }
+
+            for(m = 0; m < M; m += SGVP_IMGP_MR) {
+                mr = SGVP_IMGP_MIN(SGVP_IMGP_MR, M - m);
+
+                /* columns [k0, k0+kc) of the receptive fields of pixels m..
+                   Rows past the last pixel repeat it, their results are
+                   dropped. */
+                for(r = 0; r < SGVP_IMGP_MR; r++) {
+                    j = m + SGVP_IMGP_MIN(r, mr - 1);
+                    o = (long)(j/P)*in.h*stride + (rg->y0 + j%P/rg->w)*stride +
+                        (rg->x0 + j%P%rg->w)*in.d;
+                    if(hs) {
+                        hrows[r] = hs->in + o;
+                    } else {
+                        rows[r] = in.data + o;
+                    }
+                }
+                yf = k0 / seg;
+                x = k0 % seg;
+                for(k = 0; k < kc; k += run, x = 0, yf++) {
+                    run = SGVP_IMGP_MIN(seg - x, kc - k);
+                    for(r = 0; hs && r < SGVP_IMGP_MR; r++) {
+                        sgvp_imgp_widen(hrows[r] + yf*stride + x, hs->in_format,
+                                        wide, run);
+                        for(j = 0; j < run; j++) {
+                            for(i = 0; i < SGVP_IMGP_AW; i++) {
+                                ap[((k + j)*SGVP_IMGP_MR + r)*SGVP_IMGP_AW + i] = wide[j];
+                            }
+                        }
+                    }
+                    for(j = 0; !hs && j < run; j++) {
+                        for(r = 0; r < SGVP_IMGP_MR; r++) {
+                            v = rows[r][yf*stride + x + j];
+                            for(i = 0; i < SGVP_IMGP_AW; i++) {
+                                ap[((k + j)*SGVP_IMGP_MR + r)*SGVP_IMGP_AW + i] = v;
+                            }
+                        }
+                    }
+                }
+
+                /* pixels m.. are ldc apart unless they wrap onto a row
+                   further than w pixels on, or onto the next image */
+                for(r = 0; r < mr; r++) {
+                    j = m + r;
+                    cr[r] = rg->dst + (j/P)*rg->ldb + (j%P/rg->w)*rg->ldr +
+                            (j%P%rg->w)*ldc + n0;
+                }
+                direct = mr == SGVP_IMGP_MR && cr[mr - 1] - cr[0] == (mr - 1)*ldc;
+
+                for(n = 0; n < nc; n += SGVP_IMGP_NR) {
+                    nr = SGVP_IMGP_MIN(SGVP_IMGP_NR, nc - n);
+                    c = cr[0] + n;
+                    if(direct && nr == SGVP_IMGP_NR) {
+                        sgvp_imgp_kernel(kc, ap, bp + n*kc, SGVP_IMGP_NR, c, ldc, k0 > 0);
+                        continue;
+                    }
+                    /* edges go through a full size tile */
+                    for(r = 0; r < SGVP_IMGP_MR; r++) {
+                        for(j = 0; j < SGVP_IMGP_NR; j++) {
+                            tile[r*SGVP_IMGP_NR + j] = (r < mr && j < nr) ? cr[r][n + j] : 0.0f;
+                        }
+                    }
+                    sgvp_imgp_kernel(kc, ap, bp + n*kc, SGVP_IMGP_NR,
+                                     tile, SGVP_IMGP_NR, k0 > 0);
+                    for(r = 0; r < mr; r++) {
+                        for(j = 0; j < nr; j++) {
+                            cr[r][n + j] = tile[r*SGVP_IMGP_NR + j];
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+/* Winograd F(2x2, 3x3). Every 2x2 block of outputs (a tile) is computed
+   from the 4x4 block of input under it as Y = At*[(G*g*Gt) .* (Bt*d*B)]*A,
+   summed over the input channels. The sum is 16 matrix products, one per
+   element of the 4x4 transformed tiles, of (tiles x in.d) transformed input
+   by (in.d x out.d) transformed filter, done by the same micro-kernel as
+   above. The transforms work on several channels at once: in HWC they are
+   next to each other. As the output transform is linear, input channel
+   blocks are transformed back and added to the output one at a time. */
+#define SGVP_IMGP_WKC 16 /* input channels per block */
+#define SGVP_IMGP_WNC 64 /* output channels per block */
+
+/* d = Bt*d*B for the 4x4 tile d, t is scratch */
+#define SGVP_IMGP_BTDB(d, t, add, sub) \
+    for(i = 0; i < 4; i++) { \
+        t[i] = sub(d[i], d[8 + i]); \
+        t[4 + i] = add(d[4 + i], d[8 + i]); \
+        t[8 + i] = sub(d[8 + i], d[4 + i]); \
+        t[12 + i] = sub(d[4 + i], d[12 + i]); \
+    } \
+    for(i = 0; i < 4; i++) { \
+        d[4*i] = sub(t[4*i], t[4*i + 2]); \
+        d[4*i + 1] = add(t[4*i + 1], t[4*i + 2]); \
+        d[4*i + 2] = sub(t[4*i + 2], t[4*i + 1]); \
+        d[4*i + 3] = sub(t[4*i + 1], t[4*i + 3]); \
+    }
+
+/* y = At*m*A for the 4x4 tile m, t is scratch */
+#define SGVP_IMGP_ATMA(m, y, t, add, sub) \
+    for(i = 0; i < 4; i++) { \
+        t[i] = add(add(m[i], m[4 + i]), m[8 + i]); \
+        t[4 + i] = sub(sub(m[4 + i], m[8 + i]), m[12 + i]); \
+    } \
+    for(i = 0; i < 2; i++) { \
+        y[2*i] = add(add(t[4*i], t[4*i + 1]), t[4*i + 2]); \
+        y[2*i + 1] = sub(sub(t[4*i + 1], t[4*i + 2]), t[4*i + 3]); \
+    }
+
+#define SGVP_IMGP_FADD(a, b) ((a) + (b))
+#define SGVP_IMGP_FSUB(a, b) ((a) - (b))
+
+/* u = G*g*Gt for the 3x3 filter g, t is scratch */
+#define SGVP_IMGP_GGGT(g, u, t, add, sub, mul, half) \
+    for(i = 0; i < 3; i++) { \
+        t[i] = g[i]; \
+        t[3 + i] = mul(half, add(add(g[i], g[3 + i]), g[6 + i])); \
+        t[6 + i] = mul(half, add(sub(g[i], g[3 + i]), g[6 + i])); \
+        t[9 + i] = g[6 + i]; \
+    } \
+    for(i = 0; i < 4; i++) { \
+        u[4*i] = t[3*i]; \
+        u[4*i + 1] = mul(half, add(add(t[3*i], t[3*i + 1]), t[3*i + 2])); \
+        u[4*i + 2] = mul(half, add(sub(t[3*i], t[3*i + 1]), t[3*i + 2])); \
+        u[4*i + 3] = t[3*i + 2]; \
+    }
+
+#define SGVP_IMGP_FMUL(a, b) ((a) * (b))
+
+/* Transforms the n 3x3 filters at f[i*stride + j] (tap i of filter j) to
+   u[e*ldu + j] (element e of filter j) */
+static void sgvp_imgp_wfilt(const float* f, int stride, int n,
+                            float* u, int ldu)
+{
+    float g[9], t[12], w[16];
+    int i, j = 0;
+#ifdef SGVP_IMGP_VEC
+    SGVP_IMGP_VEC gv[9], tv[12], wv[16], half = SGVP_IMGP_SET1(0.5f);
+
+    for(; j + SGVP_IMGP_W <= n; j += SGVP_IMGP_W) {
+        for(i = 0; i < 9; i++) {
+            gv[i] = SGVP_IMGP_LOAD(f + i*stride + j);
+        }
+        SGVP_IMGP_GGGT(gv, wv, tv, SGVP_IMGP_ADD, SGVP_IMGP_SUB, SGVP_IMGP_MUL, half)
+        for(i = 0; i < 16; i++) {
+            SGVP_IMGP_STORE(u + i*ldu + j, wv[i]);
+        }
+    }
+#endif
+    for(; j < n; j++) {
+        for(i = 0; i < 9; i++) {
+            g[i] = f[i*stride + j];
+        }
+        SGVP_IMGP_GGGT(g, w, t, SGVP_IMGP_FADD, SGVP_IMGP_FSUB, SGVP_IMGP_FMUL, 0.5f)
+        for(i = 0; i < 16; i++) {
+            u[i*ldu + j] = w[i];
+        }
+    }
+}
+
+/* Channels [n0, n0+nc) of the region (counted from rg->n0). The
+   transformed filter is read from wf (laid out as sgv_wfilt) if given,
+   else each block of it is transformed from filt (or hs) here. */
+static void sgvp_imgp_winograd_block(sgv_fimg_view in, sgv_filt filt,
+                                     const float* wf, const sgvp_imgp_half* hs,
+                                     const sgvp_imgp_region* rg,
+                                     int n0, int nc)
+{
+    float ub[16*(SGVP_IMGP_WKC*SGVP_IMGP_WNC + 16)];
+    float g[9*SGVP_IMGP_WNC], hq[16*SGVP_IMGP_WKC];
+    float edge[SGVP_IMGP_WKC*SGVP_IMGP_NR];
+    float vp[16*SGVP_IMGP_WKC*SGVP_IMGP_MR*SGVP_IMGP_AW];
+    float mp[16*SGVP_IMGP_MR*SGVP_IMGP_NR];
+    float tv[16*SGVP_IMGP_WKC], zero[SGVP_IMGP_WKC];
+    float d[16], t[16], y[4];
+    const float *q[16], *b;
+    float* dst;
+    int tiles_w = (rg->w + 1)/2, per = tiles_w*((rg->h + 1)/2), tiles = rg->nb*per;
+    int c0, kc, k, n, nr, j, i, e, r, mr, m, tx, ty, tb, x, yy, ldb, eb, step;
+    long o;
+#ifdef SGVP_IMGP_VEC
+    SGVP_IMGP_VEC dv[16], tw[16], yv[4];
+#endif
+
+    for(k = 0; k < SGVP_IMGP_WKC; k++) {
+        zero[k] = 0.0f;
+    }
+    step = SGVP_IMGP_MR*SGVP_IMGP_NR;
+
+    for(c0 = 0; c0 < in.d; c0 += kc) {
+        kc = SGVP_IMGP_MIN(SGVP_IMGP_WKC, in.d - c0);
+
+        /* transformed filter rows of this block, element e at b + e*eb.
+           The padding keeps the 16 rows of ub off the same cache sets. */
+        if(wf) {
+            b = wf + c0*filt.outd + rg->n0 + n0;
+            ldb = filt.outd;
+            eb = filt.ind*filt.outd;
+        } else {
+            ldb = nc;
+            eb = kc*nc + 16;
+            for(k = 0; k < kc; k++) {
+                o = (long)(c0 + k)*filt.outd + rg->n0 + n0;
+                if(!hs) {
+                    sgvp_imgp_wfilt(filt.data + o, filt.ind*filt.outd, nc,
+                                    ub + k*nc, eb);
+                    continue;
+                }
+                for(i = 0; i < 9; i++) {
+                    sgvp_imgp_widen(hs->filt + o + (long)i*filt.ind*filt.outd,
+                                    hs->filt_format, g + i*nc, nc);
+                }
+                sgvp_imgp_wfilt(g, nc, nc, ub + k*nc, eb);
+            }
+            b = ub;
+        }
+
+        for(m = 0; m < tiles; m += SGVP_IMGP_MR) {
+            mr = SGVP_IMGP_MIN(SGVP_IMGP_MR, tiles - m);
+
+            /* Bt*d*B of tiles m.. (the last one repeated past the end), zero
+               beyond the input where the output size is odd */
+            for(r = 0; r < SGVP_IMGP_MR; r++) {
+                tb = (m + SGVP_IMGP_MIN(r, mr - 1))/per;
+                ty = (m + SGVP_IMGP_MIN(r, mr - 1))%per/tiles_w;
+                tx = (m + SGVP_IMGP_MIN(r, mr - 1))%per%tiles_w;
+                for(e = 0; e < 16; e++) {
+                    yy = rg->y0 + 2*ty + e/4;
+                    x = rg->x0 + 2*tx + e%4;
+                    o = (long)(tb*in.h + yy)*SGVP_IMGP_LD(in) + x*in.d + c0;
+                    if(yy >= in.h || x >= in.w) {
+                        q[e] = zero;
+                    } else if(hs) {
+                        sgvp_imgp_widen(hs->in + o, hs->in_format,
+                                        hq + e*SGVP_IMGP_WKC, kc);
+                        q[e] = hq + e*SGVP_IMGP_WKC;
+                    } else {
+                        q[e] = in.data + o;
+                    }
+                }
+                k = 0;
+#ifdef SGVP_IMGP_VEC
+                for(; k + SGVP_IMGP_W <= kc; k += SGVP_IMGP_W) {
+                    for(e = 0; e < 16; e++) {
+                        dv[e] = SGVP_IMGP_LOAD(q[e] + k);
+                    }
+                    SGVP_IMGP_BTDB(dv, tw, SGVP_IMGP_ADD, SGVP_IMGP_SUB)
+                    for(e = 0; e < 16; e++) {
+                        SGVP_IMGP_STORE(tv + e*kc + k, dv[e]);
+                    }
+                }
+#endif
+                for(; k < kc; k++) {
+                    for(e = 0; e < 16; e++) {
+                        d[e] = q[e][k];
+                    }
+                    SGVP_IMGP_BTDB(d, t, SGVP_IMGP_FADD, SGVP_IMGP_FSUB)
+                    for(e = 0; e < 16; e++) {
+                        tv[e*kc + k] = d[e];
+                    }
+                }
+                for(e = 0; e < 16*kc; e++) {
+                    dst = vp + (e*SGVP_IMGP_MR + r)*SGVP_IMGP_AW;
+                    for(i = 0; i < SGVP_IMGP_AW; i++) {
+                        dst[i] = tv[e];
+                    }
+                }
+            }
+
+            for(n = 0; n < nc; n += SGVP_IMGP_NR) {
+                nr = SGVP_IMGP_MIN(SGVP_IMGP_NR, nc - n);
+                for(e = 0; e < 16; e++) {
+                    if(nr == SGVP_IMGP_NR) {
+                        sgvp_imgp_kernel(kc, vp + e*kc*SGVP_IMGP_MR*SGVP_IMGP_AW,
+                                         b + e*eb + n, ldb,
+                                         mp + e*step, SGVP_IMGP_NR, 0);
+                        continue;
+                    }
+                    /* the last channels, zero padded */
+                    for(k = 0; k < kc; k++) {
+                        for(j = 0; j < SGVP_IMGP_NR; j++) {
+                            edge[k*SGVP_IMGP_NR + j] = (j < nr) ? b[e*eb + k*ldb + n + j] : 0.0f;
+                        }
+                    }
+                    sgvp_imgp_kernel(kc, vp + e*kc*SGVP_IMGP_MR*SGVP_IMGP_AW,
+                                     edge, SGVP_IMGP_NR,
+                                     mp + e*step, SGVP_IMGP_NR, 0);
+                }
+
+                /* At*M*A, added to what the previous channel blocks left */
+                for(r = 0; r < mr; r++) {
+                    tb = (m + r)/per;
+                    ty = (m + r)%per/tiles_w;
+                    tx = (m + r)%per%tiles_w;
+                    j = 0;
+#ifdef SGVP_IMGP_VEC
+                    for(; j + SGVP_IMGP_W <= nr; j += SGVP_IMGP_W) {
+                        for(e = 0; e < 16; e++) {
+                            dv[e] = SGVP_IMGP_LOAD(mp + e*step + r*SGVP_IMGP_NR + j);
+                        }
+                        SGVP_IMGP_ATMA(dv, yv, tw, SGVP_IMGP_ADD, SGVP_IMGP_SUB)
+                        for(i = 0; i < 4; i++) {
+                            yy = 2*ty + i/2;
+                            x = 2*tx + i%2;
+                            if(yy < rg->h && x < rg->w) {
+                                dst = rg->dst + tb*rg->ldb + yy*rg->ldr + x*rg->ldd + n0 + n + j;
+                                SGVP_IMGP_STORE(dst, c0 ? SGVP_IMGP_ADD(SGVP_IMGP_LOAD(dst), yv[i]) : yv[i]);
+                            }
+                        }
+                    }
+#endif
+                    for(; j < nr; j++) {
+                        for(e = 0; e < 16; e++) {
+                            d[e] = mp[e*step + r*SGVP_IMGP_NR + j];
+                        }
+                        SGVP_IMGP_ATMA(d, y, t, SGVP_IMGP_FADD, SGVP_IMGP_FSUB)
+                        for(i = 0; i < 4; i++) {
+                            yy = 2*ty + i/2;
+                            x = 2*tx + i%2;
+                            if(yy < rg->h && x < rg->w) {
+                                dst = rg->dst + tb*rg->ldb + yy*rg->ldr + x*rg->ldd + n0 + n + j;
+                                *dst = c0 ? *dst + y[i] : y[i];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void sgvp_imgp_winograd(sgv_fimg_view in, sgv_filt filt, const float* wf,
+                               const sgvp_imgp_half* hs,
+                               const sgvp_imgp_region* rg)
+{
+    int n0;
+
+    for(n0 = 0; n0 < rg->nc; n0 += SGVP_IMGP_WNC) {
+        sgvp_imgp_winograd_block(in, filt, wf, hs, rg, n0,
+                                 SGVP_IMGP_MIN(SGVP_IMGP_WNC, rg->nc - n0));
+    }
+}
+
+/* Computes the region, with Winograd if the filter is 3x3. With few input
+   channels the transforms cost more than they save. */
+static void sgvp_imgp_conv(sgv_fimg_view in, sgv_filt filt, const float* wf,
+                           const sgvp_imgp_half* hs, const sgvp_imgp_region* rg)
+{
+    if(wf || (filt.w == 3 && filt.h == 3 && in.d >= 8)) {
+        sgvp_imgp_winograd(in, filt, wf, hs, rg);
+    } else {
+        sgvp_imgp_conv_gemm(in, filt, hs, rg);
+    }
+}
+
+/* A band of pairs of rows by a chunk of blocks of SGVP_IMGP_NC channels.
+   Bands start on even rows, so the Winograd tiles are the same as for the
+   whole image. */
+static void sgvp_imgp_conv_task(void* ctx, int i)
+{
+    sgvp_imgp_job* job = (sgvp_imgp_job*)ctx;
+    sgv_fimg_view out = job->fb;
+    sgvp_imgp_region rg;
+    int y0, y1, b0, b1;
+
+    SGVP_IMGP_BAND(job, i, y0, y1);
+    SGVP_IMGP_CHUNK(job, i, (out.d + SGVP_IMGP_NC - 1)/SGVP_IMGP_NC, b0, b1);
+    rg.x0 = 0;
+    rg.y0 = 2*y0;
+    rg.w = out.w;
+    rg.h = SGVP_IMGP_MIN(2*y1, out.h) - rg.y0;
+    rg.n0 = b0*SGVP_IMGP_NC;
+    rg.nc = SGVP_IMGP_MIN(b1*SGVP_IMGP_NC, out.d) - rg.n0;
+    rg.dst = out.data + rg.y0*SGVP_IMGP_LD(out) + rg.n0;
+    rg.ldd = out.d;
+    rg.ldr = SGVP_IMGP_LD(out);
+    rg.nb = job->batch;
+    rg.ldb = out.h*SGVP_IMGP_LD(out);
+    sgvp_imgp_conv(job->fa, job->filt, job->wf, 0, &rg);
+}
+
+/* The whole output of a batch of n images. A task does the same band of
+   every image. */
+static void sgvp_imgp_conv_all(sgv_fimg_view in, sgv_filt filt, const float* wf,
+                               int n, sgv_fimg_view out)
+{
+    sgvp_imgp_job job;
+
+    job.fa = in;
+    job.fb = out;
+    job.filt = filt;
+    job.wf = wf;
+    job.batch = n;
+    sgvp_imgp_run(&job, sgvp_imgp_conv_task, (out.h + 1)/2,
+                  (out.d + SGVP_IMGP_NC - 1)/SGVP_IMGP_NC,
+                  2.0*n*out.w*SGVP_IMGP_NC*filt.w*filt.h*in.d);
+}
+
+SGVIMGP_DEF void sgv_make_wfilt(sgv_filt filt, sgv_wfilt out)
+{
+    int ci;
+
+    SGV_IMGP_ASSERT(filt.w == 3 && filt.h == 3);
+    SGV_IMGP_ASSERT(filt.ind == out.ind && filt.outd == out.outd);
+
+    for(ci = 0; ci < filt.ind; ci++) {
+        sgvp_imgp_wfilt(filt.data + ci*filt.outd, filt.ind*filt.outd,
+                        filt.outd, out.data + ci*filt.outd,
+                        filt.ind*filt.outd);
+    }
+}
+
+SGVIMGP_DEF void sgv_conv2d_valid_wfilt_view(sgv_fimg_view in, sgv_wfilt filt,
+                                             sgv_fimg_view out)
+{
+    sgv_filt f;
+
+    SGV_IMGP_ASSERT(filt.ind == in.d && filt.outd == out.d);
+    SGV_IMGP_ASSERT(out.w == in.w - 2 && out.h == in.h - 2);
+
+    f.data = 0;
+    f.w = f.h = 3;
+    f.ind = filt.ind;
+    f.outd = filt.outd;
+    sgvp_imgp_conv_all(in, f, filt.data, 1, out);
+}
+
+SGVIMGP_DEF void sgv_conv2d_valid_view(sgv_fimg_view in, sgv_filt filt,
+                                       sgv_fimg_view out)
+{
+    SGV_IMGP_ASSERT(filt.ind == in.d && filt.outd == out.d);
+    SGV_IMGP_ASSERT(out.w == (in.w - filt.w + 1));
+    SGV_IMGP_ASSERT(out.h == (in.h - filt.h + 1));
+
+    sgvp_imgp_conv_all(in, filt, 0, 1, out);
+}
+
+SGVIMGP_DEF void sgv_conv2d_valid_batch_view(sgv_fimg_view in, int n,
+                                             sgv_filt filt, sgv_fimg_view out)
+{
+    SGV_IMGP_ASSERT(filt.ind == in.d && filt.outd == out.d);
+    SGV_IMGP_ASSERT(out.w == (in.w - filt.w + 1));
+    SGV_IMGP_ASSERT(out.h == (in.h - filt.h + 1));
+
+    sgvp_imgp_conv_all(in, filt, 0, n, out);
+}
+
+SGVIMGP_DEF void sgv_conv2d_valid_wfilt_batch_view(sgv_fimg_view in, int n,
+                                                   sgv_wfilt filt,
+                                                   sgv_fimg_view out)
+{
+    sgv_filt f;
+
+    SGV_IMGP_ASSERT(filt.ind == in.d && filt.outd == out.d);
+    SGV_IMGP_ASSERT(out.w == in.w - 2 && out.h == in.h - 2);
+
+    f.data = 0;
+    f.w = f.h = 3;
+    f.ind = filt.ind;
+    f.outd = filt.outd;
+    sgvp_imgp_conv_all(in, f, filt.data, n, out);
+}
+
+/* Pooled pixels and channels per strip of sgvp_imgp_conv_pool */
+#define SGVP_IMGP_PP 64
+#define SGVP_IMGP_PC 64
+
+/* Convolves a strip of about SGVP_IMGP_PP pooled pixels at a time, as tall
+   as it can be so that the Winograd filter transform is redone less often,
+   then adds the bias, rectifies and pools while it is still in cache. Task
+   i does a band of pooled rows by a chunk of blocks of SGVP_IMGP_PC
+   channels. */
+static void sgvp_imgp_conv_pool_task(void* ctx, int i)
+{
+    sgvp_imgp_job* job = (sgvp_imgp_job*)ctx;
+    sgv_fimg_view out = job->fb;
+    float buf[4*SGVP_IMGP_PP*SGVP_IMGP_PC];
+    sgvp_imgp_region rg;
+    float *p, *o, v;
+    int cols = SGVP_IMGP_MIN(SGVP_IMGP_PP, out.w);
+    int py, ph, px, pw, x, y, j, w, ld, y0, y1, b0, b1;
+
+    SGVP_IMGP_BAND(job, i, y0, y1);
+    SGVP_IMGP_CHUNK(job, i, (out.d + SGVP_IMGP_PC - 1)/SGVP_IMGP_PC, b0, b1);
+    for(py = y0; py < y1; py += ph) {
+        ph = SGVP_IMGP_MIN(SGVP_IMGP_PP/cols, y1 - py);
+        rg.y0 = 2*py;
+        rg.h = 2*ph;
+        for(px = 0; px < out.w; px += pw) {
+            pw = SGVP_IMGP_MIN(cols, out.w - px);
+            rg.x0 = 2*px;
+            rg.w = w = 2*pw;
+            for(rg.n0 = b0*SGVP_IMGP_PC;
+                rg.n0 < SGVP_IMGP_MIN(b1*SGVP_IMGP_PC, out.d);
+                rg.n0 += rg.nc) {
+                rg.nc = ld = SGVP_IMGP_MIN(SGVP_IMGP_PC, out.d - rg.n0);
+                rg.dst = buf;
+                rg.ldd = ld;
+                rg.ldr = w*ld;
+                rg.nb = 1;
+                rg.ldb = 0;
+                sgvp_imgp_conv(job->fa, job->filt, job->wf, 0, &rg);
+
+                for(y = 0; y < ph; y++) {
+                    for(x = 0; x < pw; x++) {
+                        p = buf + (2*y*w + 2*x)*ld;
+                        o = out.data + (py + y)*SGVP_IMGP_LD(out) + (px + x)*out.d + rg.n0;
+                        for(j = 0; j < ld; j++) {
+                            v = p[j];
+                            v = p[ld + j] > v ? p[ld + j] : v;
+                            v = p[w*ld + j] > v ? p[w*ld + j] : v;
+                            v = p[(w + 1)*ld + j] > v ? p[(w + 1)*ld + j] : v;
+                            v += job->biases[rg.n0 + j];
+                            o[j] = v > 0 ? v : 0;
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void sgvp_imgp_conv_pool(sgv_fimg_view in, sgv_filt filt,
+                                const float* wf, float* biases,
+                                sgv_fimg_view out)
+{
+    sgvp_imgp_job job;
+
+    job.fa = in;
+    job.fb = out;
+    job.filt = filt;
+    job.wf = wf;
+    job.biases = biases;
+    sgvp_imgp_run(&job, sgvp_imgp_conv_pool_task, out.h,
+                  (out.d + SGVP_IMGP_PC - 1)/SGVP_IMGP_PC,
+                  8.0*out.w*SGVP_IMGP_PC*filt.w*filt.h*in.d);
+}
+
+SGVIMGP_DEF void sgv_conv2d_bias_relu_maxpool2_view(sgv_fimg_view in,
+                                                    sgv_filt filt,
+                                                    float* biases,
+                                                    sgv_fimg_view out)
+{
+    SGV_IMGP_ASSERT(filt.ind == in.d && filt.outd == out.d);
+    SGV_IMGP_ASSERT(out.w == (in.w - filt.w + 1)/2);
+    SGV_IMGP_ASSERT(out.h == (in.h - filt.h + 1)/2);
+
+    sgvp_imgp_conv_pool(in, filt, 0, biases, out);
+}
+
+SGVIMGP_DEF void sgv_conv2d_bias_relu_maxpool2_wfilt_view(sgv_fimg_view in,
+                                                          sgv_wfilt filt,
+                                                          float* biases,
+                                                          sgv_fimg_view out)
+{
+    sgv_filt f;
+
+    SGV_IMGP_ASSERT(filt.ind == in.d && filt.outd == out.d);
+    SGV_IMGP_ASSERT(out.w == (in.w - 2)/2 && out.h == (in.h - 2)/2);
+
+    f.data = 0;
+    f.w = f.h = 3;
+    f.ind = filt.ind;
+    f.outd = filt.outd;
+    sgvp_imgp_conv_pool(in, f, filt.data, biases, out);
+}
+
+static void sgvp_imgp_add_bias_task(void* ctx, int i)
+{
+    sgvp_imgp_job* job = (sgvp_imgp_job*)ctx;
+    sgv_fimg_view img = job->fa;
+    float* biases = job->biases;
+    int x, y, c, y0, y1;
+
+    SGVP_IMGP_BAND(job, i, y0, y1);
+    for(y = y0; y < y1; y++) {
+        for(x = 0; x < img.w; x++) {
+            for(c = 0; c < img.d; c++) {
+                img.data[SGVP_IMGP_LD(img)*y + img.d*x + c] += biases[c];
+            }
+        }
+    }
+}
+
+SGVIMGP_DEF void sgv_add_bias_view(sgv_fimg_view img, float* biases)
+{
+    sgvp_imgp_job job;
+
+    job.fa = img;
+    job.biases = biases;
+    sgvp_imgp_run(&job, sgvp_imgp_add_bias_task, img.h, 1, img.w*img.d);
+}
+
+static void sgvp_imgp_relu_task(void* ctx, int i)
+{
+    sgvp_imgp_job* job = (sgvp_imgp_job*)ctx;
+    sgv_fimg_view in = job->fa, out = job->fb;
+    int x, y, c, y0, y1;
+    float val;
+
+    SGVP_IMGP_BAND(job, i, y0, y1);
+    for(y = y0; y < y1; y++) {
+        for(x = 0; x < in.w; x++) {
+            for(c = 0; c < in.d; c++) {
+                val = in.data[SGVP_IMGP_LD(in)*y + in.d*x + c];
+                out.data[SGVP_IMGP_LD(out)*y + in.d*x + c] = (val > 0) ? val : 0;
+            }
+        }
+    }
+}
+
+SGVIMGP_DEF void sgv_relu_view(sgv_fimg_view in, sgv_fimg_view out)
+{
+    sgvp_imgp_job job;
+
+    SGV_IMGP_ASSERT(in.w == out.w && in.h == out.h && in.d == out.d);
+
+    job.fa = in;
+    job.fb = out;
+    sgvp_imgp_run(&job, sgvp_imgp_relu_task, in.h, 1, in.w*in.d);
+}
+
+SGVIMGP_DEF void sgv_relu_batch_view(sgv_fimg_view in, int n, sgv_fimg_view out)
+{
+    in.h *= n;
+    out.h *= n;
+    sgv_relu_view(in, out);
+}
+
+static void sgvp_imgp_maxpool2_task(void* ctx, int i)
+{
+    sgvp_imgp_job* job = (sgvp_imgp_job*)ctx;
+    sgv_fimg_view in = job->fa, out = job->fb;
+    int x, y, c, x1, y1, y0, yn, yi;
+    float val, new_val;
+
+    /* row y of the batch is row y%out.h of image y/out.h */
+    SGVP_IMGP_BAND(job, i, y0, yn);
+    for(y = y0; y < yn; y++) {
+        yi = (y/out.h)*in.h + 2*(y%out.h);
+        for(x = 0; x < out.w; x++) {
+            for(c = 0; c < out.d; c++) {
+                val = in.data[SGVP_IMGP_LD(in)*yi + in.d*(2*x) + c];
+                for(y1 = yi; y1 < yi + 2; y1++) {
+                    for(x1 = 2*x; x1 < 2*(x+1); x1++) {
+                        new_val = in.data[SGVP_IMGP_LD(in)*y1 + in.d*x1 + c];
+                        if(new_val > val) {
+                            val = new_val;
+                        }
+                    }
+                }
+                out.data[SGVP_IMGP_LD(out)*y + out.d*x + c] = val;
+            }
+        }
+    }
+}
+
+SGVIMGP_DEF void sgv_maxpool2_view(sgv_fimg_view in, sgv_fimg_view out)
+{
+    sgvp_imgp_job job;
+
+    SGV_IMGP_ASSERT(in.w/2 == out.w && in.h/2 == out.h && in.d == out.d);
+
+    job.fa = in;
+    job.fb = out;
+    sgvp_imgp_run(&job, sgvp_imgp_maxpool2_task, out.h, 1, 4.0*out.w*out.d);
+}
+
+SGVIMGP_DEF void sgv_maxpool2_batch_view(sgv_fimg_view in, int n,
+                                         sgv_fimg_view out)
+{
+    sgvp_imgp_job job;
+
+    SGV_IMGP_ASSERT(in.w/2 == out.w && in.h/2 == out.h && in.d == out.d);
+
+    job.fa = in;
+    job.fb = out;
+    sgvp_imgp_run(&job, sgvp_imgp_maxpool2_task, n*out.h, 1, 4.0*out.w*out.d);
+}
+
+/* The int8 convolution is the same implicit im2col matrix product as the
+   float one, a row of up to SGVP_IMGP_QP output pixels by SGVP_IMGP_NC
+   channels at a time. The 32-bit sums of the pieces of SGVP_IMGP_QKC depth
+   add up in acc. pmaddwd multiplies pairs of 16-bit values and adds the
+   two products, so the depth is taken in pairs: A is the input under each
+   pixel widened to 16 bits, and B holds (b[k][j], b[k+1][j]) for each of
+   SGVP_IMGP_QNR channels. The depth of each row of the filter is padded to
+   an even length (with zero weights) so that no pair straddles two rows of
+   the input, and A is then just the bytes of the rows, widened. */
+#define SGVP_IMGP_QP 64
+#define SGVP_IMGP_QKC 256
+#define SGVP_IMGP_QMR 4
+
+#if defined(__AVX2__)
+#define SGVP_IMGP_QVEC __m256i
+#define SGVP_IMGP_QW 8
+#define SGVP_IMGP_QLOAD(p) _mm256_loadu_si256((const __m256i*)(p))
+#define SGVP_IMGP_QSTORE(p, v) _mm256_storeu_si256((__m256i*)(p), v)
+#define SGVP_IMGP_QZERO() _mm256_setzero_si256()
+#define SGVP_IMGP_QBCAST(p) _mm256_set1_epi32(sgvp_imgp_load4((const unsigned char*)(p)))
+#define SGVP_IMGP_QMADD(a, b, c) _mm256_add_epi32(c, _mm256_madd_epi16(a, b))
+#elif defined(SGVP_IMGP_SSE2)
+#define SGVP_IMGP_QVEC __m128i
+#define SGVP_IMGP_QW 4
+#define SGVP_IMGP_QLOAD(p) _mm_loadu_si128((const __m128i*)(p))
+#define SGVP_IMGP_QSTORE(p, v) _mm_storeu_si128((__m128i*)(p), v)
+#define SGVP_IMGP_QZERO() _mm_setzero_si128()
+#define SGVP_IMGP_QBCAST(p) _mm_set1_epi32(sgvp_imgp_load4((const unsigned char*)(p)))
+#define SGVP_IMGP_QMADD(a, b, c) _mm_add_epi32(c, _mm_madd_epi16(a, b))
+#else
+#define SGVP_IMGP_QW 4
+#endif
+#define SGVP_IMGP_QNR (2*SGVP_IMGP_QW)
+
+#ifdef SGVP_IMGP_QVEC
+#define SGVP_IMGP_QGET(r) \
+    c##r##0 = acc ? SGVP_IMGP_QLOAD(c + (r)*ldc) : SGVP_IMGP_QZERO(); \
+    c##r##1 = acc ? SGVP_IMGP_QLOAD(c + (r)*ldc + SGVP_IMGP_QW) : SGVP_IMGP_QZERO()
+#define SGVP_IMGP_QROW(r) \
+    x = SGVP_IMGP_QBCAST(a + (r)*lda + 2*k); \
+    c##r##0 = SGVP_IMGP_QMADD(x, b0, c##r##0); \
+    c##r##1 = SGVP_IMGP_QMADD(x, b1, c##r##1)
+#define SGVP_IMGP_QPUT(r) \
+    SGVP_IMGP_QSTORE(c + (r)*ldc, c##r##0); \
+    SGVP_IMGP_QSTORE(c + (r)*ldc + SGVP_IMGP_QW, c##r##1)
+#endif
+
+/* c[QMR x QNR] (row stride ldc) = a*b, plus c if 'acc', over kp pairs of
+   depth. Row r of a is at a + r*lda. */
+static void sgvp_imgp_qkernel(int kp, const unsigned short* a, int lda,
+                              const short* b, int* c, int ldc, int acc)
+{
+#ifdef SGVP_IMGP_QVEC
+    SGVP_IMGP_QVEC c00, c01, c10, c11, c20, c21, c30, c31, b0, b1, x;
+    int k;
+
+    SGVP_IMGP_QGET(0); SGVP_IMGP_QGET(1); SGVP_IMGP_QGET(2); SGVP_IMGP_QGET(3);
+    for(k = 0; k < kp; k++, b += 2*SGVP_IMGP_QNR) {
+        b0 = SGVP_IMGP_QLOAD(b);
+        b1 = SGVP_IMGP_QLOAD(b + SGVP_IMGP_QNR);
+        SGVP_IMGP_QROW(0); SGVP_IMGP_QROW(1); SGVP_IMGP_QROW(2); SGVP_IMGP_QROW(3);
+    }
+    SGVP_IMGP_QPUT(0); SGVP_IMGP_QPUT(1); SGVP_IMGP_QPUT(2); SGVP_IMGP_QPUT(3);
+#else
+    int t[SGVP_IMGP_QMR*SGVP_IMGP_QNR];
+    int k, r, j;
+
+    for(r = 0; r < SGVP_IMGP_QMR; r++) {
+        for(j = 0; j < SGVP_IMGP_QNR; j++) {
+            t[r*SGVP_IMGP_QNR + j] = acc ? c[r*ldc + j] : 0;
+        }
+    }
+    for(k = 0; k < kp; k++, b += 2*SGVP_IMGP_QNR) {
+        for(r = 0; r < SGVP_IMGP_QMR; r++) {
+            for(j = 0; j < SGVP_IMGP_QNR; j++) {
+                t[r*SGVP_IMGP_QNR + j] += a[r*lda + 2*k]*b[2*j] +
+                                          a[r*lda + 2*k + 1]*b[2*j + 1];
+            }
+        }
+    }
+    for(r = 0; r < SGVP_IMGP_QMR; r++) {
+        for(j = 0; j < SGVP_IMGP_QNR; j++) {
+            c[r*ldc + j] = t[r*SGVP_IMGP_QNR + j];
+        }
+    }
+#endif
+}
+
+/* v rounded to the nearest integer, halves away from zero */
+static float sgvp_imgp_round(float v)
+{
+    return v >= 0 ? (float)(int)(v + 0.5f) : -(float)(int)(0.5f - v);
+}
+
+/* v + zero rounded (halves up) and saturated to a byte, without branches
+   so that it does not stall on noisy data */
+static unsigned char sgvp_imgp_sat_u8(float v, int zero)
+{
+    int q;
+
+    v += zero;
+    v = v < -1 ? -1 : v;
+    v = v > 256 ? 256 : v;
+    q = (int)(v + 256.5f) - 256;
+    q = q < 0 ? 0 : q;
+    return (unsigned char)(q > 255 ? 255 : q);
+}
+
+/* Packs B for padded depth [k0, k0 + kc) and channels [n0, n0 + nc) of
+   filt, whose rows of the filter are run deep (run2 padded): pairs of depth
+   for each channel of each block of QNR, zero past the channels and in the
+   padding */
+static void sgvp_imgp_qpack_b(sgv_qfilt filt, int run, int run2, int k0,
+                              int kc, int n0, int nc, short* bp)
+{
+    const signed char* f;
+    int i, j, k, c, r, odd;
+#ifdef SGVP_IMGP_SSE2
+    __m128i v, sign;
+#endif
+
+    for(j = 0; j < nc; j += SGVP_IMGP_QNR) {
+        for(k = k0; k < k0 + kc; k += 2) {
+            r = k%run2;
+            odd = r + 1 < run; /* the second of the pair is a real weight */
+            f = filt.data + ((k/run2)*run + r)*filt.outd + n0 + j;
+            for(c = 0; c < SGVP_IMGP_QNR; c += 8, f += 8, bp += 16) {
+#ifdef SGVP_IMGP_SSE2
+                if(j + c + 8 <= nc && odd) {
+                    /* interleave 8 bytes of the two rows, then widen */
+                    v = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)f),
+                                          _mm_loadl_epi64((const __m128i*)(f + filt.outd)));
+                    sign = _mm_cmpgt_epi8(_mm_setzero_si128(), v);
+                    _mm_storeu_si128((__m128i*)bp, _mm_unpacklo_epi8(v, sign));
+                    _mm_storeu_si128((__m128i*)(bp + 8), _mm_unpackhi_epi8(v, sign));
+                    continue;
+                }
+#endif
+                for(i = 0; i < 8; i++) {
+                    bp[2*i] = j + c + i < nc ? f[i] : 0;
+                    bp[2*i + 1] = j + c + i < nc && odd ? f[filt.outd + i] : 0;
+                }
+            }
+        }
+    }
+}
+
+/* Packs A of one pixel for padded depth [k0, k0 + kc): the input under the
+   filter from src, rows ld bytes apart and run deep (run2 padded), widened */
+static void sgvp_imgp_qpack_a(const unsigned char* src, int ld, int run,
+                              int run2, int k0, int kc, unsigned short* ap)
+{
+    const unsigned char* p;
+    int k, r, n, i;
+
+    for(k = k0; k < k0 + kc; k += n, ap += n) {
+        r = k%run2;
+        n = SGVP_IMGP_MIN(run2 - r, k0 + kc - k);
+        p = src + (k/run2)*ld + r;
+        i = 0;
+#ifdef SGVP_IMGP_SSE2
+        for(; i + 8 <= n && r + i + 8 <= run; i += 8) {
+            _mm_storeu_si128((__m128i*)(ap + i),
+                             _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(p + i)),
+                                               _mm_setzero_si128()));
+        }
+#endif
+        for(; i < n; i++) {
+            ap[i] = r + i < run ? p[i] : 0;
+        }
+    }
+}
+
+/* A band of output rows by a chunk of blocks of SGVP_IMGP_NC channels.
+   Writes the sums to job->ia if it has data, else requantizes them to
+   job->b. */
+static void sgvp_imgp_qconv_task(void* ctx, int i)
+{
+    sgvp_imgp_job* job = (sgvp_imgp_job*)ctx;
+    sgv_img_view in = job->a, out = job->b;
+    sgv_qfilt filt = job->qfilt;
+    int acc[SGVP_IMGP_QP*SGVP_IMGP_NC];
+    short bp[SGVP_IMGP_QKC*SGVP_IMGP_NC];
+    unsigned short ap[SGVP_IMGP_QMR*SGVP_IMGP_QKC];
+    int bias[SGVP_IMGP_NC];
+    float mul[SGVP_IMGP_NC], s;
+    int y0, y1, b0, b1, n0, nc, x0, np, k0, kc, packed, k, m, j, c, y, v;
+    int K = filt.w*filt.h*filt.ind, run = filt.w*filt.ind;
+    int run2 = run + (run & 1), K2 = filt.h*run2;
+    int w = job->ia.data ? job->ia.w : out.w;
+    int d = job->ia.data ? job->ia.d : out.d;
+    int ld = job->ia.data ? SGVP_IMGP_LD(job->ia) : SGVP_IMGP_LD(out);
+    unsigned char* dst;
+#ifdef SGVP_IMGP_SSE2
+    __m128 f, fz = _mm_set1_ps((float)job->qb.zero);
+    __m128i t;
+#endif
+
+    SGVP_IMGP_BAND(job, i, y0, y1);
+    SGVP_IMGP_CHUNK(job, i, (d + SGVP_IMGP_NC - 1)/SGVP_IMGP_NC, b0, b1);
+    for(n0 = b0*SGVP_IMGP_NC; n0 < SGVP_IMGP_MIN(b1*SGVP_IMGP_NC, d); n0 += nc) {
+        nc = SGVP_IMGP_MIN(SGVP_IMGP_NC, d - n0);
+
+        /* the zero of the input comes out as zero*sum(w), and goes into
+           the bias with the rest */
+        for(j = 0; j < nc; j++) {
+            v = 0;
+            for(k = 0; k < K; k++) {
+                v += filt.data[k*filt.outd + n0 + j];
+            }
+            s = job->qa.scale*filt.scales[filt.per_channel ? n0 + j : 0];
+            bias[j] = -job->qa.zero*v;
+            if(job->biases) {
+                bias[j] += (int)sgvp_imgp_round(job->biases[n0 + j]/s);
+            }
+            mul[j] = job->ia.data ? 0 : s/job->qb.scale;
+        }
+
+        packed = -1;
+        for(y = y0; y < y1; y++) {
+            for(x0 = 0; x0 < w; x0 += np) {
+                np = SGVP_IMGP_MIN(SGVP_IMGP_QP, w - x0);
+                for(k0 = 0; k0 < K2; k0 += kc) {
+                    kc = SGVP_IMGP_MIN(SGVP_IMGP_QKC, K2 - k0);
+                    if(packed != k0) {
+                        sgvp_imgp_qpack_b(filt, run, run2, k0, kc, n0, nc, bp);
+                        packed = k0;
+                    }
+                    for(m = 0; m < np; m += SGVP_IMGP_QMR) {
+                        /* QMR pixels, the last repeated past the row */
+                        for(c = 0; c < SGVP_IMGP_QMR; c++) {
+                            sgvp_imgp_qpack_a(in.data + y*SGVP_IMGP_LD(in) + (x0 +
+                                                         SGVP_IMGP_MIN(m + c, np - 1))*in.d,
+                                              SGVP_IMGP_LD(in), run, run2, k0, kc,
+                                              ap + c*SGVP_IMGP_QKC);
+                        }
+                        for(j = 0; j < nc; j += SGVP_IMGP_QNR) {
+                            sgvp_imgp_qkernel(kc/2, ap, SGVP_IMGP_QKC, bp + j*kc,
+                                              acc + m*SGVP_IMGP_NC + j,
+                                              SGVP_IMGP_NC, k0 > 0);
+                        }
+                    }
+                }
+
+                for(m = 0; m < np; m++) {
+                    if(job->ia.data) {
+                        for(j = 0; j < nc; j++) {
+                            job->ia.data[y*ld + (x0 + m)*d + n0 + j] =
+                                acc[m*SGVP_IMGP_NC + j] + bias[j];
+                        }
+                    } else {
+                        dst = out.data + y*ld + (x0 + m)*d + n0;
+                        j = 0;
+#ifdef SGVP_IMGP_SSE2
+                        /* sgvp_imgp_sat_u8 four channels at a time */
+                        for(; j + 4 <= nc; j += 4) {
+                            f = _mm_cvtepi32_ps(_mm_add_epi32(
+                                    _mm_loadu_si128((__m128i*)(acc + m*SGVP_IMGP_NC + j)),
+                                    _mm_loadu_si128((__m128i*)(bias + j))));
+                            f = _mm_add_ps(_mm_mul_ps(f, _mm_loadu_ps(mul + j)), fz);
+                            f = _mm_min_ps(_mm_max_ps(f, _mm_set1_ps(-1)), _mm_set1_ps(256));
+                            t = _mm_sub_epi32(_mm_cvttps_epi32(_mm_add_ps(f, _mm_set1_ps(256.5f))),
+                                              _mm_set1_epi32(256));
+                            t = _mm_packs_epi32(t, t);
+                            v = _mm_cvtsi128_si32(_mm_packus_epi16(t, t));
+                            memcpy(dst + j, &v, 4);
+                        }
+#endif
+                        for(; j < nc; j++) {
+                            dst[j] = sgvp_imgp_sat_u8((acc[m*SGVP_IMGP_NC + j] + bias[j])*mul[j],
+                                                      job->qb.zero);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void sgvp_imgp_qconv_all(sgv_img_view in, sgv_imgp_quant qin,
+                                sgv_qfilt filt, float* biases, sgv_img_view out,
+                                sgv_imgp_quant qout, sgv_iimg_view acc)
+{
+    sgvp_imgp_job job;
+    int w = acc.data ? acc.w : out.w, h = acc.data ? acc.h : out.h;
+    int d = acc.data ? acc.d : out.d;
+
+    SGV_IMGP_ASSERT(filt.ind == in.d && filt.outd == d);
+    SGV_IMGP_ASSERT(w == in.w - filt.w + 1 && h == in.h - filt.h + 1);
+
+    job.a = in;
+    job.b = out;
+    job.ia = acc;
+    job.qfilt = filt;
+    job.qa = qin;
+    job.qb = qout;
+    job.biases = biases;
+    sgvp_imgp_run(&job, sgvp_imgp_qconv_task, h,
+                  (d + SGVP_IMGP_NC - 1)/SGVP_IMGP_NC,
+                  (double)w*SGVP_IMGP_NC*filt.w*filt.h*in.d);
+}
+
+SGVIMGP_DEF void sgv_make_qfilt(sgv_filt filt, sgv_qfilt out)
+{
+    int K = filt.w*filt.h*filt.ind, k, c;
+    float v;
+
+    SGV_IMGP_ASSERT(filt.w == out.w && filt.h == out.h);
+    SGV_IMGP_ASSERT(filt.ind == out.ind && filt.outd == out.outd);
+
+    for(c = 0; c < (out.per_channel ? filt.outd : 1); c++) {
+        out.scales[c] = 0;
+    }
+    for(k = 0; k < K*filt.outd; k++) {
+        c = out.per_channel ? k%filt.outd : 0;
+        v = SGV_IMGP_FABS(filt.data[k]);
+        out.scales[c] = v > out.scales[c] ? v : out.scales[c];
+    }
+    for(c = 0; c < (out.per_channel ? filt.outd : 1); c++) {
+        out.scales[c] = out.scales[c] > 0 ? out.scales[c]/127 : 1;
+    }
+    for(k = 0; k < K*filt.outd; k++) {
+        out.data[k] = (signed char)sgvp_imgp_round(
+            filt.data[k]/out.scales[out.per_channel ? k%filt.outd : 0]);
+    }
+}
+
+SGVIMGP_DEF void sgv_qconv2d_valid_view(sgv_img_view in, sgv_imgp_quant qin,
+                                        sgv_qfilt filt, float* biases,
+                                        sgv_img_view out, sgv_imgp_quant qout)
+{
+    sgv_iimg_view acc;
+
+    acc.data = 0;
+    acc.w = acc.h = acc.d = acc.stride = 0;
+    sgvp_imgp_qconv_all(in, qin, filt, biases, out, qout, acc);
+}
+
+SGVIMGP_DEF void sgv_qconv2d_valid_acc_view(sgv_img_view in, sgv_imgp_quant qin,
+                                            sgv_qfilt filt, sgv_iimg_view out)
+{
+    sgv_img_view o;
+
+    o.data = 0;
+    o.w = o.h = o.d = o.stride = 0;
+    sgvp_imgp_qconv_all(in, qin, filt, 0, o, qin, out);
+}
+
+static void sgvp_imgp_qadd_bias_task(void* ctx, int i)
+{
+    sgvp_imgp_job* job = (sgvp_imgp_job*)ctx;
+    sgv_img_view img = job->a;
+    int x, y, c, y0, y1;
+    unsigned char* p;
+
+    SGVP_IMGP_BAND(job, i, y0, y1);
+    for(y = y0; y < y1; y++) {
+        for(x = 0; x < img.w; x++) {
+            p = img.data + SGVP_IMGP_LD(img)*y + x*img.d;
+            for(c = 0; c < img.d; c++) {
+                p[c] = sgvp_imgp_sat_u8(p[c] - job->qa.zero +
+                                        job->biases[c]/job->qa.scale,
+                                        job->qa.zero);
+            }
+        }
+    }
+}
+
+SGVIMGP_DEF void sgv_qadd_bias_view(sgv_img_view img, sgv_imgp_quant q,
+                                    float* biases)
+{
+    sgvp_imgp_job job;
+
+    job.a = img;
+    job.qa = q;
+    job.biases = biases;
+    sgvp_imgp_run(&job, sgvp_imgp_qadd_bias_task, img.h, 1, img.w*img.d);
+}
+
+static void sgvp_imgp_qrelu_task(void* ctx, int i)
+{
+    sgvp_imgp_job* job = (sgvp_imgp_job*)ctx;
+    sgv_img_view in = job->a, out = job->b;
+    int k, y, y0, y1, n = in.w*in.d;
+    unsigned char z = (unsigned char)SGVP_IMGP_MIN(job->qa.zero < 0 ? 0 : job->qa.zero, 255);
+    const unsigned char* p;
+    unsigned char* o;
+
+    SGVP_IMGP_BAND(job, i, y0, y1);
+    for(y = y0; y < y1; y++) {
+        p = in.data + y*SGVP_IMGP_LD(in);
+        o = out.data + y*SGVP_IMGP_LD(out);
+        for(k = 0; k < n; k++) {
+            o[k] = p[k] > z ? p[k] : z;
+        }
+    }
+}
+
+SGVIMGP_DEF void sgv_qrelu_view(sgv_img_view in, sgv_imgp_quant q,
+                                sgv_img_view out)
+{
+    sgvp_imgp_job job;
+
+    SGV_IMGP_ASSERT(in.w == out.w && in.h == out.h && in.d == out.d);
+
+    job.a = in;
+    job.b = out;
+    job.qa = q;
+    sgvp_imgp_run(&job, sgvp_imgp_qrelu_task, in.h, 1, in.w*in.d);
+}
+
+static void sgvp_imgp_qmaxpool2_task(void* ctx, int i)
+{
+    sgvp_imgp_job* job = (sgvp_imgp_job*)ctx;
+    sgv_img_view in = job->a, out = job->b;
+    int x, y, c, y0, y1, n = SGVP_IMGP_LD(in);
+    const unsigned char* p;
+    unsigned char v;
+
+    SGVP_IMGP_BAND(job, i, y0, y1);
+    for(y = y0; y < y1; y++) {
+        for(x = 0; x < out.w; x++) {
+            p = in.data + 2*y*n + 2*x*in.d;
+            for(c = 0; c < out.d; c++) {
+                v = p[c] > p[in.d + c] ? p[c] : p[in.d + c];
+                v = v > p[n + c] ? v : p[n + c];
+                v = v > p[n + in.d + c] ? v : p[n + in.d + c];
+                out.data[SGVP_IMGP_LD(out)*y + x*out.d + c] = v;
+            }
+        }
+    }
+}
+
+SGVIMGP_DEF void sgv_qmaxpool2_view(sgv_img_view in, sgv_img_view out)
+{
+    sgvp_imgp_job job;
+
+    SGV_IMGP_ASSERT(in.w/2 == out.w && in.h/2 == out.h && in.d == out.d);
+
+    job.a = in;
+    job.b = out;
+    sgvp_imgp_run(&job, sgvp_imgp_qmaxpool2_task, out.h, 1, 4.0*out.w*out.d);
+}
+
+static void sgvp_imgp_dequantize_task(void* ctx, int i)
+{
+    sgvp_imgp_job* job = (sgvp_imgp_job*)ctx;
+    sgv_img_view in = job->a;
+    sgv_fimg_view out = job->fb;
+    sgv_imgp_quant q = job->qa;
+    int k, y, y0, y1;
+    const unsigned char* p;
+    float* o;
+
+    SGVP_IMGP_BAND(job, i, y0, y1);
+    for(y = y0; y < y1; y++) {
+        p = in.data + y*SGVP_IMGP_LD(in);
+        o = out.data + y*SGVP_IMGP_LD(out);
+        for(k = 0; k < in.w*in.d; k++) {
+            o[k] = q.scale*(p[k] - q.zero);
+        }
+    }
+}
+
+SGVIMGP_DEF void sgv_dequantize_view(sgv_img_view in, sgv_imgp_quant q,
+                                     sgv_fimg_view out)
+{
+    sgvp_imgp_job job;
+
+    SGV_IMGP_ASSERT(in.w == out.w && in.h == out.h && in.d == out.d);
+
+    job.a = in;
+    job.fb = out;
+    job.qa = q;
+    sgvp_imgp_run(&job, sgvp_imgp_dequantize_task, in.h, 1, in.w*in.d);
+}
+
+static void sgvp_imgp_make_himg_task(void* ctx, int i)
+{
+    sgvp_imgp_job* job = (sgvp_imgp_job*)ctx;
+    sgv_fimg_view in = job->fa;
+    sgv_himg_view out = job->hb;
+    int y, y0, y1;
+
+    SGVP_IMGP_BAND(job, i, y0, y1);
+    for(y = y0; y < y1; y++) {
+        sgvp_imgp_narrow(in.data + y*SGVP_IMGP_LD(in), out.format,
+                         out.data + y*SGVP_IMGP_LD(out), in.w*in.d);
+    }
+}
+
+SGVIMGP_DEF void sgv_make_himg_view(sgv_fimg_view in, sgv_himg_view out)
+{
+    sgvp_imgp_job job;
+
+    SGV_IMGP_ASSERT(in.w == out.w && in.h == out.h && in.d == out.d);
+
+    job.fa = in;
+    job.hb = out;
+    sgvp_imgp_run(&job, sgvp_imgp_make_himg_task, in.h, 1, in.w*in.d);
+}
+
+static void sgvp_imgp_himg_to_fimg_task(void* ctx, int i)
+{
+    sgvp_imgp_job* job = (sgvp_imgp_job*)ctx;
+    sgv_himg_view in = job->ha;
+    sgv_fimg_view out = job->fb;
+    int y, y0, y1;
+
+    SGVP_IMGP_BAND(job, i, y0, y1);
+    for(y = y0; y < y1; y++) {
+        sgvp_imgp_widen(in.data + y*SGVP_IMGP_LD(in), in.format,
+                        out.data + y*SGVP_IMGP_LD(out), in.w*in.d);
+    }
+}
+
+SGVIMGP_DEF void sgv_himg_to_fimg_view(sgv_himg_view in, sgv_fimg_view out)
+{
+    sgvp_imgp_job job;
+
+    SGV_IMGP_ASSERT(in.w == out.w && in.h == out.h && in.d == out.d);
+
+    job.ha = in;
+    job.fb = out;
+    sgvp_imgp_run(&job, sgvp_imgp_himg_to_fimg_task, in.h, 1, in.w*in.d);
+}
+
+SGVIMGP_DEF void sgv_make_hfilt(sgv_filt filt, sgv_hfilt out)
+{
+    long k, n = (long)filt.w*filt.h*filt.ind*filt.outd;
+
+    SGV_IMGP_ASSERT(filt.w == out.w && filt.h == out.h);
+    SGV_IMGP_ASSERT(filt.ind == out.ind && filt.outd == out.outd);
+
+    for(k = 0; k < n; k += filt.outd) {
+        sgvp_imgp_narrow(filt.data + k, out.format, out.data + k, filt.outd);
+    }
+}
+
+/* Output pixels per strip of sgv_hconv2d_valid */
+#define SGVP_IMGP_HP 128
+
+/* Convolves a strip of up to SGVP_IMGP_HP pixels by SGVP_IMGP_NC channels
+   at a time into a float buffer, then rounds it to out. Task i does a band
+   of pairs of rows by a chunk of blocks of channels. Strips start on even
+   rows and columns, so the Winograd tiles are the same as for the whole
+   image. */
+static void sgvp_imgp_hconv_task(void* ctx, int i)
+{
+    sgvp_imgp_job* job = (sgvp_imgp_job*)ctx;
+    sgv_himg_view out = job->hb;
+    float buf[SGVP_IMGP_HP*SGVP_IMGP_NC];
+    sgvp_imgp_half hs;
+    sgvp_imgp_region rg;
+    sgv_fimg_view in;
+    sgv_filt f;
+    int cols = out.w <= SGVP_IMGP_HP/2 ? out.w : SGVP_IMGP_HP/2;
+    int x, y, y0, y1, b0, b1, py, ph;
+
+    hs.in = job->ha.data;
+    hs.in_format = job->ha.format;
+    hs.filt = job->hfilt.data;
+    hs.filt_format = job->hfilt.format;
+    in.data = 0;
+    in.w = job->ha.w;
+    in.h = job->ha.h;
+    in.d = job->ha.d;
+    in.stride = job->ha.stride;
+    f.data = 0;
+    f.w = job->hfilt.w;
+    f.h = job->hfilt.h;
+    f.ind = job->hfilt.ind;
+    f.outd = job->hfilt.outd;
+
+    SGVP_IMGP_BAND(job, i, y0, y1);
+    SGVP_IMGP_CHUNK(job, i, (out.d + SGVP_IMGP_NC - 1)/SGVP_IMGP_NC, b0, b1);
+    for(py = y0; py < y1; py += ph) {
+        ph = SGVP_IMGP_MIN(SGVP_IMGP_HP/(2*cols), y1 - py);
+        rg.y0 = 2*py;
+        rg.h = SGVP_IMGP_MIN(2*(py + ph), out.h) - rg.y0;
+        for(rg.x0 = 0; rg.x0 < out.w; rg.x0 += rg.w) {
+            rg.w = SGVP_IMGP_MIN(cols, out.w - rg.x0);
+            for(rg.n0 = b0*SGVP_IMGP_NC;
+                rg.n0 < SGVP_IMGP_MIN(b1*SGVP_IMGP_NC, out.d);
+                rg.n0 += rg.nc) {
+                rg.nc = SGVP_IMGP_MIN(SGVP_IMGP_NC, out.d - rg.n0);
+                rg.dst = buf;
+                rg.ldd = rg.nc;
+                rg.ldr = rg.w*rg.nc;
+                rg.nb = 1;
+                rg.ldb = 0;
+                sgvp_imgp_conv(in, f, 0, &hs, &rg);
+
+                for(y = 0; y < rg.h; y++) {
+                    for(x = 0; x < rg.w; x++) {
+                        sgvp_imgp_narrow(buf + (y*rg.w + x)*rg.nc, out.format,
+                                         out.data + (rg.y0 + y)*SGVP_IMGP_LD(out) +
+                                         (rg.x0 + x)*out.d + rg.n0, rg.nc);
+                    }
+                }
+            }
+        }
+    }
+}
+
+SGVIMGP_DEF void sgv_hconv2d_valid_view(sgv_himg_view in, sgv_hfilt filt,
+                                        sgv_himg_view out)
+{
+    sgvp_imgp_job job;
+
+    SGV_IMGP_ASSERT(filt.ind == in.d && filt.outd == out.d);
+    SGV_IMGP_ASSERT(out.w == (in.w - filt.w + 1));
+    SGV_IMGP_ASSERT(out.h == (in.h - filt.h + 1));
+
+    job.ha = in;
+    job.hb = out;
+    job.hfilt = filt;
+    sgvp_imgp_run(&job, sgvp_imgp_hconv_task, (out.h + 1)/2,
+                  (out.d + SGVP_IMGP_NC - 1)/SGVP_IMGP_NC,
+                  4.0*out.w*SGVP_IMGP_NC*filt.w*filt.h*in.d);
+}
+
+/* Values per piece of a row widened at a time */
+#define SGVP_IMGP_HB 256
+
+static void sgvp_imgp_hadd_bias_task(void* ctx, int i)
+{
+    sgvp_imgp_job* job = (sgvp_imgp_job*)ctx;
+    sgv_himg_view img = job->ha;
+    float t[SGVP_IMGP_HB];
+    unsigned short* p;
+    int k, j, m, c, y, y0, y1, n = img.w*img.d;
+
+    SGVP_IMGP_BAND(job, i, y0, y1);
+    for(y = y0; y < y1; y++) {
+        p = img.data + y*SGVP_IMGP_LD(img);
+        for(k = 0; k < n; k += m) {
+            m = SGVP_IMGP_MIN(SGVP_IMGP_HB, n - k);
+            sgvp_imgp_widen(p + k, img.format, t, m);
+            for(j = 0, c = k % img.d; j < m; j++) {
+                t[j] += job->biases[c];
+                c = (c + 1 == img.d) ? 0 : c + 1;
+            }
+            sgvp_imgp_narrow(t, img.format, p + k, m);
+        }
+    }
+}
+
+SGVIMGP_DEF void sgv_hadd_bias_view(sgv_himg_view img, float* biases)
+{
+    sgvp_imgp_job job;
+
+    job.ha = img;
+    job.biases = biases;
+    sgvp_imgp_run(&job, sgvp_imgp_hadd_bias_task, img.h, 1, img.w*img.d);
+}
+
+/* in, or in rounded to the format of out */
+#define SGVP_IMGP_HTO(v, in, out) \
+    ((in).format == (out).format ? (v) : \
+     sgvp_imgp_f2h(sgvp_imgp_h2f(v, (in).format), (out).format))
+
+static void sgvp_imgp_hrelu_task(void* ctx, int i)
+{
+    sgvp_imgp_job* job = (sgvp_imgp_job*)ctx;
+    sgv_himg_view in = job->ha, out = job->hb;
+    int k, y, y0, y1, n = in.w*in.d;
+    const unsigned short* p;
+    unsigned short* o;
+
+    /* the sign bit decides, in both formats */
+    SGVP_IMGP_BAND(job, i, y0, y1);
+    for(y = y0; y < y1; y++) {
+        p = in.data + y*SGVP_IMGP_LD(in);
+        o = out.data + y*SGVP_IMGP_LD(out);
+        if(in.format == out.format) {
+            for(k = 0; k < n; k++) {
+                o[k] = (p[k] & 0x8000) ? 0 : p[k];
+            }
+        } else {
+            for(k = 0; k < n; k++) {
+                o[k] = (p[k] & 0x8000) ? 0 : SGVP_IMGP_HTO(p[k], in, out);
+            }
+        }
+    }
+}
+
+SGVIMGP_DEF void sgv_hrelu_view(sgv_himg_view in, sgv_himg_view out)
+{
+    sgvp_imgp_job job;
+
+    SGV_IMGP_ASSERT(in.w == out.w && in.h == out.h && in.d == out.d);
+
+    job.ha = in;
+    job.hb = out;
+    sgvp_imgp_run(&job, sgvp_imgp_hrelu_task, in.h, 1, in.w*in.d);
+}
+
+/* The bits of a half precision value, made to compare as unsigned in the
+   order of the values (NaNs aside), in both formats */
+#define SGVP_IMGP_HKEY(v) (((v) & 0x8000) ? 0xffff - (v) : (v) | 0x8000)
+
+static void sgvp_imgp_hmaxpool2_task(void* ctx, int i)
+{
+    sgvp_imgp_job* job = (sgvp_imgp_job*)ctx;
+    sgv_himg_view in = job->ha, out = job->hb;
+    int x, y, c, y0, y1, n = SGVP_IMGP_LD(in);
+    const unsigned short* p;
+    unsigned short v, u;
+
+    SGVP_IMGP_BAND(job, i, y0, y1);
+    for(y = y0; y < y1; y++) {
+        for(x = 0; x < out.w; x++) {
+            p = in.data + 2*y*n + 2*x*in.d;
+            for(c = 0; c < out.d; c++) {
+                v = p[c];
+                u = p[in.d + c];
+                v = SGVP_IMGP_HKEY(u) > SGVP_IMGP_HKEY(v) ? u : v;
+                u = p[n + c];
+                v = SGVP_IMGP_HKEY(u) > SGVP_IMGP_HKEY(v) ? u : v;
+                u = p[n + in.d + c];
+                v = SGVP_IMGP_HKEY(u) > SGVP_IMGP_HKEY(v) ? u : v;
+                out.data[SGVP_IMGP_LD(out)*y + x*out.d + c] = SGVP_IMGP_HTO(v, in, out);
+            }
+        }
+    }
+}
+
+SGVIMGP_DEF void sgv_hmaxpool2_view(sgv_himg_view in, sgv_himg_view out)
+{
+    sgvp_imgp_job job;
+
+    SGV_IMGP_ASSERT(in.w/2 == out.w && in.h/2 == out.h && in.d == out.d);
+
+    job.ha = in;
+    job.hb = out;
+    sgvp_imgp_run(&job, sgvp_imgp_hmaxpool2_task, out.h, 1, 4.0*out.w*out.d);
+}
+
+SGVIMGP_DEF void sgv_softmax(float* scores_in, int n, float* probs_out)
+{
+    int i;
+    float max_score, sum;
+
+    max_score = scores_in[0];
     for(i = 0; i < n; i++) {
         if(scores_in[i] > max_score) {
             max_score = scores_in[i];
@@ -443,7 +3327,17 @@ SGVIMGP_DEF void sgv_softmax(float* scores_in, int n, float* probs_out)
     }
 }
 
-SGVIMGP_DEF unsigned char sgv_imgp_otsu(sgv_img img)
+SGVIMGP_DEF void sgv_softmax_batch(float* scores_in, int n, int classes,
+                                   float* probs_out)
+{
+    int i;
+
+    for(i = 0; i < n; i++) {
+        sgv_softmax(scores_in + i*classes, classes, probs_out + i*classes);
+    }
+}
+
+SGVIMGP_DEF unsigned char sgv_imgp_otsu_view(sgv_img_view img)
 {
     int x, y, i, sum1, total, wB, wF, sumB, mB, mF;
     int objective, level, max_objective;
@@ -453,7 +3347,7 @@ SGVIMGP_DEF unsigned char sgv_imgp_otsu(sgv_img img)
 
     for(y = 0; y < img.h; y++) {
         for(x = 0; x < img.w; x++) {
-            hist[img.data[y*img.w + x]] += 1;
+            hist[img.data[y*SGVP_IMGP_LD(img) + x]] += 1;
         }
     }
 
@@ -493,7 +3387,8 @@ SGVIMGP_DEF unsigned char sgv_imgp_otsu(sgv_img img)
     return level;
 }
 
-SGVIMGP_DEF void sgv_imgp_enhance_contrast(sgv_img in, sgv_img out)
+SGVIMGP_DEF void sgv_imgp_enhance_contrast_view(sgv_img_view in,
+                                                sgv_img_view out)
 {
     int x, y, i;
     int cdf_min;
@@ -504,7 +3399,7 @@ SGVIMGP_DEF void sgv_imgp_enhance_contrast(sgv_img in, sgv_img out)
 
     for(y = 0; y < in.h; y++) {
         for(x = 0; x < in.w; x++) {
-            int val = in.data[y*in.w + x];
+            int val = in.data[y*SGVP_IMGP_LD(in) + x];
             cdf[val]++;
         }
     }
@@ -519,31 +3414,305 @@ SGVIMGP_DEF void sgv_imgp_enhance_contrast(sgv_img in, sgv_img out)
 
     for(y = 0; y < in.h; y++) {
         for(x = 0; x < in.w; x++) {
-            out.data[y*out.w + x] = (int) ((cdf[in.data[y*in.w + x]] - cdf_min)*255.0f/(in.w*in.h - cdf_min));
+            out.data[y*SGVP_IMGP_LD(out) + x] = (int) ((cdf[in.data[y*SGVP_IMGP_LD(in) + x]] - cdf_min)*255.0f/(in.w*in.h - cdf_min));
         }
     }
 }
 
-SGVIMGP_DEF void sgv_blit(sgv_img dst, sgv_img src, sgv_imgp_i2 offset)
+static void sgvp_imgp_blit_task(void* ctx, int i)
 {
-    int x, y, d, xo, yo;
+    sgvp_imgp_job* job = (sgvp_imgp_job*)ctx;
+    sgv_img_view dst = job->a, src = job->b;
+    sgv_imgp_i2 offset = job->p;
+    int x, y, d, xo, yo, y0, y1;
+    unsigned char *p, *q;
     float alpha;
 
-    SGV_IMGP_ASSERT(dst.d == 4 && src.d == 4);
-
-    for(y = 0; y < src.h; y++) {
+    SGVP_IMGP_BAND(job, i, y0, y1);
+    for(y = y0; y < y1; y++) {
         for(x = 0; x < src.w; x++) {
             xo = x + offset.x;
             yo = y + offset.y;
             if(xo >= 0 && yo >= 0 && xo < dst.w && yo < dst.h) {
-                alpha = src.data[(y*src.w + x)*4 + 3] / 255.0f;
+                p = dst.data + yo*SGVP_IMGP_LD(dst) + xo*4;
+                q = src.data + y*SGVP_IMGP_LD(src) + x*4;
+                alpha = q[3] / 255.0f;
                 for(d = 0; d < 3; d++) {
-                    dst.data[(yo*dst.w + xo)*4 + d] = (1-alpha)*dst.data[(yo*dst.w + xo)*4 + d] + alpha*src.data[(y*src.w + x)*4 + d];
+                    p[d] = (1-alpha)*p[d] + alpha*q[d];
                 }
-                dst.data[(yo*dst.w + xo)*4 + 3] = src.data[(y*src.w + x)*4 + 3];
+                p[3] = q[3];
             }
         }
     }
 }
 
+SGVIMGP_DEF void sgv_blit_view(sgv_img_view dst, sgv_img_view src,
+                               sgv_imgp_i2 offset)
+{
+    sgvp_imgp_job job;
+
+    SGV_IMGP_ASSERT(dst.d == 4 && src.d == 4);
+
+    job.a = dst;
+    job.b = src;
+    job.p = offset;
+    sgvp_imgp_run(&job, sgvp_imgp_blit_task, src.h, 1, 8.0*src.w);
+}
+
+/* The routines on the packed structs are their _view versions with
+   stride 0 */
+static sgv_img_view sgvp_imgp_view(sgv_img img)
+{
+    sgv_img_view v;
+    v.data = img.data;
+    v.w = img.w;
+    v.h = img.h;
+    v.d = img.d;
+    v.stride = 0;
+    return v;
+}
+
+static sgv_fimg_view sgvp_imgp_fview(sgv_fimg img)
+{
+    sgv_fimg_view v;
+    v.data = img.data;
+    v.w = img.w;
+    v.h = img.h;
+    v.d = img.d;
+    v.stride = 0;
+    return v;
+}
+
+static sgv_iimg_view sgvp_imgp_iview(sgv_iimg img)
+{
+    sgv_iimg_view v;
+    v.data = img.data;
+    v.w = img.w;
+    v.h = img.h;
+    v.d = img.d;
+    v.stride = 0;
+    return v;
+}
+
+static sgv_himg_view sgvp_imgp_hview(sgv_himg img)
+{
+    sgv_himg_view v;
+    v.data = img.data;
+    v.w = img.w;
+    v.h = img.h;
+    v.d = img.d;
+    v.stride = 0;
+    v.format = img.format;
+    return v;
+}
+
+SGVIMGP_DEF void sgv_make_fimg(sgv_img in, sgv_fimg out)
+{
+    sgv_make_fimg_view(sgvp_imgp_view(in), sgvp_imgp_fview(out));
+}
+
+SGVIMGP_DEF void sgv_grey_to_rgb(sgv_img grey, sgv_img out_rgb)
+{
+    sgv_grey_to_rgb_view(sgvp_imgp_view(grey), sgvp_imgp_view(out_rgb));
+}
+
+SGVIMGP_DEF void sgv_draw_line(sgv_img img, sgv_imgp_i2 p1, sgv_imgp_i2 p2,
+                               sgv_imgp_i3 color, int thickness)
+{
+    sgv_draw_line_view(sgvp_imgp_view(img), p1, p2, color, thickness);
+}
+
+SGVIMGP_DEF void sgv_draw_rect(sgv_img img, sgv_imgp_i2 p_lt, sgv_imgp_i2 p_rb,
+                               sgv_imgp_i3 color, int thickness)
+{
+    sgv_draw_rect_view(sgvp_imgp_view(img), p_lt, p_rb, color, thickness);
+}
+
+SGVIMGP_DEF void sgv_draw_quadrilateral(sgv_img img, sgv_imgp_i2 p1,
+                                        sgv_imgp_i2 p2, sgv_imgp_i2 p3,
+                                        sgv_imgp_i2 p4, sgv_imgp_i3 color,
+                                        int thickness)
+{
+    sgv_draw_quadrilateral_view(sgvp_imgp_view(img), p1, p2, p3, p4, color,
+                                thickness);
+}
+
+SGVIMGP_DEF void sgv_conv2d_valid(sgv_fimg img, sgv_filt filt, sgv_fimg out)
+{
+    sgv_conv2d_valid_view(sgvp_imgp_fview(img), filt, sgvp_imgp_fview(out));
+}
+
+SGVIMGP_DEF void sgv_conv2d_valid_wfilt(sgv_fimg img, sgv_wfilt filt,
+                                        sgv_fimg out)
+{
+    sgv_conv2d_valid_wfilt_view(sgvp_imgp_fview(img), filt,
+                                sgvp_imgp_fview(out));
+}
+
+SGVIMGP_DEF void sgv_conv2d_bias_relu_maxpool2(sgv_fimg img, sgv_filt filt,
+                                               float* biases, sgv_fimg out)
+{
+    sgv_conv2d_bias_relu_maxpool2_view(sgvp_imgp_fview(img), filt, biases,
+                                       sgvp_imgp_fview(out));
+}
+
+SGVIMGP_DEF void sgv_conv2d_bias_relu_maxpool2_wfilt(sgv_fimg img,
+                                                     sgv_wfilt filt,
+                                                     float* biases,
+                                                     sgv_fimg out)
+{
+    sgv_conv2d_bias_relu_maxpool2_wfilt_view(sgvp_imgp_fview(img), filt, biases,
+                                             sgvp_imgp_fview(out));
+}
+
+SGVIMGP_DEF void sgv_add_bias(sgv_fimg img, float* biases)
+{
+    sgv_add_bias_view(sgvp_imgp_fview(img), biases);
+}
+
+SGVIMGP_DEF void sgv_relu(sgv_fimg in, sgv_fimg out)
+{
+    sgv_relu_view(sgvp_imgp_fview(in), sgvp_imgp_fview(out));
+}
+
+SGVIMGP_DEF void sgv_maxpool2(sgv_fimg in, sgv_fimg out)
+{
+    sgv_maxpool2_view(sgvp_imgp_fview(in), sgvp_imgp_fview(out));
+}
+
+SGVIMGP_DEF void sgv_conv2d_valid_batch(sgv_fimg img, int n, sgv_filt filt,
+                                        sgv_fimg out)
+{
+    sgv_conv2d_valid_batch_view(sgvp_imgp_fview(img), n, filt,
+                                sgvp_imgp_fview(out));
+}
+
+SGVIMGP_DEF void sgv_conv2d_valid_wfilt_batch(sgv_fimg img, int n,
+                                              sgv_wfilt filt, sgv_fimg out)
+{
+    sgv_conv2d_valid_wfilt_batch_view(sgvp_imgp_fview(img), n, filt,
+                                      sgvp_imgp_fview(out));
+}
+
+SGVIMGP_DEF void sgv_relu_batch(sgv_fimg in, int n, sgv_fimg out)
+{
+    sgv_relu_batch_view(sgvp_imgp_fview(in), n, sgvp_imgp_fview(out));
+}
+
+SGVIMGP_DEF void sgv_maxpool2_batch(sgv_fimg in, int n, sgv_fimg out)
+{
+    sgv_maxpool2_batch_view(sgvp_imgp_fview(in), n, sgvp_imgp_fview(out));
+}
+
+SGVIMGP_DEF void sgv_qconv2d_valid(sgv_img img, sgv_imgp_quant qin,
+                                   sgv_qfilt filt, float* biases, sgv_img out,
+                                   sgv_imgp_quant qout)
+{
+    sgv_qconv2d_valid_view(sgvp_imgp_view(img), qin, filt, biases,
+                           sgvp_imgp_view(out), qout);
+}
+
+SGVIMGP_DEF void sgv_qconv2d_valid_acc(sgv_img img, sgv_imgp_quant qin,
+                                       sgv_qfilt filt, sgv_iimg out)
+{
+    sgv_qconv2d_valid_acc_view(sgvp_imgp_view(img), qin, filt,
+                               sgvp_imgp_iview(out));
+}
+
+SGVIMGP_DEF void sgv_qadd_bias(sgv_img img, sgv_imgp_quant q, float* biases)
+{
+    sgv_qadd_bias_view(sgvp_imgp_view(img), q, biases);
+}
+
+SGVIMGP_DEF void sgv_qrelu(sgv_img in, sgv_imgp_quant q, sgv_img out)
+{
+    sgv_qrelu_view(sgvp_imgp_view(in), q, sgvp_imgp_view(out));
+}
+
+SGVIMGP_DEF void sgv_qmaxpool2(sgv_img in, sgv_img out)
+{
+    sgv_qmaxpool2_view(sgvp_imgp_view(in), sgvp_imgp_view(out));
+}
+
+SGVIMGP_DEF void sgv_dequantize(sgv_img in, sgv_imgp_quant q, sgv_fimg out)
+{
+    sgv_dequantize_view(sgvp_imgp_view(in), q, sgvp_imgp_fview(out));
+}
+
+SGVIMGP_DEF void sgv_make_himg(sgv_fimg in, sgv_himg out)
+{
+    sgv_make_himg_view(sgvp_imgp_fview(in), sgvp_imgp_hview(out));
+}
+
+SGVIMGP_DEF void sgv_himg_to_fimg(sgv_himg in, sgv_fimg out)
+{
+    sgv_himg_to_fimg_view(sgvp_imgp_hview(in), sgvp_imgp_fview(out));
+}
+
+SGVIMGP_DEF void sgv_hconv2d_valid(sgv_himg img, sgv_hfilt filt, sgv_himg out)
+{
+    sgv_hconv2d_valid_view(sgvp_imgp_hview(img), filt, sgvp_imgp_hview(out));
+}
+
+SGVIMGP_DEF void sgv_hadd_bias(sgv_himg img, float* biases)
+{
+    sgv_hadd_bias_view(sgvp_imgp_hview(img), biases);
+}
+
+SGVIMGP_DEF void sgv_hrelu(sgv_himg in, sgv_himg out)
+{
+    sgv_hrelu_view(sgvp_imgp_hview(in), sgvp_imgp_hview(out));
+}
+
+SGVIMGP_DEF void sgv_hmaxpool2(sgv_himg in, sgv_himg out)
+{
+    sgv_hmaxpool2_view(sgvp_imgp_hview(in), sgvp_imgp_hview(out));
+}
+
+SGVIMGP_DEF void sgv_imgp_affine_transform(sgv_img in, sgv_imgp_i2 in_offset,
+                                           float* theta, sgv_img out,
+                                           sgv_imgp_i2 out_offset)
+{
+    sgv_imgp_affine_transform_view(sgvp_imgp_view(in), in_offset, theta,
+                                   sgvp_imgp_view(out), out_offset);
+}
+
+SGVIMGP_DEF void sgv_imgp_perspective_transform(sgv_img in, float* h,
+                                                sgv_img out)
+{
+    sgv_imgp_perspective_transform_view(sgvp_imgp_view(in), h,
+                                        sgvp_imgp_view(out));
+}
+
+SGVIMGP_DEF void sgv_imgp_crop_rescale(sgv_img in, sgv_imgp_i2 in_left_top,
+                                       sgv_imgp_i2 crop_size, sgv_img out)
+{
+    sgv_imgp_crop_rescale_view(sgvp_imgp_view(in), in_left_top, crop_size,
+                               sgvp_imgp_view(out));
+}
+
+SGVIMGP_DEF void sgv_imgp_crop_rescale_filter(sgv_img in,
+                                              sgv_imgp_i2 in_left_top,
+                                              sgv_imgp_i2 crop_size,
+                                              sgv_img out, int filter)
+{
+    sgv_imgp_crop_rescale_filter_view(sgvp_imgp_view(in), in_left_top,
+                                      crop_size, sgvp_imgp_view(out), filter);
+}
+
+SGVIMGP_DEF unsigned char sgv_imgp_otsu(sgv_img img)
+{
+    return sgv_imgp_otsu_view(sgvp_imgp_view(img));
+}
+
+SGVIMGP_DEF void sgv_imgp_enhance_contrast(sgv_img in, sgv_img out)
+{
+    sgv_imgp_enhance_contrast_view(sgvp_imgp_view(in), sgvp_imgp_view(out));
+}
+
+SGVIMGP_DEF void sgv_blit(sgv_img dst, sgv_img src, sgv_imgp_i2 offset)
+{
+    sgv_blit_view(sgvp_imgp_view(dst), sgvp_imgp_view(src), offset);
+}
+
 #endif
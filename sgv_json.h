@@ -11,7 +11,8 @@ NOTES
 -----
 
 - This library is C89 conformant
-- No dynamic memory allocation on the heap is performed (and no need for libc)
+- No dynamic memory allocation on the heap is performed (and no need for libc,
+  except for pthreads with SGV_JSON_THREADS and file I/O with SGV_JSON_MMAP)
 - See http://www.json.org/ for the JSON spec.
 - Notation of pair, value, array, object, etc. are followed from the spec.
 - Tokens contain pointers to the parsed JSON string, so don't de-allocate it.
@@ -19,6 +20,16 @@ NOTES
 EXAMPLE
 -------
 
+char json[] = "{\"name\": \"sgv\", \"sizes\": [1, 2, 3]}";
+sgv_json_token tokens[32];
+char* name; int name_len, second;
+
+if(sgv_json_parse(json, sizeof(json)-1, tokens, 32) == 0) {
+    sgv_json_value_string(sgv_json_obj_value(tokens, "name"), &name, &name_len);
+    sgv_json_value_int(sgv_json_arr_value(
+        sgv_json_obj_value(tokens, "sizes"), 1), &second);
+}
+
 OPTIONS
 -------
 
@@ -28,6 +39,20 @@ Define these constants before including this lib to change the behavior.
     #define SGV_JSON_STATIC
 - To enable debug messages,
     #define SGV_JSON_DEBUG
+- To change the maximum nesting depth of arrays/objects (default 256),
+    #define SGV_JSON_MAX_DEPTH 1024
+- To parse JSON Lines in parallel in sgv_json_parse_lines (needs pthreads),
+    #define SGV_JSON_THREADS
+- To change how many objects one sgv_json_index can track (default 64),
+    #define SGV_JSON_INDEX_OBJS 256
+- To change how many segments (default 128) and bytes (default 1024) the
+  pointers of one sgv_json_query can have in all,
+    #define SGV_JSON_QUERY_SEGS 512
+    #define SGV_JSON_QUERY_TEXT 4096
+- To change how many fields one sgv_json_schema can hold (default 128),
+    #define SGV_JSON_SCHEMA_FIELDS 512
+- To parse memory mapped files and use token snapshots (needs POSIX mmap),
+    #define SGV_JSON_MMAP
 
 LICENSE
 -------
@@ -42,6 +67,8 @@ is expressed or implied.
 #ifndef SGV_JSON_H
 #define SGV_JSON_H
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -56,6 +83,19 @@ extern "C" {
 ****************************** Public API ***********************************/
 
 typedef struct sgv_json_token sgv_json_token;
+
+/* 64-bit integers */
+#if defined(_MSC_VER)
+typedef __int64 sgv_json_i64;
+typedef unsigned __int64 sgv_json_u64;
+#elif defined(__GNUC__)
+__extension__ typedef long long sgv_json_i64;
+__extension__ typedef unsigned long long sgv_json_u64;
+#else
+typedef long long sgv_json_i64;
+typedef unsigned long long sgv_json_u64;
+#endif
+
 typedef enum {
     SGV_JSON_TOKEN_ARR,
     SGV_JSON_TOKEN_ELEMENT,
@@ -71,12 +111,42 @@ typedef enum {
 
 /* returns 0 on success, negative if error, and number of tokens (positive)
    if the size of scratch_pad is in-sufficient. The root JSON obj will be in
-   tokens[0]. */
+   tokens[0]. Pass max_tokens = 0 to only count the tokens needed. */
 SGVJSON_DEF int sgv_json_parse(char* json_str,
                                int json_str_len,
                                sgv_json_token* tokens,
                                int max_tokens);
 
+/* Same as sgv_json_parse, 'flags' is a combination of sgv_json_parse_flags */
+SGVJSON_DEF int sgv_json_parse_ex(char* json_str,
+                                  int json_str_len,
+                                  sgv_json_token* tokens,
+                                  int max_tokens,
+                                  int flags);
+
+typedef enum {
+    /* Two-stage parsing: SSE2/AVX2 first index the structural characters of
+       the text 32 bytes at a time, then the tokens are built off the index.
+       Falls back to the scalar parser where SSE2 is not available. Gives
+       the same tokens as the scalar parser. */
+    SGV_JSON_PARSE_SIMD = 1,
+    /* Decodes the escapes of keys and string values in place in json_str
+       once the tokens are known to fit, so a run that only counts tokens
+       leaves the text alone. Lone surrogates in \u escapes become U+FFFD.
+       The text is no longer JSON afterwards, don't parse it again. */
+    SGV_JSON_PARSE_UNESCAPE = 2,
+    /* Rejects text that is not valid UTF-8 (overlong forms, surrogates and
+       code points past U+10FFFF included) before anything is parsed */
+    SGV_JSON_PARSE_UTF8 = 4
+} sgv_json_parse_flags;
+
+/* Errors returned by sgv_json_parse */
+#define SGV_JSON_ERROR_INVALID (-1) /* malformed JSON */
+#define SGV_JSON_ERROR_DEPTH   (-2) /* nested deeper than SGV_JSON_MAX_DEPTH */
+#define SGV_JSON_ERROR_ROOTS   (-3) /* more records than max_roots */
+#define SGV_JSON_ERROR_TYPE    (-4) /* a value does not suit its field */
+#define SGV_JSON_ERROR_FILE    (-5) /* a file can't be read or written */
+
 /* Returns first pair in the obj, NULL if the JSON object is empty/on error */
 SGVJSON_DEF sgv_json_token* sgv_json_first_pair(sgv_json_token* obj);
 
@@ -119,13 +189,28 @@ SGVJSON_DEF sgv_json_token* sgv_json_value_obj(sgv_json_token* value);
 /* returns JSON array on success, NULL if error */
 SGVJSON_DEF sgv_json_token* sgv_json_value_array(sgv_json_token* value);
 
-/* returns 0 on success. negative on error */
+/* returns 0 on success. negative on error. The string is the raw text
+   between the quotes, escapes and all, unless the document was parsed with
+   SGV_JSON_PARSE_UNESCAPE. */
 SGVJSON_DEF int sgv_json_value_string(sgv_json_token* value,
                                       char **str, int *str_len);
 
-/* returns 0 on success. negative on error */
+/* Numbers are decoded (exactly, correctly rounded) the first time they are
+   read and the result is cached in the token of the enclosing pair/element,
+   so these accessors write to the tokens. Non-integers are truncated
+   towards zero by the integer accessors. */
+
+/* returns 0 on success. negative on error or if out of range */
 SGVJSON_DEF int sgv_json_value_int(sgv_json_token* value, int* number);
 
+/* returns 0 on success. negative on error or if out of range */
+SGVJSON_DEF int sgv_json_value_int64(sgv_json_token* value,
+                                     sgv_json_i64* number);
+
+/* returns 0 on success. negative on error or if out of range */
+SGVJSON_DEF int sgv_json_value_uint64(sgv_json_token* value,
+                                      sgv_json_u64* number);
+
 /* returns 0 on success. negative on error */
 SGVJSON_DEF int sgv_json_value_double(sgv_json_token* value, double* number);
 
@@ -135,6 +220,247 @@ SGVJSON_DEF int sgv_json_value_bool(sgv_json_token* value, int* bool_val);
 /* returns 0 on success. negative on error. is_null = 1 if Null, else 0 */
 SGVJSON_DEF int sgv_json_value_null(sgv_json_token* value, int* is_null);
 
+/* Parses newline-delimited JSON (JSON Lines), one document per line. Blank
+   lines are skipped. roots[i] is set to the root token of the i-th record
+   and *n_roots to the number of records. The input is split into
+   n_threads ranges at line boundaries and every range is parsed into its
+   own slice of 'tokens', sized in proportion to its bytes. Define
+   SGV_JSON_THREADS to parse the ranges in parallel with pthreads,
+   otherwise they are parsed one after the other.
+   Returns the same as sgv_json_parse. A positive return is the max_tokens
+   needed for this n_threads. On error *n_roots is the index of the
+   offending record. Returns SGV_JSON_ERROR_ROOTS if there are more than
+   max_roots records, *n_roots then has the count. */
+SGVJSON_DEF int sgv_json_parse_lines(char* json_str,
+                                     int json_str_len,
+                                     sgv_json_token* tokens,
+                                     int max_tokens,
+                                     sgv_json_token** roots,
+                                     int max_roots,
+                                     int* n_roots,
+                                     int n_threads);
+
+/* Key index for objects with many keys. Hash tables of the keys of an
+   object are built lazily, the first time the object is looked up, in the
+   scratch buffer given to sgv_json_index_init. Later lookups in that
+   object take constant time. Objects that don't fit in the scratch buffer
+   are scanned linearly, like sgv_json_obj_value. */
+typedef struct sgv_json_index sgv_json_index;
+
+SGVJSON_DEF void sgv_json_index_init(sgv_json_index* idx,
+                                     void* scratch, int scratch_len);
+
+/* Same as sgv_json_obj_value, using (and building if needed) the index */
+SGVJSON_DEF sgv_json_token* sgv_json_index_value(sgv_json_index* idx,
+                                                 sgv_json_token* obj,
+                                                 char* key);
+
+/* Streaming parser. Feed the document in chunks of any size, events are
+   delivered to the callback as soon as they complete. Nothing is kept
+   around between chunks except a few bytes of parser state, so memory use
+   does not grow with the size of the document. */
+
+typedef enum {
+    SGV_JSON_EVENT_OBJ_BEGIN,
+    SGV_JSON_EVENT_OBJ_END,
+    SGV_JSON_EVENT_ARR_BEGIN,
+    SGV_JSON_EVENT_ARR_END,
+    SGV_JSON_EVENT_KEY,
+    SGV_JSON_EVENT_STR,
+    SGV_JSON_EVENT_NUM,
+    SGV_JSON_EVENT_BOOL,
+    SGV_JSON_EVENT_NULL
+} sgv_json_event_type;
+
+typedef struct {
+    sgv_json_event_type type;
+    char* str;    /* text of a key, string (without quotes) or number */
+    int str_len;
+    int partial;  /* 1 if a key/string continues in the next event. Happens
+                     when a string spans chunks, str is then a fragment. */
+    int bool_val;
+} sgv_json_event;
+
+/* Return 0 to continue parsing, anything else stops the parser and is
+   returned from sgv_json_stream_feed */
+typedef int (*sgv_json_event_cb)(void* user, sgv_json_event* ev);
+
+typedef struct sgv_json_stream sgv_json_stream;
+
+SGVJSON_DEF void sgv_json_stream_init(sgv_json_stream* st,
+                                      sgv_json_event_cb cb, void* user);
+
+/* Parses the next chunk of the document. Event strings point into 'chunk'
+   (or into 'st' for numbers split between chunks), so they are valid
+   only during the callback. Returns 0 on success, negative on error. */
+SGVJSON_DEF int sgv_json_stream_feed(sgv_json_stream* st,
+                                     char* chunk, int chunk_len);
+
+/* Call after the last chunk. Returns 0 if a complete document was seen. */
+SGVJSON_DEF int sgv_json_stream_end(sgv_json_stream* st);
+
+/* Writer. Output goes to a caller supplied buffer. With a flush callback
+   the buffer is handed to it whenever it fills up (and at the end);
+   without one, output that does not fit is only counted, like snprintf.
+   Nothing is allocated. The calls must form a valid document: keys and
+   values alternate in objects and commas/colons are added as needed. */
+typedef struct sgv_json_writer sgv_json_writer;
+
+/* Gets the next len bytes of output. Return 0 to go on or a negative
+   value to stop writing, the writer calls then return that value.
+   Positive returns are taken as success. */
+typedef int (*sgv_json_flush_cb)(void* user, char* buf, int len);
+
+SGVJSON_DEF void sgv_json_write_init(sgv_json_writer* w, char* buf,
+                                     int buf_len, sgv_json_flush_cb flush,
+                                     void* user);
+
+/* All of these return 0 on success and negative on error. The first error
+   sticks and is returned by every later call. */
+SGVJSON_DEF int sgv_json_write_obj_begin(sgv_json_writer* w);
+SGVJSON_DEF int sgv_json_write_obj_end(sgv_json_writer* w);
+SGVJSON_DEF int sgv_json_write_arr_begin(sgv_json_writer* w);
+SGVJSON_DEF int sgv_json_write_arr_end(sgv_json_writer* w);
+
+/* Strings are escaped as needed, UTF-8 is passed through as is */
+SGVJSON_DEF int sgv_json_write_key(sgv_json_writer* w, char* key, int len);
+SGVJSON_DEF int sgv_json_write_string(sgv_json_writer* w, char* str, int len);
+
+SGVJSON_DEF int sgv_json_write_int64(sgv_json_writer* w, sgv_json_i64 number);
+
+/* Shortest text that reads back as the same double. NaN and infinities
+   are written as null. */
+SGVJSON_DEF int sgv_json_write_double(sgv_json_writer* w, double number);
+SGVJSON_DEF int sgv_json_write_bool(sgv_json_writer* w, int bool_val);
+SGVJSON_DEF int sgv_json_write_null(sgv_json_writer* w);
+
+/* Writes a parsed value (and everything in it) as it was in the source
+   text, minus the whitespace */
+SGVJSON_DEF int sgv_json_write_token(sgv_json_writer* w, sgv_json_token* value);
+
+/* Flushes the rest of the output. Returns the length of the whole
+   document, negative on error or if it is incomplete. Without a flush
+   callback a return larger than buf_len means the output was cut short. */
+SGVJSON_DEF int sgv_json_write_end(sgv_json_writer* w);
+
+/* JSON Pointer (RFC 6901) queries, for pulling a few values out of a big
+   document. Pointers are compiled once and can be run on any number of
+   documents. */
+typedef struct sgv_json_query sgv_json_query;
+
+/* Compiles pointers like "/items/0/name" ("" is the whole document). They
+   are copied into q. Returns 0 on success, negative if a pointer is
+   malformed or they don't fit in q. */
+SGVJSON_DEF int sgv_json_query_compile(sgv_json_query* q,
+                                       char** pointers, int n_pointers);
+
+/* Finds the values of the pointers in one pass over the text. Only those
+   values are turned into tokens, one after the other in 'tokens'. The rest
+   of the document is skipped by matching brackets without making tokens,
+   and the scan stops as soon as all the pointers are found, so those parts
+   are only checked for balanced brackets and terminated strings.
+   results[i] is set to the value of the i-th pointer, NULL if it is not
+   in the document. Returns the same as sgv_json_parse. */
+SGVJSON_DEF int sgv_json_query_run(sgv_json_query* q,
+                                   char* json_str, int json_str_len,
+                                   sgv_json_token* tokens, int max_tokens,
+                                   sgv_json_token** results);
+
+/* Decoding straight into C structs, in one pass and without tokens. A
+   struct is described by an array of fields ended by one with a NULL key:
+
+   typedef struct { int id; double scale; sgv_json_string name; } conf;
+   sgv_json_field conf_fields[] = {
+       {"id", SGV_JSON_FIELD_INT, offsetof(conf, id), NULL},
+       {"scale", SGV_JSON_FIELD_DOUBLE, offsetof(conf, scale), NULL},
+       {"name", SGV_JSON_FIELD_STRING, offsetof(conf, name), NULL},
+       {NULL, SGV_JSON_FIELD_INT, 0, NULL}
+   }; */
+typedef enum {
+    SGV_JSON_FIELD_INT,    /* int */
+    SGV_JSON_FIELD_INT64,  /* sgv_json_i64 */
+    SGV_JSON_FIELD_UINT64, /* sgv_json_u64 */
+    SGV_JSON_FIELD_FLOAT,  /* float */
+    SGV_JSON_FIELD_DOUBLE, /* double */
+    SGV_JSON_FIELD_BOOL,   /* int, 0 or 1 */
+    SGV_JSON_FIELD_STRING, /* sgv_json_string, as sgv_json_value_string */
+    SGV_JSON_FIELD_JSON,   /* sgv_json_string, the text of any value */
+    SGV_JSON_FIELD_OBJ     /* a struct described by 'nested' */
+} sgv_json_field_type;
+
+typedef struct {
+    char* str;
+    int len;
+} sgv_json_string;
+
+typedef struct sgv_json_field {
+    char* key;
+    sgv_json_field_type type;
+    int offset;                    /* offsetof the member */
+    struct sgv_json_field* nested; /* fields of SGV_JSON_FIELD_OBJ */
+} sgv_json_field;
+
+/* The fields of a struct and of the structs nested in it, with their keys
+   hashed */
+typedef struct sgv_json_schema sgv_json_schema;
+
+/* Returns 0 on success, negative if the fields don't fit in sc */
+SGVJSON_DEF int sgv_json_schema_init(sgv_json_schema* sc,
+                                     sgv_json_field* fields);
+
+/* Decodes the JSON object in json_str into the struct at 'out'. Members
+   that are null or have no field are skipped like in sgv_json_query_run,
+   fields with no member are left alone and of repeated keys the last one
+   wins. Strings point into json_str.
+   Returns 0 on success, negative on error: SGV_JSON_ERROR_TYPE if a value
+   does not suit its field. On error 'out' may be partly written. */
+SGVJSON_DEF int sgv_json_decode_struct(sgv_json_schema* sc,
+                                       char* json_str, int json_str_len,
+                                       void* out);
+
+#ifdef SGV_JSON_MMAP
+/* A memory mapped file. data/len is its JSON text. */
+typedef struct {
+    char* data;
+    int len;
+    void* base;             /* private */
+    int size;
+    sgv_json_i64 src_size;
+    sgv_json_i64 src_mtime;
+} sgv_json_map;
+
+/* Maps the file (copy-on-write, the file itself is never changed) and
+   parses it in place with sgv_json_parse_ex. Tokens point into the
+   mapping. Returns the same as sgv_json_parse_ex, with
+   SGV_JSON_ERROR_FILE if the file can't be mapped. Unless there is an
+   error, release the mapping with sgv_json_unmap once done with the
+   tokens; if they didn't fit, map->data can be parsed again instead. */
+SGVJSON_DEF int sgv_json_parse_file(const char* path, sgv_json_map* map,
+                                    sgv_json_token* tokens, int max_tokens,
+                                    int flags);
+
+SGVJSON_DEF void sgv_json_unmap(sgv_json_map* map);
+
+/* Saves the tokens of a document parsed by sgv_json_parse_file, together
+   with its text, into a snapshot file. The snapshot is relocatable: it
+   can be mapped at any address and read by the accessors as is, with no
+   parsing. It depends on the pointer size and byte order. Returns 0 on
+   success, SGV_JSON_ERROR_FILE if it can't be written. */
+SGVJSON_DEF int sgv_json_save_snapshot(const char* path, sgv_json_map* map,
+                                       sgv_json_token* tokens);
+
+/* Maps a snapshot read-only and shared, so all the processes loading it
+   share its pages. *root is set to the root token. If source_path is not
+   NULL, the snapshot is rejected when that file changed since it was
+   saved. Returns 0 on success, SGV_JSON_ERROR_FILE if the file can't be
+   mapped or is not a valid snapshot for this build. Release with
+   sgv_json_unmap. */
+SGVJSON_DEF int sgv_json_load_snapshot(const char* path,
+                                       const char* source_path,
+                                       sgv_json_map* map,
+                                       sgv_json_token** root);
+#endif
+
 
 /*****************************************************************************
 *****************************************************************************/
@@ -143,21 +469,104 @@ SGVJSON_DEF int sgv_json_value_null(sgv_json_token* value, int* is_null);
    The definition of this struct may change in future versions of this lib.
    It is a private struct whose definition has been exposed to facilitate
    allocation of tokens on the stack (or static allocation) */
+/* Tokens are stored in document order (a pair is followed by its key and
+   its value, a container by its children), so the first child of a token
+   is the next token and a subtree is skipped by jumping 'len' tokens. */
 struct sgv_json_token {
-    sgv_json_token_type type;
-    union token_data {
-        struct {
-            sgv_json_token* next;
-            sgv_json_token* key;
-            sgv_json_token* value;
-        } node;
-        struct {
-            char* str;
-            int str_len;
-            int integer_num;
-            double decimal_num;
-        } value;
-    } data;
+    int tag;       /* sgv_json_token_type in the low byte, flags above */
+    int len;       /* tokens in the subtree for arrays, objects, pairs and
+                      elements; string length for keys and values */
+    union {
+        ptrdiff_t str;  /* keys and values: start of the string relative
+                           to the token */
+        sgv_json_u64 i; /* pairs/elements: the decoded number they hold */
+        double d;
+    } u;
+};
+
+#ifndef SGV_JSON_MAX_DEPTH
+#define SGV_JSON_MAX_DEPTH 256
+#endif
+
+/* Longest number the streaming parser can carry across chunks */
+#define SGV_JSON_STREAM_MAX_NUM 64
+
+/* WARNING: Private like sgv_json_token, exposed to allow allocating it */
+struct sgv_json_stream {
+    sgv_json_event_cb cb;
+    void* user;
+    int error;
+    int state, depth;      /* grammar */
+    unsigned char is_obj[SGV_JSON_MAX_DEPTH];
+    int lex;               /* lexer state at the end of the last chunk */
+    int esc;               /* escape sequence in progress in a string */
+    int is_key;
+    const char* lit;       /* literal being matched and how far */
+    int lit_pos;
+    int num_len;
+    char num[SGV_JSON_STREAM_MAX_NUM];
+};
+
+/* Max objects tracked by one sgv_json_index */
+#ifndef SGV_JSON_INDEX_OBJS
+#define SGV_JSON_INDEX_OBJS 64
+#endif
+
+/* WARNING: Private like sgv_json_token, exposed to allow allocating it */
+struct sgv_json_index {
+    char* scratch;
+    int scratch_len;
+    int used;
+    sgv_json_token* objs[SGV_JSON_INDEX_OBJS]; /* open addressing on obj */
+    int tables[SGV_JSON_INDEX_OBJS];  /* offset of the table, -1 if none */
+    int caps[SGV_JSON_INDEX_OBJS];    /* slots in the table, power of 2 */
+};
+
+/* WARNING: Private like sgv_json_token, exposed to allow allocating it */
+struct sgv_json_writer {
+    char* buf;
+    int buf_len;
+    int used;              /* bytes in buf */
+    int total;             /* bytes of output so far */
+    sgv_json_flush_cb flush;
+    void* user;
+    int error;
+    int state, depth;      /* grammar */
+    unsigned char is_obj[SGV_JSON_MAX_DEPTH];
+};
+
+/* Max pointers in one sgv_json_query */
+#define SGV_JSON_QUERY_PATHS 32
+
+/* Max segments and bytes of all the pointers in one sgv_json_query */
+#ifndef SGV_JSON_QUERY_SEGS
+#define SGV_JSON_QUERY_SEGS 128
+#endif
+#ifndef SGV_JSON_QUERY_TEXT
+#define SGV_JSON_QUERY_TEXT 1024
+#endif
+
+/* WARNING: Private like sgv_json_token, exposed to allow allocating it */
+struct sgv_json_query {
+    int n_paths;
+    int first[SGV_JSON_QUERY_PATHS + 1]; /* first segment of each path */
+    int seg[SGV_JSON_QUERY_SEGS + 1];    /* start of each segment in text */
+    int idx[SGV_JSON_QUERY_SEGS];        /* as an array index, -1 if not
+                                            one, -2 if it has a backslash */
+    char text[SGV_JSON_QUERY_TEXT];      /* the segments, unescaped */
+};
+
+/* Max fields in one sgv_json_schema, all nested structs included */
+#ifndef SGV_JSON_SCHEMA_FIELDS
+#define SGV_JSON_SCHEMA_FIELDS 128
+#endif
+
+/* WARNING: Private like sgv_json_token, exposed to allow allocating it */
+struct sgv_json_schema {
+    sgv_json_field* fields[SGV_JSON_SCHEMA_FIELDS];
+    unsigned int hash[SGV_JSON_SCHEMA_FIELDS];
+    int key_len[SGV_JSON_SCHEMA_FIELDS];
+    int nested[SGV_JSON_SCHEMA_FIELDS];  /* where the nested fields start */
 };
 
 #ifdef __cplusplus
@@ -168,7 +577,68 @@ struct sgv_json_token {
 
 /*****************************************************************************
 ****************************** Implementation********************************/
-#ifdef SGV_JSON_IMPLEMENTATION
+/* once, even if the header is included again (e.g. by sgv_nnet.h) */
+#if defined(SGV_JSON_IMPLEMENTATION) && !defined(SGVP_JSON_IMPLEMENTED)
+#define SGVP_JSON_IMPLEMENTED
+
+#define SGVP_JSON_NULL ((sgv_json_token*)0)
+
+/* The builder sits in the inner loop of every lexer */
+#if defined(__GNUC__)
+#define SGVP_JSON_INLINE __inline__ __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#define SGVP_JSON_INLINE __forceinline
+#else
+#define SGVP_JSON_INLINE
+#endif
+#define SGVP_JSON_TYPE 0xff  /* token tag bits holding the type */
+#define SGVP_JSON_NEXT 0x100 /* another pair/element follows the subtree */
+#define SGVP_JSON_INT  0x200 /* pairs/elements: u.i is a cached int64 */
+#define SGVP_JSON_UINT 0x400 /* u.i is a cached uint64 above INT64_MAX */
+#define SGVP_JSON_DBL  0x800 /* u.d is a cached double */
+#define SGVP_JSON_CACHED (SGVP_JSON_INT | SGVP_JSON_UINT | SGVP_JSON_DBL)
+#define SGVP_JSON_SLOT1 0x1000 /* values: the pair/element is 1 or 2 */
+#define SGVP_JSON_SLOT2 0x2000 /*         tokens before */
+#define SGVP_JSON_UNESC 0x4000 /* keys/strings: escapes decoded in place */
+#define SGVP_JSON_IS_DIGIT(c) ((c) >= '0' && (c) <= '9')
+
+/* The lexer turns the text into these events, the builder checks the
+   grammar and links up the tokens. */
+enum {
+    SGVP_EV_OBJ_BEGIN,
+    SGVP_EV_OBJ_END,
+    SGVP_EV_ARR_BEGIN,
+    SGVP_EV_ARR_END,
+    SGVP_EV_COLON,
+    SGVP_EV_COMMA,
+    SGVP_EV_STR,
+    SGVP_EV_NUM,
+    SGVP_EV_TRUE,
+    SGVP_EV_FALSE,
+    SGVP_EV_NULL
+};
+
+/* What the builder expects next */
+enum {
+    SGVP_ST_VALUE,     /* a value (root, after ':' or after ',' in arrays) */
+    SGVP_ST_ARR_FIRST, /* after '[', a value or ']' */
+    SGVP_ST_OBJ_FIRST, /* after '{', a key or '}' */
+    SGVP_ST_KEY,       /* after ',' in objects, a key */
+    SGVP_ST_COLON,     /* after a key */
+    SGVP_ST_NEXT,      /* after a value in a container, ',' or the closer */
+    SGVP_ST_DONE       /* the root value is complete */
+};
+
+typedef struct {
+    sgv_json_token* tokens;
+    int max_tokens;
+    int n;      /* tokens needed so far. Can run past max_tokens. */
+    int state;
+    int depth;
+    int parent[SGV_JSON_MAX_DEPTH]; /* open containers */
+    int last[SGV_JSON_MAX_DEPTH];   /* their last pair/element, -1 if none */
+    unsigned char is_obj[SGV_JSON_MAX_DEPTH];
+} sgvp_json_builder;
 
 #ifdef SGV_JSON_DEBUG
 #include <stdio.h>
@@ -181,9 +651,819 @@ static void sgv_json_print(const char *str, ...)
 #define SGV_JSON_LOG(x) do { if (0) sgv_json_print x; } while (0)
 #endif
 
-SGVJSON_DEF sgv_json_token_type sgv_json_type(sgv_json_token* token)
+/* Returns the length of the number at s, 0 if it is malformed */
+static int sgvp_json_lex_num(const char* s, const char* end)
+{
+    const char* p = s;
+
+    if(*p == '-') {
+        p++;
+    }
+    if(p < end && *p == '0') {
+        p++;
+    } else if(p < end && *p >= '1' && *p <= '9') {
+        for(p++; p < end && SGVP_JSON_IS_DIGIT(*p); p++);
+    } else {
+        return 0;
+    }
+    if(p < end && *p == '.') {
+        p++;
+        if(p == end || !SGVP_JSON_IS_DIGIT(*p)) {
+            return 0;
+        }
+        for(p++; p < end && SGVP_JSON_IS_DIGIT(*p); p++);
+    }
+    if(p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        if(p < end && (*p == '+' || *p == '-')) {
+            p++;
+        }
+        if(p == end || !SGVP_JSON_IS_DIGIT(*p)) {
+            return 0;
+        }
+        for(p++; p < end && SGVP_JSON_IS_DIGIT(*p); p++);
+    }
+    return p - s;
+}
+
+static int sgvp_json_is_hex(char c)
+{
+    return SGVP_JSON_IS_DIGIT(c) || (c >= 'a' && c <= 'f') ||
+           (c >= 'A' && c <= 'F');
+}
+
+/* s is just past the opening quote. Returns the length of the string up to
+   the closing quote, -1 if it is malformed or unterminated. */
+static int sgvp_json_lex_str(const char* s, const char* end)
+{
+    const char* p = s;
+    unsigned char c = 0;
+
+    for(;;) {
+        while(p < end && (c = *p) != '"' && c != '\\' && c >= 0x20) {
+            p++;
+        }
+        if(p == end || c < 0x20) {
+            return -1;
+        }
+        if(c == '"') {
+            return p - s;
+        }
+        if(++p == end) {
+            return -1;
+        }
+        switch(*p) {
+        case '"': case '\\': case '/':
+        case 'b': case 'f': case 'n': case 'r': case 't':
+            p++;
+            break;
+        case 'u':
+            if(end - p < 5 || !sgvp_json_is_hex(p[1]) ||
+               !sgvp_json_is_hex(p[2]) || !sgvp_json_is_hex(p[3]) ||
+               !sgvp_json_is_hex(p[4])) {
+                return -1;
+            }
+            p += 5;
+            break;
+        default:
+            return -1;
+        }
+    }
+}
+
+static int sgvp_json_lex_lit(const char* s, const char* end,
+                             const char* lit, int len)
+{
+    int i;
+    if(end - s < len) {
+        return 0;
+    }
+    for(i = 0; i < len; i++) {
+        if(s[i] != lit[i]) {
+            return 0;
+        }
+    }
+    return len;
+}
+
+/* Recognizes number/true/false/null at s. Returns the event, *len is 0 if
+   it is none of them. */
+static int sgvp_json_lex_scalar(const char* s, const char* end, int* len)
+{
+    switch(*s) {
+    case 't':
+        *len = sgvp_json_lex_lit(s, end, "true", 4);
+        return SGVP_EV_TRUE;
+    case 'f':
+        *len = sgvp_json_lex_lit(s, end, "false", 5);
+        return SGVP_EV_FALSE;
+    case 'n':
+        *len = sgvp_json_lex_lit(s, end, "null", 4);
+        return SGVP_EV_NULL;
+    case '-': case '0': case '1': case '2': case '3': case '4':
+    case '5': case '6': case '7': case '8': case '9':
+        *len = sgvp_json_lex_num(s, end);
+        return SGVP_EV_NUM;
+    }
+    *len = 0;
+    return SGVP_EV_NULL;
+}
+
+static SGVP_JSON_INLINE sgv_json_token* sgvp_json_tok(sgvp_json_builder* b, int i)
+{
+    return (i >= 0 && i < b->max_tokens) ? &b->tokens[i] : SGVP_JSON_NULL;
+}
+
+/* Returns the index of a fresh token. Past max_tokens they are only counted */
+static SGVP_JSON_INLINE int sgvp_json_new(sgvp_json_builder* b, int type,
+                                          char* str, int len)
+{
+    sgv_json_token* t = sgvp_json_tok(b, b->n);
+    if(t) {
+        t->tag = type;
+        t->len = len;
+        t->u.str = str ? str - (char*)t : 0;
+    }
+    return b->n++;
+}
+
+/* Appends a pair/element to the open container at level d */
+static SGVP_JSON_INLINE void sgvp_json_append(sgvp_json_builder* b, int d,
+                                              int child)
+{
+    sgv_json_token* prev = sgvp_json_tok(b, b->last[d]);
+    if(prev) {
+        prev->tag |= SGVP_JSON_NEXT;
+    }
+    b->last[d] = child;
+}
+
+/* The subtree of token i ends at the last token made */
+static SGVP_JSON_INLINE void sgvp_json_close(sgvp_json_builder* b, int i)
+{
+    sgv_json_token* t = sgvp_json_tok(b, i);
+    if(t) {
+        t->len = b->n - i;
+    }
+}
+
+/* Closes the pair/element holding the complete value v at level d */
+static SGVP_JSON_INLINE void sgvp_json_close_slot(sgvp_json_builder* b,
+                                                  int d, int v)
+{
+    if(d > 0) {
+        sgvp_json_close(b, v - (b->is_obj[d - 1] ? 2 : 1));
+    }
+}
+
+#define SGVP_JSON_KEY 1
+
+/* Checks that 'ev' may come next and moves to the next state. Returns
+   SGVP_JSON_KEY if the event is a string used as an object key, 0 for any
+   other event that is allowed and negative on error. */
+static SGVP_JSON_INLINE int sgvp_json_grammar(int* state, int* depth,
+                                              unsigned char* is_obj, int ev)
+{
+    int obj;
+
+    switch(ev) {
+    case SGVP_EV_OBJ_BEGIN:
+    case SGVP_EV_ARR_BEGIN:
+        obj = (ev == SGVP_EV_OBJ_BEGIN);
+        if(*state != SGVP_ST_VALUE && *state != SGVP_ST_ARR_FIRST) {
+            return SGV_JSON_ERROR_INVALID;
+        }
+        if(*depth == SGV_JSON_MAX_DEPTH) {
+            return SGV_JSON_ERROR_DEPTH;
+        }
+        is_obj[(*depth)++] = (unsigned char)obj;
+        *state = obj ? SGVP_ST_OBJ_FIRST : SGVP_ST_ARR_FIRST;
+        return 0;
+
+    case SGVP_EV_OBJ_END:
+    case SGVP_EV_ARR_END:
+        obj = (ev == SGVP_EV_OBJ_END);
+        if(*depth == 0 || is_obj[*depth - 1] != obj) {
+            return SGV_JSON_ERROR_INVALID;
+        }
+        if(*state != SGVP_ST_NEXT &&
+           *state != (obj ? SGVP_ST_OBJ_FIRST : SGVP_ST_ARR_FIRST)) {
+            return SGV_JSON_ERROR_INVALID;
+        }
+        (*depth)--;
+        *state = *depth ? SGVP_ST_NEXT : SGVP_ST_DONE;
+        return 0;
+
+    case SGVP_EV_COLON:
+        if(*state != SGVP_ST_COLON) {
+            return SGV_JSON_ERROR_INVALID;
+        }
+        *state = SGVP_ST_VALUE;
+        return 0;
+
+    case SGVP_EV_COMMA:
+        if(*state != SGVP_ST_NEXT) {
+            return SGV_JSON_ERROR_INVALID;
+        }
+        *state = is_obj[*depth - 1] ? SGVP_ST_KEY : SGVP_ST_VALUE;
+        return 0;
+
+    case SGVP_EV_STR:
+        if(*state == SGVP_ST_OBJ_FIRST || *state == SGVP_ST_KEY) {
+            *state = SGVP_ST_COLON;
+            return SGVP_JSON_KEY;
+        }
+        /* a string value */
+        /* fall through */
+    default:
+        if(*state != SGVP_ST_VALUE && *state != SGVP_ST_ARR_FIRST) {
+            return SGV_JSON_ERROR_INVALID;
+        }
+        *state = *depth ? SGVP_ST_NEXT : SGVP_ST_DONE;
+        return 0;
+    }
+}
+
+static SGVP_JSON_INLINE int sgvp_json_event(sgvp_json_builder* b, int ev,
+                                            char* str, int len)
 {
-    return token->type;
+    int r, v, d = b->depth;
+
+    if((r = sgvp_json_grammar(&b->state, &b->depth, b->is_obj, ev)) < 0) {
+        return r;
+    }
+    switch(ev) {
+    case SGVP_EV_OBJ_END:
+    case SGVP_EV_ARR_END:
+        v = b->parent[d - 1];
+        sgvp_json_close(b, v);
+        sgvp_json_close_slot(b, d - 1, v);
+        return 0;
+    case SGVP_EV_COLON:
+    case SGVP_EV_COMMA:
+        return 0;
+    }
+
+    /* a pair is followed by its key and its value */
+    if(r == SGVP_JSON_KEY) {
+        sgvp_json_append(b, d - 1, sgvp_json_new(b, SGV_JSON_TOKEN_PAIR, 0, 1));
+        sgvp_json_new(b, SGV_JSON_TOKEN_KEY, str, len);
+        return 0;
+    }
+
+    /* an element is followed by its value */
+    if(d > 0 && !b->is_obj[d - 1]) {
+        sgvp_json_append(b, d - 1, sgvp_json_new(b, SGV_JSON_TOKEN_ELEMENT, 0, 1));
+    }
+
+    if(ev == SGVP_EV_OBJ_BEGIN || ev == SGVP_EV_ARR_BEGIN) {
+        v = sgvp_json_new(b, ev == SGVP_EV_OBJ_BEGIN ? SGV_JSON_TOKEN_OBJ :
+                                                       SGV_JSON_TOKEN_ARR, 0, 1);
+        b->parent[d] = v;
+        b->last[d] = -1;
+    } else {
+        v = sgvp_json_new(b, (ev == SGVP_EV_STR ? SGV_JSON_TOKEN_VAL_STR :
+                              ev == SGVP_EV_NUM ? SGV_JSON_TOKEN_VAL_NUM :
+                              ev == SGVP_EV_NULL ? SGV_JSON_TOKEN_VAL_NULL :
+                              SGV_JSON_TOKEN_VAL_BOOL) |
+                             (d == 0 ? 0 : b->is_obj[d - 1] ? SGVP_JSON_SLOT2 :
+                                                           SGVP_JSON_SLOT1),
+                          str, len);
+        sgvp_json_close_slot(b, d, v);
+    }
+    return 0;
+}
+
+/* Scalar lexer, one byte at a time */
+static int sgvp_json_lex(sgvp_json_builder* b, char* json_str, int json_str_len)
+{
+    char *p = json_str, *end = json_str + json_str_len, *s;
+    int ev, len, r;
+
+    while(p < end) {
+        s = p;
+        len = 1;
+        switch(*p) {
+        case ' ': case '\t': case '\n': case '\r':
+            p++;
+            continue;
+        case '{': ev = SGVP_EV_OBJ_BEGIN; p++; break;
+        case '}': ev = SGVP_EV_OBJ_END; p++; break;
+        case '[': ev = SGVP_EV_ARR_BEGIN; p++; break;
+        case ']': ev = SGVP_EV_ARR_END; p++; break;
+        case ':': ev = SGVP_EV_COLON; p++; break;
+        case ',': ev = SGVP_EV_COMMA; p++; break;
+        case '"':
+            s = p + 1;
+            if((len = sgvp_json_lex_str(s, end)) < 0) {
+                SGV_JSON_LOG(("sgv_json: bad string at %d\n", (int)(p - json_str)));
+                return SGV_JSON_ERROR_INVALID;
+            }
+            ev = SGVP_EV_STR;
+            p = s + len + 1;
+            break;
+        default:
+            ev = sgvp_json_lex_scalar(p, end, &len);
+            p += len;
+            break;
+        }
+        if(len == 0 && ev != SGVP_EV_STR) {
+            SGV_JSON_LOG(("sgv_json: unexpected '%c' at %d\n", *s, (int)(s - json_str)));
+            return SGV_JSON_ERROR_INVALID;
+        }
+        if((r = sgvp_json_event(b, ev, s, len)) < 0) {
+            SGV_JSON_LOG(("sgv_json: unexpected '%c' at %d\n", *s, (int)(s - json_str)));
+            return r;
+        }
+    }
+    return 0;
+}
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define SGVP_JSON_HAVE_SIMD
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#else
+#include <emmintrin.h>
+#endif
+
+#define SGVP_JSON_BATCH 64 /* blocks of 32 bytes indexed per stage 1 run */
+
+/* Stage 1 state. index[] holds one bit per byte of the text for every
+   position stage 2 has to look at: structural characters outside strings,
+   unescaped quotes, escaping backslashes inside strings and the first byte
+   of every scalar (number/true/false/null). */
+typedef struct {
+    const char* json;
+    int len;
+    int pos;                 /* first byte not yet indexed */
+    int base;                /* text offset of index[cur] */
+    int cur, n;
+    unsigned int index[SGVP_JSON_BATCH];
+    unsigned int in_string;  /* carries across blocks, all ones or zero */
+    unsigned int escape;     /* first byte of the next block is escaped */
+    unsigned int other;      /* last byte of the block was a scalar byte */
+    unsigned int ctrl;       /* control characters seen inside strings */
+} sgvp_json_scanner;
+
+static SGVP_JSON_INLINE int sgvp_json_ctz(unsigned int x)
+{
+#if defined(__GNUC__)
+    return __builtin_ctz(x);
+#else
+    int i = 0;
+    while(!(x & 1)) {
+        x >>= 1;
+        i++;
+    }
+    return i;
+#endif
+}
+
+/* Classifies 32 bytes into bit masks (bit i is byte i) */
+static SGVP_JSON_INLINE void sgvp_json_classify(const char* p, unsigned int* quote,
+                               unsigned int* bslash, unsigned int* ws,
+                               unsigned int* op, unsigned int* ctrl)
+{
+#ifdef __AVX2__
+    __m256i v = _mm256_loadu_si256((const __m256i*)p);
+    __m256i lc = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    *quote = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')));
+    *bslash = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+    *ws = (unsigned int)_mm256_movemask_epi8(_mm256_or_si256(
+              _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                              _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+              _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+                              _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')))));
+    /* '[' | 0x20 == '{', ']' | 0x20 == '}'. The control characters that
+       alias ':' and ',' this way are rejected by stage 2. */
+    *op = (unsigned int)_mm256_movemask_epi8(_mm256_or_si256(
+              _mm256_or_si256(_mm256_cmpeq_epi8(lc, _mm256_set1_epi8('{')),
+                              _mm256_cmpeq_epi8(lc, _mm256_set1_epi8('}'))),
+              _mm256_or_si256(_mm256_cmpeq_epi8(lc, _mm256_set1_epi8(':')),
+                              _mm256_cmpeq_epi8(lc, _mm256_set1_epi8(',')))));
+    *ctrl = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+              _mm256_max_epu8(v, _mm256_set1_epi8(0x1F)), _mm256_set1_epi8(0x1F)));
+#else
+    int i;
+    *quote = *bslash = *ws = *op = *ctrl = 0;
+    for(i = 0; i < 32; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+        __m128i lc = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        *quote |= (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('"'))) << i;
+        *bslash |= (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))) << i;
+        *ws |= (unsigned int)_mm_movemask_epi8(_mm_or_si128(
+                   _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                                _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+                   _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+                                _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))))) << i;
+        *op |= (unsigned int)_mm_movemask_epi8(_mm_or_si128(
+                   _mm_or_si128(_mm_cmpeq_epi8(lc, _mm_set1_epi8('{')),
+                                _mm_cmpeq_epi8(lc, _mm_set1_epi8('}'))),
+                   _mm_or_si128(_mm_cmpeq_epi8(lc, _mm_set1_epi8(':')),
+                                _mm_cmpeq_epi8(lc, _mm_set1_epi8(','))))) << i;
+        *ctrl |= (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(
+                   _mm_max_epu8(v, _mm_set1_epi8(0x1F)), _mm_set1_epi8(0x1F))) << i;
+    }
+#endif
+}
+
+/* Stage 1: indexes the next batch of blocks. Returns 0 at the end of text */
+static int sgvp_json_stage1(sgvp_json_scanner* sc)
+{
+    char tail[32];
+    const char* p;
+    unsigned int quote, bslash, ws, op, ctrl, escaped, starts, str, other;
+    int i, b;
+
+    sc->base = sc->pos;
+    sc->cur = 0;
+    for(sc->n = 0; sc->n < SGVP_JSON_BATCH && sc->pos < sc->len; sc->n++) {
+        p = sc->json + sc->pos;
+        if(sc->len - sc->pos < 32) {
+            for(i = 0; i < 32; i++) {
+                tail[i] = (i < sc->len - sc->pos) ? p[i] : ' ';
+            }
+            p = tail;
+        }
+        sgvp_json_classify(p, &quote, &bslash, &ws, &op, &ctrl);
+
+        /* Backslashes are rare, walk them one by one. An unescaped one
+           escapes the byte after it. */
+        escaped = sc->escape;
+        bslash &= ~escaped;
+        starts = bslash;
+        sc->escape = 0;
+        while(bslash) {
+            b = sgvp_json_ctz(bslash);
+            if(b == 31) {
+                sc->escape = 1;
+            } else {
+                escaped |= 2u << b;
+            }
+            bslash &= ~(3u << b);
+            starts &= ~(escaped & (2u << b));
+        }
+        quote &= ~escaped;
+
+        /* Prefix xor of the quotes gives the bytes inside strings (opening
+           quote included, closing quote excluded) */
+        str = quote;
+        str ^= str << 1;
+        str ^= str << 2;
+        str ^= str << 4;
+        str ^= str << 8;
+        str ^= str << 16;
+        str ^= sc->in_string;
+        sc->in_string = (str >> 31) ? ~0u : 0;
+
+        sc->ctrl |= ctrl & str;
+        other = ~(ws | op | quote) & ~str;
+        sc->index[sc->n] = (op & ~str) | quote | (starts & str) |
+                           (other & ~((other << 1) | sc->other));
+        sc->other = other >> 31;
+        sc->pos += 32;
+    }
+    if(sc->pos > sc->len) {
+        sc->pos = sc->len;
+    }
+    return sc->n;
+}
+
+/* Stage 2 iterator: returns the next indexed text offset, -1 at the end */
+static SGVP_JSON_INLINE int sgvp_json_next(sgvp_json_scanner* sc)
+{
+    int b;
+    while(sc->cur == sc->n || !sc->index[sc->cur]) {
+        if(sc->cur < sc->n) {
+            sc->cur++;
+            sc->base += 32;
+        } else if(!sgvp_json_stage1(sc)) {
+            return -1;
+        }
+    }
+    b = sgvp_json_ctz(sc->index[sc->cur]);
+    sc->index[sc->cur] &= sc->index[sc->cur] - 1;
+    return sc->base + b;
+}
+
+static int sgvp_json_is_delim(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == ',' ||
+           c == ':' || c == '[' || c == ']' || c == '{' || c == '}' ||
+           c == '"';
+}
+
+/* Stage 2: walks the index and feeds the same events to the builder as the
+   scalar lexer does */
+static int sgvp_json_lex_simd(sgvp_json_builder* b,
+                              char* json_str, int json_str_len)
+{
+    sgvp_json_scanner sc;
+    char *s, *end = json_str + json_str_len;
+    int i, j, ev, len, r;
+
+    sc.json = json_str;
+    sc.len = json_str_len;
+    sc.pos = sc.base = sc.cur = sc.n = 0;
+    sc.in_string = sc.escape = sc.other = sc.ctrl = 0;
+
+    while((i = sgvp_json_next(&sc)) >= 0) {
+        s = json_str + i;
+        len = 1;
+        switch(*s) {
+        case '{': ev = SGVP_EV_OBJ_BEGIN; break;
+        case '}': ev = SGVP_EV_OBJ_END; break;
+        case '[': ev = SGVP_EV_ARR_BEGIN; break;
+        case ']': ev = SGVP_EV_ARR_END; break;
+        case ':': ev = SGVP_EV_COLON; break;
+        case ',': ev = SGVP_EV_COMMA; break;
+        case '"':
+            /* escapes up to the closing quote */
+            while((j = sgvp_json_next(&sc)) >= 0 && json_str[j] == '\\') {
+                if(j + 1 >= json_str_len) {
+                    j = -1;
+                    break;
+                }
+                switch(json_str[j+1]) {
+                case '"': case '\\': case '/':
+                case 'b': case 'f': case 'n': case 'r': case 't':
+                    break;
+                case 'u':
+                    if(end - json_str - j < 6 ||
+                       !sgvp_json_is_hex(json_str[j+2]) ||
+                       !sgvp_json_is_hex(json_str[j+3]) ||
+                       !sgvp_json_is_hex(json_str[j+4]) ||
+                       !sgvp_json_is_hex(json_str[j+5])) {
+                        j = -1;
+                    }
+                    break;
+                default:
+                    j = -1;
+                    break;
+                }
+                if(j < 0) {
+                    break;
+                }
+            }
+            if(j < 0) {
+                SGV_JSON_LOG(("sgv_json: bad string at %d\n", i));
+                return SGV_JSON_ERROR_INVALID;
+            }
+            ev = SGVP_EV_STR;
+            s++;
+            len = j - i - 1;
+            break;
+        default:
+            ev = sgvp_json_lex_scalar(s, end, &len);
+            if(len && s + len < end && !sgvp_json_is_delim(s[len])) {
+                len = 0;
+            }
+            break;
+        }
+        if(len == 0 && ev != SGVP_EV_STR) {
+            SGV_JSON_LOG(("sgv_json: unexpected '%c' at %d\n", *s, i));
+            return SGV_JSON_ERROR_INVALID;
+        }
+        if((r = sgvp_json_event(b, ev, s, len)) < 0) {
+            SGV_JSON_LOG(("sgv_json: unexpected '%c' at %d\n", *s, i));
+            return r;
+        }
+    }
+    if(sc.ctrl || sc.in_string) {
+        SGV_JSON_LOG(("sgv_json: bad string\n"));
+        return SGV_JSON_ERROR_INVALID;
+    }
+    return 0;
+}
+#endif
+
+/* Decodes the escape sequence at s (just past the backslash) as UTF-8 into
+   out. Returns the number of bytes written, *n is set to the length of
+   the escape sequence. Surrogate pairs in \u escapes are combined. */
+static int sgvp_json_unescape1(const char* s, const char* end, char* out,
+                               int* n)
+{
+    unsigned long c = 0, c2 = 0;
+    int i;
+
+    *n = 1;
+    switch(*s) {
+    case 'b': out[0] = '\b'; return 1;
+    case 'f': out[0] = '\f'; return 1;
+    case 'n': out[0] = '\n'; return 1;
+    case 'r': out[0] = '\r'; return 1;
+    case 't': out[0] = '\t'; return 1;
+    case 'u': break;
+    default: out[0] = *s; return 1;
+    }
+    for(i = 1; i <= 4; i++) {
+        c = c * 16 + (SGVP_JSON_IS_DIGIT(s[i]) ? s[i] - '0' : (s[i] | 0x20) - 'a' + 10);
+    }
+    *n = 5;
+    if(c >= 0xD800 && c < 0xDC00 && end - s >= 11 && s[5] == '\\' && s[6] == 'u') {
+        for(i = 7; i <= 10; i++) {
+            c2 = c2 * 16 + (SGVP_JSON_IS_DIGIT(s[i]) ? s[i] - '0' : (s[i] | 0x20) - 'a' + 10);
+        }
+        if(c2 >= 0xDC00 && c2 < 0xE000) {
+            c = 0x10000 + ((c - 0xD800) << 10) + (c2 - 0xDC00);
+            *n = 11;
+        }
+    }
+    if(c < 0x80) {
+        out[0] = (char)c;
+        return 1;
+    }
+    if(c < 0x800) {
+        out[0] = (char)(0xC0 | (c >> 6));
+        out[1] = (char)(0x80 | (c & 0x3F));
+        return 2;
+    }
+    if(c < 0x10000) {
+        out[0] = (char)(0xE0 | (c >> 12));
+        out[1] = (char)(0x80 | ((c >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (c & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (c >> 18));
+    out[1] = (char)(0x80 | ((c >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((c >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (c & 0x3F));
+    return 4;
+}
+
+/* Unescapes the string s in place and returns its new length. Runs without
+   escapes are moved 16 bytes at a time, or not at all up to the first
+   escape. */
+static int sgvp_json_unescape(char* s, int len)
+{
+    char *src = s, *dst = s, *end = s + len;
+    int i, m, n;
+#ifdef SGVP_JSON_HAVE_SIMD
+    __m128i v, bslash = _mm_set1_epi8('\\');
+#endif
+
+    for(;;) {
+#ifdef SGVP_JSON_HAVE_SIMD
+        for(; end - src >= 16; src += 16, dst += 16) {
+            v = _mm_loadu_si128((const __m128i*)src);
+            m = _mm_movemask_epi8(_mm_cmpeq_epi8(v, bslash));
+            if(m) {
+                /* a full store would overwrite text not read yet */
+                n = sgvp_json_ctz((unsigned int)m);
+                for(i = 0; i < n; i++) {
+                    dst[i] = src[i];
+                }
+                src += n;
+                dst += n;
+                break;
+            }
+            if(dst != src) {
+                _mm_storeu_si128((__m128i*)dst, v);
+            }
+        }
+#endif
+        while(src < end && *src != '\\') {
+            *dst++ = *src++;
+        }
+        if(src == end) {
+            return dst - s;
+        }
+        m = sgvp_json_unescape1(src + 1, end, dst, &n);
+        if(m == 3 && (unsigned char)dst[0] == 0xED &&
+           (unsigned char)dst[1] >= 0xA0) {
+            /* lone surrogate */
+            dst[0] = (char)0xEF;
+            dst[1] = (char)0xBF;
+            dst[2] = (char)0xBD;
+        }
+        src += n + 1;
+        dst += m;
+    }
+}
+
+/* Returns 0 if the text is valid UTF-8, -1 if not. ASCII is skipped 32
+   bytes at a time. */
+static int sgvp_json_utf8(const char* str, int len)
+{
+    const unsigned char *s = (const unsigned char*)str, *end = s + len;
+    unsigned int c, lo, hi;
+    int i, n;
+
+    while(s < end) {
+#ifdef SGVP_JSON_HAVE_SIMD
+        while(end - s >= 32 && !_mm_movemask_epi8(_mm_or_si128(
+                  _mm_loadu_si128((const __m128i*)s),
+                  _mm_loadu_si128((const __m128i*)(s + 16))))) {
+            s += 32;
+        }
+#endif
+        while(s < end && *s < 0x80) {
+            s++;
+        }
+        if(s == end) {
+            break;
+        }
+        /* the second byte has a narrower range where that is what rules
+           out overlong forms, surrogates and code points past U+10FFFF */
+        c = *s;
+        lo = 0x80;
+        hi = 0xBF;
+        if(c >= 0xC2 && c <= 0xDF) {
+            n = 1;
+        } else if(c >= 0xE0 && c <= 0xEF) {
+            n = 2;
+            lo = (c == 0xE0) ? 0xA0 : 0x80;
+            hi = (c == 0xED) ? 0x9F : 0xBF;
+        } else if(c >= 0xF0 && c <= 0xF4) {
+            n = 3;
+            lo = (c == 0xF0) ? 0x90 : 0x80;
+            hi = (c == 0xF4) ? 0x8F : 0xBF;
+        } else {
+            return -1;
+        }
+        if(end - s <= n || s[1] < lo || s[1] > hi) {
+            return -1;
+        }
+        for(i = 2; i <= n; i++) {
+            if((s[i] & 0xC0) != 0x80) {
+                return -1;
+            }
+        }
+        s += n + 1;
+    }
+    return 0;
+}
+
+/* The parser proper. *n_tokens is set to the number of tokens the document
+   needs, whether or not they fit in max_tokens. */
+static int sgvp_json_parse(char* json_str, int json_str_len,
+                           sgv_json_token* tokens, int max_tokens,
+                           int flags, int* n_tokens)
+{
+    sgvp_json_builder b;
+    sgv_json_token* t;
+    int i, r, type;
+
+    b.tokens = tokens;
+    b.max_tokens = max_tokens;
+    b.n = 0;
+    b.state = SGVP_ST_VALUE;
+    b.depth = 0;
+
+    if((flags & SGV_JSON_PARSE_UTF8) && sgvp_json_utf8(json_str, json_str_len)) {
+        SGV_JSON_LOG(("sgv_json: bad UTF-8\n"));
+        return SGV_JSON_ERROR_INVALID;
+    }
+
+#ifdef SGVP_JSON_HAVE_SIMD
+    if(flags & SGV_JSON_PARSE_SIMD) {
+        r = sgvp_json_lex_simd(&b, json_str, json_str_len);
+    } else
+#endif
+    {
+        r = sgvp_json_lex(&b, json_str, json_str_len);
+    }
+    if(r < 0) {
+        return r;
+    }
+
+    *n_tokens = b.n;
+    if(b.state != SGVP_ST_DONE) {
+        SGV_JSON_LOG(("sgv_json: unexpected end of input\n"));
+        return SGV_JSON_ERROR_INVALID;
+    }
+
+    if((flags & SGV_JSON_PARSE_UNESCAPE) && b.n <= max_tokens) {
+        for(i = 0; i < b.n; i++) {
+            t = tokens + i;
+            type = t->tag & SGVP_JSON_TYPE;
+            if(type == SGV_JSON_TOKEN_KEY || type == SGV_JSON_TOKEN_VAL_STR) {
+                r = sgvp_json_unescape((char*)t + t->u.str, t->len);
+                /* every escape is longer than what it stands for */
+                if(r != t->len) {
+                    t->len = r;
+                    t->tag |= SGVP_JSON_UNESC;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+SGVJSON_DEF int sgv_json_parse_ex(char* json_str,
+                                  int json_str_len,
+                                  sgv_json_token* tokens,
+                                  int max_tokens,
+                                  int flags)
+{
+    int n, r;
+    r = sgvp_json_parse(json_str, json_str_len, tokens, max_tokens, flags, &n);
+    if(r) {
+        return r;
+    }
+    return (n > max_tokens) ? n : 0;
 }
 
 SGVJSON_DEF int sgv_json_parse(char* json_str,
@@ -191,12 +1471,3060 @@ SGVJSON_DEF int sgv_json_parse(char* json_str,
                                sgv_json_token* tokens,
                                int max_tokens)
 {
-    json_str = json_str;
-    json_str_len = json_str_len;
-    tokens = tokens;
-    max_tokens = max_tokens;
-    SGV_JSON_LOG(("Debug test %d\n", max_tokens));
+    return sgv_json_parse_ex(json_str, json_str_len, tokens, max_tokens, 0);
+}
+
+SGVJSON_DEF sgv_json_token_type sgv_json_type(sgv_json_token* token)
+{
+    return (sgv_json_token_type)(token->tag & SGVP_JSON_TYPE);
+}
+
+static int sgvp_json_is(sgv_json_token* t, sgv_json_token_type type)
+{
+    return t && (t->tag & SGVP_JSON_TYPE) == (int)type;
+}
+
+static char* sgvp_json_str(sgv_json_token* t)
+{
+    return (char*)t + t->u.str;
+}
+
+static sgv_json_token* sgvp_json_first(sgv_json_token* t,
+                                       sgv_json_token_type type)
+{
+    return (sgvp_json_is(t, type) && t->len > 1) ? t + 1 : SGVP_JSON_NULL;
+}
+
+static sgv_json_token* sgvp_json_sibling(sgv_json_token* t,
+                                         sgv_json_token_type type)
+{
+    return (sgvp_json_is(t, type) && (t->tag & SGVP_JSON_NEXT)) ?
+           t + t->len : SGVP_JSON_NULL;
+}
+
+SGVJSON_DEF sgv_json_token* sgv_json_first_pair(sgv_json_token* obj)
+{
+    return sgvp_json_first(obj, SGV_JSON_TOKEN_OBJ);
+}
+
+SGVJSON_DEF sgv_json_token* sgv_json_next_pair(sgv_json_token* current_pair)
+{
+    return sgvp_json_sibling(current_pair, SGV_JSON_TOKEN_PAIR);
+}
+
+SGVJSON_DEF sgv_json_token* sgv_json_first_element(sgv_json_token* arr)
+{
+    return sgvp_json_first(arr, SGV_JSON_TOKEN_ARR);
+}
+
+SGVJSON_DEF sgv_json_token* sgv_json_next_element(sgv_json_token* arr)
+{
+    return sgvp_json_sibling(arr, SGV_JSON_TOKEN_ELEMENT);
+}
+
+SGVJSON_DEF sgv_json_token* sgv_json_pair_key(sgv_json_token* pair)
+{
+    return sgvp_json_is(pair, SGV_JSON_TOKEN_PAIR) ? pair + 1 : SGVP_JSON_NULL;
+}
+
+SGVJSON_DEF sgv_json_token* sgv_json_pair_value(sgv_json_token* pair)
+{
+    return sgvp_json_is(pair, SGV_JSON_TOKEN_PAIR) ? pair + 2 : SGVP_JSON_NULL;
+}
+
+SGVJSON_DEF sgv_json_token* sgv_json_element_value(sgv_json_token* element)
+{
+    return sgvp_json_is(element, SGV_JSON_TOKEN_ELEMENT) ?
+           element + 1 : SGVP_JSON_NULL;
+}
+
+static int sgvp_json_memeq(const char* a, const char* b, int len)
+{
+    int i;
+    for(i = 0; i < len; i++) {
+        if(a[i] != b[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Compares the (raw) string of a token with a NUL terminated key */
+static int sgvp_json_streq(const char* s, int len, const char* key)
+{
+    int i;
+    for(i = 0; i < len; i++) {
+        if(s[i] != key[i]) {
+            return 0;
+        }
+    }
+    return key[len] == '\0';
+}
+
+SGVJSON_DEF sgv_json_token* sgv_json_obj_value(sgv_json_token* obj, char* key)
+{
+    sgv_json_token* pair = sgv_json_first_pair(obj);
+    while(pair) {
+        if(sgvp_json_streq(sgvp_json_str(pair + 1), pair[1].len, key)) {
+            return pair + 2;
+        }
+        if(!(pair->tag & SGVP_JSON_NEXT)) {
+            break;
+        }
+        pair += pair->len;
+    }
+    return SGVP_JSON_NULL;
+}
+
+SGVJSON_DEF sgv_json_token* sgv_json_arr_value(sgv_json_token* arr, int idx)
+{
+    sgv_json_token* el = sgv_json_first_element(arr);
+    for(; el && idx > 0; idx--) {
+        el = (el->tag & SGVP_JSON_NEXT) ? el + el->len : SGVP_JSON_NULL;
+    }
+    return (el && idx == 0) ? el + 1 : SGVP_JSON_NULL;
+}
+
+SGVJSON_DEF int sgv_json_key_string(sgv_json_token* pair_key,
+                                    char **str, int *str_len)
+{
+    if(!sgvp_json_is(pair_key, SGV_JSON_TOKEN_KEY)) {
+        return -1;
+    }
+    *str = sgvp_json_str(pair_key);
+    *str_len = pair_key->len;
     return 0;
 }
 
+SGVJSON_DEF sgv_json_token* sgv_json_value_obj(sgv_json_token* value)
+{
+    return sgvp_json_is(value, SGV_JSON_TOKEN_OBJ) ? value : SGVP_JSON_NULL;
+}
+
+SGVJSON_DEF sgv_json_token* sgv_json_value_array(sgv_json_token* value)
+{
+    return sgvp_json_is(value, SGV_JSON_TOKEN_ARR) ? value : SGVP_JSON_NULL;
+}
+
+SGVJSON_DEF int sgv_json_value_string(sgv_json_token* value,
+                                      char **str, int *str_len)
+{
+    if(!sgvp_json_is(value, SGV_JSON_TOKEN_VAL_STR)) {
+        return -1;
+    }
+    *str = sgvp_json_str(value);
+    *str_len = value->len;
+    return 0;
+}
+
+/* Numbers are decoded on first access. The Eisel-Lemire algorithm gives
+   the correctly rounded double off one 64x64 bit multiplication by a
+   normalized power of 5 in the common case; when the truncated power of 5
+   leaves the result ambiguous, a slow but exact decimal conversion takes
+   over. */
+
+/* floor(5^q * 2^s) in [2^63, 2^64) for q in [-342, 308], high/low 32 bits */
+static const unsigned int sgvp_json_pow5[651*2] = {
+    0xeef453d6u,0x923bd65au, 0x9558b466u,0x1b6565f8u, 0xbaaee17fu,0xa23ebf76u,
+    0xe95a99dfu,0x8ace6f53u, 0x91d8a02bu,0xb6c10594u, 0xb64ec836u,0xa47146f9u,
+    0xe3e27a44u,0x4d8d98b7u, 0x8e6d8c6au,0xb0787f72u, 0xb208ef85u,0x5c969f4fu,
+    0xde8b2b66u,0xb3bc4723u, 0x8b16fb20u,0x3055ac76u, 0xaddcb9e8u,0x3c6b1793u,
+    0xd953e862u,0x4b85dd78u, 0x87d4713du,0x6f33aa6bu, 0xa9c98d8cu,0xcb009506u,
+    0xd43bf0efu,0xfdc0ba48u, 0x84a57695u,0xfe98746du, 0xa5ced43bu,0x7e3e9188u,
+    0xcf42894au,0x5dce35eau, 0x818995ceu,0x7aa0e1b2u, 0xa1ebfb42u,0x19491a1fu,
+    0xca66fa12u,0x9f9b60a6u, 0xfd00b897u,0x478238d0u, 0x9e20735eu,0x8cb16382u,
+    0xc5a89036u,0x2fddbc62u, 0xf712b443u,0xbbd52b7bu, 0x9a6bb0aau,0x55653b2du,
+    0xc1069cd4u,0xeabe89f8u, 0xf148440au,0x256e2c76u, 0x96cd2a86u,0x5764dbcau,
+    0xbc807527u,0xed3e12bcu, 0xeba09271u,0xe88d976bu, 0x93445b87u,0x31587ea3u,
+    0xb8157268u,0xfdae9e4cu, 0xe61acf03u,0x3d1a45dfu, 0x8fd0c162u,0x06306babu,
+    0xb3c4f1bau,0x87bc8696u, 0xe0b62e29u,0x29aba83cu, 0x8c71dcd9u,0xba0b4925u,
+    0xaf8e5410u,0x288e1b6fu, 0xdb71e914u,0x32b1a24au, 0x892731acu,0x9faf056eu,
+    0xab70fe17u,0xc79ac6cau, 0xd64d3d9du,0xb981787du, 0x85f04682u,0x93f0eb4eu,
+    0xa76c5823u,0x38ed2621u, 0xd1476e2cu,0x07286faau, 0x82cca4dbu,0x847945cau,
+    0xa37fce12u,0x6597973cu, 0xcc5fc196u,0xfefd7d0cu, 0xff77b1fcu,0xbebcdc4fu,
+    0x9faacf3du,0xf73609b1u, 0xc795830du,0x75038c1du, 0xf97ae3d0u,0xd2446f25u,
+    0x9becce62u,0x836ac577u, 0xc2e801fbu,0x244576d5u, 0xf3a20279u,0xed56d48au,
+    0x9845418cu,0x345644d6u, 0xbe5691efu,0x416bd60cu, 0xedec366bu,0x11c6cb8fu,
+    0x94b3a202u,0xeb1c3f39u, 0xb9e08a83u,0xa5e34f07u, 0xe858ad24u,0x8f5c22c9u,
+    0x91376c36u,0xd99995beu, 0xb5854744u,0x8ffffb2du, 0xe2e69915u,0xb3fff9f9u,
+    0x8dd01fadu,0x907ffc3bu, 0xb1442798u,0xf49ffb4au, 0xdd95317fu,0x31c7fa1du,
+    0x8a7d3eefu,0x7f1cfc52u, 0xad1c8eabu,0x5ee43b66u, 0xd863b256u,0x369d4a40u,
+    0x873e4f75u,0xe2224e68u, 0xa90de353u,0x5aaae202u, 0xd3515c28u,0x31559a83u,
+    0x8412d999u,0x1ed58091u, 0xa5178fffu,0x668ae0b6u, 0xce5d73ffu,0x402d98e3u,
+    0x80fa687fu,0x881c7f8eu, 0xa139029fu,0x6a239f72u, 0xc9874347u,0x44ac874eu,
+    0xfbe91419u,0x15d7a922u, 0x9d71ac8fu,0xada6c9b5u, 0xc4ce17b3u,0x99107c22u,
+    0xf6019da0u,0x7f549b2bu, 0x99c10284u,0x4f94e0fbu, 0xc0314325u,0x637a1939u,
+    0xf03d93eeu,0xbc589f88u, 0x96267c75u,0x35b763b5u, 0xbbb01b92u,0x83253ca2u,
+    0xea9c2277u,0x23ee8bcbu, 0x92a1958au,0x7675175fu, 0xb749faedu,0x14125d36u,
+    0xe51c79a8u,0x5916f484u, 0x8f31cc09u,0x37ae58d2u, 0xb2fe3f0bu,0x8599ef07u,
+    0xdfbdceceu,0x67006ac9u, 0x8bd6a141u,0x006042bdu, 0xaecc4991u,0x4078536du,
+    0xda7f5bf5u,0x90966848u, 0x888f9979u,0x7a5e012du, 0xaab37fd7u,0xd8f58178u,
+    0xd5605fcdu,0xcf32e1d6u, 0x855c3be0u,0xa17fcd26u, 0xa6b34ad8u,0xc9dfc06fu,
+    0xd0601d8eu,0xfc57b08bu, 0x823c1279u,0x5db6ce57u, 0xa2cb1717u,0xb52481edu,
+    0xcb7ddcddu,0xa26da268u, 0xfe5d5415u,0x0b090b02u, 0x9efa548du,0x26e5a6e1u,
+    0xc6b8e9b0u,0x709f109au, 0xf867241cu,0x8cc6d4c0u, 0x9b407691u,0xd7fc44f8u,
+    0xc2109436u,0x4dfb5636u, 0xf294b943u,0xe17a2bc4u, 0x979cf3cau,0x6cec5b5au,
+    0xbd8430bdu,0x08277231u, 0xece53cecu,0x4a314ebdu, 0x940f4613u,0xae5ed136u,
+    0xb9131798u,0x99f68584u, 0xe757dd7eu,0xc07426e5u, 0x9096ea6fu,0x3848984fu,
+    0xb4bca50bu,0x065abe63u, 0xe1ebce4du,0xc7f16dfbu, 0x8d3360f0u,0x9cf6e4bdu,
+    0xb080392cu,0xc4349decu, 0xdca04777u,0xf541c567u, 0x89e42caau,0xf9491b60u,
+    0xac5d37d5u,0xb79b6239u, 0xd77485cbu,0x25823ac7u, 0x86a8d39eu,0xf77164bcu,
+    0xa8530886u,0xb54dbdebu, 0xd267caa8u,0x62a12d66u, 0x8380dea9u,0x3da4bc60u,
+    0xa4611653u,0x8d0deb78u, 0xcd795be8u,0x70516656u, 0x806bd971u,0x4632dff6u,
+    0xa086cfcdu,0x97bf97f3u, 0xc8a883c0u,0xfdaf7df0u, 0xfad2a4b1u,0x3d1b5d6cu,
+    0x9cc3a6eeu,0xc6311a63u, 0xc3f490aau,0x77bd60fcu, 0xf4f1b4d5u,0x15acb93bu,
+    0x99171105u,0x2d8bf3c5u, 0xbf5cd546u,0x78eef0b6u, 0xef340a98u,0x172aace4u,
+    0x9580869fu,0x0e7aac0eu, 0xbae0a846u,0xd2195712u, 0xe998d258u,0x869facd7u,
+    0x91ff8377u,0x5423cc06u, 0xb67f6455u,0x292cbf08u, 0xe41f3d6au,0x7377eecau,
+    0x8e938662u,0x882af53eu, 0xb23867fbu,0x2a35b28du, 0xdec681f9u,0xf4c31f31u,
+    0x8b3c113cu,0x38f9f37eu, 0xae0b158bu,0x4738705eu, 0xd98ddaeeu,0x19068c76u,
+    0x87f8a8d4u,0xcfa417c9u, 0xa9f6d30au,0x038d1dbcu, 0xd47487ccu,0x8470652bu,
+    0x84c8d4dfu,0xd2c63f3bu, 0xa5fb0a17u,0xc777cf09u, 0xcf79cc9du,0xb955c2ccu,
+    0x81ac1fe2u,0x93d599bfu, 0xa21727dbu,0x38cb002fu, 0xca9cf1d2u,0x06fdc03bu,
+    0xfd442e46u,0x88bd304au, 0x9e4a9cecu,0x15763e2eu, 0xc5dd4427u,0x1ad3cdbau,
+    0xf7549530u,0xe188c128u, 0x9a94dd3eu,0x8cf578b9u, 0xc13a148eu,0x3032d6e7u,
+    0xf18899b1u,0xbc3f8ca1u, 0x96f5600fu,0x15a7b7e5u, 0xbcb2b812u,0xdb11a5deu,
+    0xebdf6617u,0x91d60f56u, 0x936b9fceu,0xbb25c995u, 0xb84687c2u,0x69ef3bfbu,
+    0xe65829b3u,0x046b0afau, 0x8ff71a0fu,0xe2c2e6dcu, 0xb3f4e093u,0xdb73a093u,
+    0xe0f218b8u,0xd25088b8u, 0x8c974f73u,0x83725573u, 0xafbd2350u,0x644eeacfu,
+    0xdbac6c24u,0x7d62a583u, 0x894bc396u,0xce5da772u, 0xab9eb47cu,0x81f5114fu,
+    0xd686619bu,0xa27255a2u, 0x8613fd01u,0x45877585u, 0xa798fc41u,0x96e952e7u,
+    0xd17f3b51u,0xfca3a7a0u, 0x82ef8513u,0x3de648c4u, 0xa3ab6658u,0x0d5fdaf5u,
+    0xcc963feeu,0x10b7d1b3u, 0xffbbcfe9u,0x94e5c61fu, 0x9fd561f1u,0xfd0f9bd3u,
+    0xc7caba6eu,0x7c5382c8u, 0xf9bd690au,0x1b68637bu, 0x9c1661a6u,0x51213e2du,
+    0xc31bfa0fu,0xe5698db8u, 0xf3e2f893u,0xdec3f126u, 0x986ddb5cu,0x6b3a76b7u,
+    0xbe895233u,0x86091465u, 0xee2ba6c0u,0x678b597fu, 0x94db4838u,0x40b717efu,
+    0xba121a46u,0x50e4ddebu, 0xe896a0d7u,0xe51e1566u, 0x915e2486u,0xef32cd60u,
+    0xb5b5ada8u,0xaaff80b8u, 0xe3231912u,0xd5bf60e6u, 0x8df5efabu,0xc5979c8fu,
+    0xb1736b96u,0xb6fd83b3u, 0xddd0467cu,0x64bce4a0u, 0x8aa22c0du,0xbef60ee4u,
+    0xad4ab711u,0x2eb3929du, 0xd89d64d5u,0x7a607744u, 0x87625f05u,0x6c7c4a8bu,
+    0xa93af6c6u,0xc79b5d2du, 0xd389b478u,0x79823479u, 0x843610cbu,0x4bf160cbu,
+    0xa54394feu,0x1eedb8feu, 0xce947a3du,0xa6a9273eu, 0x811ccc66u,0x8829b887u,
+    0xa163ff80u,0x2a3426a8u, 0xc9bcff60u,0x34c13052u, 0xfc2c3f38u,0x41f17c67u,
+    0x9d9ba783u,0x2936edc0u, 0xc5029163u,0xf384a931u, 0xf64335bcu,0xf065d37du,
+    0x99ea0196u,0x163fa42eu, 0xc06481fbu,0x9bcf8d39u, 0xf07da27au,0x82c37088u,
+    0x964e858cu,0x91ba2655u, 0xbbe226efu,0xb628afeau, 0xeadab0abu,0xa3b2dbe5u,
+    0x92c8ae6bu,0x464fc96fu, 0xb77ada06u,0x17e3bbcbu, 0xe5599087u,0x9ddcaabdu,
+    0x8f57fa54u,0xc2a9eab6u, 0xb32df8e9u,0xf3546564u, 0xdff97724u,0x70297ebdu,
+    0x8bfbea76u,0xc619ef36u, 0xaefae514u,0x77a06b03u, 0xdab99e59u,0x958885c4u,
+    0x88b402f7u,0xfd75539bu, 0xaae103b5u,0xfcd2a881u, 0xd59944a3u,0x7c0752a2u,
+    0x857fcae6u,0x2d8493a5u, 0xa6dfbd9fu,0xb8e5b88eu, 0xd097ad07u,0xa71f26b2u,
+    0x825ecc24u,0xc873782fu, 0xa2f67f2du,0xfa90563bu, 0xcbb41ef9u,0x79346bcau,
+    0xfea126b7u,0xd78186bcu, 0x9f24b832u,0xe6b0f436u, 0xc6ede63fu,0xa05d3143u,
+    0xf8a95fcfu,0x88747d94u, 0x9b69dbe1u,0xb548ce7cu, 0xc24452dau,0x229b021bu,
+    0xf2d56790u,0xab41c2a2u, 0x97c560bau,0x6b0919a5u, 0xbdb6b8e9u,0x05cb600fu,
+    0xed246723u,0x473e3813u, 0x9436c076u,0x0c86e30bu, 0xb9447093u,0x8fa89bceu,
+    0xe7958cb8u,0x7392c2c2u, 0x90bd77f3u,0x483bb9b9u, 0xb4ecd5f0u,0x1a4aa828u,
+    0xe2280b6cu,0x20dd5232u, 0x8d590723u,0x948a535fu, 0xb0af48ecu,0x79ace837u,
+    0xdcdb1b27u,0x98182244u, 0x8a08f0f8u,0xbf0f156bu, 0xac8b2d36u,0xeed2dac5u,
+    0xd7adf884u,0xaa879177u, 0x86ccbb52u,0xea94baeau, 0xa87fea27u,0xa539e9a5u,
+    0xd29fe4b1u,0x8e88640eu, 0x83a3eeeeu,0xf9153e89u, 0xa48ceaaau,0xb75a8e2bu,
+    0xcdb02555u,0x653131b6u, 0x808e1755u,0x5f3ebf11u, 0xa0b19d2au,0xb70e6ed6u,
+    0xc8de0475u,0x64d20a8bu, 0xfb158592u,0xbe068d2eu, 0x9ced737bu,0xb6c4183du,
+    0xc428d05au,0xa4751e4cu, 0xf5330471u,0x4d9265dfu, 0x993fe2c6u,0xd07b7fabu,
+    0xbf8fdb78u,0x849a5f96u, 0xef73d256u,0xa5c0f77cu, 0x95a86376u,0x27989aadu,
+    0xbb127c53u,0xb17ec159u, 0xe9d71b68u,0x9dde71afu, 0x92267121u,0x62ab070du,
+    0xb6b00d69u,0xbb55c8d1u, 0xe45c10c4u,0x2a2b3b05u, 0x8eb98a7au,0x9a5b04e3u,
+    0xb267ed19u,0x40f1c61cu, 0xdf01e85fu,0x912e37a3u, 0x8b61313bu,0xbabce2c6u,
+    0xae397d8au,0xa96c1b77u, 0xd9c7dcedu,0x53c72255u, 0x881cea14u,0x545c7575u,
+    0xaa242499u,0x697392d2u, 0xd4ad2dbfu,0xc3d07787u, 0x84ec3c97u,0xda624ab4u,
+    0xa6274bbdu,0xd0fadd61u, 0xcfb11eadu,0x453994bau, 0x81ceb32cu,0x4b43fcf4u,
+    0xa2425ff7u,0x5e14fc31u, 0xcad2f7f5u,0x359a3b3eu, 0xfd87b5f2u,0x8300ca0du,
+    0x9e74d1b7u,0x91e07e48u, 0xc6120625u,0x76589ddau, 0xf79687aeu,0xd3eec551u,
+    0x9abe14cdu,0x44753b52u, 0xc16d9a00u,0x95928a27u, 0xf1c90080u,0xbaf72cb1u,
+    0x971da050u,0x74da7beeu, 0xbce50864u,0x92111aeau, 0xec1e4a7du,0xb69561a5u,
+    0x9392ee8eu,0x921d5d07u, 0xb877aa32u,0x36a4b449u, 0xe69594beu,0xc44de15bu,
+    0x901d7cf7u,0x3ab0acd9u, 0xb424dc35u,0x095cd80fu, 0xe12e1342u,0x4bb40e13u,
+    0x8cbccc09u,0x6f5088cbu, 0xafebff0bu,0xcb24aafeu, 0xdbe6feceu,0xbdedd5beu,
+    0x89705f41u,0x36b4a597u, 0xabcc7711u,0x8461cefcu, 0xd6bf94d5u,0xe57a42bcu,
+    0x8637bd05u,0xaf6c69b5u, 0xa7c5ac47u,0x1b478423u, 0xd1b71758u,0xe219652bu,
+    0x83126e97u,0x8d4fdf3bu, 0xa3d70a3du,0x70a3d70au, 0xccccccccu,0xccccccccu,
+    0x80000000u,0x00000000u, 0xa0000000u,0x00000000u, 0xc8000000u,0x00000000u,
+    0xfa000000u,0x00000000u, 0x9c400000u,0x00000000u, 0xc3500000u,0x00000000u,
+    0xf4240000u,0x00000000u, 0x98968000u,0x00000000u, 0xbebc2000u,0x00000000u,
+    0xee6b2800u,0x00000000u, 0x9502f900u,0x00000000u, 0xba43b740u,0x00000000u,
+    0xe8d4a510u,0x00000000u, 0x9184e72au,0x00000000u, 0xb5e620f4u,0x80000000u,
+    0xe35fa931u,0xa0000000u, 0x8e1bc9bfu,0x04000000u, 0xb1a2bc2eu,0xc5000000u,
+    0xde0b6b3au,0x76400000u, 0x8ac72304u,0x89e80000u, 0xad78ebc5u,0xac620000u,
+    0xd8d726b7u,0x177a8000u, 0x87867832u,0x6eac9000u, 0xa968163fu,0x0a57b400u,
+    0xd3c21bceu,0xcceda100u, 0x84595161u,0x401484a0u, 0xa56fa5b9u,0x9019a5c8u,
+    0xcecb8f27u,0xf4200f3au, 0x813f3978u,0xf8940984u, 0xa18f07d7u,0x36b90be5u,
+    0xc9f2c9cdu,0x04674edeu, 0xfc6f7c40u,0x45812296u, 0x9dc5ada8u,0x2b70b59du,
+    0xc5371912u,0x364ce305u, 0xf684df56u,0xc3e01bc6u, 0x9a130b96u,0x3a6c115cu,
+    0xc097ce7bu,0xc90715b3u, 0xf0bdc21au,0xbb48db20u, 0x96769950u,0xb50d88f4u,
+    0xbc143fa4u,0xe250eb31u, 0xeb194f8eu,0x1ae525fdu, 0x92efd1b8u,0xd0cf37beu,
+    0xb7abc627u,0x050305adu, 0xe596b7b0u,0xc643c719u, 0x8f7e32ceu,0x7bea5c6fu,
+    0xb35dbf82u,0x1ae4f38bu, 0xe0352f62u,0xa19e306eu, 0x8c213d9du,0xa502de45u,
+    0xaf298d05u,0x0e4395d6u, 0xdaf3f046u,0x51d47b4cu, 0x88d8762bu,0xf324cd0fu,
+    0xab0e93b6u,0xefee0053u, 0xd5d238a4u,0xabe98068u, 0x85a36366u,0xeb71f041u,
+    0xa70c3c40u,0xa64e6c51u, 0xd0cf4b50u,0xcfe20765u, 0x82818f12u,0x81ed449fu,
+    0xa321f2d7u,0x226895c7u, 0xcbea6f8cu,0xeb02bb39u, 0xfee50b70u,0x25c36a08u,
+    0x9f4f2726u,0x179a2245u, 0xc722f0efu,0x9d80aad6u, 0xf8ebad2bu,0x84e0d58bu,
+    0x9b934c3bu,0x330c8577u, 0xc2781f49u,0xffcfa6d5u, 0xf316271cu,0x7fc3908au,
+    0x97edd871u,0xcfda3a56u, 0xbde94e8eu,0x43d0c8ecu, 0xed63a231u,0xd4c4fb27u,
+    0x945e455fu,0x24fb1cf8u, 0xb975d6b6u,0xee39e436u, 0xe7d34c64u,0xa9c85d44u,
+    0x90e40fbeu,0xea1d3a4au, 0xb51d13aeu,0xa4a488ddu, 0xe264589au,0x4dcdab14u,
+    0x8d7eb760u,0x70a08aecu, 0xb0de6538u,0x8cc8ada8u, 0xdd15fe86u,0xaffad912u,
+    0x8a2dbf14u,0x2dfcc7abu, 0xacb92ed9u,0x397bf996u, 0xd7e77a8fu,0x87daf7fbu,
+    0x86f0ac99u,0xb4e8dafdu, 0xa8acd7c0u,0x222311bcu, 0xd2d80db0u,0x2aabd62bu,
+    0x83c7088eu,0x1aab65dbu, 0xa4b8cab1u,0xa1563f52u, 0xcde6fd5eu,0x09abcf26u,
+    0x80b05e5au,0xc60b6178u, 0xa0dc75f1u,0x778e39d6u, 0xc913936du,0xd571c84cu,
+    0xfb587849u,0x4ace3a5fu, 0x9d174b2du,0xcec0e47bu, 0xc45d1df9u,0x42711d9au,
+    0xf5746577u,0x930d6500u, 0x9968bf6au,0xbbe85f20u, 0xbfc2ef45u,0x6ae276e8u,
+    0xefb3ab16u,0xc59b14a2u, 0x95d04aeeu,0x3b80ece5u, 0xbb445da9u,0xca61281fu,
+    0xea157514u,0x3cf97226u, 0x924d692cu,0xa61be758u, 0xb6e0c377u,0xcfa2e12eu,
+    0xe498f455u,0xc38b997au, 0x8edf98b5u,0x9a373fecu, 0xb2977ee3u,0x00c50fe7u,
+    0xdf3d5e9bu,0xc0f653e1u, 0x8b865b21u,0x5899f46cu, 0xae67f1e9u,0xaec07187u,
+    0xda01ee64u,0x1a708de9u, 0x884134feu,0x908658b2u, 0xaa51823eu,0x34a7eedeu,
+    0xd4e5e2cdu,0xc1d1ea96u, 0x850fadc0u,0x9923329eu, 0xa6539930u,0xbf6bff45u,
+    0xcfe87f7cu,0xef46ff16u, 0x81f14faeu,0x158c5f6eu, 0xa26da399u,0x9aef7749u,
+    0xcb090c80u,0x01ab551cu, 0xfdcb4fa0u,0x02162a63u, 0x9e9f11c4u,0x014dda7eu,
+    0xc646d635u,0x01a1511du, 0xf7d88bc2u,0x4209a565u, 0x9ae75759u,0x6946075fu,
+    0xc1a12d2fu,0xc3978937u, 0xf209787bu,0xb47d6b84u, 0x9745eb4du,0x50ce6332u,
+    0xbd176620u,0xa501fbffu, 0xec5d3fa8u,0xce427affu, 0x93ba47c9u,0x80e98cdfu,
+    0xb8a8d9bbu,0xe123f017u, 0xe6d3102au,0xd96cec1du, 0x9043ea1au,0xc7e41392u,
+    0xb454e4a1u,0x79dd1877u, 0xe16a1dc9u,0xd8545e94u, 0x8ce2529eu,0x2734bb1du,
+    0xb01ae745u,0xb101e9e4u, 0xdc21a117u,0x1d42645du, 0x899504aeu,0x72497ebau,
+    0xabfa45dau,0x0edbde69u, 0xd6f8d750u,0x9292d603u, 0x865b8692u,0x5b9bc5c2u,
+    0xa7f26836u,0xf282b732u, 0xd1ef0244u,0xaf2364ffu, 0x8335616au,0xed761f1fu,
+    0xa402b9c5u,0xa8d3a6e7u, 0xcd036837u,0x130890a1u, 0x80222122u,0x6be55a64u,
+    0xa02aa96bu,0x06deb0fdu, 0xc83553c5u,0xc8965d3du, 0xfa42a8b7u,0x3abbf48cu,
+    0x9c69a972u,0x84b578d7u, 0xc38413cfu,0x25e2d70du, 0xf46518c2u,0xef5b8cd1u,
+    0x98bf2f79u,0xd5993802u, 0xbeeefb58u,0x4aff8603u, 0xeeaaba2eu,0x5dbf6784u,
+    0x952ab45cu,0xfa97a0b2u, 0xba756174u,0x393d88dfu, 0xe912b9d1u,0x478ceb17u,
+    0x91abb422u,0xccb812eeu, 0xb616a12bu,0x7fe617aau, 0xe39c4976u,0x5fdf9d94u,
+    0x8e41ade9u,0xfbebc27du, 0xb1d21964u,0x7ae6b31cu, 0xde469fbdu,0x99a05fe3u,
+    0x8aec23d6u,0x80043beeu, 0xada72cccu,0x20054ae9u, 0xd910f7ffu,0x28069da4u,
+    0x87aa9affu,0x79042286u, 0xa99541bfu,0x57452b28u, 0xd3fa922fu,0x2d1675f2u,
+    0x847c9b5du,0x7c2e09b7u, 0xa59bc234u,0xdb398c25u, 0xcf02b2c2u,0x1207ef2eu,
+    0x8161afb9u,0x4b44f57du, 0xa1ba1ba7u,0x9e1632dcu, 0xca28a291u,0x859bbf93u,
+    0xfcb2cb35u,0xe702af78u, 0x9defbf01u,0xb061adabu, 0xc56baec2u,0x1c7a1916u,
+    0xf6c69a72u,0xa3989f5bu, 0x9a3c2087u,0xa63f6399u, 0xc0cb28a9u,0x8fcf3c7fu,
+    0xf0fdf2d3u,0xf3c30b9fu, 0x969eb7c4u,0x7859e743u, 0xbc4665b5u,0x96706114u,
+    0xeb57ff22u,0xfc0c7959u, 0x9316ff75u,0xdd87cbd8u, 0xb7dcbf53u,0x54e9beceu,
+    0xe5d3ef28u,0x2a242e81u, 0x8fa47579u,0x1a569d10u, 0xb38d92d7u,0x60ec4455u,
+    0xe070f78du,0x3927556au, 0x8c469ab8u,0x43b89562u, 0xaf584166u,0x54a6babbu,
+    0xdb2e51bfu,0xe9d0696au, 0x88fcf317u,0xf22241e2u, 0xab3c2fddu,0xeeaad25au,
+    0xd60b3bd5u,0x6a5586f1u, 0x85c70565u,0x62757456u, 0xa738c6beu,0xbb12d16cu,
+    0xd106f86eu,0x69d785c7u, 0x82a45b45u,0x0226b39cu, 0xa34d7216u,0x42b06084u,
+    0xcc20ce9bu,0xd35c78a5u, 0xff290242u,0xc83396ceu, 0x9f79a169u,0xbd203e41u,
+    0xc75809c4u,0x2c684dd1u, 0xf92e0c35u,0x37826145u, 0x9bbcc7a1u,0x42b17ccbu,
+    0xc2abf989u,0x935ddbfeu, 0xf356f7ebu,0xf83552feu, 0x98165af3u,0x7b2153deu,
+    0xbe1bf1b0u,0x59e9a8d6u, 0xeda2ee1cu,0x7064130cu, 0x9485d4d1u,0xc63e8be7u,
+    0xb9a74a06u,0x37ce2ee1u, 0xe8111c87u,0xc5c1ba99u, 0x910ab1d4u,0xdb9914a0u,
+    0xb54d5e4au,0x127f59c8u, 0xe2a0b5dcu,0x971f303au, 0x8da471a9u,0xde737e24u,
+    0xb10d8e14u,0x56105dadu, 0xdd50f199u,0x6b947518u, 0x8a5296ffu,0xe33cc92fu,
+    0xace73cbfu,0xdc0bfb7bu, 0xd8210befu,0xd30efa5au, 0x8714a775u,0xe3e95c78u,
+    0xa8d9d153u,0x5ce3b396u, 0xd31045a8u,0x341ca07cu, 0x83ea2b89u,0x2091e44du,
+    0xa4e4b66bu,0x68b65d60u, 0xce1de406u,0x42e3f4b9u, 0x80d2ae83u,0xe9ce78f3u,
+    0xa1075a24u,0xe4421730u, 0xc94930aeu,0x1d529cfcu, 0xfb9b7cd9u,0xa4a7443cu,
+    0x9d412e08u,0x06e88aa5u, 0xc491798au,0x08a2ad4eu, 0xf5b5d7ecu,0x8acb58a2u,
+    0x9991a6f3u,0xd6bf1765u, 0xbff610b0u,0xcc6edd3fu, 0xeff394dcu,0xff8a948eu,
+    0x95f83d0au,0x1fb69cd9u, 0xbb764c4cu,0xa7a4440fu, 0xea53df5fu,0xd18d5513u,
+    0x92746b9bu,0xe2f8552cu, 0xb7118682u,0xdbb66a77u, 0xe4d5e823u,0x92a40515u,
+    0x8f05b116u,0x3ba6832du, 0xb2c71d5bu,0xca9023f8u, 0xdf78e4b2u,0xbd342cf6u,
+    0x8bab8eefu,0xb6409c1au, 0xae9672abu,0xa3d0c320u, 0xda3c0f56u,0x8cc4f3e8u,
+    0x88658996u,0x17fb1871u, 0xaa7eebfbu,0x9df9de8du, 0xd51ea6fau,0x85785631u,
+    0x8533285cu,0x936b35deu, 0xa67ff273u,0xb8460356u, 0xd01fef10u,0xa657842cu,
+    0x8213f56au,0x67f6b29bu, 0xa298f2c5u,0x01f45f42u, 0xcb3f2f76u,0x42717713u,
+    0xfe0efb53u,0xd30dd4d7u, 0x9ec95d14u,0x63e8a506u, 0xc67bb459u,0x7ce2ce48u,
+    0xf81aa16fu,0xdc1b81dau, 0x9b10a4e5u,0xe9913128u, 0xc1d4ce1fu,0x63f57d72u,
+    0xf24a01a7u,0x3cf2dccfu, 0x976e4108u,0x8617ca01u, 0xbd49d14au,0xa79dbc82u,
+    0xec9c459du,0x51852ba2u, 0x93e1ab82u,0x52f33b45u, 0xb8da1662u,0xe7b00a17u,
+    0xe7109bfbu,0xa19c0c9du, 0x906a617du,0x450187e2u, 0xb484f9dcu,0x9641e9dau,
+    0xe1a63853u,0xbbd26451u, 0x8d07e334u,0x55637eb2u, 0xb049dc01u,0x6abc5e5fu,
+    0xdc5c5301u,0xc56b75f7u, 0x89b9b3e1u,0x1b6329bau, 0xac2820d9u,0x623bf429u,
+    0xd732290fu,0xbacaf133u, 0x867f59a9u,0xd4bed6c0u, 0xa81f3014u,0x49ee8c70u,
+    0xd226fc19u,0x5c6a2f8cu, 0x83585d8fu,0xd9c25db7u, 0xa42e74f3u,0xd032f525u,
+    0xcd3a1230u,0xc43fb26fu, 0x80444b5eu,0x7aa7cf85u, 0xa0555e36u,0x1951c366u,
+    0xc86ab5c3u,0x9fa63440u, 0xfa856334u,0x878fc150u, 0x9c935e00u,0xd4b9d8d2u,
+    0xc3b83581u,0x09e84f07u, 0xf4a642e1u,0x4c6262c8u, 0x98e7e9ccu,0xcfbd7dbdu,
+    0xbf21e440u,0x03acdd2cu, 0xeeea5d50u,0x04981478u, 0x95527a52u,0x02df0ccbu,
+    0xbaa718e6u,0x8396cffdu, 0xe950df20u,0x247c83fdu, 0x91d28b74u,0x16cdd27eu,
+    0xb6472e51u,0x1c81471du, 0xe3d8f9e5u,0x63a198e5u, 0x8e679c2fu,0x5e44ff8fu
+};
+
+#define SGVP_JSON_U64(hi, lo) (((sgv_json_u64)(hi) << 32) | (lo))
+
+/* Returns the high 64 bits of a*b, the low ones in *lo */
+static sgv_json_u64 sgvp_json_mul128(sgv_json_u64 a, sgv_json_u64 b,
+                                     sgv_json_u64* lo)
+{
+#if defined(__SIZEOF_INT128__)
+    __extension__ unsigned __int128 p = (unsigned __int128)a * b;
+    *lo = (sgv_json_u64)p;
+    return (sgv_json_u64)(p >> 64);
+#else
+    sgv_json_u64 m = 0xFFFFFFFFu;
+    sgv_json_u64 p00 = (a & m) * (b & m), p01 = (a & m) * (b >> 32);
+    sgv_json_u64 p10 = (a >> 32) * (b & m), p11 = (a >> 32) * (b >> 32);
+    sgv_json_u64 mid = (p00 >> 32) + (p01 & m) + (p10 & m);
+    *lo = (mid << 32) | (p00 & m);
+    return p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+#endif
+}
+
+static int sgvp_json_clz64(sgv_json_u64 x)
+{
+#if defined(__GNUC__)
+    return __builtin_clzll(x);
+#else
+    int n = 0;
+    while(!(x >> 63)) {
+        x <<= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+/* IEEE double bits of w * 10^q. Returns 0 if the result is ambiguous or
+   subnormal and the slow path has to decide. */
+static int sgvp_json_eisel_lemire(sgv_json_u64 w, int q, sgv_json_u64* bits)
+{
+    sgv_json_u64 t, hi, lo, m;
+    int lz, upper, shift, e;
+
+    if(w == 0 || q < -342) {
+        *bits = 0;
+        return 1;
+    }
+    if(q > 308) {
+        *bits = (sgv_json_u64)0x7FF << 52;
+        return 1;
+    }
+
+    lz = sgvp_json_clz64(w);
+    w <<= lz;
+    t = SGVP_JSON_U64(sgvp_json_pow5[2*(q + 342)], sgvp_json_pow5[2*(q + 342) + 1]);
+    hi = sgvp_json_mul128(w, t, &lo);
+
+    /* The power of 5 is truncated, so the exact product is in
+       [hi:lo, hi:lo + w). A carry into the bits kept below is ambiguous, so
+       is a possible tie that has to round to even. */
+    if((hi & 0x1FF) == 0x1FF && lo + w < lo) {
+        return 0;
+    }
+    upper = (int)(hi >> 63);
+    shift = upper + 9;
+    m = hi >> shift;
+    if(lo == 0 && (hi & 0x1FF) == 0 && (m & 3) == 1) {
+        return 0;
+    }
+
+    /* floor(q * log2(10)) + 1086 - lz + upper */
+    e = (q < 0 ? -((-217706*q + 65535) >> 16) : (217706*q) >> 16) +
+        1086 - lz + upper;
+    if(e <= 0) {
+        return 0;
+    }
+    m = (m + (m & 1)) >> 1;
+    if(m >> 53) {
+        m >>= 1;
+        e++;
+    }
+    if(e >= 0x7FF) {
+        *bits = (sgv_json_u64)0x7FF << 52;
+        return 1;
+    }
+    *bits = (m & (((sgv_json_u64)1 << 52) - 1)) | ((sgv_json_u64)e << 52);
+    return 1;
+}
+
+/* The slow path: the number as a big decimal 0.d[0]d[1]... * 10^dp that
+   is shifted by powers of 2 into [1/2, 1) and then to 53 bits. */
+#define SGVP_JSON_DIGITS 800
+
+typedef struct {
+    int nd, dp, trunc;
+    unsigned char d[SGVP_JSON_DIGITS];
+} sgvp_json_decimal;
+
+static void sgvp_json_dec_trim(sgvp_json_decimal* a)
+{
+    while(a->nd > 0 && a->d[a->nd - 1] == 0) {
+        a->nd--;
+    }
+    if(a->nd == 0) {
+        a->dp = 0;
+    }
+}
+
+/* a *= 2^k, k <= 60 */
+static void sgvp_json_dec_lshift(sgvp_json_decimal* a, int k)
+{
+    unsigned char tmp[SGVP_JSON_DIGITS + 20];
+    sgv_json_u64 n = 0, quo;
+    int r, w = SGVP_JSON_DIGITS + 20, nd;
+
+    for(r = a->nd - 1; r >= 0 || n; r--) {
+        if(r >= 0) {
+            n += (sgv_json_u64)a->d[r] << k;
+        }
+        quo = n / 10;
+        tmp[--w] = (unsigned char)(n - 10*quo);
+        n = quo;
+    }
+    nd = SGVP_JSON_DIGITS + 20 - w;
+    a->dp += nd - a->nd;
+    if(nd > SGVP_JSON_DIGITS) {
+        for(r = SGVP_JSON_DIGITS; r < nd; r++) {
+            a->trunc |= (tmp[w + r] != 0);
+        }
+        nd = SGVP_JSON_DIGITS;
+    }
+    for(r = 0; r < nd; r++) {
+        a->d[r] = tmp[w + r];
+    }
+    a->nd = nd;
+    sgvp_json_dec_trim(a);
+}
+
+/* a /= 2^k, k <= 60 */
+static void sgvp_json_dec_rshift(sgvp_json_decimal* a, int k)
+{
+    sgv_json_u64 n = 0, mask = ((sgv_json_u64)1 << k) - 1;
+    int r = 0, w = 0;
+
+    for(; !(n >> k); r++) {
+        if(r >= a->nd) {
+            if(n == 0) {
+                a->nd = 0;
+                return;
+            }
+            while(!(n >> k)) {
+                n *= 10;
+                r++;
+            }
+            break;
+        }
+        n = n*10 + a->d[r];
+    }
+    a->dp -= r - 1;
+    for(; r < a->nd; r++) {
+        a->d[w++] = (unsigned char)(n >> k);
+        n = (n & mask)*10 + a->d[r];
+    }
+    while(n > 0) {
+        if(w < SGVP_JSON_DIGITS) {
+            a->d[w++] = (unsigned char)(n >> k);
+        } else if(n >> k) {
+            a->trunc = 1;
+        }
+        n = (n & mask)*10;
+    }
+    a->nd = w;
+    sgvp_json_dec_trim(a);
+}
+
+static void sgvp_json_dec_shift(sgvp_json_decimal* a, int k)
+{
+    for(; k > 60; k -= 60) {
+        sgvp_json_dec_lshift(a, 60);
+    }
+    for(; k < -60; k += 60) {
+        sgvp_json_dec_rshift(a, 60);
+    }
+    if(k > 0) {
+        sgvp_json_dec_lshift(a, k);
+    } else if(k < 0) {
+        sgvp_json_dec_rshift(a, -k);
+    }
+}
+
+/* Integer part of a, rounded half to even */
+static sgv_json_u64 sgvp_json_dec_round(sgvp_json_decimal* a)
+{
+    sgv_json_u64 n = 0;
+    int i, up;
+
+    for(i = 0; i < a->dp; i++) {
+        n = n*10 + (i < a->nd ? a->d[i] : 0);
+    }
+    if(a->dp < 0 || a->dp >= a->nd) {
+        return n;
+    }
+    if(a->d[a->dp] == 5 && a->dp + 1 == a->nd) {
+        up = a->trunc || (a->dp > 0 && (a->d[a->dp - 1] & 1));
+    } else {
+        up = a->d[a->dp] >= 5;
+    }
+    return n + up;
+}
+
+static sgv_json_u64 sgvp_json_slow_bits(const char* s, const char* end)
+{
+    static const int powtab[] = {1, 3, 6, 9, 13, 16, 19, 23, 26};
+    sgvp_json_decimal a;
+    sgv_json_u64 m;
+    int e = 0, n, ev = 0, eneg = 0, dot = 0;
+
+    a.nd = a.dp = a.trunc = 0;
+    for(; s < end && (*s == '.' || SGVP_JSON_IS_DIGIT(*s)); s++) {
+        if(*s == '.') {
+            dot = 1;
+            a.dp = a.nd;
+        } else if(*s == '0' && a.nd == 0) {
+            a.dp--;
+        } else if(a.nd < SGVP_JSON_DIGITS) {
+            a.d[a.nd++] = (unsigned char)(*s - '0');
+        } else if(*s != '0') {
+            a.trunc = 1;
+        }
+    }
+    if(!dot) {
+        a.dp = a.nd;
+    }
+    if(s < end) {
+        s++; /* 'e' or 'E' */
+        if(*s == '-' || *s == '+') {
+            eneg = (*s++ == '-');
+        }
+        for(; s < end; s++) {
+            if(ev < 10000) {
+                ev = ev*10 + (*s - '0');
+            }
+        }
+    }
+    a.dp += eneg ? -ev : ev;
+    sgvp_json_dec_trim(&a);
+
+    if(a.nd == 0 || a.dp < -330) {
+        return 0;
+    }
+    if(a.dp > 310) {
+        return (sgv_json_u64)0x7FF << 52;
+    }
+    while(a.dp > 0) {
+        n = a.dp >= 9 ? 27 : powtab[a.dp];
+        sgvp_json_dec_shift(&a, -n);
+        e += n;
+    }
+    while(a.dp < 0 || (a.dp == 0 && a.d[0] < 5)) {
+        n = -a.dp >= 9 ? 27 : powtab[-a.dp];
+        sgvp_json_dec_shift(&a, n);
+        e -= n;
+    }
+    /* now in [1/2, 1), doubles are in [1, 2) */
+    e--;
+    if(e < -1022) {
+        sgvp_json_dec_shift(&a, e + 1022);
+        e = -1022;
+    }
+    if(e > 1023) {
+        return (sgv_json_u64)0x7FF << 52;
+    }
+    sgvp_json_dec_shift(&a, 53);
+    m = sgvp_json_dec_round(&a);
+    if(m >> 53) {
+        m >>= 1;
+        if(++e > 1023) {
+            return (sgv_json_u64)0x7FF << 52;
+        }
+    }
+    if(!(m >> 52)) {
+        e = -1023; /* subnormal */
+    }
+    return (m & (((sgv_json_u64)1 << 52) - 1)) | ((sgv_json_u64)(e + 1023) << 52);
+}
+
+/* Doubles are not computed in extended precision (no x87) */
+#if !(defined(__i386__) || defined(_M_IX86)) || defined(__SSE2_MATH__) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SGVP_JSON_EXACT_FP
+
+static const double sgvp_json_pow10[23] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+#endif
+
+/* Decodes the number literal at s. Integer literals that fit are returned
+   exactly as SGVP_JSON_INT (*u is two's complement) or SGVP_JSON_UINT,
+   anything else as SGVP_JSON_DBL in *d. */
+static int sgvp_json_decode(const char* s, int len, sgv_json_u64* u, double* d)
+{
+    union { sgv_json_u64 u; double d; } bits;
+    const char *p = s, *end = s + len, *digits;
+    sgv_json_u64 w = 0, b2;
+    int neg = 0, n = 0, q = 0, ev = 0, eneg = 0, frac = 0, many = 0, dig, ok;
+
+    if(*p == '-') {
+        neg = 1;
+        p++;
+    }
+    digits = p;
+
+    for(; p < end && SGVP_JSON_IS_DIGIT(*p); p++) {
+        dig = *p - '0';
+        if(w > (~(sgv_json_u64)0 - dig) / 10) {
+            break;
+        }
+        w = w*10 + dig;
+    }
+    if(p == end) {
+        if(!neg) {
+            *u = w;
+            return (w >> 63) ? SGVP_JSON_UINT : SGVP_JSON_INT;
+        }
+        if(w && w <= (sgv_json_u64)1 << 63) {
+            *u = 0 - w;
+            return SGVP_JSON_INT;
+        }
+    }
+
+    /* w * 10^q with the first 19 significant digits in w */
+    w = 0;
+    for(p = digits; p < end && (SGVP_JSON_IS_DIGIT(*p) || *p == '.'); p++) {
+        if(*p == '.') {
+            frac = 1;
+            continue;
+        }
+        dig = *p - '0';
+        if(n < 19) {
+            if(w || dig) {
+                w = w*10 + dig;
+                n++;
+            }
+            q -= frac;
+        } else {
+            many |= dig;
+            q += !frac;
+        }
+    }
+    if(p < end) {
+        p++; /* 'e' or 'E' */
+        if(*p == '-' || *p == '+') {
+            eneg = (*p++ == '-');
+        }
+        for(; p < end; p++) {
+            if(ev < 10000) {
+                ev = ev*10 + (*p - '0');
+            }
+        }
+    }
+    q += eneg ? -ev : ev;
+
+#ifdef SGVP_JSON_EXACT_FP
+    /* Both w and 10^|q| are exact doubles, so one multiplication or
+       division rounds correctly */
+    if(!many && w >> 53 == 0 && q >= -22 && q <= 22) {
+        *d = (q < 0) ? (double)(sgv_json_i64)w / sgvp_json_pow10[-q] :
+                       (double)(sgv_json_i64)w * sgvp_json_pow10[q];
+        *d = neg ? -*d : *d;
+        return SGVP_JSON_DBL;
+    }
+#endif
+
+    /* with digits dropped the number is in (w, w + 1) * 10^q */
+    ok = sgvp_json_eisel_lemire(w, q, &bits.u);
+    if(ok && many) {
+        ok = sgvp_json_eisel_lemire(w + 1, q, &b2) && b2 == bits.u;
+    }
+    if(!ok) {
+        bits.u = sgvp_json_slow_bits(digits, end);
+    }
+    bits.u |= (sgv_json_u64)neg << 63;
+    *d = bits.d;
+    return SGVP_JSON_DBL;
+}
+
+/* Decodes a number token, through the cache in its pair/element if any */
+static int sgvp_json_num(sgv_json_token* value, sgv_json_u64* u, double* d)
+{
+    sgv_json_token* slot = SGVP_JSON_NULL;
+    int kind;
+
+    if(!sgvp_json_is(value, SGV_JSON_TOKEN_VAL_NUM)) {
+        return 0;
+    }
+    if(value->tag & SGVP_JSON_SLOT1) {
+        slot = value - 1;
+    } else if(value->tag & SGVP_JSON_SLOT2) {
+        slot = value - 2;
+    }
+    if(slot && (slot->tag & SGVP_JSON_CACHED)) {
+        *u = slot->u.i;
+        *d = slot->u.d;
+        return slot->tag & SGVP_JSON_CACHED;
+    }
+    kind = sgvp_json_decode(sgvp_json_str(value), value->len, u, d);
+    if(slot) {
+        if(kind == SGVP_JSON_DBL) {
+            slot->u.d = *d;
+        } else {
+            slot->u.i = *u;
+        }
+        slot->tag |= kind;
+    }
+    return kind;
+}
+
+/* Converts a decoded number of the given kind to an integer in [lo, hi] */
+static int sgvp_json_to_i64(int kind, sgv_json_u64 u, double d,
+                            double lo, double hi, sgv_json_i64* number)
+{
+    switch(kind) {
+    case SGVP_JSON_INT:
+        d = (double)(sgv_json_i64)u;
+        if(d < lo || d > hi) {
+            return -1;
+        }
+        *number = (sgv_json_i64)u;
+        return 0;
+    case SGVP_JSON_DBL:
+        /* lo - 1 rounds to lo for 64 bits, where lo itself must pass */
+        if(!((d >= lo || d > lo - 1) && d < hi + 1)) {
+            return -1;
+        }
+        *number = (sgv_json_i64)d;
+        return 0;
+    }
+    return -1;
+}
+
+static int sgvp_json_to_u64(int kind, sgv_json_u64 u, double d,
+                            sgv_json_u64* number)
+{
+    switch(kind) {
+    case SGVP_JSON_INT:
+        if(u >> 63) {
+            return -1;
+        }
+        /* fall through */
+    case SGVP_JSON_UINT:
+        *number = u;
+        return 0;
+    case SGVP_JSON_DBL:
+        if(!(d > -1 && d < 18446744073709551616.0)) {
+            return -1;
+        }
+        *number = (sgv_json_u64)d;
+        return 0;
+    }
+    return -1;
+}
+
+static int sgvp_json_to_double(int kind, sgv_json_u64 u, double d,
+                               double* number)
+{
+    switch(kind) {
+    case SGVP_JSON_INT:
+        *number = (double)(sgv_json_i64)u;
+        return 0;
+    case SGVP_JSON_UINT:
+        *number = (double)u;
+        return 0;
+    case SGVP_JSON_DBL:
+        *number = d;
+        return 0;
+    }
+    return -1;
+}
+
+SGVJSON_DEF int sgv_json_value_int(sgv_json_token* value, int* number)
+{
+    sgv_json_u64 u = 0;
+    sgv_json_i64 n;
+    double d = 0;
+    int kind = sgvp_json_num(value, &u, &d);
+    if(sgvp_json_to_i64(kind, u, d, -2147483648.0, 2147483647.0, &n)) {
+        return -1;
+    }
+    *number = (int)n;
+    return 0;
+}
+
+SGVJSON_DEF int sgv_json_value_int64(sgv_json_token* value,
+                                     sgv_json_i64* number)
+{
+    sgv_json_u64 u = 0;
+    double d = 0;
+    int kind = sgvp_json_num(value, &u, &d);
+    return sgvp_json_to_i64(kind, u, d, -9223372036854775808.0,
+                            9223372036854775807.0, number);
+}
+
+SGVJSON_DEF int sgv_json_value_uint64(sgv_json_token* value,
+                                      sgv_json_u64* number)
+{
+    sgv_json_u64 u = 0;
+    double d = 0;
+    int kind = sgvp_json_num(value, &u, &d);
+    return sgvp_json_to_u64(kind, u, d, number);
+}
+
+SGVJSON_DEF int sgv_json_value_double(sgv_json_token* value, double* number)
+{
+    sgv_json_u64 u = 0;
+    double d = 0;
+    int kind = sgvp_json_num(value, &u, &d);
+    return sgvp_json_to_double(kind, u, d, number);
+}
+
+SGVJSON_DEF int sgv_json_value_bool(sgv_json_token* value, int* bool_val)
+{
+    if(!sgvp_json_is(value, SGV_JSON_TOKEN_VAL_BOOL)) {
+        return -1;
+    }
+    *bool_val = (sgvp_json_str(value)[0] == 't');
+    return 0;
+}
+
+SGVJSON_DEF int sgv_json_value_null(sgv_json_token* value, int* is_null)
+{
+    if(!value) {
+        return -1;
+    }
+    *is_null = sgvp_json_is(value, SGV_JSON_TOKEN_VAL_NULL);
+    return 0;
+}
+
+/* Streaming lexer states */
+enum {
+    SGVP_LX_TOP, /* between tokens */
+    SGVP_LX_STR, /* inside a string */
+    SGVP_LX_NUM, /* inside a number, the start of it is in st->num */
+    SGVP_LX_LIT  /* inside true/false/null */
+};
+
+SGVJSON_DEF void sgv_json_stream_init(sgv_json_stream* st,
+                                      sgv_json_event_cb cb, void* user)
+{
+    st->cb = cb;
+    st->user = user;
+    st->error = 0;
+    st->state = SGVP_ST_VALUE;
+    st->depth = 0;
+    st->lex = SGVP_LX_TOP;
+    st->esc = 0;
+    st->is_key = 0;
+    st->lit = 0;
+    st->lit_pos = 0;
+    st->num_len = 0;
+}
+
+static int sgvp_json_stream_fail(sgv_json_stream* st, int err)
+{
+    SGV_JSON_LOG(("sgv_json: stream error %d\n", err));
+    st->error = err;
+    return err;
+}
+
+static int sgvp_json_stream_emit(sgv_json_stream* st, sgv_json_event_type type,
+                                 char* str, int len, int partial)
+{
+    sgv_json_event ev;
+    int r;
+
+    ev.type = type;
+    ev.str = str;
+    ev.str_len = len;
+    ev.partial = partial;
+    ev.bool_val = (type == SGV_JSON_EVENT_BOOL && str[0] == 't');
+    if((r = st->cb(st->user, &ev))) {
+        st->error = r;
+    }
+    return r;
+}
+
+static int sgvp_json_stream_num(sgv_json_stream* st, char* s, int len)
+{
+    int r;
+    if(sgvp_json_lex_num(s, s + len) != len) {
+        return sgvp_json_stream_fail(st, SGV_JSON_ERROR_INVALID);
+    }
+    if((r = sgvp_json_grammar(&st->state, &st->depth, st->is_obj, SGVP_EV_NUM)) < 0) {
+        return sgvp_json_stream_fail(st, r);
+    }
+    st->lex = SGVP_LX_TOP;
+    st->num_len = 0;
+    return sgvp_json_stream_emit(st, SGV_JSON_EVENT_NUM, s, len, 0);
+}
+
+static int sgvp_json_is_num_char(char c)
+{
+    return SGVP_JSON_IS_DIGIT(c) || c == '-' || c == '+' || c == '.' ||
+           c == 'e' || c == 'E';
+}
+
+SGVJSON_DEF int sgv_json_stream_feed(sgv_json_stream* st,
+                                     char* chunk, int chunk_len)
+{
+    char *p = chunk, *end = chunk + chunk_len, *s;
+    int r = 0, ev, i;
+    unsigned char c;
+
+    if(st->error) {
+        return st->error;
+    }
+
+    while(p < end && !r) {
+        switch(st->lex) {
+        case SGVP_LX_STR:
+            for(s = p; p < end; p++) {
+                c = *p;
+                if(st->esc == 1) {
+                    switch(c) {
+                    case '"': case '\\': case '/':
+                    case 'b': case 'f': case 'n': case 'r': case 't':
+                        st->esc = 0;
+                        break;
+                    case 'u':
+                        st->esc = 5;
+                        break;
+                    default:
+                        return sgvp_json_stream_fail(st, SGV_JSON_ERROR_INVALID);
+                    }
+                } else if(st->esc) {
+                    if(!sgvp_json_is_hex(c)) {
+                        return sgvp_json_stream_fail(st, SGV_JSON_ERROR_INVALID);
+                    }
+                    st->esc = (st->esc == 2) ? 0 : st->esc - 1;
+                } else if(c == '"') {
+                    break;
+                } else if(c == '\\') {
+                    st->esc = 1;
+                } else if(c < 0x20) {
+                    return sgvp_json_stream_fail(st, SGV_JSON_ERROR_INVALID);
+                }
+            }
+            ev = st->is_key ? SGV_JSON_EVENT_KEY : SGV_JSON_EVENT_STR;
+            if(p < end) {
+                st->lex = SGVP_LX_TOP;
+                r = sgvp_json_stream_emit(st, (sgv_json_event_type)ev, s, p - s, 0);
+                p++;
+            } else if(p > s) {
+                r = sgvp_json_stream_emit(st, (sgv_json_event_type)ev, s, p - s, 1);
+            }
+            break;
+
+        case SGVP_LX_NUM:
+            for(s = p; p < end && sgvp_json_is_num_char(*p); p++);
+            if(st->num_len + (p - s) > SGV_JSON_STREAM_MAX_NUM) {
+                return sgvp_json_stream_fail(st, SGV_JSON_ERROR_INVALID);
+            }
+            for(i = 0; s + i < p; i++) {
+                st->num[st->num_len++] = s[i];
+            }
+            if(p < end) {
+                r = sgvp_json_stream_num(st, st->num, st->num_len);
+            }
+            break;
+
+        case SGVP_LX_LIT:
+            for(; p < end && st->lit[st->lit_pos]; p++, st->lit_pos++) {
+                if(*p != st->lit[st->lit_pos]) {
+                    return sgvp_json_stream_fail(st, SGV_JSON_ERROR_INVALID);
+                }
+            }
+            if(!st->lit[st->lit_pos]) {
+                ev = (st->lit[0] == 'n') ? SGVP_EV_NULL : SGVP_EV_TRUE;
+                r = sgvp_json_grammar(&st->state, &st->depth, st->is_obj, ev);
+                if(r < 0) {
+                    return sgvp_json_stream_fail(st, r);
+                }
+                st->lex = SGVP_LX_TOP;
+                r = sgvp_json_stream_emit(st, st->lit[0] == 'n' ?
+                                          SGV_JSON_EVENT_NULL : SGV_JSON_EVENT_BOOL,
+                                          (char*)st->lit, st->lit_pos, 0);
+            }
+            break;
+
+        default:
+            c = *p;
+            switch(c) {
+            case ' ': case '\t': case '\n': case '\r':
+                p++;
+                continue;
+            case '{': case '}': case '[': case ']': case ':': case ',':
+                ev = (c == '{') ? SGVP_EV_OBJ_BEGIN : (c == '}') ? SGVP_EV_OBJ_END :
+                     (c == '[') ? SGVP_EV_ARR_BEGIN : (c == ']') ? SGVP_EV_ARR_END :
+                     (c == ':') ? SGVP_EV_COLON : SGVP_EV_COMMA;
+                if((r = sgvp_json_grammar(&st->state, &st->depth, st->is_obj, ev)) < 0) {
+                    return sgvp_json_stream_fail(st, r);
+                }
+                if(c != ':' && c != ',') {
+                    r = sgvp_json_stream_emit(st,
+                            (c == '{') ? SGV_JSON_EVENT_OBJ_BEGIN :
+                            (c == '}') ? SGV_JSON_EVENT_OBJ_END :
+                            (c == '[') ? SGV_JSON_EVENT_ARR_BEGIN :
+                            SGV_JSON_EVENT_ARR_END, p, 1, 0);
+                }
+                p++;
+                break;
+            case '"':
+                r = sgvp_json_grammar(&st->state, &st->depth, st->is_obj, SGVP_EV_STR);
+                if(r < 0) {
+                    return sgvp_json_stream_fail(st, r);
+                }
+                st->is_key = (r == SGVP_JSON_KEY);
+                st->lex = SGVP_LX_STR;
+                st->esc = 0;
+                r = 0;
+                p++;
+                break;
+            case 't': case 'f': case 'n':
+                st->lit = (c == 't') ? "true" : (c == 'f') ? "false" : "null";
+                st->lit_pos = 0;
+                st->lex = SGVP_LX_LIT;
+                break;
+            case '-': case '0': case '1': case '2': case '3': case '4':
+            case '5': case '6': case '7': case '8': case '9':
+                /* numbers are emitted from the chunk unless they span chunks */
+                for(s = p; p < end && sgvp_json_is_num_char(*p); p++);
+                if(p < end) {
+                    r = sgvp_json_stream_num(st, s, p - s);
+                } else {
+                    st->num_len = 0;
+                    st->lex = SGVP_LX_NUM;
+                    p = s;
+                }
+                break;
+            default:
+                return sgvp_json_stream_fail(st, SGV_JSON_ERROR_INVALID);
+            }
+            break;
+        }
+    }
+    return r;
+}
+
+SGVJSON_DEF int sgv_json_stream_end(sgv_json_stream* st)
+{
+    int r;
+    if(st->error) {
+        return st->error;
+    }
+    if(st->lex == SGVP_LX_NUM &&
+       (r = sgvp_json_stream_num(st, st->num, st->num_len))) {
+        return r;
+    }
+    if(st->lex != SGVP_LX_TOP || st->state != SGVP_ST_DONE) {
+        return sgvp_json_stream_fail(st, SGV_JSON_ERROR_INVALID);
+    }
+    return 0;
+}
+
+#ifndef SGV_JSON_MAX_THREADS
+#define SGV_JSON_MAX_THREADS 64
+#endif
+
+#ifdef SGV_JSON_THREADS
+#include <pthread.h>
+#endif
+
+/* A range of JSON Lines parsed by one thread */
+typedef struct {
+    char *begin, *end;      /* starts right after a '\n' (or at the text) */
+    sgv_json_token* tokens; /* this range's slice of the tokens */
+    int max_tokens;
+    sgv_json_token** roots;
+    int first_root;         /* index of the first record of the range */
+    int n_records;
+    int need;               /* tokens needed by the range */
+    int error;
+    int bad_record;
+    int phase;              /* 0: count records, 1: parse them */
+} sgvp_json_range;
+
+/* Returns the '\n' ending the line at p, or end. JSON strings can not hold
+   a raw newline, so there is no need to track quotes. */
+static char* sgvp_json_eol(char* p, char* end)
+{
+#ifdef SGVP_JSON_HAVE_SIMD
+    unsigned int m;
+    for(; end - p >= 16; p += 16) {
+        m = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(
+                _mm_loadu_si128((const __m128i*)p), _mm_set1_epi8('\n')));
+        if(m) {
+            return p + sgvp_json_ctz(m);
+        }
+    }
+#endif
+    while(p < end && *p != '\n') {
+        p++;
+    }
+    return p;
+}
+
+static int sgvp_json_is_blank(char* p, char* end)
+{
+    for(; p < end; p++) {
+        if(*p != ' ' && *p != '\t' && *p != '\r') {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void* sgvp_json_range_run(void* arg)
+{
+    sgvp_json_range* r = (sgvp_json_range*)arg;
+    char *p, *e;
+    sgv_json_token* t;
+    int i = 0, n, left, used = 0;
+
+    for(p = r->begin; p < r->end; p = e + 1) {
+        e = sgvp_json_eol(p, r->end);
+        if(sgvp_json_is_blank(p, e)) {
+            continue;
+        }
+        if(r->phase == 1) {
+            /* past the slice only count, without forming the pointer */
+            left = 0;
+            t = NULL;
+            if(used < r->max_tokens) {
+                left = r->max_tokens - used;
+                t = r->tokens + used;
+            }
+            r->error = sgvp_json_parse(p, e - p, t, left, 0, &n);
+            if(r->error) {
+                r->bad_record = r->first_root + i;
+                return 0;
+            }
+            if(n <= left) {
+                r->roots[r->first_root + i] = t;
+            }
+            used += n;
+        }
+        i++;
+    }
+    r->n_records = i;
+    r->need = used;
+    return 0;
+}
+
+/* Runs every range, on its own thread where possible */
+static void sgvp_json_run_ranges(sgvp_json_range* r, int n)
+{
+    int i;
+#ifdef SGV_JSON_THREADS
+    pthread_t th[SGV_JSON_MAX_THREADS];
+    int started[SGV_JSON_MAX_THREADS];
+    for(i = 1; i < n; i++) {
+        started[i] = !pthread_create(&th[i], 0, sgvp_json_range_run, &r[i]);
+    }
+    sgvp_json_range_run(&r[0]);
+    for(i = 1; i < n; i++) {
+        if(started[i]) {
+            pthread_join(th[i], 0);
+        } else {
+            sgvp_json_range_run(&r[i]);
+        }
+    }
+#else
+    for(i = 0; i < n; i++) {
+        sgvp_json_range_run(&r[i]);
+    }
+#endif
+}
+
+SGVJSON_DEF int sgv_json_parse_lines(char* json_str,
+                                     int json_str_len,
+                                     sgv_json_token* tokens,
+                                     int max_tokens,
+                                     sgv_json_token** roots,
+                                     int max_roots,
+                                     int* n_roots,
+                                     int n_threads)
+{
+    sgvp_json_range r[SGV_JSON_MAX_THREADS];
+    char *end = json_str + json_str_len, *p = json_str;
+    int i, n, t0, t1, total = 0, need = 0;
+    double scale, m;
+
+    if(n_threads < 1) {
+        n_threads = 1;
+    }
+    if(n_threads > SGV_JSON_MAX_THREADS) {
+        n_threads = SGV_JSON_MAX_THREADS;
+    }
+
+    /* Equal byte ranges, each moved up to the next line */
+    for(n = 0; n < n_threads && p < end; n++) {
+        r[n].begin = p;
+        p = json_str + (int)((double)json_str_len * (n + 1) / n_threads);
+        if(p < r[n].begin) {
+            p = r[n].begin;
+        }
+        p = sgvp_json_eol(p, end);
+        p += (p < end);
+        r[n].end = p;
+        r[n].phase = 0;
+        r[n].error = 0;
+    }
+
+    sgvp_json_run_ranges(r, n);
+    for(i = 0; i < n; i++) {
+        r[i].first_root = total;
+        total += r[i].n_records;
+    }
+    *n_roots = total;
+    if(total > max_roots) {
+        return SGV_JSON_ERROR_ROOTS;
+    }
+
+    /* Token slices in proportion to the bytes of the ranges */
+    scale = json_str_len ? (double)max_tokens / json_str_len : 0;
+    for(i = 0; i < n; i++) {
+        t0 = (int)((r[i].begin - json_str) * scale);
+        t1 = (i == n - 1) ? max_tokens : (int)((r[i].end - json_str) * scale);
+        r[i].tokens = tokens ? tokens + t0 : tokens;
+        r[i].max_tokens = t1 - t0;
+        r[i].roots = roots;
+        r[i].phase = 1;
+    }
+
+    sgvp_json_run_ranges(r, n);
+    for(i = 0; i < n; i++) {
+        if(r[i].error) {
+            *n_roots = r[i].bad_record;
+            return r[i].error;
+        }
+        if(r[i].need > r[i].max_tokens) {
+            /* smallest max_tokens that gives this range enough tokens */
+            m = (double)(r[i].need + 1) * json_str_len / (r[i].end - r[i].begin) + 1;
+            if(m > need) {
+                need = (m < 2147483647.0) ? (int)m : 2147483647;
+            }
+        }
+    }
+    return need;
+}
+
+typedef struct {
+    unsigned int hash;
+    sgv_json_token* pair;
+} sgvp_json_slot;
+
+/* FNV-1a */
+static unsigned int sgvp_json_hash(const char* s, int len)
+{
+    unsigned int h = 2166136261u;
+    int i;
+    for(i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)s[i]) * 16777619u;
+    }
+    return h;
+}
+
+SGVJSON_DEF void sgv_json_index_init(sgv_json_index* idx,
+                                     void* scratch, int scratch_len)
+{
+    int i;
+    idx->scratch = (char*)scratch;
+    idx->scratch_len = scratch_len;
+    idx->used = 0;
+    for(i = 0; i < SGV_JSON_INDEX_OBJS; i++) {
+        idx->objs[i] = SGVP_JSON_NULL;
+    }
+}
+
+/* Builds the table of 'obj' in the scratch buffer, returns its offset or -1
+   if it does not fit */
+static int sgvp_json_index_build(sgv_json_index* idx, sgv_json_token* obj,
+                                 int* cap)
+{
+    sgvp_json_slot* tab;
+    sgv_json_token* pair;
+    char *k = 0, *k2 = 0;
+    int i, n = 0, len = 0, off, k2len = 0;
+    unsigned int h;
+
+    for(pair = sgv_json_first_pair(obj); pair; pair = sgv_json_next_pair(pair)) {
+        n++;
+    }
+    for(*cap = 8; *cap < 2*n; *cap *= 2);
+
+    off = (idx->used + (int)sizeof(void*) - 1) & ~((int)sizeof(void*) - 1);
+    if(off + *cap * (int)sizeof(sgvp_json_slot) > idx->scratch_len) {
+        return -1;
+    }
+    idx->used = off + *cap * (int)sizeof(sgvp_json_slot);
+    tab = (sgvp_json_slot*)(idx->scratch + off);
+    for(i = 0; i < *cap; i++) {
+        tab[i].pair = SGVP_JSON_NULL;
+    }
+
+    for(pair = sgv_json_first_pair(obj); pair; pair = sgv_json_next_pair(pair)) {
+        sgv_json_key_string(sgv_json_pair_key(pair), &k, &len);
+        h = sgvp_json_hash(k, len);
+        for(i = h & (*cap - 1); tab[i].pair; i = (i + 1) & (*cap - 1)) {
+            /* on duplicate keys the first one wins, like obj_value */
+            if(tab[i].hash == h) {
+                sgv_json_key_string(sgv_json_pair_key(tab[i].pair), &k2, &k2len);
+                if(k2len == len && sgvp_json_memeq(k, k2, len)) {
+                    break;
+                }
+            }
+        }
+        if(!tab[i].pair) {
+            tab[i].hash = h;
+            tab[i].pair = pair;
+        }
+    }
+    return off;
+}
+
+SGVJSON_DEF sgv_json_token* sgv_json_index_value(sgv_json_index* idx,
+                                                 sgv_json_token* obj,
+                                                 char* key)
+{
+    sgvp_json_slot* tab;
+    char* k = 0;
+    int i, d, len, klen = 0, mask;
+    unsigned int h;
+
+    if(!sgvp_json_is(obj, SGV_JSON_TOKEN_OBJ)) {
+        return SGVP_JSON_NULL;
+    }
+
+    /* find the object in the directory, index it on first use */
+    d = (int)((((unsigned long)(char*)obj) >> 3) * 2654435761u % SGV_JSON_INDEX_OBJS);
+    for(i = 0; i < SGV_JSON_INDEX_OBJS; i++, d = (d + 1) % SGV_JSON_INDEX_OBJS) {
+        if(idx->objs[d] == obj) {
+            break;
+        }
+        if(!idx->objs[d]) {
+            idx->objs[d] = obj;
+            idx->tables[d] = sgvp_json_index_build(idx, obj, &idx->caps[d]);
+            break;
+        }
+    }
+    if(i == SGV_JSON_INDEX_OBJS || idx->tables[d] < 0) {
+        return sgv_json_obj_value(obj, key);
+    }
+
+    for(len = 0; key[len]; len++);
+    h = sgvp_json_hash(key, len);
+    tab = (sgvp_json_slot*)(idx->scratch + idx->tables[d]);
+    mask = idx->caps[d] - 1;
+    for(i = h & mask; tab[i].pair; i = (i + 1) & mask) {
+        if(tab[i].hash == h) {
+            sgv_json_key_string(sgv_json_pair_key(tab[i].pair), &k, &klen);
+            if(klen == len && sgvp_json_memeq(k, key, len)) {
+                return sgv_json_pair_value(tab[i].pair);
+            }
+        }
+    }
+    return SGVP_JSON_NULL;
+}
+
+SGVJSON_DEF void sgv_json_write_init(sgv_json_writer* w, char* buf,
+                                     int buf_len, sgv_json_flush_cb flush,
+                                     void* user)
+{
+    w->buf = buf;
+    w->buf_len = buf_len;
+    w->used = 0;
+    w->total = 0;
+    w->flush = flush;
+    w->user = user;
+    w->error = 0;
+    w->state = SGVP_ST_VALUE;
+    w->depth = 0;
+}
+
+/* Hands the buffer to the flush callback */
+static int sgvp_json_write_flush(sgv_json_writer* w)
+{
+    int r;
+    if(w->flush && w->used > 0) {
+        if((r = w->flush(w->user, w->buf, w->used)) < 0) {
+            w->error = r;
+        }
+        w->used = 0;
+    }
+    return w->error;
+}
+
+static void sgvp_json_put(sgv_json_writer* w, const char* s, int len)
+{
+    int i, n;
+
+    w->total += len;
+    while(len > 0) {
+        if(w->used == w->buf_len) {
+            if(!w->flush || sgvp_json_write_flush(w)) {
+                return;
+            }
+        }
+        n = (len < w->buf_len - w->used) ? len : w->buf_len - w->used;
+        for(i = 0; i < n; i++) {
+            w->buf[w->used + i] = s[i];
+        }
+        w->used += n;
+        s += n;
+        len -= n;
+    }
+}
+
+/* Checks that a value/key/closer may come next and writes the comma or
+   colon before it */
+static int sgvp_json_write_ev(sgv_json_writer* w, int ev, int key)
+{
+    int r;
+
+    if(w->error) {
+        return w->error;
+    }
+    if(w->state == SGVP_ST_NEXT && ev != SGVP_EV_OBJ_END &&
+       ev != SGVP_EV_ARR_END) {
+        sgvp_json_grammar(&w->state, &w->depth, w->is_obj, SGVP_EV_COMMA);
+        sgvp_json_put(w, ",", 1);
+    }
+    r = sgvp_json_grammar(&w->state, &w->depth, w->is_obj, ev);
+    if(r < 0 || (r == SGVP_JSON_KEY) != key) {
+        w->error = (r < 0) ? r : SGV_JSON_ERROR_INVALID;
+    }
+    return w->error;
+}
+
+static int sgvp_json_write_raw(sgv_json_writer* w, int ev,
+                               const char* s, int len)
+{
+    if(sgvp_json_write_ev(w, ev, 0)) {
+        return w->error;
+    }
+    sgvp_json_put(w, s, len);
+    return w->error;
+}
+
+SGVJSON_DEF int sgv_json_write_obj_begin(sgv_json_writer* w)
+{
+    return sgvp_json_write_raw(w, SGVP_EV_OBJ_BEGIN, "{", 1);
+}
+
+SGVJSON_DEF int sgv_json_write_obj_end(sgv_json_writer* w)
+{
+    return sgvp_json_write_raw(w, SGVP_EV_OBJ_END, "}", 1);
+}
+
+SGVJSON_DEF int sgv_json_write_arr_begin(sgv_json_writer* w)
+{
+    return sgvp_json_write_raw(w, SGVP_EV_ARR_BEGIN, "[", 1);
+}
+
+SGVJSON_DEF int sgv_json_write_arr_end(sgv_json_writer* w)
+{
+    return sgvp_json_write_raw(w, SGVP_EV_ARR_END, "]", 1);
+}
+
+SGVJSON_DEF int sgv_json_write_bool(sgv_json_writer* w, int bool_val)
+{
+    return sgvp_json_write_raw(w, SGVP_EV_TRUE, bool_val ? "true" : "false",
+                               bool_val ? 4 : 5);
+}
+
+SGVJSON_DEF int sgv_json_write_null(sgv_json_writer* w)
+{
+    return sgvp_json_write_raw(w, SGVP_EV_NULL, "null", 4);
+}
+
+/* Length of the run at s that needs no escaping */
+static int sgvp_json_plain(const char* s, int len)
+{
+    int i = 0;
+    unsigned char c;
+#ifdef SGVP_JSON_HAVE_SIMD
+    __m128i v;
+    unsigned int m;
+    for(; len - i >= 16; i += 16) {
+        v = _mm_loadu_si128((const __m128i*)(s + i));
+        m = (unsigned int)_mm_movemask_epi8(_mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+                             _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))),
+                _mm_cmpeq_epi8(_mm_max_epu8(v, _mm_set1_epi8(0x1F)),
+                               _mm_set1_epi8(0x1F))));
+        if(m) {
+            return i + sgvp_json_ctz(m);
+        }
+    }
+#endif
+    for(; i < len; i++) {
+        c = (unsigned char)s[i];
+        if(c == '"' || c == '\\' || c < 0x20) {
+            break;
+        }
+    }
+    return i;
+}
+
+static void sgvp_json_put_escaped(sgv_json_writer* w, const char* s, int len)
+{
+    static const char hex[] = "0123456789abcdef";
+    char e[6];
+    int n;
+    unsigned char c;
+
+    sgvp_json_put(w, "\"", 1);
+    while(len > 0) {
+        n = sgvp_json_plain(s, len);
+        sgvp_json_put(w, s, n);
+        s += n;
+        len -= n;
+        if(len == 0) {
+            break;
+        }
+        c = (unsigned char)*s++;
+        len--;
+        e[0] = '\\';
+        n = 2;
+        switch(c) {
+        case '"': e[1] = '"'; break;
+        case '\\': e[1] = '\\'; break;
+        case '\b': e[1] = 'b'; break;
+        case '\f': e[1] = 'f'; break;
+        case '\n': e[1] = 'n'; break;
+        case '\r': e[1] = 'r'; break;
+        case '\t': e[1] = 't'; break;
+        default:
+            e[1] = 'u';
+            e[2] = e[3] = '0';
+            e[4] = hex[c >> 4];
+            e[5] = hex[c & 15];
+            n = 6;
+            break;
+        }
+        sgvp_json_put(w, e, n);
+    }
+    sgvp_json_put(w, "\"", 1);
+}
+
+SGVJSON_DEF int sgv_json_write_key(sgv_json_writer* w, char* key, int len)
+{
+    if(sgvp_json_write_ev(w, SGVP_EV_STR, 1)) {
+        return w->error;
+    }
+    sgvp_json_put_escaped(w, key, len);
+    sgvp_json_grammar(&w->state, &w->depth, w->is_obj, SGVP_EV_COLON);
+    sgvp_json_put(w, ":", 1);
+    return w->error;
+}
+
+SGVJSON_DEF int sgv_json_write_string(sgv_json_writer* w, char* str, int len)
+{
+    if(sgvp_json_write_ev(w, SGVP_EV_STR, 0)) {
+        return w->error;
+    }
+    sgvp_json_put_escaped(w, str, len);
+    return w->error;
+}
+
+SGVJSON_DEF int sgv_json_write_int64(sgv_json_writer* w, sgv_json_i64 number)
+{
+    char s[20];
+    sgv_json_u64 u = (number < 0) ? 0 - (sgv_json_u64)number :
+                                    (sgv_json_u64)number;
+    int i = 20;
+
+    do {
+        s[--i] = (char)('0' + u % 10);
+        u /= 10;
+    } while(u);
+    if(number < 0) {
+        s[--i] = '-';
+    }
+    return sgvp_json_write_raw(w, SGVP_EV_NUM, s + i, 20 - i);
+}
+
+/* Shortest digits of a double with Grisu3 (Loitsch, "Printing
+   Floating-Point Numbers Quickly and Accurately with Integers"). In the
+   rare cases where Grisu3 can't prove its result, the exact decimal value
+   is rounded to 1, 2, ... digits until it reads back as the same double. */
+
+/* Normalized f * 2^e approximations of 10^k for k = -348, -340, ..., 340 */
+static const struct {
+    unsigned int hi, lo;
+    short e, k;
+} sgvp_json_cached_pow10[87] = {
+    {0xfa8fd5a0u, 0x081c0288u, -1220, -348},
+    {0xbaaee17fu, 0xa23ebf76u, -1193, -340},
+    {0x8b16fb20u, 0x3055ac76u, -1166, -332},
+    {0xcf42894au, 0x5dce35eau, -1140, -324},
+    {0x9a6bb0aau, 0x55653b2du, -1113, -316},
+    {0xe61acf03u, 0x3d1a45dfu, -1087, -308},
+    {0xab70fe17u, 0xc79ac6cau, -1060, -300},
+    {0xff77b1fcu, 0xbebcdc4fu, -1034, -292},
+    {0xbe5691efu, 0x416bd60cu, -1007, -284},
+    {0x8dd01fadu, 0x907ffc3cu, -980, -276},
+    {0xd3515c28u, 0x31559a83u, -954, -268},
+    {0x9d71ac8fu, 0xada6c9b5u, -927, -260},
+    {0xea9c2277u, 0x23ee8bcbu, -901, -252},
+    {0xaecc4991u, 0x4078536du, -874, -244},
+    {0x823c1279u, 0x5db6ce57u, -847, -236},
+    {0xc2109436u, 0x4dfb5637u, -821, -228},
+    {0x9096ea6fu, 0x3848984fu, -794, -220},
+    {0xd77485cbu, 0x25823ac7u, -768, -212},
+    {0xa086cfcdu, 0x97bf97f4u, -741, -204},
+    {0xef340a98u, 0x172aace5u, -715, -196},
+    {0xb23867fbu, 0x2a35b28eu, -688, -188},
+    {0x84c8d4dfu, 0xd2c63f3bu, -661, -180},
+    {0xc5dd4427u, 0x1ad3cdbau, -635, -172},
+    {0x936b9fceu, 0xbb25c996u, -608, -164},
+    {0xdbac6c24u, 0x7d62a584u, -582, -156},
+    {0xa3ab6658u, 0x0d5fdaf6u, -555, -148},
+    {0xf3e2f893u, 0xdec3f126u, -529, -140},
+    {0xb5b5ada8u, 0xaaff80b8u, -502, -132},
+    {0x87625f05u, 0x6c7c4a8bu, -475, -124},
+    {0xc9bcff60u, 0x34c13053u, -449, -116},
+    {0x964e858cu, 0x91ba2655u, -422, -108},
+    {0xdff97724u, 0x70297ebdu, -396, -100},
+    {0xa6dfbd9fu, 0xb8e5b88fu, -369, -92},
+    {0xf8a95fcfu, 0x88747d94u, -343, -84},
+    {0xb9447093u, 0x8fa89bcfu, -316, -76},
+    {0x8a08f0f8u, 0xbf0f156bu, -289, -68},
+    {0xcdb02555u, 0x653131b6u, -263, -60},
+    {0x993fe2c6u, 0xd07b7facu, -236, -52},
+    {0xe45c10c4u, 0x2a2b3b06u, -210, -44},
+    {0xaa242499u, 0x697392d3u, -183, -36},
+    {0xfd87b5f2u, 0x8300ca0eu, -157, -28},
+    {0xbce50864u, 0x92111aebu, -130, -20},
+    {0x8cbccc09u, 0x6f5088ccu, -103, -12},
+    {0xd1b71758u, 0xe219652cu, -77, -4},
+    {0x9c400000u, 0x00000000u, -50, 4},
+    {0xe8d4a510u, 0x00000000u, -24, 12},
+    {0xad78ebc5u, 0xac620000u, 3, 20},
+    {0x813f3978u, 0xf8940984u, 30, 28},
+    {0xc097ce7bu, 0xc90715b3u, 56, 36},
+    {0x8f7e32ceu, 0x7bea5c70u, 83, 44},
+    {0xd5d238a4u, 0xabe98068u, 109, 52},
+    {0x9f4f2726u, 0x179a2245u, 136, 60},
+    {0xed63a231u, 0xd4c4fb27u, 162, 68},
+    {0xb0de6538u, 0x8cc8ada8u, 189, 76},
+    {0x83c7088eu, 0x1aab65dbu, 216, 84},
+    {0xc45d1df9u, 0x42711d9au, 242, 92},
+    {0x924d692cu, 0xa61be758u, 269, 100},
+    {0xda01ee64u, 0x1a708deau, 295, 108},
+    {0xa26da399u, 0x9aef774au, 322, 116},
+    {0xf209787bu, 0xb47d6b85u, 348, 124},
+    {0xb454e4a1u, 0x79dd1877u, 375, 132},
+    {0x865b8692u, 0x5b9bc5c2u, 402, 140},
+    {0xc83553c5u, 0xc8965d3du, 428, 148},
+    {0x952ab45cu, 0xfa97a0b3u, 455, 156},
+    {0xde469fbdu, 0x99a05fe3u, 481, 164},
+    {0xa59bc234u, 0xdb398c25u, 508, 172},
+    {0xf6c69a72u, 0xa3989f5cu, 534, 180},
+    {0xb7dcbf53u, 0x54e9beceu, 561, 188},
+    {0x88fcf317u, 0xf22241e2u, 588, 196},
+    {0xcc20ce9bu, 0xd35c78a5u, 614, 204},
+    {0x98165af3u, 0x7b2153dfu, 641, 212},
+    {0xe2a0b5dcu, 0x971f303au, 667, 220},
+    {0xa8d9d153u, 0x5ce3b396u, 694, 228},
+    {0xfb9b7cd9u, 0xa4a7443cu, 720, 236},
+    {0xbb764c4cu, 0xa7a44410u, 747, 244},
+    {0x8bab8eefu, 0xb6409c1au, 774, 252},
+    {0xd01fef10u, 0xa657842cu, 800, 260},
+    {0x9b10a4e5u, 0xe9913129u, 827, 268},
+    {0xe7109bfbu, 0xa19c0c9du, 853, 276},
+    {0xac2820d9u, 0x623bf429u, 880, 284},
+    {0x80444b5eu, 0x7aa7cf85u, 907, 292},
+    {0xbf21e440u, 0x03acdd2du, 933, 300},
+    {0x8e679c2fu, 0x5e44ff8fu, 960, 308},
+    {0xd433179du, 0x9c8cb841u, 986, 316},
+    {0x9e19db92u, 0xb4e31ba9u, 1013, 324},
+    {0xeb96bf6eu, 0xbadf77d9u, 1039, 332},
+    {0xaf87023bu, 0x9bf0ee6bu, 1066, 340}
+};
+
+typedef struct {
+    sgv_json_u64 f;
+    int e;
+} sgvp_json_fp;
+
+/* Rounded high half of the product */
+static sgvp_json_fp sgvp_json_fp_mul(sgvp_json_fp x, sgvp_json_fp y)
+{
+    sgvp_json_fp r;
+    sgv_json_u64 lo;
+    r.f = sgvp_json_mul128(x.f, y.f, &lo);
+    r.f += lo >> 63;
+    r.e = x.e + y.e + 64;
+    return r;
+}
+
+static int sgvp_json_round_weed(char* buf, int len, sgv_json_u64 dist_high_w,
+                                sgv_json_u64 unsafe, sgv_json_u64 rest,
+                                sgv_json_u64 ten_kappa, sgv_json_u64 unit)
+{
+    sgv_json_u64 small = dist_high_w - unit, big = dist_high_w + unit;
+
+    /* move down towards w as long as the digits stay inside the interval
+       and get closer to w */
+    while(rest < small && unsafe - rest >= ten_kappa &&
+          (rest + ten_kappa < small ||
+           small - rest >= rest + ten_kappa - small)) {
+        buf[len - 1]--;
+        rest += ten_kappa;
+    }
+    /* ambiguous if another candidate could be closer */
+    if(rest < big && unsafe - rest >= ten_kappa &&
+       (rest + ten_kappa < big || big - rest > rest + ten_kappa - big)) {
+        return 0;
+    }
+    return 2*unit <= rest && rest <= unsafe - 4*unit;
+}
+
+/* Digits of the double v > 0 into buf, value = digits * 10^(*k). Returns the
+   number of digits, 0 if Grisu3 gave up. */
+static int sgvp_json_grisu3(double v, char* buf, int* k)
+{
+    union { double d; sgv_json_u64 u; } bits;
+    sgvp_json_fp w, lo, hi, c, one, too_lo, too_hi;
+    sgv_json_u64 frac, unsafe, unit = 1, rest;
+    unsigned int integ, div;
+    int i, len = 0, kappa, lz, min_e;
+
+    bits.d = v;
+    w.f = bits.u & (((sgv_json_u64)1 << 52) - 1);
+    w.e = (int)(bits.u >> 52);
+    if(w.e) {
+        w.f |= (sgv_json_u64)1 << 52;
+        w.e -= 1075;
+    } else {
+        w.e = -1074;
+    }
+
+    /* boundaries halfway to the neighbours, the lower one is closer at
+       powers of 2 */
+    hi.f = (w.f << 1) + 1;
+    hi.e = w.e - 1;
+    if(w.f == (sgv_json_u64)1 << 52 && w.e > -1074) {
+        lo.f = (w.f << 2) - 1;
+        lo.e = w.e - 2;
+    } else {
+        lo.f = (w.f << 1) - 1;
+        lo.e = w.e - 1;
+    }
+    lz = sgvp_json_clz64(hi.f);
+    hi.f <<= lz;
+    hi.e -= lz;
+    lo.f <<= lo.e - hi.e;
+    lo.e = hi.e;
+    lz = sgvp_json_clz64(w.f);
+    w.f <<= lz;
+    w.e -= lz;
+
+    /* a power of 10 that brings the exponent into [-60, -32] */
+    min_e = -60 - (w.e + 64);
+    i = ((min_e + 63 + 1240) * 1233) >> 12;
+    i = (i > 26) ? (i - 26) / 8 : 0;
+    if(i > 86) {
+        i = 86;
+    }
+    while(i < 86 && sgvp_json_cached_pow10[i].e < min_e) {
+        i++;
+    }
+    while(i > 0 && sgvp_json_cached_pow10[i].e > min_e + 28) {
+        i--;
+    }
+    c.f = SGVP_JSON_U64(sgvp_json_cached_pow10[i].hi, sgvp_json_cached_pow10[i].lo);
+    c.e = sgvp_json_cached_pow10[i].e;
+    w = sgvp_json_fp_mul(w, c);
+    lo = sgvp_json_fp_mul(lo, c);
+    hi = sgvp_json_fp_mul(hi, c);
+
+    /* the scaled boundaries are off by less than one unit */
+    too_lo.f = lo.f - unit;
+    too_hi.f = hi.f + unit;
+    too_lo.e = too_hi.e = hi.e;
+    unsafe = too_hi.f - too_lo.f;
+    one.e = w.e;
+    one.f = (sgv_json_u64)1 << -one.e;
+    integ = (unsigned int)(too_hi.f >> -one.e);
+    frac = too_hi.f & (one.f - 1);
+
+    for(div = 1, kappa = 1; integ / div >= 10; div *= 10, kappa++);
+    while(kappa > 0) {
+        buf[len++] = (char)('0' + integ / div);
+        integ %= div;
+        kappa--;
+        rest = ((sgv_json_u64)integ << -one.e) + frac;
+        if(rest < unsafe) {
+            *k = kappa - sgvp_json_cached_pow10[i].k;
+            return sgvp_json_round_weed(buf, len, too_hi.f - w.f, unsafe, rest,
+                                        (sgv_json_u64)div << -one.e, unit) ?
+                   len : 0;
+        }
+        div /= 10;
+    }
+    for(;;) {
+        frac *= 10;
+        unit *= 10;
+        unsafe *= 10;
+        buf[len++] = (char)('0' + (int)(frac >> -one.e));
+        frac &= one.f - 1;
+        kappa--;
+        if(frac < unsafe) {
+            *k = kappa - sgvp_json_cached_pow10[i].k;
+            return sgvp_json_round_weed(buf, len, (too_hi.f - w.f) * unit,
+                                        unsafe, frac, one.f, unit) ? len : 0;
+        }
+    }
+}
+
+/* Does digits * 10^k read back as v? */
+static int sgvp_json_reads_as(const char* digits, int len, int k, double v)
+{
+    char s[40];
+    sgv_json_u64 u;
+    double d;
+    int i, n;
+
+    for(n = 0; n < len; n++) {
+        s[n] = digits[n];
+    }
+    s[n++] = 'e';
+    if(k < 0) {
+        s[n++] = '-';
+        k = -k;
+    }
+    i = n;
+    do {
+        s[n++] = (char)('0' + k % 10);
+        k /= 10;
+    } while(k);
+    for(k = n - 1; i < k; i++, k--) {
+        char t = s[i];
+        s[i] = s[k];
+        s[k] = t;
+    }
+    sgvp_json_decode(s, n, &u, &d);
+    return d == v;
+}
+
+/* Fallback: the exact decimal expansion of v rounded to as few digits as
+   possible. Same contract as sgvp_json_grisu3. */
+static int sgvp_json_shortest_exact(double v, char* buf, int* k)
+{
+    union { double d; sgv_json_u64 u; } bits;
+    sgvp_json_decimal a;
+    sgv_json_u64 f;
+    char cand[2][17];
+    int e, p, i, j, up = 0, len[2], exp[2];
+
+    bits.d = v;
+    f = bits.u & (((sgv_json_u64)1 << 52) - 1);
+    e = (int)(bits.u >> 52);
+    if(e) {
+        f |= (sgv_json_u64)1 << 52;
+        e -= 1075;
+    } else {
+        e = -1074;
+    }
+    for(a.nd = 0; f; f /= 10) {
+        a.d[a.nd++] = (unsigned char)(f % 10);
+    }
+    for(i = 0, j = a.nd - 1; i < j; i++, j--) {
+        unsigned char t = a.d[i];
+        a.d[i] = a.d[j];
+        a.d[j] = t;
+    }
+    a.dp = a.nd;
+    a.trunc = 0;
+    sgvp_json_dec_trim(&a);
+    sgvp_json_dec_shift(&a, e);
+
+    for(p = 1; p < a.nd; p++) {
+        /* the p digit decimals below and above v */
+        for(i = 0; i < p; i++) {
+            cand[0][i] = cand[1][i] = (char)('0' + a.d[i]);
+        }
+        /* the carry can shorten the upper one, 1299 -> 13 */
+        len[0] = p;
+        exp[0] = a.dp - p;
+        for(i = p - 1; i >= 0 && cand[1][i] == '9'; i--);
+        if(i < 0) {
+            cand[1][0] = '1';
+            len[1] = 1;
+            exp[1] = a.dp;
+        } else {
+            cand[1][i]++;
+            len[1] = i + 1;
+            exp[1] = a.dp - len[1];
+        }
+        up = a.d[p] > 5 || (a.d[p] == 5 && (a.nd > p + 1 || (a.d[p - 1] & 1)));
+        if(p == 17) {
+            break;
+        }
+        for(j = 0; j < 2; j++, up = !up) {
+            if(sgvp_json_reads_as(cand[up], len[up], exp[up], v)) {
+                break;
+            }
+        }
+        if(j < 2) {
+            break;
+        }
+    }
+    if(p == a.nd) {
+        for(i = 0; i < p; i++) {
+            buf[i] = (char)('0' + a.d[i]);
+        }
+        *k = a.dp - p;
+        return p;
+    }
+    for(i = 0; i < len[up]; i++) {
+        buf[i] = cand[up][i];
+    }
+    *k = exp[up];
+    return len[up];
+}
+
+/* Writes digits * 10^k the way JavaScript does: plain up to 21 digits
+   before the point and 6 zeros after it, with an exponent otherwise */
+static int sgvp_json_format(char* s, const char* digits, int len, int k)
+{
+    int n = 0, i, pt = len + k, e;
+
+    if(pt >= len && pt <= 21) {
+        for(i = 0; i < len; i++) {
+            s[n++] = digits[i];
+        }
+        for(; i < pt; i++) {
+            s[n++] = '0';
+        }
+    } else if(pt > 0 && pt <= 21) {
+        for(i = 0; i < len; i++) {
+            if(i == pt) {
+                s[n++] = '.';
+            }
+            s[n++] = digits[i];
+        }
+    } else if(pt > -6 && pt <= 0) {
+        s[n++] = '0';
+        s[n++] = '.';
+        for(i = pt; i < 0; i++) {
+            s[n++] = '0';
+        }
+        for(i = 0; i < len; i++) {
+            s[n++] = digits[i];
+        }
+    } else {
+        s[n++] = digits[0];
+        if(len > 1) {
+            s[n++] = '.';
+            for(i = 1; i < len; i++) {
+                s[n++] = digits[i];
+            }
+        }
+        s[n++] = 'e';
+        e = pt - 1;
+        if(e < 0) {
+            s[n++] = '-';
+            e = -e;
+        }
+        if(e >= 100) {
+            s[n++] = (char)('0' + e / 100);
+        }
+        if(e >= 10) {
+            s[n++] = (char)('0' + e / 10 % 10);
+        }
+        s[n++] = (char)('0' + e % 10);
+    }
+    return n;
+}
+
+SGVJSON_DEF int sgv_json_write_double(sgv_json_writer* w, double number)
+{
+    union { double d; sgv_json_u64 u; } bits;
+    char digits[18], s[32];
+    int len, k, n = 0;
+
+    bits.d = number;
+    if((bits.u >> 52 & 0x7FF) == 0x7FF) {
+        return sgv_json_write_null(w);
+    }
+    if(bits.u >> 63) {
+        s[n++] = '-';
+        number = -number;
+    }
+    if(number == 0) {
+        s[n++] = '0';
+    } else {
+        if(!(len = sgvp_json_grisu3(number, digits, &k))) {
+            len = sgvp_json_shortest_exact(number, digits, &k);
+        }
+        n += sgvp_json_format(s + n, digits, len, k);
+    }
+    return sgvp_json_write_raw(w, SGVP_EV_NUM, s, n);
+}
+
+SGVJSON_DEF int sgv_json_write_token(sgv_json_writer* w, sgv_json_token* value)
+{
+    sgv_json_token* t;
+    int ev;
+
+    if(!value) {
+        if(!w->error) {
+            w->error = SGV_JSON_ERROR_INVALID;
+        }
+        return w->error;
+    }
+    switch(sgv_json_type(value)) {
+    case SGV_JSON_TOKEN_OBJ:
+        sgv_json_write_obj_begin(w);
+        for(t = sgv_json_first_pair(value); t && !w->error; t = sgv_json_next_pair(t)) {
+            if(!sgvp_json_write_ev(w, SGVP_EV_STR, 1)) {
+                if(t[1].tag & SGVP_JSON_UNESC) {
+                    sgvp_json_put_escaped(w, sgvp_json_str(t + 1), t[1].len);
+                    sgvp_json_put(w, ":", 1);
+                } else {
+                    sgvp_json_put(w, "\"", 1);
+                    sgvp_json_put(w, sgvp_json_str(t + 1), t[1].len);
+                    sgvp_json_put(w, "\":", 2);
+                }
+                sgvp_json_grammar(&w->state, &w->depth, w->is_obj, SGVP_EV_COLON);
+            }
+            sgv_json_write_token(w, sgv_json_pair_value(t));
+        }
+        return sgv_json_write_obj_end(w);
+    case SGV_JSON_TOKEN_ARR:
+        sgv_json_write_arr_begin(w);
+        for(t = sgv_json_first_element(value); t && !w->error; t = sgv_json_next_element(t)) {
+            sgv_json_write_token(w, sgv_json_element_value(t));
+        }
+        return sgv_json_write_arr_end(w);
+    case SGV_JSON_TOKEN_VAL_STR:
+        if(sgvp_json_write_ev(w, SGVP_EV_STR, 0)) {
+            return w->error;
+        }
+        if(value->tag & SGVP_JSON_UNESC) {
+            sgvp_json_put_escaped(w, sgvp_json_str(value), value->len);
+        } else {
+            sgvp_json_put(w, "\"", 1);
+            sgvp_json_put(w, sgvp_json_str(value), value->len);
+            sgvp_json_put(w, "\"", 1);
+        }
+        return w->error;
+    case SGV_JSON_TOKEN_VAL_NUM:
+    case SGV_JSON_TOKEN_VAL_BOOL:
+    case SGV_JSON_TOKEN_VAL_NULL:
+        ev = sgv_json_type(value) == SGV_JSON_TOKEN_VAL_NUM ? SGVP_EV_NUM :
+             sgv_json_type(value) == SGV_JSON_TOKEN_VAL_NULL ? SGVP_EV_NULL :
+             SGVP_EV_TRUE;
+        return sgvp_json_write_raw(w, ev, sgvp_json_str(value), value->len);
+    default:
+        if(!w->error) {
+            w->error = SGV_JSON_ERROR_INVALID;
+        }
+        return w->error;
+    }
+}
+
+SGVJSON_DEF int sgv_json_write_end(sgv_json_writer* w)
+{
+    if(!w->error && w->state != SGVP_ST_DONE) {
+        w->error = SGV_JSON_ERROR_INVALID;
+    }
+    if(sgvp_json_write_flush(w)) {
+        return w->error;
+    }
+    return w->total;
+}
+
+#ifdef SGVP_JSON_HAVE_SIMD
+/* Bit masks of the quotes, backslashes, '[{' and ']}' in 32 bytes */
+static SGVP_JSON_INLINE void sgvp_json_brackets(const char* p,
+                                                unsigned int* quote,
+                                                unsigned int* bslash,
+                                                unsigned int* open,
+                                                unsigned int* close)
+{
+    __m128i v, lc;
+    int i;
+    *quote = *bslash = *open = *close = 0;
+    for(i = 0; i < 32; i += 16) {
+        v = _mm_loadu_si128((const __m128i*)(p + i));
+        lc = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        *quote |= (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('"'))) << i;
+        *bslash |= (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))) << i;
+        *open |= (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(lc, _mm_set1_epi8('{'))) << i;
+        *close |= (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(lc, _mm_set1_epi8('}'))) << i;
+    }
+}
+#endif
+
+/* Skips the value at p, or with 'closer' set, the rest of the object or
+   array it closes. Inside objects and arrays only the brackets and quotes
+   are looked at, 32 bytes at a time where SSE2 is available, the same way
+   stage 1 of the SIMD parser finds the strings. Returns the end, NULL on
+   error. */
+static char* sgvp_json_skip(char* p, char* end, char closer, int* err)
+{
+    char closers[SGV_JSON_MAX_DEPTH];
+    int depth = 0, n, in_str = 0, esc = 0;
+#ifdef SGVP_JSON_HAVE_SIMD
+    unsigned int quote, bslash, open, close, escaped, str, bits;
+    unsigned int in_string = 0, escape = 0;
+    int b;
+#endif
+
+    *err = SGV_JSON_ERROR_INVALID;
+    if(closer) {
+        closers[depth++] = closer;
+    } else if(*p == '"') {
+        n = sgvp_json_lex_str(p + 1, end);
+        return n < 0 ? 0 : p + n + 2;
+    } else if(*p == '{' || *p == '[') {
+        closers[depth++] = (char)(*p++ + 2);
+    } else {
+        sgvp_json_lex_scalar(p, end, &n);
+        return n ? p + n : 0;
+    }
+
+#ifdef SGVP_JSON_HAVE_SIMD
+    for(; end - p >= 32; p += 32) {
+        sgvp_json_brackets(p, &quote, &bslash, &open, &close);
+        escaped = escape;
+        bslash &= ~escaped;
+        escape = 0;
+        while(bslash) {
+            b = sgvp_json_ctz(bslash);
+            if(b == 31) {
+                escape = 1;
+            } else {
+                escaped |= 2u << b;
+            }
+            bslash &= ~(3u << b);
+        }
+        quote &= ~escaped;
+        str = quote;
+        str ^= str << 1;
+        str ^= str << 2;
+        str ^= str << 4;
+        str ^= str << 8;
+        str ^= str << 16;
+        str ^= in_string;
+        in_string = (str >> 31) ? ~0u : 0;
+
+        for(bits = (open | close) & ~str; bits; bits &= bits - 1) {
+            b = sgvp_json_ctz(bits);
+            if(open & (1u << b)) {
+                if(depth == SGV_JSON_MAX_DEPTH) {
+                    *err = SGV_JSON_ERROR_DEPTH;
+                    return 0;
+                }
+                closers[depth++] = (char)(p[b] + 2);
+            } else if(closers[--depth] != p[b]) {
+                return 0;
+            } else if(depth == 0) {
+                return p + b + 1;
+            }
+        }
+    }
+    in_str = (in_string != 0);
+    esc = (int)escape;
+#endif
+
+    for(; p < end; p++) {
+        if(esc) {
+            esc = 0;
+        } else if(in_str) {
+            esc = (*p == '\\');
+            in_str = (*p != '"');
+        } else if(*p == '"') {
+            in_str = 1;
+        } else if(*p == '{' || *p == '[') {
+            if(depth == SGV_JSON_MAX_DEPTH) {
+                *err = SGV_JSON_ERROR_DEPTH;
+                return 0;
+            }
+            closers[depth++] = (char)(*p + 2);
+        } else if(*p == '}' || *p == ']') {
+            if(closers[--depth] != *p) {
+                return 0;
+            }
+            if(depth == 0) {
+                return p + 1;
+            }
+        }
+    }
+    return 0;
+}
+
+static char* sgvp_json_ws(char* p, char* end)
+{
+    while(p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+        p++;
+    }
+    return p;
+}
+
+SGVJSON_DEF int sgv_json_query_compile(sgv_json_query* q,
+                                       char** pointers, int n_pointers)
+{
+    char *p, *s, c;
+    int i, j = 0, k = 0, n, len, idx;
+
+    if(n_pointers < 0 || n_pointers > SGV_JSON_QUERY_PATHS) {
+        return SGV_JSON_ERROR_INVALID;
+    }
+    q->n_paths = n_pointers;
+    for(i = 0; i < n_pointers; i++) {
+        q->first[i] = j;
+        p = pointers[i];
+        if(*p && *p != '/') {
+            return SGV_JSON_ERROR_INVALID;
+        }
+        while(*p) {
+            /* a segment, with ~0 for '~' and ~1 for '/' */
+            if(j == SGV_JSON_QUERY_SEGS) {
+                return SGV_JSON_ERROR_INVALID;
+            }
+            q->seg[j] = k;
+            q->idx[j] = -1;
+            for(p++; *p && *p != '/'; p++) {
+                c = *p;
+                if(c == '~') {
+                    if(p[1] != '0' && p[1] != '1') {
+                        return SGV_JSON_ERROR_INVALID;
+                    }
+                    c = (*++p == '0') ? '~' : '/';
+                }
+                if(k == SGV_JSON_QUERY_TEXT) {
+                    return SGV_JSON_ERROR_INVALID;
+                }
+                q->text[k++] = c;
+                if(c == '\\') {
+                    q->idx[j] = -2;
+                }
+            }
+
+            /* array index: digits without leading zeros */
+            s = q->text + q->seg[j];
+            len = k - q->seg[j];
+            if(q->idx[j] == -1 && len > 0 && len <= 9 &&
+               (s[0] != '0' || len == 1)) {
+                for(n = 0, idx = 0; n < len && SGVP_JSON_IS_DIGIT(s[n]); n++) {
+                    idx = idx * 10 + (s[n] - '0');
+                }
+                if(n == len) {
+                    q->idx[j] = idx;
+                }
+            }
+            j++;
+        }
+    }
+    q->first[i] = j;
+    q->seg[j] = k;
+    return 0;
+}
+
+/* Compares the raw text of a string, escapes and all, with the unescaped
+   string k */
+static int sgvp_json_raw_eq(const char* s, int len, const char* k, int k_len)
+{
+    const char* end = s + len;
+    char u[4];
+    int i, m, n;
+
+    while(s < end) {
+        if(*s != '\\') {
+            if(k_len == 0 || *s++ != *k++) {
+                return 0;
+            }
+            k_len--;
+            continue;
+        }
+        m = sgvp_json_unescape1(s + 1, end, u, &n);
+        if(m > k_len) {
+            return 0;
+        }
+        for(i = 0; i < m; i++) {
+            if(u[i] != k[i]) {
+                return 0;
+            }
+        }
+        s += n + 1;
+        k += m;
+        k_len -= m;
+    }
+    return k_len == 0;
+}
+
+/* Compares the raw text of a key with segment j of the query */
+static int sgvp_json_query_key(sgv_json_query* q, int j, const char* s, int len)
+{
+    const char* k = q->text + q->seg[j];
+    int k_len = q->seg[j + 1] - q->seg[j];
+
+    if(len == k_len) {
+        /* escapes make the raw text longer than the key */
+        return q->idx[j] != -2 && sgvp_json_memeq(s, k, len);
+    }
+    return len > k_len && sgvp_json_raw_eq(s, len, k, k_len);
+}
+
+/* Follows segments j .. end-1 of the query down from token t */
+static sgv_json_token* sgvp_json_query_tok(sgv_json_query* q, sgv_json_token* t,
+                                           int j, int end)
+{
+    sgv_json_token* pair;
+
+    for(; t && j < end; j++) {
+        if(sgvp_json_is(t, SGV_JSON_TOKEN_ARR)) {
+            t = (q->idx[j] >= 0) ? sgv_json_arr_value(t, q->idx[j]) :
+                                   SGVP_JSON_NULL;
+            continue;
+        }
+        pair = sgv_json_first_pair(t);
+        while(pair && !sgvp_json_query_key(q, j, sgvp_json_str(pair + 1),
+                                           pair[1].len)) {
+            pair = sgv_json_next_pair(pair);
+        }
+        t = pair ? pair + 2 : SGVP_JSON_NULL;
+    }
+    return t;
+}
+
+typedef struct {
+    sgv_json_query* q;
+    sgv_json_token* tokens;
+    int max_tokens;
+    int n;                  /* tokens needed so far */
+    sgv_json_token** results;
+    unsigned long pending;  /* paths not found yet */
+} sgvp_json_finder;
+
+/* Makes tokens for the value s[0..len-1] at depth d, which holds the
+   values of the paths in m */
+static int sgvp_json_query_build(sgvp_json_finder* r, char* s, int len,
+                                 int d, unsigned long m)
+{
+    sgvp_json_builder b;
+    sgv_json_token* root;
+    int i, ret;
+
+    b.tokens = r->tokens + (r->n < r->max_tokens ? r->n : 0);
+    b.max_tokens = (r->n < r->max_tokens) ? r->max_tokens - r->n : 0;
+    b.n = 0;
+    b.state = SGVP_ST_VALUE;
+    b.depth = 0;
+    if((ret = sgvp_json_lex(&b, s, len)) < 0) {
+        return ret;
+    }
+    if(b.state != SGVP_ST_DONE) {
+        return SGV_JSON_ERROR_INVALID;
+    }
+    root = (b.n <= b.max_tokens) ? b.tokens : SGVP_JSON_NULL;
+    r->n += b.n;
+
+    for(i = 0; i < r->q->n_paths; i++) {
+        if(m & (1ul << i)) {
+            r->results[i] = sgvp_json_query_tok(r->q, root, r->q->first[i] + d,
+                                                r->q->first[i + 1]);
+        }
+    }
+    r->pending &= ~m;
+    return 0;
+}
+
+/* Paths in m that may still match past member k of the container at
+   depth d (k is -1 for objects) */
+static unsigned long sgvp_json_query_more(sgv_json_query* q, unsigned long m,
+                                          int d, int k)
+{
+    int i;
+    if(k < 0) {
+        return m;
+    }
+    for(i = 0; i < q->n_paths; i++) {
+        if((m & (1ul << i)) && q->idx[q->first[i] + d] <= k) {
+            m &= ~(1ul << i);
+        }
+    }
+    return m;
+}
+
+enum {
+    SGVP_QY_VALUE,  /* at a value, wanted by the paths in m */
+    SGVP_QY_NEXT,   /* after a value */
+    SGVP_QY_MEMBER  /* at the next member of an object/array */
+};
+
+SGVJSON_DEF int sgv_json_query_run(sgv_json_query* q,
+                                   char* json_str, int json_str_len,
+                                   sgv_json_token* tokens, int max_tokens,
+                                   sgv_json_token** results)
+{
+    sgvp_json_finder r;
+    unsigned long mask[SGV_JSON_MAX_DEPTH], m;
+    int idx[SGV_JSON_MAX_DEPTH];
+    char closers[SGV_JSON_MAX_DEPTH];
+    char *p = json_str, *end = json_str + json_str_len, *s;
+    int i, j, d = 0, st = SGVP_QY_VALUE, hit, ret, len = 0;
+
+    r.q = q;
+    r.tokens = tokens;
+    r.max_tokens = max_tokens;
+    r.n = 0;
+    r.results = results;
+    r.pending = 0;
+    for(i = 0; i < q->n_paths; i++) {
+        results[i] = SGVP_JSON_NULL;
+        r.pending |= 1ul << i;
+    }
+    m = r.pending;
+
+    p = sgvp_json_ws(p, end);
+    while(r.pending) {
+        switch(st) {
+        case SGVP_QY_VALUE:
+            if(p == end) {
+                return SGV_JSON_ERROR_INVALID;
+            }
+            hit = 0;
+            for(i = 0; i < q->n_paths; i++) {
+                if((m & (1ul << i)) && q->first[i + 1] - q->first[i] == d) {
+                    hit = 1;
+                }
+            }
+            if(m && !hit && (*p == '{' || *p == '[')) {
+                /* descend */
+                if(d == SGV_JSON_MAX_DEPTH) {
+                    return SGV_JSON_ERROR_DEPTH;
+                }
+                mask[d] = m;
+                closers[d] = (char)(*p + 2);
+                idx[d++] = 0;
+                p = sgvp_json_ws(p + 1, end);
+                if(p < end && *p == closers[d - 1]) {
+                    p++;
+                    d--;
+                    st = SGVP_QY_NEXT;
+                } else {
+                    st = SGVP_QY_MEMBER;
+                }
+                break;
+            }
+            s = p;
+            if(!(p = sgvp_json_skip(p, end, 0, &ret))) {
+                return ret;
+            }
+            if(hit && (ret = sgvp_json_query_build(&r, s, p - s, d, m)) < 0) {
+                return ret;
+            }
+            st = SGVP_QY_NEXT;
+            break;
+
+        case SGVP_QY_NEXT:
+            p = sgvp_json_ws(p, end);
+            if(d == 0) {
+                if(p != end) {
+                    return SGV_JSON_ERROR_INVALID;
+                }
+                r.pending = 0;
+                break;
+            }
+            if(p < end && *p == closers[d - 1]) {
+                p++;
+                d--;
+                break;
+            }
+            if(p == end || *p != ',') {
+                return SGV_JSON_ERROR_INVALID;
+            }
+            if(!sgvp_json_query_more(q, mask[d - 1] & r.pending, d - 1,
+                                     closers[d - 1] == ']' ? idx[d - 1] : -1)) {
+                /* nothing more to find in this one */
+                if(!(p = sgvp_json_skip(p, end, closers[d - 1], &ret))) {
+                    return ret;
+                }
+                d--;
+                break;
+            }
+            p = sgvp_json_ws(p + 1, end);
+            idx[d - 1]++;
+            st = SGVP_QY_MEMBER;
+            break;
+
+        case SGVP_QY_MEMBER:
+            m = mask[d - 1] & r.pending;
+            if(closers[d - 1] == '}') {
+                if(p == end || *p != '"' || (len = sgvp_json_lex_str(p + 1, end)) < 0) {
+                    return SGV_JSON_ERROR_INVALID;
+                }
+                s = p + 1;
+                p = sgvp_json_ws(s + len + 1, end);
+                if(p == end || *p != ':') {
+                    return SGV_JSON_ERROR_INVALID;
+                }
+                p = sgvp_json_ws(p + 1, end);
+                for(i = 0; i < q->n_paths; i++) {
+                    j = q->first[i] + d - 1;
+                    if((m & (1ul << i)) && !sgvp_json_query_key(q, j, s, len)) {
+                        m &= ~(1ul << i);
+                    }
+                }
+                /* on duplicate keys the first one wins, like obj_value */
+                mask[d - 1] &= ~m;
+            } else {
+                for(i = 0; i < q->n_paths; i++) {
+                    j = q->first[i] + d - 1;
+                    if((m & (1ul << i)) && q->idx[j] != idx[d - 1]) {
+                        m &= ~(1ul << i);
+                    }
+                }
+            }
+            st = SGVP_QY_VALUE;
+            break;
+        }
+    }
+    return (r.n > max_tokens) ? r.n : 0;
+}
+
+/* Appends the fields of one descriptor, the terminating one included, to
+   the schema at n. Returns the new number of fields, -1 if they don't fit. */
+static int sgvp_json_schema_add(sgv_json_schema* sc, int n,
+                                sgv_json_field* fields)
+{
+    int len;
+    for(;;) {
+        if(n == SGV_JSON_SCHEMA_FIELDS) {
+            return -1;
+        }
+        sc->fields[n] = fields;
+        sc->nested[n] = -1;
+        if(!fields->key) {
+            return n + 1;
+        }
+        for(len = 0; fields->key[len]; len++);
+        sc->key_len[n] = len;
+        sc->hash[n++] = sgvp_json_hash(fields->key, len);
+        fields++;
+    }
+}
+
+SGVJSON_DEF int sgv_json_schema_init(sgv_json_schema* sc,
+                                     sgv_json_field* fields)
+{
+    sgv_json_field* f;
+    int i, j, n;
+
+    /* Descriptors are laid out one after the other. A nested one is added
+       the first time it is seen, so recursive structs work too. */
+    if((n = sgvp_json_schema_add(sc, 0, fields)) < 0) {
+        return SGV_JSON_ERROR_INVALID;
+    }
+    for(i = 0; i < n; i++) {
+        f = sc->fields[i];
+        if(!f->key || f->type != SGV_JSON_FIELD_OBJ) {
+            continue;
+        }
+        if(!f->nested) {
+            return SGV_JSON_ERROR_INVALID;
+        }
+        for(j = 0; j < n && sc->fields[j] != f->nested; j++);
+        if(j == n && (n = sgvp_json_schema_add(sc, n, f->nested)) < 0) {
+            return SGV_JSON_ERROR_INVALID;
+        }
+        sc->nested[i] = j;
+    }
+    return 0;
+}
+
+/* Finds the field for the raw key s (hashed to h) in the descriptor
+   starting at 'first'. Members usually come in the order of the fields,
+   so the search starts after the last field found (*hint). Returns -1 if
+   there is none. */
+static int sgvp_json_schema_find(sgv_json_schema* sc, int first, int* hint,
+                                 const char* s, int len, unsigned int h)
+{
+    int i, pass;
+
+    for(pass = 0; pass < 2; pass++) {
+        for(i = *hint; sc->fields[i]->key; i++) {
+            if(sc->hash[i] == h && sc->key_len[i] == len &&
+               sgvp_json_memeq(s, sc->fields[i]->key, len)) {
+                *hint = sc->fields[i + 1]->key ? i + 1 : first;
+                return i;
+            }
+        }
+        if(*hint == first) {
+            break;
+        }
+        *hint = first;
+    }
+
+    /* keys with escapes hash differently */
+    for(i = 0; i < len && s[i] != '\\'; i++);
+    if(i < len) {
+        for(i = first; sc->fields[i]->key; i++) {
+            if(sgvp_json_raw_eq(s, len, sc->fields[i]->key, sc->key_len[i])) {
+                return i;
+            }
+        }
+    }
+    return -1;
+}
+
+/* Stores the scalar value at p in the member 'dst' of type 'type'. Returns
+   the end of the value, NULL on error. */
+static char* sgvp_json_store(int type, char* dst, char* p, char* end,
+                             int* err)
+{
+    sgv_json_u64 u = 0;
+    sgv_json_i64 n = 0;
+    double d = 0;
+    int len, kind;
+    char* s;
+
+    *err = SGV_JSON_ERROR_TYPE;
+    switch(type) {
+    case SGV_JSON_FIELD_STRING:
+        if(*p != '"') {
+            return 0;
+        }
+        if((len = sgvp_json_lex_str(p + 1, end)) < 0) {
+            *err = SGV_JSON_ERROR_INVALID;
+            return 0;
+        }
+        ((sgv_json_string*)dst)->str = p + 1;
+        ((sgv_json_string*)dst)->len = len;
+        return p + len + 2;
+
+    case SGV_JSON_FIELD_JSON:
+        if(!(s = sgvp_json_skip(p, end, 0, err))) {
+            return 0;
+        }
+        ((sgv_json_string*)dst)->str = p;
+        ((sgv_json_string*)dst)->len = s - p;
+        return s;
+
+    case SGV_JSON_FIELD_BOOL:
+        if((len = sgvp_json_lex_lit(p, end, "true", 4)) != 0) {
+            *(int*)dst = 1;
+        } else if((len = sgvp_json_lex_lit(p, end, "false", 5)) != 0) {
+            *(int*)dst = 0;
+        } else {
+            return 0;
+        }
+        return p + len;
+    }
+
+    /* numbers */
+    if(*p != '-' && !SGVP_JSON_IS_DIGIT(*p)) {
+        return 0;
+    }
+    if((len = sgvp_json_lex_num(p, end)) == 0) {
+        *err = SGV_JSON_ERROR_INVALID;
+        return 0;
+    }
+    kind = sgvp_json_decode(p, len, &u, &d);
+    switch(type) {
+    case SGV_JSON_FIELD_INT:
+        if(sgvp_json_to_i64(kind, u, d, -2147483648.0, 2147483647.0, &n)) {
+            return 0;
+        }
+        *(int*)dst = (int)n;
+        break;
+    case SGV_JSON_FIELD_INT64:
+        if(sgvp_json_to_i64(kind, u, d, -9223372036854775808.0,
+                            9223372036854775807.0, (sgv_json_i64*)dst)) {
+            return 0;
+        }
+        break;
+    case SGV_JSON_FIELD_UINT64:
+        if(sgvp_json_to_u64(kind, u, d, (sgv_json_u64*)dst)) {
+            return 0;
+        }
+        break;
+    case SGV_JSON_FIELD_FLOAT:
+        sgvp_json_to_double(kind, u, d, &d);
+        *(float*)dst = (float)d;
+        break;
+    case SGV_JSON_FIELD_DOUBLE:
+        sgvp_json_to_double(kind, u, d, (double*)dst);
+        break;
+    default:
+        return 0;
+    }
+    return p + len;
+}
+
+SGVJSON_DEF int sgv_json_decode_struct(sgv_json_schema* sc,
+                                       char* json_str, int json_str_len,
+                                       void* out)
+{
+    char* base[SGV_JSON_MAX_DEPTH];
+    int desc[SGV_JSON_MAX_DEPTH], hint[SGV_JSON_MAX_DEPTH];
+    char *p, *end = json_str + json_str_len, *s;
+    sgv_json_field* f;
+    unsigned int h;
+    int depth, i, len, err;
+
+    p = sgvp_json_ws(json_str, end);
+    if(p == end || *p != '{') {
+        return (p == end) ? SGV_JSON_ERROR_INVALID : SGV_JSON_ERROR_TYPE;
+    }
+    base[0] = (char*)out;
+    desc[0] = hint[0] = 0;
+    depth = 1;
+    p = sgvp_json_ws(p + 1, end);
+    if(p < end && *p == '}') {
+        p++;
+        depth = 0;
+    }
+
+    while(depth > 0) {
+        /* a member of the innermost object, the key is hashed as it is
+           scanned */
+        if(p == end || *p != '"') {
+            return SGV_JSON_ERROR_INVALID;
+        }
+        s = ++p;
+        h = 2166136261u;
+        while(p < end && *p != '"' && *p != '\\' && (unsigned char)*p >= 0x20) {
+            h = (h ^ (unsigned char)*p++) * 16777619u;
+        }
+        if(p < end && *p == '"') {
+            len = p - s;
+        } else if((len = sgvp_json_lex_str(s, end)) < 0) {
+            return SGV_JSON_ERROR_INVALID;
+        } else {
+            h = sgvp_json_hash(s, len);
+        }
+        p = sgvp_json_ws(s + len + 1, end);
+        if(p == end || *p != ':') {
+            return SGV_JSON_ERROR_INVALID;
+        }
+        p = sgvp_json_ws(p + 1, end);
+        if(p == end) {
+            return SGV_JSON_ERROR_INVALID;
+        }
+
+        i = sgvp_json_schema_find(sc, desc[depth - 1], &hint[depth - 1],
+                                  s, len, h);
+        f = (i < 0 || *p == 'n') ? 0 : sc->fields[i];
+        if(!f) {
+            /* not wanted, or null which leaves the member alone */
+            if(!(p = sgvp_json_skip(p, end, 0, &err))) {
+                return err;
+            }
+        } else if(f->type == SGV_JSON_FIELD_OBJ) {
+            if(*p != '{') {
+                return SGV_JSON_ERROR_TYPE;
+            }
+            if(depth == SGV_JSON_MAX_DEPTH) {
+                return SGV_JSON_ERROR_DEPTH;
+            }
+            base[depth] = base[depth - 1] + f->offset;
+            desc[depth] = hint[depth] = sc->nested[i];
+            depth++;
+            p = sgvp_json_ws(p + 1, end);
+            if(p == end || *p != '}') {
+                continue;
+            }
+            p++;
+            depth--;
+        } else if(!(p = sgvp_json_store(f->type, base[depth - 1] + f->offset,
+                                        p, end, &err))) {
+            return err;
+        }
+
+        /* ',' or the ends of objects */
+        while(depth > 0) {
+            p = sgvp_json_ws(p, end);
+            if(p < end && *p == ',') {
+                p = sgvp_json_ws(p + 1, end);
+                break;
+            }
+            if(p == end || *p != '}') {
+                return SGV_JSON_ERROR_INVALID;
+            }
+            p++;
+            depth--;
+        }
+    }
+    return (sgvp_json_ws(p, end) == end) ? 0 : SGV_JSON_ERROR_INVALID;
+}
+
+#ifdef SGV_JSON_MMAP
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Snapshot layout: this header, the tokens, then the text. String offsets
+   in the tokens are relative to the token, so they hold wherever the file
+   is mapped. */
+#define SGVP_JSON_SNAP_VERSION 2
+
+typedef struct {
+    char magic[4];          /* "SGVJ" */
+    unsigned int order;     /* 0x01020304 in the byte order of the writer */
+    int version;
+    int token_size;         /* sizeof(sgv_json_token) of the writer */
+    int n_tokens;
+    int text_len;
+    sgv_json_i64 src_size;  /* the source file when the snapshot was made */
+    sgv_json_i64 src_mtime;
+} sgvp_json_snap;
+
+/* Maps the whole file, writable with copy-on-write or read-only */
+static int sgvp_json_map(const char* path, sgv_json_map* map, int writable)
+{
+    struct stat st;
+    void* p;
+    int fd;
+
+    map->base = 0;
+    map->size = 0;
+    if((fd = open(path, writable ? O_RDWR : O_RDONLY)) < 0 &&
+       (!writable || (fd = open(path, O_RDONLY)) < 0)) {
+        return SGV_JSON_ERROR_FILE;
+    }
+    if(fstat(fd, &st) || st.st_size > 2147483647) {
+        close(fd);
+        return SGV_JSON_ERROR_FILE;
+    }
+    map->src_size = (sgv_json_i64)st.st_size;
+    map->src_mtime = (sgv_json_i64)st.st_mtime;
+    if(st.st_size > 0) {
+        p = mmap(0, (size_t)st.st_size, PROT_READ | (writable ? PROT_WRITE : 0),
+                 writable ? MAP_PRIVATE : MAP_SHARED, fd, 0);
+        if(p == MAP_FAILED) {
+            close(fd);
+            return SGV_JSON_ERROR_FILE;
+        }
+        map->base = p;
+        map->size = (int)st.st_size;
+    }
+    close(fd);
+    map->data = (char*)map->base;
+    map->len = map->size;
+    return 0;
+}
+
+SGVJSON_DEF void sgv_json_unmap(sgv_json_map* map)
+{
+    if(map->base) {
+        munmap(map->base, (size_t)map->size);
+    }
+    map->base = map->data = 0;
+    map->size = map->len = 0;
+}
+
+SGVJSON_DEF int sgv_json_parse_file(const char* path, sgv_json_map* map,
+                                    sgv_json_token* tokens, int max_tokens,
+                                    int flags)
+{
+    int r;
+    if((r = sgvp_json_map(path, map, 1)) < 0) {
+        return r;
+    }
+    if((r = sgv_json_parse_ex(map->data, map->len, tokens, max_tokens, flags)) < 0) {
+        sgv_json_unmap(map);
+    }
+    return r;
+}
+
+SGVJSON_DEF int sgv_json_save_snapshot(const char* path, sgv_json_map* map,
+                                       sgv_json_token* tokens)
+{
+    sgv_json_token buf[256];
+    sgvp_json_snap h;
+    sgv_json_u64 u;
+    double d;
+    char tmp[1024];
+    FILE* f;
+    int i, j, n, text_off, ok;
+
+    n = sgvp_json_is(tokens, SGV_JSON_TOKEN_OBJ) ||
+        sgvp_json_is(tokens, SGV_JSON_TOKEN_ARR) ? tokens->len : 1;
+
+    /* decode every number now, so that nothing is written to the tokens
+       once they are mapped read-only */
+    for(i = 0; i < n; i++) {
+        if(sgvp_json_is(&tokens[i], SGV_JSON_TOKEN_VAL_NUM)) {
+            sgvp_json_num(&tokens[i], &u, &d);
+        }
+    }
+
+    h.magic[0] = 'S'; h.magic[1] = 'G'; h.magic[2] = 'V'; h.magic[3] = 'J';
+    h.order = 0x01020304u;
+    h.version = SGVP_JSON_SNAP_VERSION;
+    h.token_size = (int)sizeof(sgv_json_token);
+    h.n_tokens = n;
+    h.text_len = map->len;
+    h.src_size = map->src_size;
+    h.src_mtime = map->src_mtime;
+    text_off = (int)sizeof(h) + n * (int)sizeof(sgv_json_token);
+
+    /* written next to the snapshot and renamed over it, so that readers
+       never see half a file */
+    for(i = 0; path[i] && i < (int)sizeof(tmp) - 5; i++) {
+        tmp[i] = path[i];
+    }
+    if(path[i]) {
+        return SGV_JSON_ERROR_FILE;
+    }
+    tmp[i++] = '.'; tmp[i++] = 't'; tmp[i++] = 'm'; tmp[i++] = 'p'; tmp[i] = 0;
+    if(!(f = fopen(tmp, "wb"))) {
+        return SGV_JSON_ERROR_FILE;
+    }
+    ok = fwrite(&h, sizeof(h), 1, f) == 1;
+    for(i = 0; ok && i < n; i += j) {
+        for(j = 0; j < 256 && i + j < n; j++) {
+            buf[j] = tokens[i + j];
+            if((buf[j].tag & SGVP_JSON_TYPE) >= SGV_JSON_TOKEN_KEY) {
+                buf[j].u.str = text_off + (sgvp_json_str(&tokens[i + j]) - map->data) -
+                               ((int)sizeof(h) + (i + j) * (int)sizeof(sgv_json_token));
+            }
+        }
+        ok = fwrite(buf, sizeof(sgv_json_token), j, f) == (size_t)j;
+    }
+    ok = ok && fwrite(map->data, 1, map->len, f) == (size_t)map->len;
+    ok = !fclose(f) && ok;
+    if(!ok || rename(tmp, path)) {
+        remove(tmp);
+        return SGV_JSON_ERROR_FILE;
+    }
+    return 0;
+}
+
+SGVJSON_DEF int sgv_json_load_snapshot(const char* path,
+                                       const char* source_path,
+                                       sgv_json_map* map,
+                                       sgv_json_token** root)
+{
+    sgvp_json_snap h;
+    sgv_json_i64 size = 0, mtime = 0;
+    struct stat st;
+    int r;
+
+    if(source_path) {
+        if(stat(source_path, &st)) {
+            return SGV_JSON_ERROR_FILE;
+        }
+        size = (sgv_json_i64)st.st_size;
+        mtime = (sgv_json_i64)st.st_mtime;
+    }
+    if((r = sgvp_json_map(path, map, 0)) < 0) {
+        return r;
+    }
+    if(map->size < (int)sizeof(h)) {
+        sgv_json_unmap(map);
+        return SGV_JSON_ERROR_FILE;
+    }
+    h = *(sgvp_json_snap*)map->base;
+    if(h.magic[0] != 'S' || h.magic[1] != 'G' || h.magic[2] != 'V' ||
+       h.magic[3] != 'J' || h.order != 0x01020304u ||
+       h.version != SGVP_JSON_SNAP_VERSION ||
+       h.token_size != (int)sizeof(sgv_json_token) || h.n_tokens < 1 ||
+       h.text_len < 0 || h.n_tokens > (map->size - (int)sizeof(h)) / h.token_size ||
+       map->size != (int)sizeof(h) + h.n_tokens * h.token_size + h.text_len ||
+       (source_path && (h.src_size != size || h.src_mtime != mtime))) {
+        sgv_json_unmap(map);
+        return SGV_JSON_ERROR_FILE;
+    }
+    *root = (sgv_json_token*)((char*)map->base + sizeof(h));
+    map->data = (char*)(*root + h.n_tokens);
+    map->len = h.text_len;
+    return 0;
+}
+#endif
+
 #endif
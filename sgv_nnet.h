@@ -0,0 +1,804 @@
+/*  sgv_nnet.h - Public domain lib to run small convnets described in JSON
+
+Do this:
+    #define SGV_NNET_IMPLEMENTATION
+before you include this file in *one* C or C++ file to create the
+implementation. It includes sgv_json.h and sgv_imgproc.h, whose
+implementations must be compiled in (in the same file or another one).
+
+NOTES
+-----
+
+- This library is C89 conformant and does no heap allocation. The net is
+  held in an sgv_nnet (which can be static), the JSON tokens, the weights
+  and the arena are given by the caller.
+- The weights are not copied, they must outlive the net. The JSON text and
+  its tokens are only needed by sgv_nnet_load.
+- Every intermediate tensor lives in one arena, sized and laid out once by
+  sgv_nnet_load, so sgv_nnet_run allocates nothing. Tensors whose lifetimes
+  (from the layer that makes one to the last layer that reads it) do not
+  overlap share memory, largest first. relu and softmax run in place when
+  nothing else reads their input.
+- Layers run with the batched routines of sgv_imgproc.h, in parallel if a
+  parallel-for is set there.
+- For images too big to hold every tensor of, sgv_nnet_plan_stream plans
+  the arena again with each tensor a line buffer of the rows its readers
+  need at once, and sgv_nnet_stream runs the layers over strips of rows,
+  each as soon as the rows it reads are made. The input is read in strips
+  by a callback (say, sgv_make_fimg on rows of a camera frame) and the
+  outputs are handed to another one as their rows are done, so the arena
+  grows with the width of the image and not its area.
+
+MODEL
+-----
+
+{
+    "input": [32, 32, 3],                  (w, h, d of one image)
+    "batch": 16,                           (images per run, 1 if left out)
+    "layers": [
+        {"op": "conv2d_valid", "filter": [5, 5], "outd": 16},
+        {"op": "relu"},
+        {"name": "p1", "op": "maxpool2"},
+        {"op": "conv2d_bias_relu_maxpool2", "filter": [3, 3], "outd": 32},
+        {"op": "conv2d_valid", "filter": [6, 6], "outd": 10, "bias": false},
+        {"name": "probs", "op": "softmax"}
+    ],
+    "outputs": ["probs", "p1"]             (the last layer if left out)
+}
+
+A layer reads the output of the one before it, or of the layer named by
+its "input" ("input" itself being the input of the net). softmax is taken
+over the channels of every pixel. The weights are floats, one after another
+in the order of the layers: for each conv its filter (as sgv_filt) and then
+its outd biases, unless "bias" is false.
+
+EXAMPLE
+-------
+
+sgv_nnet net; (static, it is a few KB)
+sgv_json_token tokens[256];
+sgv_nnet_weights wts;
+
+if(sgv_nnet_map_weights("model.bin", &wts) == 0 &&
+   sgv_nnet_load(&net, json, json_len, tokens, 256, wts.data, wts.n) == 0) {
+    float* arena = malloc(net.arena_size*sizeof(float));
+    sgv_fimg probs = sgv_nnet_run(&net, images, arena);
+    ...
+}
+
+OPTIONS
+-------
+
+- If you want all functions in this lib to be static,
+    #define SGV_NNET_STATIC
+- To change the maximum number of layers (default 64) and outputs
+  (default 8) of a net,
+    #define SGV_NNET_MAX_LAYERS 256
+    #define SGV_NNET_MAX_OUTPUTS 16
+- If you dont want <assert.h>, #define SGV_NNET_ASSERT(x)
+- To map weight files (needs POSIX mmap),
+    #define SGV_NNET_MMAP
+
+LICENSE
+-------
+
+This software is in the public domain. Where that dedication is not
+recognized, redistribution and use in source and binary forms, with
+or without modification, are permitted. No warranty for any purpose
+is expressed or implied.
+
+*/
+
+#ifndef SGV_NNET_H
+#define SGV_NNET_H
+
+#include "sgv_json.h"
+#include "sgv_imgproc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef SGV_NNET_STATIC
+#define SGVNNET_DEF static
+#else
+#define SGVNNET_DEF extern
+#endif
+
+#ifndef SGV_NNET_MAX_LAYERS
+#define SGV_NNET_MAX_LAYERS 64
+#endif
+
+#ifndef SGV_NNET_MAX_OUTPUTS
+#define SGV_NNET_MAX_OUTPUTS 8
+#endif
+
+/*****************************************************************************
+****************************** Public API ***********************************/
+
+/* Errors returned by sgv_nnet_load */
+#define SGV_NNET_ERROR_JSON    (-1) /* the model is not valid JSON */
+#define SGV_NNET_ERROR_MODEL   (-2) /* unknown op, bad shape, name, ... */
+#define SGV_NNET_ERROR_WEIGHTS (-3) /* the weights don't add up */
+#define SGV_NNET_ERROR_LAYERS  (-4) /* over SGV_NNET_MAX_LAYERS/_OUTPUTS */
+#define SGV_NNET_ERROR_FILE    (-5) /* a file can't be read */
+
+typedef enum {
+    SGV_NNET_CONV,      /* sgv_conv2d_valid, then sgv_add_bias if biased */
+    SGV_NNET_CONV_POOL, /* sgv_conv2d_bias_relu_maxpool2 */
+    SGV_NNET_RELU,
+    SGV_NNET_MAXPOOL2,
+    SGV_NNET_SOFTMAX
+} sgv_nnet_op;
+
+typedef struct {
+    sgv_nnet_op op;
+    int in, out;        /* tensors read and written */
+    sgv_filt filt;      /* convs */
+    float* biases;      /* convs, NULL for none */
+} sgv_nnet_layer;
+
+/* Tensor 0 is the input, tensor i+1 the output of layer i */
+typedef struct {
+    int w, h, d;        /* of one image */
+    long size;          /* floats, for the whole batch */
+    long offset;        /* floats into the arena */
+    int first, last;    /* the layer making it, the last one reading it */
+    int home;           /* the tensor it shares memory with (in place) */
+    int rows;           /* rows held at once, h unless streaming */
+} sgv_nnet_tensor;
+
+typedef struct {
+    sgv_nnet_layer layers[SGV_NNET_MAX_LAYERS];
+    sgv_nnet_tensor tensors[SGV_NNET_MAX_LAYERS + 1];
+    int outputs[SGV_NNET_MAX_OUTPUTS];
+    int n_layers, n_outputs, batch;
+    int strip;          /* rows per strip when streaming, else 0 */
+    long arena_size;    /* floats sgv_nnet_run needs */
+    long naive_size;    /* floats with a buffer per tensor */
+} sgv_nnet;
+
+/* Parses the model (see MODEL above) with the given tokens, takes the
+   weights from n_weights floats and plans the arena. Returns 0 on success,
+   a negative SGV_NNET_ERROR_* on error, or the number of tokens needed
+   (positive) if max_tokens is too few. */
+SGVNNET_DEF int sgv_nnet_load(sgv_nnet* net, char* json, int json_len,
+                              sgv_json_token* tokens, int max_tokens,
+                              float* weights, long n_weights);
+
+/* Runs the net on a batch of net->batch images (see sgv_imgproc.h), of the
+   w, h and d of the model's input, with an arena of net->arena_size floats.
+   Returns the first output, which is in the arena. */
+SGVNNET_DEF sgv_fimg sgv_nnet_run(sgv_nnet* net, sgv_fimg in, float* arena);
+
+/* Output i of the last run in that arena, a batch of net->batch images */
+SGVNNET_DEF sgv_fimg sgv_nnet_output(sgv_nnet* net, float* arena, int i);
+
+/* Fills rows [y, y + rows.h) of the input into rows */
+typedef void (*sgv_nnet_read_rows)(void* user, int y, sgv_fimg rows);
+
+/* Rows [y, y + rows.h) of output i, only valid during the call */
+typedef void (*sgv_nnet_write_rows)(void* user, int i, int y, sgv_fimg rows);
+
+/* Plans the arena of a loaded net (with a batch of 1) for sgv_nnet_stream,
+   which then makes strip rows of a tensor at a time. Even strips suit the
+   Winograd convs and the pooling best; pick them so a strip of every layer
+   stays in cache. Returns 0, or SGV_NNET_ERROR_MODEL. sgv_nnet_run needs
+   the net loaded again. */
+SGVNNET_DEF int sgv_nnet_plan_stream(sgv_nnet* net, int strip);
+
+/* Runs the net on one image in strips of rows, with an arena of
+   net->arena_size floats as planned by sgv_nnet_plan_stream. The input
+   rows are asked of read in order, and every row of each output is given
+   to write once, in order, as soon as it is made. */
+SGVNNET_DEF void sgv_nnet_stream(sgv_nnet* net, sgv_nnet_read_rows read,
+                                 sgv_nnet_write_rows write, void* user,
+                                 float* arena);
+
+#ifdef SGV_NNET_MMAP
+typedef struct {
+    float* data;
+    long n;             /* floats */
+    void* base;         /* private */
+    long size;
+} sgv_nnet_weights;
+
+/* Maps a file of weights read-only and shared, so all the processes
+   running the same model share its pages. Returns 0 on success,
+   SGV_NNET_ERROR_FILE if it can't be mapped. Release with
+   sgv_nnet_unmap_weights once done with the nets using it. */
+SGVNNET_DEF int sgv_nnet_map_weights(const char* path, sgv_nnet_weights* w);
+
+SGVNNET_DEF void sgv_nnet_unmap_weights(sgv_nnet_weights* w);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/*****************************************************************************
+*****************************************************************************/
+
+#ifdef SGV_NNET_IMPLEMENTATION
+
+#ifndef SGV_NNET_ASSERT
+#include <assert.h>
+#define SGV_NNET_ASSERT(x) assert(x)
+#endif
+
+#include <string.h>
+
+/* Offsets in the arena are multiples of this many floats (a cache line) */
+#define SGVP_NNET_ALIGN 16
+
+/* sgv_json_obj_value, for string literals in C++ too */
+static sgv_json_token* sgvp_nnet_get(sgv_json_token* obj, const char* key)
+{
+    return sgv_json_obj_value(obj, (char*)key);
+}
+
+/* Names of the tensors while loading, pointing into the JSON text */
+typedef struct {
+    char* str;
+    int len;
+} sgvp_nnet_name;
+
+static int sgvp_nnet_streq(const char* s, int len, const char* key)
+{
+    int i;
+    for(i = 0; i < len; i++) {
+        if(s[i] != key[i]) {
+            return 0;
+        }
+    }
+    return key[len] == '\0';
+}
+
+/* The latest of tensors [0, n) with the name in value, -1 if none */
+static int sgvp_nnet_find(sgvp_nnet_name* names, int n, sgv_json_token* value)
+{
+    char* s;
+    int len, i, k;
+
+    if(sgv_json_value_string(value, &s, &len)) {
+        return -1;
+    }
+    for(i = n - 1; i >= 0; i--) {
+        if(names[i].len == len) {
+            for(k = 0; k < len && names[i].str[k] == s[k]; k++) {
+            }
+            if(k == len) {
+                return i;
+            }
+        }
+    }
+    return -1;
+}
+
+/* Reads an array of exactly n positive ints */
+static int sgvp_nnet_ints(sgv_json_token* value, int* v, int n)
+{
+    int i;
+
+    if(!sgv_json_value_array(value) || sgv_json_arr_value(value, n)) {
+        return -1;
+    }
+    for(i = 0; i < n; i++) {
+        if(sgv_json_value_int(sgv_json_arr_value(value, i), v + i) || v[i] < 1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Layer i from its JSON object, with its weights from *pos on */
+static int sgvp_nnet_layer(sgv_nnet* net, int i, sgv_json_token* obj,
+                           sgvp_nnet_name* names, float* weights,
+                           long n_weights, long* pos)
+{
+    static const char* ops[] = {"conv2d_valid", "conv2d_bias_relu_maxpool2",
+                                "relu", "maxpool2", "softmax"};
+    sgv_nnet_layer* l = net->layers + i;
+    sgv_nnet_tensor *in, *out = net->tensors + i + 1;
+    sgv_json_token* v;
+    char* s;
+    int len, f[2], outd, bias = 1;
+    long k;
+
+    if(!sgv_json_value_obj(obj) ||
+       sgv_json_value_string(sgvp_nnet_get(obj, "op"), &s, &len)) {
+        return SGV_NNET_ERROR_MODEL;
+    }
+    for(k = 0; k < (long)(sizeof(ops)/sizeof(ops[0])); k++) {
+        if(sgvp_nnet_streq(s, len, ops[k])) {
+            break;
+        }
+    }
+    if(k == (long)(sizeof(ops)/sizeof(ops[0]))) {
+        return SGV_NNET_ERROR_MODEL;
+    }
+    l->op = (sgv_nnet_op)k;
+
+    l->in = i;
+    if((v = sgvp_nnet_get(obj, "input")) &&
+       (l->in = sgvp_nnet_find(names, i + 1, v)) < 0) {
+        return SGV_NNET_ERROR_MODEL;
+    }
+    l->out = i + 1;
+    names[i + 1].len = 0;
+    if((v = sgvp_nnet_get(obj, "name")) &&
+       sgv_json_value_string(v, &names[i + 1].str, &names[i + 1].len)) {
+        return SGV_NNET_ERROR_MODEL;
+    }
+
+    in = net->tensors + l->in;
+    out->w = in->w;
+    out->h = in->h;
+    out->d = in->d;
+    l->filt.data = l->biases = 0;
+    switch(l->op) {
+    case SGV_NNET_CONV:
+    case SGV_NNET_CONV_POOL:
+        if(sgvp_nnet_ints(sgvp_nnet_get(obj, "filter"), f, 2) ||
+           sgv_json_value_int(sgvp_nnet_get(obj, "outd"), &outd) || outd < 1) {
+            return SGV_NNET_ERROR_MODEL;
+        }
+        if(l->op == SGV_NNET_CONV && (v = sgvp_nnet_get(obj, "bias")) &&
+           sgv_json_value_bool(v, &bias)) {
+            return SGV_NNET_ERROR_MODEL;
+        }
+        l->filt.w = f[0];
+        l->filt.h = f[1];
+        l->filt.ind = in->d;
+        l->filt.outd = outd;
+        k = (long)f[0]*f[1]*in->d*outd;
+        if(n_weights - *pos < k + (bias ? outd : 0)) {
+            return SGV_NNET_ERROR_WEIGHTS;
+        }
+        l->filt.data = weights + *pos;
+        *pos += k;
+        if(bias) {
+            l->biases = weights + *pos;
+            *pos += outd;
+        }
+        out->w = in->w - f[0] + 1;
+        out->h = in->h - f[1] + 1;
+        out->d = outd;
+        if(l->op == SGV_NNET_CONV_POOL) {
+            out->w /= 2;
+            out->h /= 2;
+        }
+        break;
+    case SGV_NNET_MAXPOOL2:
+        out->w /= 2;
+        out->h /= 2;
+        break;
+    default:
+        break;
+    }
+    return (out->w < 1 || out->h < 1) ? SGV_NNET_ERROR_MODEL : 0;
+}
+
+/* Lifetimes, then offsets: tensors largest first, each at the lowest offset
+   clear of those placed before it that are alive at the same time */
+static void sgvp_nnet_plan(sgv_nnet* net)
+{
+    sgv_nnet_tensor *t = net->tensors, *p, *q;
+    sgv_nnet_layer* l;
+    int order[SGV_NNET_MAX_LAYERS];
+    int n = net->n_layers, m, i, j, k;
+    long off;
+
+    for(i = 0; i <= n; i++) {
+        t[i].size = (long)net->batch*t[i].w*t[i].h*t[i].d;
+        t[i].size = (t[i].size + SGVP_NNET_ALIGN - 1)/SGVP_NNET_ALIGN*SGVP_NNET_ALIGN;
+        t[i].first = t[i].last = i - 1;
+        t[i].home = i;
+        t[i].rows = t[i].h;
+        t[i].offset = 0;
+    }
+    for(i = 0; i < n; i++) {
+        t[net->layers[i].in].last = i;
+    }
+    for(i = 0; i < net->n_outputs; i++) {
+        t[net->outputs[i]].last = n;
+    }
+
+    /* relu and softmax overwrite an input that nothing reads afterwards */
+    for(i = 0; i < n; i++) {
+        l = net->layers + i;
+        k = l->in;
+        if((l->op == SGV_NNET_RELU || l->op == SGV_NNET_SOFTMAX) &&
+           k > 0 && t[k].last == i) {
+            t[l->out].home = t[k].home;
+            p = t + t[k].home;
+            p->last = t[l->out].last > p->last ? t[l->out].last : p->last;
+        }
+    }
+
+    m = 0;
+    net->naive_size = 0;
+    for(i = 1; i <= n; i++) {
+        net->naive_size += t[i].size;
+        if(t[i].home != i) {
+            continue;
+        }
+        for(j = m++; j > 0 && t[order[j - 1]].size < t[i].size; j--) {
+            order[j] = order[j - 1];
+        }
+        order[j] = i;
+    }
+
+    net->arena_size = 0;
+    for(i = 0; i < m; i++) {
+        p = t + order[i];
+        off = 0;
+        for(j = 0; j < i; j++) {
+            q = t + order[j];
+            if(q->first <= p->last && p->first <= q->last &&
+               q->offset < off + p->size && off < q->offset + q->size) {
+                off = q->offset + q->size;
+                j = -1;
+            }
+        }
+        p->offset = off;
+        if(off + p->size > net->arena_size) {
+            net->arena_size = off + p->size;
+        }
+    }
+    for(i = 1; i <= n; i++) {
+        t[i].offset = t[t[i].home].offset;
+    }
+    net->strip = 0;
+}
+
+SGVNNET_DEF int sgv_nnet_load(sgv_nnet* net, char* json, int json_len,
+                              sgv_json_token* tokens, int max_tokens,
+                              float* weights, long n_weights)
+{
+    sgvp_nnet_name names[SGV_NNET_MAX_LAYERS + 1];
+    sgv_json_token *v, *el;
+    int r, n, in[3];
+    long pos = 0;
+
+    if((r = sgv_json_parse(json, json_len, tokens, max_tokens)) != 0) {
+        return r > 0 ? r : SGV_NNET_ERROR_JSON;
+    }
+    if(!sgv_json_value_obj(tokens) ||
+       sgvp_nnet_ints(sgvp_nnet_get(tokens, "input"), in, 3)) {
+        return SGV_NNET_ERROR_MODEL;
+    }
+    net->batch = 1;
+    if((v = sgvp_nnet_get(tokens, "batch")) &&
+       (sgv_json_value_int(v, &net->batch) || net->batch < 1)) {
+        return SGV_NNET_ERROR_MODEL;
+    }
+    net->tensors[0].w = in[0];
+    net->tensors[0].h = in[1];
+    net->tensors[0].d = in[2];
+    names[0].str = (char*)"input";
+    names[0].len = 5;
+
+    n = 0;
+    v = sgv_json_value_array(sgvp_nnet_get(tokens, "layers"));
+    for(el = sgv_json_first_element(v); el; el = sgv_json_next_element(el), n++) {
+        if(n == SGV_NNET_MAX_LAYERS) {
+            return SGV_NNET_ERROR_LAYERS;
+        }
+        if((r = sgvp_nnet_layer(net, n, sgv_json_element_value(el), names,
+                                weights, n_weights, &pos)) < 0) {
+            return r;
+        }
+    }
+    if(n == 0) {
+        return SGV_NNET_ERROR_MODEL;
+    }
+    if(pos != n_weights) {
+        return SGV_NNET_ERROR_WEIGHTS;
+    }
+    net->n_layers = n;
+
+    net->n_outputs = 0;
+    if((v = sgvp_nnet_get(tokens, "outputs"))) {
+        if(!sgv_json_value_array(v)) {
+            return SGV_NNET_ERROR_MODEL;
+        }
+        for(el = sgv_json_first_element(v); el; el = sgv_json_next_element(el)) {
+            if(net->n_outputs == SGV_NNET_MAX_OUTPUTS) {
+                return SGV_NNET_ERROR_LAYERS;
+            }
+            r = sgvp_nnet_find(names, n + 1, sgv_json_element_value(el));
+            if(r < 1) {
+                return SGV_NNET_ERROR_MODEL;
+            }
+            net->outputs[net->n_outputs++] = r;
+        }
+    }
+    if(net->n_outputs == 0) {
+        net->outputs[net->n_outputs++] = n;
+    }
+
+    sgvp_nnet_plan(net);
+    return 0;
+}
+
+/* Tensor k of the batch, the input or in the arena */
+static sgv_fimg sgvp_nnet_view(sgv_nnet* net, sgv_fimg in, float* arena, int k)
+{
+    sgv_nnet_tensor* t = net->tensors + k;
+    sgv_fimg v;
+
+    if(k == 0) {
+        return in;
+    }
+    v.data = arena + t->offset;
+    v.w = t->w;
+    v.h = t->h;
+    v.d = t->d;
+    return v;
+}
+
+/* Layer l from a to b, batches of n images */
+static void sgvp_nnet_exec(sgv_nnet_layer* l, sgv_fimg a, sgv_fimg b, int n)
+{
+    sgv_fimg a1 = a, b1 = b;
+    int j;
+
+    switch(l->op) {
+    case SGV_NNET_CONV:
+        sgv_conv2d_valid_batch(a, n, l->filt, b);
+        if(l->biases) {
+            b.h *= n;
+            sgv_add_bias(b, l->biases);
+        }
+        break;
+    case SGV_NNET_CONV_POOL:
+        for(j = 0; j < n; j++) {
+            a1.data = a.data + j*a.h*a.w*a.d;
+            b1.data = b.data + j*b.h*b.w*b.d;
+            sgv_conv2d_bias_relu_maxpool2(a1, l->filt, l->biases, b1);
+        }
+        break;
+    case SGV_NNET_RELU:
+        sgv_relu_batch(a, n, b);
+        break;
+    case SGV_NNET_MAXPOOL2:
+        sgv_maxpool2_batch(a, n, b);
+        break;
+    case SGV_NNET_SOFTMAX:
+        for(j = 0; j < n*a.h; j++) {
+            sgv_softmax_batch(a.data + j*a.w*a.d, a.w, a.d,
+                              b.data + j*b.w*b.d);
+        }
+        break;
+    }
+}
+
+SGVNNET_DEF sgv_fimg sgv_nnet_run(sgv_nnet* net, sgv_fimg in, float* arena)
+{
+    sgv_nnet_layer* l;
+    int i;
+
+    SGV_NNET_ASSERT(net->strip == 0);
+    SGV_NNET_ASSERT(in.w == net->tensors[0].w && in.h == net->tensors[0].h &&
+                    in.d == net->tensors[0].d);
+
+    for(i = 0; i < net->n_layers; i++) {
+        l = net->layers + i;
+        sgvp_nnet_exec(l, sgvp_nnet_view(net, in, arena, l->in),
+                       sgvp_nnet_view(net, in, arena, l->out), net->batch);
+    }
+    return sgv_nnet_output(net, arena, 0);
+}
+
+SGVNNET_DEF sgv_fimg sgv_nnet_output(sgv_nnet* net, float* arena, int i)
+{
+    sgv_fimg none;
+
+    SGV_NNET_ASSERT(i >= 0 && i < net->n_outputs);
+
+    none.data = 0;
+    none.w = none.h = none.d = 0;
+    return sgvp_nnet_view(net, none, arena, net->outputs[i]);
+}
+
+/* Output row y of layer l reads its input rows from step*y, span of them */
+static void sgvp_nnet_window(sgv_nnet_layer* l, int* step, int* span)
+{
+    switch(l->op) {
+    case SGV_NNET_CONV:
+        *step = 1;
+        *span = l->filt.h;
+        break;
+    case SGV_NNET_CONV_POOL:
+        *step = 2;
+        *span = l->filt.h + 1;
+        break;
+    case SGV_NNET_MAXPOOL2:
+        *step = 2;
+        *span = 2;
+        break;
+    default:
+        *step = 1;
+        *span = 1;
+        break;
+    }
+}
+
+SGVNNET_DEF int sgv_nnet_plan_stream(sgv_nnet* net, int strip)
+{
+    sgv_nnet_tensor* t = net->tensors;
+    int n = net->n_layers, i, step, span, rows;
+    long off = 0;
+
+    if(net->batch != 1 || strip < 1) {
+        return SGV_NNET_ERROR_MODEL;
+    }
+
+    /* A strip of a reader, plus the rows of the next strip made before the
+       reader gets to run on them */
+    for(i = 0; i <= n; i++) {
+        t[i].rows = strip;
+    }
+    for(i = 0; i < n; i++) {
+        sgvp_nnet_window(net->layers + i, &step, &span);
+        rows = step*(strip - 1) + span + strip - 1;
+        if(rows > t[net->layers[i].in].rows) {
+            t[net->layers[i].in].rows = rows;
+        }
+    }
+    for(i = 0; i <= n; i++) {
+        if(t[i].rows > t[i].h) {
+            t[i].rows = t[i].h;
+        }
+        t[i].size = (long)t[i].rows*t[i].w*t[i].d;
+        t[i].size = (t[i].size + SGVP_NNET_ALIGN - 1)/SGVP_NNET_ALIGN*SGVP_NNET_ALIGN;
+        t[i].home = i;
+        t[i].offset = off;
+        off += t[i].size;
+    }
+    net->arena_size = off;
+    net->strip = strip;
+    return 0;
+}
+
+/* Makes the next strip of tensor k (read in if k is 0) if its input rows
+   are there and its line buffer has room, dropping the rows every reader
+   is past. Returns 1 if it did. */
+static int sgvp_nnet_strip(sgv_nnet* net, int k, int* done, int* base,
+                           sgv_nnet_read_rows read, sgv_nnet_write_rows write,
+                           void* user, float* arena)
+{
+    sgv_nnet_tensor* t = net->tensors + k;
+    sgv_nnet_layer* l = k > 0 ? net->layers + k - 1 : 0;
+    sgv_fimg a, b;
+    int y = done[k], m = t->h - y, ld = t->w*t->d, step, span, low, i;
+
+    m = m < net->strip ? m : net->strip;
+    if(m <= 0) {
+        return 0;
+    }
+    if(l) {
+        sgvp_nnet_window(l, &step, &span);
+        if(step*(y + m - 1) + span > done[l->in]) {
+            return 0;
+        }
+    }
+    if(y + m - base[k] > t->rows) {
+        low = y;
+        for(i = 0; i < net->n_layers; i++) {
+            if(net->layers[i].in == k) {
+                sgvp_nnet_window(net->layers + i, &step, &span);
+                if(step*done[i + 1] < low) {
+                    low = step*done[i + 1];
+                }
+            }
+        }
+        if(y + m - low > t->rows) {
+            return 0;
+        }
+        memmove(arena + t->offset, arena + t->offset + (long)(low - base[k])*ld,
+                sizeof(float)*(y - low)*ld);
+        base[k] = low;
+    }
+
+    b.data = arena + t->offset + (long)(y - base[k])*ld;
+    b.w = t->w;
+    b.h = m;
+    b.d = t->d;
+    if(l) {
+        sgvp_nnet_window(l, &step, &span);
+        a = b;
+        t = net->tensors + l->in;
+        a.data = arena + t->offset + (long)(step*y - base[l->in])*t->w*t->d;
+        a.w = t->w;
+        a.h = step*(m - 1) + span;
+        a.d = t->d;
+        sgvp_nnet_exec(l, a, b, 1);
+    } else {
+        read(user, y, b);
+    }
+    done[k] = y + m;
+    for(i = 0; i < net->n_outputs; i++) {
+        if(net->outputs[i] == k) {
+            write(user, i, y, b);
+        }
+    }
+    return 1;
+}
+
+SGVNNET_DEF void sgv_nnet_stream(sgv_nnet* net, sgv_nnet_read_rows read,
+                                 sgv_nnet_write_rows write, void* user,
+                                 float* arena)
+{
+    int done[SGV_NNET_MAX_LAYERS + 1];  /* rows of each tensor made */
+    int base[SGV_NNET_MAX_LAYERS + 1];  /* the row at the top of its buffer */
+    int i, more = 1;
+
+    SGV_NNET_ASSERT(net->strip > 0);
+
+    for(i = 0; i <= net->n_layers; i++) {
+        done[i] = base[i] = 0;
+    }
+    while(more) {
+        more = 0;
+        for(i = 0; i <= net->n_layers; i++) {
+            while(sgvp_nnet_strip(net, i, done, base, read, write, user, arena)) {
+                more = 1;
+            }
+        }
+    }
+    for(i = 0; i <= net->n_layers; i++) {
+        SGV_NNET_ASSERT(done[i] == net->tensors[i].h);
+    }
+}
+
+#ifdef SGV_NNET_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+SGVNNET_DEF int sgv_nnet_map_weights(const char* path, sgv_nnet_weights* w)
+{
+    struct stat st;
+    void* p;
+    int fd;
+
+    w->base = w->data = 0;
+    w->size = w->n = 0;
+    if((fd = open(path, O_RDONLY)) < 0) {
+        return SGV_NNET_ERROR_FILE;
+    }
+    if(fstat(fd, &st) || st.st_size % sizeof(float)) {
+        close(fd);
+        return SGV_NNET_ERROR_FILE;
+    }
+    if(st.st_size > 0) {
+        p = mmap(0, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if(p == MAP_FAILED) {
+            close(fd);
+            return SGV_NNET_ERROR_FILE;
+        }
+        w->base = p;
+        w->size = (long)st.st_size;
+    }
+    close(fd);
+    w->data = (float*)w->base;
+    w->n = w->size/(long)sizeof(float);
+    return 0;
+}
+
+SGVNNET_DEF void sgv_nnet_unmap_weights(sgv_nnet_weights* w)
+{
+    if(w->base) {
+        munmap(w->base, (size_t)w->size);
+    }
+    w->base = w->data = 0;
+    w->size = w->n = 0;
+}
+#endif
+
+#endif
@@ -18,6 +18,35 @@ int main() {
     assert(fabs(mat[5] - 3.0f) < EPS);
     printf("Test 2 passed . . .\n");
 
+    {
+        float src[8] = {0, 0, 100, 0, 100, 80, 0, 80};
+        float dst[8] = {12, 7, 90, 20, 110, 95, -5, 70};
+        float line[8] = {0, 0, 1, 1, 2, 2, 0, 5};
+        float h[9], hi[9], x, y, w;
+        int i;
+
+        assert(sgv_glm_homography(h, src, dst) == 0);
+        for(i = 0; i < 4; i++)
+        {
+            w = h[6]*src[2*i] + h[7]*src[2*i+1] + h[8];
+            x = (h[0]*src[2*i] + h[1]*src[2*i+1] + h[2]) / w;
+            y = (h[3]*src[2*i] + h[4]*src[2*i+1] + h[5]) / w;
+            assert(fabs(x - dst[2*i]) < EPS && fabs(y - dst[2*i+1]) < EPS);
+        }
+        assert(sgv_glm_inverse3(hi, h) == 0);
+        sgv_glm_inverse3(h, h);
+        for(i = 0; i < 4; i++)
+        {
+            assert(fabs(h[i] - hi[i]) < 1e-6f);
+            w = h[6]*dst[2*i] + h[7]*dst[2*i+1] + h[8];
+            x = (h[0]*dst[2*i] + h[1]*dst[2*i+1] + h[2]) / w;
+            y = (h[3]*dst[2*i] + h[4]*dst[2*i+1] + h[5]) / w;
+            assert(fabs(x - src[2*i]) < EPS && fabs(y - src[2*i+1]) < EPS);
+        }
+        assert(sgv_glm_homography(h, line, dst) == -1);
+    }
+    printf("Test 3 passed . . .\n");
+
     printf("All tests done . . .\n");
     return 0;
 }
@@ -2,4 +2,6 @@
 
 gcc -std=c89 -pedantic -Wall -O2 -fsanitize=address -fno-omit-frame-pointer -I../../ test.c -o out -lm
 ./out
+gcc -std=c89 -pedantic -Wall -O2 -fsanitize=address -fno-omit-frame-pointer -DSGV_IMGP_THREADS -pthread -I../../ test.c -o out -lm
+./out
 rm -f out
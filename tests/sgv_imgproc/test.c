@@ -1,10 +1,1195 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
 
 #define SGV_IMGP_IMPLEMENTATION
 #include "sgv_imgproc.h"
+#define SGV_GLMATH_IMPLEMENTATION
+#include "sgv_glmath.h"
+
+/* Straightforward convolution to check the fast paths against */
+static void conv_ref(sgv_fimg in, sgv_filt filt, sgv_fimg out)
+{
+    int xo, yo, co, xf, yf, ci;
+    float tmp;
+    for(yo = 0; yo < out.h; yo++) {
+        for(xo = 0; xo < out.w; xo++) {
+            for(co = 0; co < out.d; co++) {
+                tmp = 0;
+                for(yf = 0; yf < filt.h; yf++) {
+                    for(xf = 0; xf < filt.w; xf++) {
+                        for(ci = 0; ci < in.d; ci++) {
+                            tmp += in.data[((yo+yf)*in.w + xo+xf)*in.d + ci] *
+                                   filt.data[((yf*filt.w + xf)*in.d + ci)*out.d + co];
+                        }
+                    }
+                }
+                out.data[(yo*out.w + xo)*out.d + co] = tmp;
+            }
+        }
+    }
+}
+
+/* Bias, ReLU and 2x2 max pool of a convolution output */
+static void pool_ref(sgv_fimg in, float* biases, sgv_fimg out)
+{
+    int x, y, c;
+    float v, *p;
+    for(y = 0; y < out.h; y++) {
+        for(x = 0; x < out.w; x++) {
+            for(c = 0; c < out.d; c++) {
+                p = in.data + (2*y*in.w + 2*x)*in.d + c;
+                v = p[0];
+                v = p[in.d] > v ? p[in.d] : v;
+                v = p[in.w*in.d] > v ? p[in.w*in.d] : v;
+                v = p[(in.w + 1)*in.d] > v ? p[(in.w + 1)*in.d] : v;
+                v += biases[c];
+                out.data[(y*out.w + x)*out.d + c] = v > 0 ? v : 0;
+            }
+        }
+    }
+}
+
+/* A parallel-for that runs the tasks backwards, to check that the result
+   does not depend on the order */
+static void backwards_for(void* user, int n, sgv_imgp_task task, void* ctx)
+{
+    int i;
+    for(i = n - 1; i >= 0; i--) {
+        task(ctx, i);
+    }
+    (*(int*)user)++;
+}
+
+/* Runs the routines that split their work into tasks, writing all the
+   results to out. Returns the end of what was written. */
+static float* run_all(sgv_fimg in, sgv_filt filt, float* biases, float* out)
+{
+    float theta[4] = {0.9f, 0.2f, -0.3f, 1.1f};
+    sgv_imgp_i2 o1 = {3, 5}, o2 = {1, 2}, sz = {40, 30};
+    sgv_img a = {0}, b = {0};
+    sgv_fimg c = {0}, p = {0};
+    sgv_himg hi = {0}, hc = {0}, hp = {0};
+    sgv_hfilt hf;
+    sgv_imgp_quant q = {0.05f, 128};
+    float* end;
+    int i;
+
+    c.w = in.w - filt.w + 1; c.h = in.h - filt.h + 1; c.d = filt.outd;
+    p.w = c.w/2; p.h = c.h/2; p.d = c.d;
+    c.data = out;
+    sgv_conv2d_valid(in, filt, c);
+    sgv_add_bias(c, biases);
+    sgv_relu(c, c);
+    p.data = out + c.w*c.h*c.d;
+    sgv_maxpool2(c, p);
+    p.data += p.w*p.h*p.d;
+    sgv_conv2d_bias_relu_maxpool2(in, filt, biases, p);
+
+    a.w = 61; a.h = 47; a.d = 4;
+    a.data = (unsigned char*)malloc(a.w*a.h*a.d);
+    b.w = 50; b.h = 41; b.d = 4;
+    b.data = (unsigned char*)malloc(b.w*b.h*b.d);
+    for(i = 0; i < a.w*a.h*a.d; i++) {
+        a.data[i] = (unsigned char)(i*7 + i/13);
+    }
+    sgv_imgp_affine_transform(a, o1, theta, b, o2);
+    sgv_blit(a, b, o1);
+    sgv_imgp_crop_rescale(a, o2, sz, b);
+    c.w = b.w; c.h = b.h; c.d = b.d;
+    c.data = p.data + p.w*p.h*p.d;
+    sgv_make_fimg(b, c);
+    c.data += c.w*c.h*c.d;
+    sgv_dequantize(b, q, c);
+    c.data += c.w*c.h*c.d;
+    for(i = 0; i < a.w*a.h*a.d; i++) {
+        c.data[i] = a.data[i];
+    }
+    end = c.data + a.w*a.h*a.d;
+    free(a.data);
+    free(b.data);
+
+    /* half precision, fp16 in and bfloat16 out */
+    hi.w = in.w; hi.h = in.h; hi.d = in.d;
+    hf.w = filt.w; hf.h = filt.h; hf.ind = filt.ind; hf.outd = filt.outd;
+    hf.format = SGV_IMGP_BF16;
+    hc.w = in.w - filt.w + 1; hc.h = in.h - filt.h + 1; hc.d = filt.outd;
+    hc.format = SGV_IMGP_BF16;
+    hp.w = hc.w/2; hp.h = hc.h/2; hp.d = hc.d;
+    hi.data = (unsigned short*)malloc(2*hi.w*hi.h*hi.d);
+    hf.data = (unsigned short*)malloc(2*hf.w*hf.h*hf.ind*hf.outd);
+    hc.data = (unsigned short*)malloc(2*hc.w*hc.h*hc.d);
+    hp.data = (unsigned short*)malloc(2*hp.w*hp.h*hp.d);
+    sgv_make_himg(in, hi);
+    sgv_make_hfilt(filt, hf);
+    sgv_hconv2d_valid(hi, hf, hc);
+    sgv_hadd_bias(hc, biases);
+    sgv_hrelu(hc, hc);
+    sgv_hmaxpool2(hc, hp);
+    c.w = hp.w; c.h = hp.h; c.d = hp.d;
+    c.data = end;
+    sgv_himg_to_fimg(hp, c);
+    free(hi.data);
+    free(hf.data);
+    free(hc.data);
+    free(hp.data);
+    return end + c.w*c.h*c.d;
+}
+
+#ifdef SGV_IMGP_THREADS
+typedef struct {
+    sgv_fimg in;
+    sgv_filt filt;
+    float *biases, *out;
+} run_args;
+
+static void* run_thread(void* arg)
+{
+    run_args* a = (run_args*)arg;
+    run_all(a->in, a->filt, a->biases, a->out);
+    return 0;
+}
+#endif
+
+/* sgv_imgp_crop_rescale as it was before the separable filters */
+static void crop_rescale_ref(sgv_img in, sgv_imgp_i2 in_left_top,
+                             sgv_imgp_i2 crop_size, sgv_img out)
+{
+    int x, y, c, temp, x1, y1, dsf, xo_a, yo_a, xo_b, yo_b;
+    float xi, yi, alpha, beta;
+
+    dsf = (crop_size.x+out.w-1)/out.w;
+    if((crop_size.y+out.h-1)/out.h > dsf) {
+        dsf = (crop_size.y+out.h-1)/out.h;
+    }
+    for(y = 0; y < out.h; y++) {
+        for(x = 0; x < out.w; x++) {
+            for(c = 0; c < out.d; c++) {
+                temp = 0;
+                for(y1 = dsf*y; y1 < dsf*(y+1); y1++) {
+                    for(x1 = dsf*x; x1 < dsf*(x+1); x1++) {
+                        xi = (x1 + 0.5f)/(out.w*dsf);
+                        yi = (y1 + 0.5f)/(out.h*dsf);
+                        xo_a = xi*crop_size.x - 0.5f + in_left_top.x, xo_b = xo_a+1;
+                        alpha = xo_a - in_left_top.x + 1.5f - xi*crop_size.x;
+                        yo_a = yi*crop_size.y - 0.5f + in_left_top.y, yo_b = yo_a+1;
+                        beta = yo_a - in_left_top.y + 1.5f - yi*crop_size.y;
+                        if(xo_a >= 0 && yo_a >= 0 && xo_a < in.w && yo_a < in.h)
+                            temp += alpha * beta * in.data[in.w*in.d*yo_a + in.d*xo_a + c];
+                        if(xo_b >= 0 && yo_a >= 0 && xo_b < in.w && yo_a < in.h)
+                            temp += (1-alpha) * beta * in.data[in.w*in.d*yo_a + in.d*xo_b + c];
+                        if(xo_a >= 0 && yo_b >= 0 && xo_a < in.w && yo_b < in.h)
+                            temp += alpha * (1-beta) * in.data[in.w*in.d*yo_b + in.d*xo_a + c];
+                        if(xo_b >= 0 && yo_b >= 0 && xo_b < in.w && yo_b < in.h)
+                            temp += (1-alpha) * (1-beta) * in.data[in.w*in.d*yo_b + in.d*xo_b + c];
+                    }
+                }
+                out.data[out.w*out.d*y + out.d*x + c] = temp/(dsf*dsf);
+            }
+        }
+    }
+}
+
+/* Bilinear sample of in at (x, y) in float, black off the image */
+static float bilinear_ref(sgv_img in, float x, float y, int c)
+{
+    int x0 = (int)floor(x), y0 = (int)floor(y), k, xk, yk;
+    float fx = x - x0, fy = y - y0, w, sum = 0;
+
+    for(k = 0; k < 4; k++) {
+        xk = x0 + (k & 1);
+        yk = y0 + (k >> 1);
+        w = ((k & 1) ? fx : 1 - fx)*((k >> 1) ? fy : 1 - fy);
+        if(xk >= 0 && yk >= 0 && xk < in.w && yk < in.h) {
+            sum += w*in.data[(yk*in.w + xk)*in.d + c];
+        }
+    }
+    return sum;
+}
+
+static float frand(void)
+{
+    return rand() / (float)RAND_MAX - 0.5f;
+}
+
+static void fill(float* p, int n)
+{
+    int i;
+    for(i = 0; i < n; i++) {
+        p[i] = frand();
+    }
+}
+
+static int same(float* a, float* b, int n, float tol)
+{
+    int i;
+    for(i = 0; i < n; i++) {
+        if(a[i] - b[i] > tol || b[i] - a[i] > tol) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Within rel of b, relative, or 1e-5 */
+static int near(float* a, float* b, int n, float rel)
+{
+    int i;
+    float tol;
+    for(i = 0; i < n; i++) {
+        tol = rel*(b[i] > 0 ? b[i] : -b[i]) + 1e-5f;
+        if(a[i] - b[i] > tol || b[i] - a[i] > tol) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* The w x h view at (x, y) of a packed image */
+static sgv_img_view view(sgv_img img, int x, int y, int w, int h)
+{
+    sgv_img_view v;
+    v.data = img.data + (y*img.w + x)*img.d;
+    v.w = w; v.h = h; v.d = img.d; v.stride = img.w*img.d;
+    return v;
+}
+
+static sgv_fimg_view fview(sgv_fimg img, int x, int y, int w, int h)
+{
+    sgv_fimg_view v;
+    v.data = img.data + (y*img.w + x)*img.d;
+    v.w = w; v.h = h; v.d = img.d; v.stride = img.w*img.d;
+    return v;
+}
+
+/* Copies h rows of n bytes, ldp and ldq bytes apart */
+static void copy_rows(void* p, int ldp, const void* q, int ldq, int h, int n)
+{
+    int y;
+    for(y = 0; y < h; y++) {
+        memcpy((char*)p + y*ldp, (const char*)q + y*ldq, n);
+    }
+}
+
+/* The h rows of n bytes at v (ld bytes apart) are those at p (packed), and
+   the other 'size' bytes of buf, which v is in, are all c */
+static int same_view(const void* buf, int size, const void* v, int ld,
+                     const void* p, int h, int n, int c)
+{
+    const unsigned char *b = (const unsigned char*)buf;
+    int i, k;
+    for(i = 0; i < size; i++) {
+        k = (int)(b + i - (const unsigned char*)v);
+        if(k >= 0 && k/ld < h && k%ld < n) {
+            if(b[i] != ((const unsigned char*)p)[k/ld*n + k%ld]) {
+                return 0;
+            }
+        } else if(b[i] != c) {
+            return 0;
+        }
+    }
+    return 1;
+}
 
 int main()
 {
-    printf("At least the lib compiles...\n");
+    /* w, h, d of the input, w, h of the filter, output channels */
+    int convs[][6] = {{5, 4, 1, 1, 1, 1}, {9, 7, 3, 3, 3, 16}, {13, 11, 5, 3, 2, 19},
+                      {8, 8, 40, 5, 5, 7}, {6, 20, 130, 3, 3, 70}};
+    int wconvs[][4] = {{4, 4, 1, 1}, {9, 8, 3, 5}, {12, 7, 20, 70}, {5, 11, 33, 9}};
+    /* w, h, d of the input, w, h of the filter, output channels */
+    int pconvs[][6] = {{6, 6, 1, 3, 3, 2}, {11, 8, 4, 2, 3, 9}, {75, 9, 12, 3, 3, 70},
+                       {14, 13, 9, 3, 3, 130}, {10, 10, 5, 5, 5, 3}, {140, 7, 2, 3, 3, 5}};
+    sgv_fimg in = {0}, out = {0}, ref = {0}, conv = {0};
+    float* biases;
+    sgv_filt filt;
+    sgv_wfilt wfilt;
+    int i;
+
+    printf("Test 1 ...\n");
+    for(i = 0; i < (int)(sizeof(convs)/sizeof(convs[0])); i++) {
+        in.w = convs[i][0]; in.h = convs[i][1]; in.d = convs[i][2];
+        filt.w = convs[i][3]; filt.h = convs[i][4];
+        filt.ind = in.d; filt.outd = convs[i][5];
+        out.w = ref.w = in.w - filt.w + 1;
+        out.h = ref.h = in.h - filt.h + 1;
+        out.d = ref.d = filt.outd;
+        in.data = (float*)malloc(sizeof(float)*in.w*in.h*in.d);
+        filt.data = (float*)malloc(sizeof(float)*filt.w*filt.h*filt.ind*filt.outd);
+        out.data = (float*)malloc(sizeof(float)*out.w*out.h*out.d);
+        ref.data = (float*)malloc(sizeof(float)*out.w*out.h*out.d);
+        fill(in.data, in.w*in.h*in.d);
+        fill(filt.data, filt.w*filt.h*filt.ind*filt.outd);
+        conv_ref(in, filt, ref);
+        sgv_conv2d_valid(in, filt, out);
+        assert(same(out.data, ref.data, out.w*out.h*out.d, 1e-4f));
+        free(in.data);
+        free(filt.data);
+        free(out.data);
+        free(ref.data);
+    }
+
+    printf("Test 2 ...\n");
+    for(i = 0; i < (int)(sizeof(wconvs)/sizeof(wconvs[0])); i++) {
+        in.w = wconvs[i][0]; in.h = wconvs[i][1]; in.d = wconvs[i][2];
+        filt.w = filt.h = 3;
+        filt.ind = wfilt.ind = in.d;
+        filt.outd = wfilt.outd = wconvs[i][3];
+        out.w = ref.w = in.w - 2;
+        out.h = ref.h = in.h - 2;
+        out.d = ref.d = filt.outd;
+        in.data = (float*)malloc(sizeof(float)*in.w*in.h*in.d);
+        filt.data = (float*)malloc(sizeof(float)*9*filt.ind*filt.outd);
+        wfilt.data = (float*)malloc(sizeof(float)*16*filt.ind*filt.outd);
+        out.data = (float*)malloc(sizeof(float)*out.w*out.h*out.d);
+        ref.data = (float*)malloc(sizeof(float)*out.w*out.h*out.d);
+        fill(in.data, in.w*in.h*in.d);
+        fill(filt.data, 9*filt.ind*filt.outd);
+        conv_ref(in, filt, ref);
+        sgv_make_wfilt(filt, wfilt);
+        sgv_conv2d_valid_wfilt(in, wfilt, out);
+        assert(same(out.data, ref.data, out.w*out.h*out.d, 1e-4f));
+        free(in.data);
+        free(filt.data);
+        free(wfilt.data);
+        free(out.data);
+        free(ref.data);
+    }
+
+    printf("Test 3 ...\n");
+    for(i = 0; i < (int)(sizeof(pconvs)/sizeof(pconvs[0])); i++) {
+        in.w = pconvs[i][0]; in.h = pconvs[i][1]; in.d = pconvs[i][2];
+        filt.w = pconvs[i][3]; filt.h = pconvs[i][4];
+        filt.ind = wfilt.ind = in.d;
+        filt.outd = wfilt.outd = pconvs[i][5];
+        conv.w = in.w - filt.w + 1;
+        conv.h = in.h - filt.h + 1;
+        out.w = ref.w = conv.w/2;
+        out.h = ref.h = conv.h/2;
+        conv.d = out.d = ref.d = filt.outd;
+        in.data = (float*)malloc(sizeof(float)*in.w*in.h*in.d);
+        filt.data = (float*)malloc(sizeof(float)*filt.w*filt.h*filt.ind*filt.outd);
+        biases = (float*)malloc(sizeof(float)*filt.outd);
+        conv.data = (float*)malloc(sizeof(float)*conv.w*conv.h*conv.d);
+        out.data = (float*)malloc(sizeof(float)*out.w*out.h*out.d);
+        ref.data = (float*)malloc(sizeof(float)*out.w*out.h*out.d);
+        fill(in.data, in.w*in.h*in.d);
+        fill(filt.data, filt.w*filt.h*filt.ind*filt.outd);
+        fill(biases, filt.outd);
+        conv_ref(in, filt, conv);
+        pool_ref(conv, biases, ref);
+        sgv_conv2d_bias_relu_maxpool2(in, filt, biases, out);
+        assert(same(out.data, ref.data, out.w*out.h*out.d, 1e-4f));
+        if(filt.w == 3 && filt.h == 3) {
+            wfilt.data = (float*)malloc(sizeof(float)*16*filt.ind*filt.outd);
+            sgv_make_wfilt(filt, wfilt);
+            sgv_conv2d_bias_relu_maxpool2_wfilt(in, wfilt, biases, out);
+            assert(same(out.data, ref.data, out.w*out.h*out.d, 1e-4f));
+            free(wfilt.data);
+        }
+        free(in.data);
+        free(filt.data);
+        free(biases);
+        free(conv.data);
+        free(out.data);
+        free(ref.data);
+    }
+
+    printf("Test 4 ...\n");
+    {
+        float *res1, *res2, *end;
+        int calls = 0;
+#ifdef SGV_IMGP_THREADS
+        run_args args;
+        pthread_t th;
+#endif
+
+        in.w = 70; in.h = 67; in.d = 16;
+        filt.w = filt.h = 3;
+        filt.ind = in.d; filt.outd = 80;
+        in.data = (float*)malloc(sizeof(float)*in.w*in.h*in.d);
+        filt.data = (float*)malloc(sizeof(float)*9*filt.ind*filt.outd);
+        biases = (float*)malloc(sizeof(float)*filt.outd);
+        res1 = (float*)malloc(sizeof(float)*1000000);
+        res2 = (float*)malloc(sizeof(float)*1000000);
+        fill(in.data, in.w*in.h*in.d);
+        fill(filt.data, 9*filt.ind*filt.outd);
+        fill(biases, filt.outd);
+
+        end = run_all(in, filt, biases, res1);
+        sgv_imgp_set_parallel_for(backwards_for, &calls, 3);
+        run_all(in, filt, biases, res2);
+        sgv_imgp_set_parallel_for(0, 0, 1);
+        assert(calls > 0);
+        assert(memcmp(res1, res2, (end - res1)*sizeof(float)) == 0);
+#ifdef SGV_IMGP_THREADS
+        assert(sgv_imgp_start_threads(4) == 0);
+        for(i = 0; i < 3; i++) {
+            memset(res2, 0, (end - res1)*sizeof(float));
+            run_all(in, filt, biases, res2);
+            assert(memcmp(res1, res2, (end - res1)*sizeof(float)) == 0);
+        }
+        /* stopping waits for a call running on another thread */
+        args.in = in;
+        args.filt = filt;
+        args.biases = biases;
+        args.out = res2;
+        memset(res2, 0, (end - res1)*sizeof(float));
+        assert(pthread_create(&th, 0, run_thread, &args) == 0);
+        sgv_imgp_stop_threads();
+        pthread_join(th, 0);
+        assert(memcmp(res1, res2, (end - res1)*sizeof(float)) == 0);
+        /* no workers to start, but the pool must still stop cleanly */
+        assert(sgv_imgp_start_threads(0) == -1);
+        sgv_imgp_stop_threads();
+        assert(sgv_imgp_start_threads(2) == 0);
+        sgv_imgp_stop_threads();
+#endif
+        free(in.data);
+        free(filt.data);
+        free(biases);
+        free(res1);
+        free(res2);
+    }
+
+    printf("Test 5 ...\n");
+    {
+        /* w, h of the output, x, y, w, h of the crop */
+        int crops[][6] = {{20, 15, 3, 4, 57, 41}, {64, 50, 10, 0, 30, 25},
+                          {7, 9, -5, -3, 70, 60}, {33, 33, 0, 0, 80, 60}};
+        sgv_img a = {0}, b = {0}, r = {0};
+        sgv_imgp_i2 lt, sz;
+        int f, k, x, y;
+
+        a.w = 80; a.h = 60; a.d = 3;
+        a.data = (unsigned char*)malloc(a.w*a.h*a.d);
+        b.data = (unsigned char*)malloc(64*50*3);
+        r.data = (unsigned char*)malloc(64*50*3);
+        for(i = 0; i < a.w*a.h*a.d; i++) {
+            a.data[i] = (unsigned char)(rand() & 255);
+        }
+        for(i = 0; i < (int)(sizeof(crops)/sizeof(crops[0])); i++) {
+            b.w = r.w = crops[i][0]; b.h = r.h = crops[i][1]; b.d = r.d = 3;
+            lt.x = crops[i][2]; lt.y = crops[i][3];
+            sz.x = crops[i][4]; sz.y = crops[i][5];
+            crop_rescale_ref(a, lt, sz, r);
+            sgv_imgp_crop_rescale_filter(a, lt, sz, b, SGV_IMGP_RESCALE_LEGACY);
+            assert(memcmp(b.data, r.data, b.w*b.h*b.d) == 0);
+        }
+
+        /* area shrinking by 2 is the mean of 2x2 pixels */
+        b.w = 40; b.h = 30;
+        lt.x = lt.y = 0;
+        sz.x = 80; sz.y = 60;
+        sgv_imgp_crop_rescale(a, lt, sz, b);
+        for(y = 0; y < b.h; y++) {
+            for(x = 0; x < b.w*3; x++) {
+                k = a.data[(2*y*a.w)*3 + (x/3)*6 + x%3] +
+                    a.data[(2*y*a.w)*3 + (x/3)*6 + 3 + x%3] +
+                    a.data[((2*y + 1)*a.w)*3 + (x/3)*6 + x%3] +
+                    a.data[((2*y + 1)*a.w)*3 + (x/3)*6 + 3 + x%3];
+                k = k - 4*b.data[(y*b.w)*3 + x];
+                assert(k >= -6 && k <= 6);
+            }
+        }
+
+        /* flat stays flat, and the part of the crop off the image is black */
+        for(i = 0; i < a.w*a.h*a.d; i++) {
+            a.data[i] = 200;
+        }
+        b.w = 64; b.h = 50;
+        lt.x = -40; lt.y = 10;
+        sz.x = 80; sz.y = 13;
+        for(f = 0; f < 3; f++) {
+            sgv_imgp_crop_rescale_filter(a, lt, sz, b, f);
+            for(y = 0; y < b.h; y++) {
+                for(x = 0; x < b.w; x++) {
+                    k = (x + 0.5f)*sz.x/b.w + lt.x >= 0 ? 200 : 0;
+                    assert(b.data[(y*b.w + x)*3] == k);
+                }
+            }
+        }
+        free(a.data);
+
+        /* 4K into 2x2 is past the separable filters and is supersampled;
+           each output pixel is about the mean of its flat quadrant */
+        a.w = 3840; a.h = 2160;
+        a.data = (unsigned char*)malloc(a.w*a.h*a.d);
+        for(y = 0; y < a.h; y++) {
+            for(x = 0; x < a.w*3; x++) {
+                a.data[y*a.w*3 + x] = (unsigned char)(40*(2*y/a.h) + 80*(2*x/(a.w*3)) + x%3);
+            }
+        }
+        b.w = b.h = 2;
+        lt.x = lt.y = 0;
+        sz.x = a.w; sz.y = a.h;
+        sgv_imgp_crop_rescale(a, lt, sz, b);
+        for(i = 0; i < 12; i++) {
+            k = b.data[i] - (40*(i/6) + 80*(i%6/3) + i%3);
+            assert(k >= -2 && k <= 2);
+        }
+        free(a.data);
+        free(b.data);
+        free(r.data);
+    }
+
+    printf("Test 6 ...\n");
+    {
+        /* w, h, d of the input, w, h of the output */
+        int warps[][5] = {{64, 48, 1, 70, 50}, {64, 48, 3, 37, 64},
+                          {31, 40, 4, 64, 64}, {80, 9, 3, 41, 6}};
+        float thetas[][4] = {{1, 0, 0, 1}, {0.98f, 0.17f, -0.17f, 0.98f},
+                             {0.5f, -0.9f, 1.1f, 0.3f}, {-1.2f, 0, 0, 1.3f}};
+        sgv_imgp_i2 ins[] = {{0, 0}, {10, -5}, {-20, 17}}, outs[] = {{0, 0}, {3, 7}};
+        float shift[4] = {1, 1.0f/4096, 0, 1};
+        sgv_img a = {0}, b = {0};
+        float x, y, *th;
+        int j, k, m, c, ix, iy;
+
+        for(i = 0; i < (int)(sizeof(warps)/sizeof(warps[0])); i++) {
+            a.w = warps[i][0]; a.h = warps[i][1]; a.d = b.d = warps[i][2];
+            b.w = warps[i][3]; b.h = warps[i][4];
+            a.data = malloc(a.w*a.h*a.d);
+            b.data = malloc(b.w*b.h*b.d);
+            for(k = 0; k < a.w*a.h*a.d; k++) {
+                a.data[k] = rand() & 255;
+            }
+            for(j = 0; j < (int)(sizeof(thetas)/sizeof(thetas[0])); j++) {
+                for(m = 0; m < 6; m++) {
+                    th = thetas[j];
+                    sgv_imgp_affine_transform(a, ins[m%3], th, b, outs[m/3]);
+                    for(iy = 0; iy < b.h; iy++) {
+                        for(ix = 0; ix < b.w; ix++) {
+                            x = (ix + outs[m/3].x + 0.5f)/b.w;
+                            y = (iy + outs[m/3].y + 0.5f)/b.h;
+                            for(c = 0; c < b.d; c++) {
+                                k = (int)(bilinear_ref(a, th[0]*a.w*x + th[1]*a.w*y + ins[m%3].x,
+                                                       th[2]*a.h*x + th[3]*a.h*y + ins[m%3].y,
+                                                       c) + 0.5f);
+                                k -= b.data[(iy*b.w + ix)*b.d + c];
+                                assert(k >= -2 && k <= 2);
+                            }
+                        }
+                    }
+                }
+            }
+            free(a.data);
+            free(b.data);
+        }
+        /* a shift by a half step of the Q7 weights: the pixels done four
+           at a time and the ones done one by one must round it the same */
+        a.w = b.w = 64; a.h = b.h = 2; a.d = b.d = 4;
+        a.data = malloc(a.w*a.h*a.d);
+        b.data = malloc(b.w*b.h*b.d);
+        for(k = 0; k < a.w*a.h*a.d; k++) {
+            a.data[k] = k/4%2*255;
+        }
+        sgv_imgp_affine_transform(a, ins[0], shift, b, outs[0]);
+        for(k = 0; k < 61*4; k++) {
+            assert(b.data[k] == b.data[k + 8]);
+        }
+        free(a.data);
+        free(b.data);
+    }
+
+    printf("Test 7 ...\n");
+    {
+        /* w, h, d of the input, w, h of the output */
+        int warps[][5] = {{64, 48, 1, 70, 50}, {64, 48, 3, 37, 64},
+                          {31, 40, 4, 64, 64}, {80, 9, 3, 41, 6}};
+        /* corners of the output in the input: a rectangle, a tilted
+           quadrilateral, one partly off the image and one with the horizon
+           across the output */
+        float quads[][8] = {{0, 0, 1, 0, 1, 1, 0, 1},
+                            {0.1f, 0.05f, 0.8f, 0.2f, 0.95f, 0.9f, 0.02f, 0.7f},
+                            {-0.3f, 0.2f, 1.1f, -0.2f, 0.9f, 1.2f, 0.1f, 0.8f},
+                            {0.3f, 0, 0.7f, 0, 3, 1, -2, 1}};
+        float corners[8], in_pts[8], h[9], x, y, w;
+        sgv_img a = {0}, b = {0};
+        int j, k, c, ix, iy;
+
+        for(i = 0; i < (int)(sizeof(warps)/sizeof(warps[0])); i++) {
+            a.w = warps[i][0]; a.h = warps[i][1]; a.d = b.d = warps[i][2];
+            b.w = warps[i][3]; b.h = warps[i][4];
+            a.data = malloc(a.w*a.h*a.d);
+            b.data = malloc(b.w*b.h*b.d);
+            for(k = 0; k < a.w*a.h*a.d; k++) {
+                a.data[k] = rand() & 255;
+            }
+            corners[0] = 0; corners[1] = 0; corners[2] = b.w; corners[3] = 0;
+            corners[4] = b.w; corners[5] = b.h; corners[6] = 0; corners[7] = b.h;
+            for(j = 0; j < (int)(sizeof(quads)/sizeof(quads[0])); j++) {
+                for(k = 0; k < 4; k++) {
+                    in_pts[2*k] = quads[j][2*k]*a.w;
+                    in_pts[2*k + 1] = quads[j][2*k + 1]*a.h;
+                }
+                assert(sgv_glm_homography(h, corners, in_pts) == 0);
+                sgv_imgp_perspective_transform(a, h, b);
+                for(iy = 0; iy < b.h; iy++) {
+                    for(ix = 0; ix < b.w; ix++) {
+                        w = h[6]*(ix + 0.5f) + h[7]*(iy + 0.5f) + h[8];
+                        x = (h[0]*(ix + 0.5f) + h[1]*(iy + 0.5f) + h[2])/w - 0.5f;
+                        y = (h[3]*(ix + 0.5f) + h[4]*(iy + 0.5f) + h[5])/w - 0.5f;
+                        for(c = 0; c < b.d; c++) {
+                            k = w > 0 ? (int)(bilinear_ref(a, x, y, c) + 0.5f) : 0;
+                            k -= b.data[(iy*b.w + ix)*b.d + c];
+                            assert(k >= -2 && k <= 2);
+                        }
+                    }
+                }
+            }
+
+            /* the identity is a copy */
+            if(a.w >= b.w && a.h >= b.h) {
+                h[0] = h[4] = h[8] = 1;
+                h[1] = h[2] = h[3] = h[5] = h[6] = h[7] = 0;
+                sgv_imgp_perspective_transform(a, h, b);
+                for(iy = 0; iy < b.h; iy++) {
+                    assert(memcmp(b.data + iy*b.w*b.d, a.data + iy*a.w*a.d,
+                                  b.w*b.d) == 0);
+                }
+            }
+            free(a.data);
+            free(b.data);
+        }
+    }
+
+    printf("Test 8 ...\n");
+    {
+        /* w, h, d of the input, w, h of the filter, output channels */
+        int qconvs[][6] = {{5, 4, 1, 1, 1, 1}, {9, 7, 3, 3, 3, 16}, {13, 11, 5, 3, 2, 19},
+                           {70, 6, 40, 5, 5, 7}, {6, 20, 130, 3, 3, 70}};
+        sgv_img a = {0}, b = {0}, c = {0};
+        sgv_iimg acc = {0};
+        sgv_qfilt qfilt;
+        sgv_imgp_quant qin, qout;
+        float v, s;
+        int j, k, m, x, y, n, pc;
+
+        qin.scale = 2/255.0f;
+        qin.zero = 128;
+        qout.scale = 0.05f;
+        qout.zero = 100;
+        for(i = 0; i < (int)(sizeof(qconvs)/sizeof(qconvs[0])); i++) {
+            for(pc = 0; pc < 2; pc++) {
+                a.w = qconvs[i][0]; a.h = qconvs[i][1]; a.d = qconvs[i][2];
+                filt.w = qconvs[i][3]; filt.h = qconvs[i][4];
+                filt.ind = a.d; filt.outd = qconvs[i][5];
+                b.w = acc.w = a.w - filt.w + 1; b.h = acc.h = a.h - filt.h + 1;
+                b.d = acc.d = filt.outd;
+                n = filt.w*filt.h*filt.ind*filt.outd;
+                a.data = malloc(a.w*a.h*a.d);
+                b.data = malloc(b.w*b.h*b.d);
+                acc.data = malloc(b.w*b.h*b.d*sizeof(int));
+                filt.data = malloc(n*sizeof(float));
+                biases = malloc(filt.outd*sizeof(float));
+                qfilt.w = filt.w; qfilt.h = filt.h; qfilt.ind = filt.ind;
+                qfilt.outd = filt.outd; qfilt.per_channel = pc;
+                qfilt.data = malloc(n);
+                qfilt.scales = malloc(filt.outd*sizeof(float));
+                for(k = 0; k < a.w*a.h*a.d; k++) {
+                    a.data[k] = rand() & 255;
+                }
+                fill(filt.data, n);
+                fill(biases, filt.outd);
+                for(k = 0; k < n; k++) {
+                    filt.data[k] *= 1 + k%filt.outd;
+                }
+                sgv_make_qfilt(filt, qfilt);
+                for(k = 0; k < n; k++) {
+                    s = qfilt.scales[pc ? k%filt.outd : 0];
+                    assert(fabs(qfilt.data[k]*s - filt.data[k]) <= s/2 + 1e-6f);
+                }
+
+                /* the sums are exact, and the requantized output is them
+                   rounded */
+                sgv_qconv2d_valid_acc(a, qin, qfilt, acc);
+                sgv_qconv2d_valid(a, qin, qfilt, biases, b, qout);
+                for(y = 0; y < b.h; y++) {
+                    for(x = 0; x < b.w; x++) {
+                        for(j = 0; j < b.d; j++) {
+                            k = 0;
+                            for(m = 0; m < filt.w*filt.h*filt.ind; m++) {
+                                k += qfilt.data[m*filt.outd + j]*
+                                     (a.data[((y + m/(filt.w*a.d))*a.w + x)*a.d +
+                                             m%(filt.w*a.d)] - qin.zero);
+                            }
+                            assert(acc.data[(y*b.w + x)*b.d + j] == k);
+                            s = qin.scale*qfilt.scales[pc ? j : 0];
+                            v = (k*s + biases[j])/qout.scale + qout.zero;
+                            v = v < 0 ? 0 : v > 255 ? 255 : v;
+                            k = b.data[(y*b.w + x)*b.d + j];
+                            assert(fabs(v - k) <= 1);
+                        }
+                    }
+                }
+                free(a.data);
+                free(b.data);
+                free(acc.data);
+                free(filt.data);
+                free(biases);
+                free(qfilt.data);
+                free(qfilt.scales);
+            }
+        }
+
+        /* relu, bias and pooling on the bytes */
+        a.w = 9; a.h = 7; a.d = 3;
+        b = a;
+        b.w = 4; b.h = 3;
+        c = a;
+        a.data = malloc(a.w*a.h*a.d);
+        b.data = malloc(b.w*b.h*b.d);
+        c.data = malloc(a.w*a.h*a.d);
+        for(k = 0; k < a.w*a.h*a.d; k++) {
+            a.data[k] = rand() & 255;
+        }
+        sgv_qrelu(a, qout, c);
+        for(k = 0; k < a.w*a.h*a.d; k++) {
+            assert(c.data[k] == (a.data[k] > qout.zero ? a.data[k] : qout.zero));
+        }
+        sgv_qmaxpool2(a, b);
+        for(y = 0; y < b.h; y++) {
+            for(x = 0; x < b.w; x++) {
+                for(j = 0; j < b.d; j++) {
+                    k = 0;
+                    for(m = 0; m < 4; m++) {
+                        n = a.data[((2*y + m/2)*a.w + 2*x + m%2)*a.d + j];
+                        k = n > k ? n : k;
+                    }
+                    assert(b.data[(y*b.w + x)*b.d + j] == k);
+                }
+            }
+        }
+        memcpy(c.data, a.data, a.w*a.h*a.d);
+        {
+            float bias[3] = {1.0f, -0.52f, 20.0f};
+            sgv_qadd_bias(c, qout, bias);
+            for(k = 0; k < a.w*a.h*a.d; k++) {
+                v = a.data[k] + bias[k%3]/qout.scale;
+                v = v < 0 ? 0 : v > 255 ? 255 : v;
+                assert(fabs(c.data[k] - v) <= 0.5f);
+            }
+        }
+        free(a.data);
+        free(b.data);
+        free(c.data);
+    }
+
+    printf("Test 9 ...\n");
+    {
+        /* Every call on views into bigger buffers (f: float, u: bytes) and
+           on packed copies of them: the views get the same values and the
+           rest of the output buffer keeps its fill */
+        sgv_fimg fbig = {0}, fp = {0}, fq = {0};
+        sgv_img ubig = {0}, up = {0}, uq = {0};
+        sgv_fimg_view fv, fo;
+        sgv_img_view uv, uo;
+        sgv_filt f3, f5;
+        sgv_wfilt wfilt;
+        sgv_qfilt qfilt;
+        sgv_imgp_quant qin, qout;
+        sgv_imgp_i2 o0 = {-3, 2}, o1 = {1, 0}, sz = {17, 12};
+        float theta[4] = {0.9f, 0.3f, -0.2f, 1.1f};
+        float h[9] = {1.1f, 0.1f, -2, -0.05f, 0.9f, 1, 0.002f, -0.001f, 1};
+        float *fbuf, *bias;
+        unsigned char* ubuf;
+        int j, k, n;
+
+        fbig.w = 31; fbig.h = 23; fbig.d = 12;
+        fbig.data = malloc(fbig.w*fbig.h*fbig.d*sizeof(float));
+        fill(fbig.data, fbig.w*fbig.h*fbig.d);
+        fv = fview(fbig, 4, 3, 22, 17);
+        fp.w = fv.w; fp.h = fv.h; fp.d = fv.d;
+        fp.data = malloc(fp.w*fp.h*fp.d*sizeof(float));
+        copy_rows(fp.data, fp.w*fp.d*sizeof(float), fv.data, fv.stride*sizeof(float),
+                  fp.h, fp.w*fp.d*sizeof(float));
+
+        f3.w = f3.h = 3; f5.w = f5.h = 5;
+        f3.ind = f5.ind = wfilt.ind = fbig.d;
+        f3.outd = f5.outd = wfilt.outd = 10;
+        f3.data = malloc(9*f3.ind*f3.outd*sizeof(float));
+        f5.data = malloc(25*f5.ind*f5.outd*sizeof(float));
+        wfilt.data = malloc(16*f3.ind*f3.outd*sizeof(float));
+        bias = malloc(fbig.d*sizeof(float));
+        fill(f3.data, 9*f3.ind*f3.outd);
+        fill(f5.data, 25*f5.ind*f5.outd);
+        fill(bias, fbig.d);
+        sgv_make_wfilt(f3, wfilt);
+
+        n = 64*64*16;
+        fbuf = malloc(n*sizeof(float));
+        fq.data = malloc(n*sizeof(float));
+        for(k = 0; k < 7; k++) {
+            fq.w = fv.w - (k == 1 ? 2 : k == 0 ? 4 : 0);
+            fq.h = fv.h - (k == 1 ? 2 : k == 0 ? 4 : 0);
+            fq.d = k < 2 ? f3.outd : fv.d;
+            if(k == 2 || k == 3) {
+                fq.w = (fv.w - 2*k + 2)/2;
+                fq.h = (fv.h - 2*k + 2)/2;
+                fq.d = f3.outd;
+            } else if(k == 5) {
+                fq.w /= 2;
+                fq.h /= 2;
+            }
+            fo.w = fq.w; fo.h = fq.h; fo.d = fq.d;
+            fo.data = fbuf + 2*(fq.w + 5)*fq.d + 3*fq.d;
+            fo.stride = (fq.w + 5)*fq.d;
+            memset(fbuf, 0x7f, n*sizeof(float));
+            switch(k) {
+            case 0:
+                sgv_conv2d_valid_view(fv, f5, fo);
+                sgv_conv2d_valid(fp, f5, fq);
+                break;
+            case 1:
+                sgv_conv2d_valid_view(fv, f3, fo);
+                sgv_conv2d_valid(fp, f3, fq);
+                break;
+            case 2:
+                sgv_conv2d_bias_relu_maxpool2_wfilt_view(fv, wfilt, bias, fo);
+                sgv_conv2d_bias_relu_maxpool2_wfilt(fp, wfilt, bias, fq);
+                break;
+            case 3:
+                sgv_conv2d_bias_relu_maxpool2_view(fv, f5, bias, fo);
+                sgv_conv2d_bias_relu_maxpool2(fp, f5, bias, fq);
+                break;
+            case 4:
+                sgv_relu_view(fv, fo);
+                sgv_relu(fp, fq);
+                break;
+            case 5:
+                sgv_maxpool2_view(fv, fo);
+                sgv_maxpool2(fp, fq);
+                break;
+            case 6:
+                copy_rows(fo.data, fo.stride*sizeof(float), fp.data, fp.w*fp.d*sizeof(float),
+                          fp.h, fp.w*fp.d*sizeof(float));
+                memcpy(fq.data, fp.data, fp.w*fp.h*fp.d*sizeof(float));
+                sgv_add_bias_view(fo, bias);
+                sgv_add_bias(fq, bias);
+                break;
+            }
+            assert(same_view(fbuf, n*sizeof(float), fo.data, fo.stride*sizeof(float),
+                             fq.data, fq.h, fq.w*fq.d*sizeof(float), 0x7f));
+        }
+
+        ubig.w = 37; ubig.h = 29; ubig.d = 4;
+        ubig.data = malloc(ubig.w*ubig.h*ubig.d);
+        for(k = 0; k < ubig.w*ubig.h*ubig.d; k++) {
+            ubig.data[k] = rand() & 255;
+        }
+        /* right up to the end of the buffer */
+        uv = view(ubig, 9, 5, 28, 24);
+        up.w = uv.w; up.h = uv.h; up.d = uv.d;
+        up.data = malloc(up.w*up.h*up.d);
+        copy_rows(up.data, up.w*up.d, uv.data, uv.stride, up.h, up.w*up.d);
+
+        f3.ind = qfilt.ind = uv.d;
+        qfilt.w = qfilt.h = 3;
+        qfilt.outd = f3.outd;
+        qfilt.per_channel = 1;
+        qfilt.data = malloc(9*qfilt.ind*qfilt.outd);
+        qfilt.scales = malloc(qfilt.outd*sizeof(float));
+        sgv_make_qfilt(f3, qfilt);
+        qin.scale = 2/255.0f;
+        qin.zero = 128;
+        qout.scale = 0.05f;
+        qout.zero = 100;
+
+        ubuf = malloc(n);
+        uq.data = malloc(n);
+        for(k = 0; k < 9; k++) {
+            uq.w = k == 0 ? uv.w - 2 : k == 1 ? uv.w/2 : k < 5 ? uv.w : 23;
+            uq.h = k == 0 ? uv.h - 2 : k == 1 ? uv.h/2 : k < 5 ? uv.h : 19;
+            uq.d = k == 0 ? qfilt.outd : uv.d;
+            uo.w = uq.w; uo.h = uq.h; uo.d = uq.d;
+            uo.data = ubuf + 2*(uq.w + 5)*uq.d + 3*uq.d;
+            uo.stride = (uq.w + 5)*uq.d;
+            memset(ubuf, 0x7f, n);
+            switch(k) {
+            case 0:
+                sgv_qconv2d_valid_view(uv, qin, qfilt, bias, uo, qout);
+                sgv_qconv2d_valid(up, qin, qfilt, bias, uq, qout);
+                break;
+            case 1:
+                sgv_qmaxpool2_view(uv, uo);
+                sgv_qmaxpool2(up, uq);
+                break;
+            case 2:
+                sgv_qrelu_view(uv, qin, uo);
+                sgv_qrelu(up, qin, uq);
+                break;
+            case 3:
+            case 4:
+                copy_rows(uo.data, uo.stride, up.data, up.w*up.d, up.h, up.w*up.d);
+                memcpy(uq.data, up.data, up.w*up.h*up.d);
+                if(k == 3) {
+                    sgv_qadd_bias_view(uo, qin, bias);
+                    sgv_qadd_bias(uq, qin, bias);
+                } else {
+                    sgv_blit_view(uo, uv, o0);
+                    sgv_blit(uq, up, o0);
+                }
+                break;
+            case 5:
+                sgv_imgp_affine_transform_view(uv, o1, theta, uo, o0);
+                sgv_imgp_affine_transform(up, o1, theta, uq, o0);
+                break;
+            case 6:
+                sgv_imgp_perspective_transform_view(uv, h, uo);
+                sgv_imgp_perspective_transform(up, h, uq);
+                break;
+            case 7:
+            case 8:
+                j = k == 7 ? SGV_IMGP_RESCALE_AUTO : SGV_IMGP_RESCALE_BICUBIC;
+                sgv_imgp_crop_rescale_filter_view(uv, o0, sz, uo, j);
+                sgv_imgp_crop_rescale_filter(up, o0, sz, uq, j);
+                break;
+            }
+            assert(same_view(ubuf, n, uo.data, uo.stride,
+                             uq.data, uq.h, uq.w*uq.d, 0x7f));
+        }
+
+        free(fbig.data);
+        free(fp.data);
+        free(fq.data);
+        free(fbuf);
+        free(f3.data);
+        free(f5.data);
+        free(wfilt.data);
+        free(bias);
+        free(ubig.data);
+        free(up.data);
+        free(uq.data);
+        free(ubuf);
+        free(qfilt.data);
+        free(qfilt.scales);
+    }
+
+    printf("Test 10 ...\n");
+    {
+        /* w, h, d of the input, w, h of the filter, output channels */
+        int bconvs[][6] = {{9, 7, 3, 3, 3, 16}, {12, 9, 12, 3, 3, 10}, {8, 8, 20, 5, 5, 7},
+                           {3, 3, 5, 3, 3, 70}};
+        sgv_fimg b = {0}, p = {0}, q = {0};
+        sgv_wfilt wfilt;
+        float scores[4*10], probs[4*10];
+        int j, n = 5, sz;
+
+        for(i = 0; i < (int)(sizeof(bconvs)/sizeof(bconvs[0])); i++) {
+            in.w = bconvs[i][0]; in.h = bconvs[i][1]; in.d = bconvs[i][2];
+            filt.w = bconvs[i][3]; filt.h = bconvs[i][4];
+            filt.ind = wfilt.ind = in.d; filt.outd = wfilt.outd = bconvs[i][5];
+            out.w = ref.w = b.w = in.w - filt.w + 1;
+            out.h = ref.h = b.h = in.h - filt.h + 1;
+            out.d = ref.d = b.d = filt.outd;
+            sz = out.w*out.h*out.d;
+            in.data = (float*)malloc(sizeof(float)*n*in.w*in.h*in.d);
+            filt.data = (float*)malloc(sizeof(float)*filt.w*filt.h*filt.ind*filt.outd);
+            wfilt.data = (float*)malloc(sizeof(float)*16*filt.ind*filt.outd);
+            out.data = (float*)malloc(sizeof(float)*n*sz);
+            b.data = (float*)malloc(sizeof(float)*n*sz);
+            ref.data = (float*)malloc(sizeof(float)*sz);
+            fill(in.data, n*in.w*in.h*in.d);
+            fill(filt.data, filt.w*filt.h*filt.ind*filt.outd);
+
+            /* each image of the batch as it would come out on its own */
+            sgv_conv2d_valid_batch(in, n, filt, out);
+            conv = in;
+            for(j = 0; j < n; j++) {
+                conv.data = in.data + j*in.w*in.h*in.d;
+                sgv_conv2d_valid(conv, filt, ref);
+                assert(same(out.data + j*sz, ref.data, sz, 1e-5f));
+            }
+            if(filt.w == 3 && filt.h == 3) {
+                sgv_make_wfilt(filt, wfilt);
+                sgv_conv2d_valid_wfilt_batch(in, n, wfilt, b);
+                for(j = 0; j < n; j++) {
+                    conv.data = in.data + j*in.w*in.h*in.d;
+                    sgv_conv2d_valid_wfilt(conv, wfilt, ref);
+                    assert(same(b.data + j*sz, ref.data, sz, 1e-5f));
+                }
+            }
+
+            sgv_relu_batch(out, n, b);
+            for(j = 0; j < n*sz; j++) {
+                assert(b.data[j] == (out.data[j] > 0 ? out.data[j] : 0));
+            }
+            p = out;
+            q = out;
+            q.w /= 2; q.h /= 2;
+            q.data = b.data;
+            sgv_maxpool2_batch(out, n, q);
+            q.data = ref.data;
+            for(j = 0; j < n; j++) {
+                p.data = out.data + j*sz;
+                sgv_maxpool2(p, q);
+                assert(same(b.data + j*q.w*q.h*q.d, ref.data, q.w*q.h*q.d, 0));
+            }
+
+            free(in.data);
+            free(filt.data);
+            free(wfilt.data);
+            free(out.data);
+            free(b.data);
+            free(ref.data);
+        }
+
+        fill(scores, 4*10);
+        sgv_softmax_batch(scores, 4, 10, probs);
+        for(j = 0; j < 4; j++) {
+            sgv_softmax(scores + j*10, 10, scores + j*10);
+            assert(same(probs + j*10, scores + j*10, 10, 0));
+        }
+    }
+
+    printf("Test 11 ...\n");
+    {
+        static unsigned short codes[65536], back[65536], hx[4096];
+        static float vals[65536], xs[4096];
+        /* values that round to ties, the edges of the range, and their
+           expected fp16 and bfloat16 codes */
+        float ties[8] = {1 + 1/2048.0f, 1 + 3/2048.0f, 65519, 65520,
+                         1/33554432.0f, 3/33554432.0f, 1 + 1/256.0f, 1 + 3/256.0f};
+        unsigned short f16s[8] = {0x3c00, 0x3c02, 0x7bff, 0x7c00, 0, 2, 0x3c04, 0x3c0c};
+        unsigned short bf16s[8] = {0x3f80, 0x3f80, 0x4780, 0x4780,
+                                   0x3300, 0x33c0, 0x3f80, 0x3f82};
+        int formats[2] = {SGV_IMGP_F16, SGV_IMGP_BF16};
+        sgv_himg h = {0}, h2 = {0}, hin = {0}, hout = {0}, hp = {0};
+        sgv_fimg f = {0}, fx = {0}, p = {0};
+        sgv_hfilt hfilt;
+        float ulp, lo, hi, w, *bias;
+        int j, k, c, top;
+
+        h.w = h2.w = f.w = 256; h.h = h2.h = f.h = 256; h.d = h2.d = f.d = 1;
+        h.data = codes; h2.data = back; f.data = vals;
+        hp.w = fx.w = 64; hp.h = fx.h = 64; hp.d = fx.d = 1;
+        hp.data = hx; fx.data = xs;
+        for(j = 0; j < 65536; j++) {
+            codes[j] = (unsigned short)j;
+        }
+        for(k = 0; k < 2; k++) {
+            /* every value goes to a float and back unchanged, bfloat16
+               subnormals aside (they are flushed) */
+            h.format = h2.format = hp.format = formats[k];
+            top = k ? 0x7f80 : 0x7c00;
+            sgv_himg_to_fimg(h, f);
+            sgv_make_himg(f, h2);
+            for(j = 0; j < 65536; j++) {
+                if((j & 0x7fff) > top) {
+                    assert(vals[j] != vals[j]);
+                } else if(k && (j & 0x7f80) == 0) {
+                    assert(back[j] == (j & 0x8000));
+                } else {
+                    assert(back[j] == j && vals[j] == -vals[j ^ 0x8000]);
+                }
+            }
+            for(j = 1; j <= top; j++) {
+                assert(vals[j] > vals[j - 1]);
+            }
+            assert(vals[k ? 0x3f80 : 0x3c00] == 1 && vals[top] > 1e38f);
+
+            /* and floats round to the nearest one, ties to even */
+            for(j = 0; j < 4096; j++) {
+                xs[j] = frand()*(float)pow(2, rand() % 48 - (k ? 40 : 30));
+            }
+            memcpy(xs, ties, sizeof(ties));
+            sgv_make_himg(fx, hp);
+            for(j = 0; j < 8; j++) {
+                assert(hx[j] == (k ? bf16s[j] : f16s[j]));
+            }
+            for(j = 8; j < 4096; j++) {
+                c = hx[j] & 0x7fff;
+                w = vals[c];
+                lo = c > 0 ? vals[c - 1] : 0;
+                hi = c < top ? vals[c + 1] : vals[top];
+                assert(((hx[j] & 0x8000) != 0) == (xs[j] < 0));
+                xs[j] = xs[j] > 0 ? xs[j] : -xs[j];
+                if(k && xs[j] < vals[0x80]) {
+                    assert(c == 0);
+                } else if(c == top) {
+                    assert(xs[j] >= vals[top - 1]);
+                } else {
+                    assert(w - xs[j] <= hi - xs[j] && xs[j] - w <= xs[j] - lo);
+                }
+            }
+        }
+
+        /* conv, bias, relu and pool in half precision against the same
+           steps in floats on the same values */
+        for(i = 0; i < (int)(sizeof(convs)/sizeof(convs[0])); i++) {
+            hin.w = in.w = convs[i][0]; hin.h = in.h = convs[i][1]; hin.d = in.d = convs[i][2];
+            hfilt.w = filt.w = convs[i][3]; hfilt.h = filt.h = convs[i][4];
+            hfilt.ind = filt.ind = in.d; hfilt.outd = filt.outd = convs[i][5];
+            hout.w = out.w = ref.w = in.w - filt.w + 1;
+            hout.h = out.h = ref.h = in.h - filt.h + 1;
+            hout.d = out.d = ref.d = filt.outd;
+            hin.format = formats[i % 2];
+            hfilt.format = formats[i/2 % 2];
+            hout.format = formats[(i + 1) % 2];
+            ulp = hout.format == SGV_IMGP_F16 ? 1/1024.0f : 1/128.0f;
+            in.data = (float*)malloc(sizeof(float)*in.w*in.h*in.d);
+            filt.data = (float*)malloc(sizeof(float)*filt.w*filt.h*filt.ind*filt.outd);
+            out.data = (float*)malloc(sizeof(float)*out.w*out.h*out.d);
+            ref.data = (float*)malloc(sizeof(float)*out.w*out.h*out.d);
+            bias = (float*)malloc(sizeof(float)*out.d);
+            hin.data = (unsigned short*)malloc(2*in.w*in.h*in.d);
+            hfilt.data = (unsigned short*)malloc(2*filt.w*filt.h*filt.ind*filt.outd);
+            hout.data = (unsigned short*)malloc(2*out.w*out.h*out.d);
+            fill(in.data, in.w*in.h*in.d);
+            fill(filt.data, filt.w*filt.h*filt.ind*filt.outd);
+            fill(bias, out.d);
+            sgv_make_himg(in, hin);
+            sgv_himg_to_fimg(hin, in);
+            sgv_make_hfilt(filt, hfilt);
+            h.data = hfilt.data;
+            h.w = filt.w*filt.h*filt.ind*filt.outd; h.h = 1;
+            h.format = hfilt.format;
+            f.w = h.w; f.h = 1;
+            f.data = filt.data;
+            sgv_himg_to_fimg(h, f);
+
+            conv_ref(in, filt, ref);
+            sgv_hconv2d_valid(hin, hfilt, hout);
+            sgv_himg_to_fimg(hout, out);
+            assert(near(out.data, ref.data, out.w*out.h*out.d, ulp));
+
+            /* the float steps on exactly what the half ones get */
+            sgv_add_bias(out, bias);
+            sgv_hadd_bias(hout, bias);
+            memcpy(ref.data, out.data, sizeof(float)*out.w*out.h*out.d);
+            sgv_himg_to_fimg(hout, out);
+            assert(near(out.data, ref.data, out.w*out.h*out.d, ulp/2));
+            sgv_relu(out, ref);
+            sgv_hrelu(hout, hout);
+            sgv_himg_to_fimg(hout, out);
+            assert(same(out.data, ref.data, out.w*out.h*out.d, 0));
+            p = ref;
+            p.w /= 2; p.h /= 2;
+            hp = hout;
+            hp.w /= 2; hp.h /= 2;
+            hp.format = formats[i/2 % 2];
+            hp.data = hx;
+            sgv_maxpool2(out, p);
+            sgv_hmaxpool2(hout, hp);
+            fx.w = p.w; fx.h = p.h; fx.d = p.d;
+            sgv_himg_to_fimg(hp, fx);
+            assert(near(xs, p.data, p.w*p.h*p.d, hp.format == hout.format ? 0 :
+                        (hp.format == SGV_IMGP_F16 ? 1/1024.0f : 1/128.0f)));
+
+            free(in.data);
+            free(filt.data);
+            free(out.data);
+            free(ref.data);
+            free(bias);
+            free(hin.data);
+            free(hfilt.data);
+            free(hout.data);
+        }
+    }
+
+    printf("All tests done.\n");
     return 0;
 }
@@ -1,16 +1,428 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
+#include <assert.h>
 
 #define SGV_JSON_IMPLEMENTATION
+#define SGV_JSON_MMAP
 #include "sgv_json.h"
 
+typedef struct {
+    char text[256];
+    int len, partial;
+} events;
+
+typedef struct {
+    int x;
+    float y;
+} point;
+
+typedef struct {
+    int id, on;
+    sgv_json_i64 big;
+    double scale;
+    sgv_json_string name, extra;
+    point at;
+} conf;
+
+static sgv_json_field point_fields[] = {
+    {"x", SGV_JSON_FIELD_INT, offsetof(point, x), NULL},
+    {"y", SGV_JSON_FIELD_FLOAT, offsetof(point, y), NULL},
+    {NULL, SGV_JSON_FIELD_INT, 0, NULL}
+};
+
+static sgv_json_field conf_fields[] = {
+    {"id", SGV_JSON_FIELD_INT, offsetof(conf, id), NULL},
+    {"name", SGV_JSON_FIELD_STRING, offsetof(conf, name), NULL},
+    {"at", SGV_JSON_FIELD_OBJ, offsetof(conf, at), point_fields},
+    {"big", SGV_JSON_FIELD_INT64, offsetof(conf, big), NULL},
+    {"scale", SGV_JSON_FIELD_DOUBLE, offsetof(conf, scale), NULL},
+    {"on", SGV_JSON_FIELD_BOOL, offsetof(conf, on), NULL},
+    {"extra", SGV_JSON_FIELD_JSON, offsetof(conf, extra), NULL},
+    {NULL, SGV_JSON_FIELD_INT, 0, NULL}
+};
+
+static int record(void* user, sgv_json_event* ev)
+{
+    events* e = user;
+    if(!e->partial) {
+        e->text[e->len++] = 'A' + ev->type;
+    }
+    memcpy(e->text + e->len, ev->str, ev->type >= SGV_JSON_EVENT_KEY ? ev->str_len : 0);
+    e->len += ev->type >= SGV_JSON_EVENT_KEY ? ev->str_len : 0;
+    e->partial = ev->partial;
+    return 0;
+}
+
+static int stream(char* s, int chunk, events* e)
+{
+    sgv_json_stream st;
+    int i, r = 0, len = strlen(s);
+    memset(e, 0, sizeof(*e));
+    sgv_json_stream_init(&st, record, e);
+    for(i = 0; i < len && r == 0; i += chunk) {
+        r = sgv_json_stream_feed(&st, s + i, (len - i < chunk) ? len - i : chunk);
+    }
+    return r ? r : sgv_json_stream_end(&st);
+}
+
+static int collect(void* user, char* buf, int len)
+{
+    events* e = user;
+    memcpy(e->text + e->len, buf, len);
+    e->len += len;
+    return 0;
+}
+
+static int refuse(void* user, char* buf, int len)
+{
+    (void)buf;
+    (void)len;
+    return *(int*)user;
+}
+
+static int parse(char* s, sgv_json_token* tokens, int max_tokens)
+{
+    return sgv_json_parse(s, strlen(s), tokens, max_tokens);
+}
+
 int main()
 {
     char json_str1[] = "{}";
-    sgv_json_token tokens[100];
+    char json_str2[] = " {\"a\": [1, -2.5e1, true, null], \"b\" : \"x\\\"y\", \"c\": {}} ";
+    char json_str3[] = "[\"\", {\"\": \"\"}]";
+    char trunc[] = "[\"a\\\"\\u0041\\\\\"]";
+    char* buf;
+    char* bad[] = {"", "{", "[1,]", "{\"a\":1,}", "{\"a\" 1}", "01", "1 2",
+                   "\"a\nb\"", "\"\\x\"", "[1}", "tru", "-", "1.", "{1:2}"};
+    char deep[SGV_JSON_MAX_DEPTH+1];
+    char lines[] = "{\"id\": 1}\n\n{\"id\": 2, \"s\": \"a\"}\r\n  [3, 4]\n\"last\"\n";
+    sgv_json_token tokens[100], tokens2[100];
+    sgv_json_token* roots[8];
+    char many[512], key[8];
+    char dup[] = "{\"a\": 1, \"b\": {\"x\": true}, \"a\": 2}";
+    char nested[] = "{\"a\": {\"b\": {\"c\": 1}}, \"d\": [[], {}, [2]], \"e\": 3}";
+    char nums[] = "[9007199254740993, -9223372036854775808, 18446744073709551615, "
+                  "1e400, 2.2250738585072011e-308, 0.1, -1.5e3, 3000000000, "
+                  "-9.223372036854775808e18, 9.223372036854775808e18]";
+    char out[128], small[5];
+    char doc[] = "{\"meta\": {\"id\": 7, \"a/b\": \"x\"}, \"skip\": [[{\"]\": \"}\"}]],"
+                 " \"items\": [{\"n\": 1}, {\"n\": 2, \"tags\": [\"p\", \"q\"]}]}";
+    char* ptrs[] = {"/items/1/tags/1", "/meta/a~1b", "/items/1", "/missing",
+                    "/items/01", "", "/b", "a", "/~2"};
+    sgv_json_token* found[5];
+    sgv_json_query qry;
+    char cfg[] = "{\"id\": 7, \"skip\": [1, {\"a\": \"]\"}], \"name\": \"n\\\"m\", "
+                 "\"at\": {\"y\": 0.5, \"x\": -2}, \"big\": -9007199254740993, "
+                 "\"scale\": 2.5e3, \"on\": true, \"extra\": [1, 2], "
+                 "\"\\u0069d\": 8, \"scale\": null}";
+    char* cfg_bad[] = {"{\"id\": \"7\"}", "{\"id\": 3000000000}", "[1]",
+                       "{\"at\": [1]}", "{\"on\": 1}"};
+    sgv_json_schema schema;
+    conf c;
+    sgv_json_map map;
+    FILE* f;
+    double dbl;
+    char* expect = "{\"a\\\"b\":[-9223372036854775808,0.1,1e21,-2.5e-7,100,true,null],"
+                   "\"s\":\"tab\\there \\u0001 \\\\ is long enough to skip\"}";
+    char esc[] = "{\"k\\u00e9y\": \"a long run of plain text\\n\\ud83d\\ude00 \\\\ \\ud800 end\"}";
+    char* utf8_bad[] = {"\"\xc0\xaf\"", "\"\xed\xa0\x80\"", "\"\xf4\x90\x80\x80\"",
+                        "\"\xe2\x82\"", "\"long enough for the vector loop to run \xff\""};
+    sgv_json_writer wr;
+    sgv_json_index idx;
+    sgv_json_i64 i64;
+    sgv_json_u64 u64;
+    double scratch[128];
+    events ev1, ev2;
+    sgv_json_token *v, *el;
+    char* str;
+    int i, len, num, b;
+    double d;
 
     printf("Test 1 ...\n");
-    sgv_json_parse(json_str1, strlen(json_str1), tokens, 100);
+    assert(sgv_json_parse(json_str1, strlen(json_str1), tokens, 100) == 0);
+    assert(sgv_json_type(tokens) == SGV_JSON_TOKEN_OBJ);
+    assert(sgv_json_first_pair(tokens) == NULL);
+
+    printf("Test 2 ...\n");
+    assert(parse(json_str2, tokens, 100) == 0);
+    v = sgv_json_obj_value(tokens, "a");
+    assert(sgv_json_value_array(v) == v);
+    assert(sgv_json_value_int(sgv_json_arr_value(v, 0), &num) == 0 && num == 1);
+    assert(sgv_json_value_double(sgv_json_arr_value(v, 1), &d) == 0 && d == -25.0);
+    assert(sgv_json_value_bool(sgv_json_arr_value(v, 2), &b) == 0 && b == 1);
+    assert(sgv_json_value_null(sgv_json_arr_value(v, 3), &b) == 0 && b == 1);
+    assert(sgv_json_arr_value(v, 4) == NULL);
+    for(i = 0, el = sgv_json_first_element(v); el; el = sgv_json_next_element(el)) {
+        i++;
+    }
+    assert(i == 4);
+    assert(sgv_json_value_string(sgv_json_obj_value(tokens, "b"), &str, &len) == 0);
+    assert(len == 4 && strncmp(str, "x\\\"y", 4) == 0);
+    assert(sgv_json_first_pair(sgv_json_value_obj(sgv_json_obj_value(tokens, "c"))) == NULL);
+    assert(sgv_json_obj_value(tokens, "d") == NULL);
+    assert(sgv_json_key_string(sgv_json_pair_key(sgv_json_first_pair(tokens)), &str, &len) == 0);
+    assert(len == 1 && str[0] == 'a');
+    assert(parse(json_str3, tokens, 100) == 0);
+    assert(sgv_json_value_string(sgv_json_arr_value(tokens, 0), &str, &len) == 0 && len == 0);
+    v = sgv_json_value_obj(sgv_json_arr_value(tokens, 1));
+    assert(sgv_json_value_string(sgv_json_obj_value(v, ""), &str, &len) == 0 && len == 0);
+
+    printf("Test 3 ...\n");
+    assert(parse(json_str2, tokens, 5) == 18);
+    assert(parse(json_str2, NULL, 0) == 18);
+
+    printf("Test 4 ...\n");
+    for(i = 0; i < (int)(sizeof(bad)/sizeof(bad[0])); i++) {
+        assert(parse(bad[i], tokens, 100) == SGV_JSON_ERROR_INVALID);
+    }
+
+    printf("Test 5 ...\n");
+    memset(deep, '[', sizeof(deep));
+    assert(sgv_json_parse(deep, sizeof(deep), tokens, 100) == SGV_JSON_ERROR_DEPTH);
+
+    printf("Test 6 ...\n");
+    assert(sgv_json_parse_ex(json_str2, strlen(json_str2), tokens2, 100, SGV_JSON_PARSE_SIMD) == 0);
+    assert(parse(json_str2, tokens, 100) == 0);
+    for(i = 0; i < 18; i++) {
+        assert(sgv_json_type(&tokens[i]) == sgv_json_type(&tokens2[i]));
+    }
+    v = sgv_json_obj_value(tokens2, "b");
+    assert(sgv_json_value_string(v, &str, &len) == 0 && len == 4);
+    for(i = 0; i < (int)(sizeof(bad)/sizeof(bad[0])); i++) {
+        assert(sgv_json_parse_ex(bad[i], strlen(bad[i]), tokens, 100, SGV_JSON_PARSE_SIMD) < 0);
+    }
+    for(i = 1; i <= (int)strlen(trunc); i++) {
+        /* exact-size copy so reads past the end are caught */
+        buf = (char*)malloc(i);
+        memcpy(buf, trunc, i);
+        assert(sgv_json_parse_ex(buf, i, tokens, 100, 0) ==
+               sgv_json_parse_ex(buf, i, tokens2, 100, SGV_JSON_PARSE_SIMD));
+        free(buf);
+    }
+
+    printf("Test 7 ...\n");
+    assert(stream(json_str2, 1000, &ev1) == 0);
+    assert(strcmp(ev1.text, "AEaCG1G-2.5e1HtrueInullDEbFx\\\"yEcABB") == 0);
+    for(i = 1; i < 8; i++) {
+        assert(stream(json_str2, i, &ev2) == 0);
+        assert(strcmp(ev1.text, ev2.text) == 0);
+    }
+    for(i = 0; i < (int)(sizeof(bad)/sizeof(bad[0])); i++) {
+        assert(stream(bad[i], 1, &ev2) < 0);
+    }
+
+    printf("Test 8 ...\n");
+    for(i = 1; i <= 4; i++) {
+        num = sgv_json_parse_lines(lines, strlen(lines), tokens, 4, roots, 8, &len, i);
+        assert(num > 4);
+        assert(sgv_json_parse_lines(lines, strlen(lines), tokens, num, roots, 8, &len, i) == 0);
+        assert(len == 4);
+        assert(sgv_json_value_int(sgv_json_obj_value(roots[0], "id"), &b) == 0 && b == 1);
+        assert(sgv_json_value_int(sgv_json_obj_value(roots[1], "id"), &b) == 0 && b == 2);
+        assert(sgv_json_value_int(sgv_json_arr_value(roots[2], 1), &b) == 0 && b == 4);
+        assert(sgv_json_value_string(roots[3], &str, &len) == 0 && len == 4);
+    }
+    assert(sgv_json_parse_lines(lines, strlen(lines), tokens, 100, roots, 2, &len, 2) == SGV_JSON_ERROR_ROOTS);
+    assert(len == 4);
+    lines[strlen(lines) - 2] = ',';
+    assert(sgv_json_parse_lines(lines, strlen(lines), tokens, 100, roots, 8, &len, 3) == SGV_JSON_ERROR_INVALID);
+    assert(len == 3);
+
+    printf("Test 9 ...\n");
+    len = sprintf(many, "{");
+    for(i = 0; i < 30; i++) {
+        len += sprintf(many + len, "%s\"k%d\": %d", i ? ", " : "", i, i);
+    }
+    sprintf(many + len, "}");
+    assert(sgv_json_parse(many, strlen(many), tokens, 100) == 0);
+    sgv_json_index_init(&idx, scratch, sizeof(scratch));
+    for(i = 0; i < 30; i++) {
+        sprintf(key, "k%d", i);
+        v = sgv_json_index_value(&idx, tokens, key);
+        assert(v == sgv_json_obj_value(tokens, key));
+        assert(sgv_json_value_int(v, &b) == 0 && b == i);
+    }
+    assert(sgv_json_index_value(&idx, tokens, "k30") == 0);
+    assert(sgv_json_index_value(&idx, tokens, "k") == 0);
+    sgv_json_index_init(&idx, scratch, 16);
+    assert(sgv_json_value_int(sgv_json_index_value(&idx, tokens, "k7"), &b) == 0 && b == 7);
+    assert(sgv_json_parse(dup, strlen(dup), tokens2, 100) == 0);
+    sgv_json_index_init(&idx, scratch, sizeof(scratch));
+    assert(sgv_json_value_int(sgv_json_index_value(&idx, tokens2, "a"), &b) == 0 && b == 1);
+    v = sgv_json_index_value(&idx, tokens2, "b");
+    assert(sgv_json_value_bool(sgv_json_index_value(&idx, v, "x"), &b) == 0 && b == 1);
+    assert(sgv_json_index_value(&idx, tokens2, "x") == 0);
+    assert(sgv_json_index_value(&idx, sgv_json_index_value(&idx, tokens2, "a"), "a") == 0);
+
+    printf("Test 10 ...\n");
+    assert(sgv_json_parse(nested, strlen(nested), tokens, 100) == 0);
+    v = sgv_json_next_pair(sgv_json_first_pair(tokens));
+    assert(sgv_json_key_string(sgv_json_pair_key(v), &str, &len) == 0 && len == 1 && str[0] == 'd');
+    el = sgv_json_first_element(sgv_json_pair_value(v));
+    assert(sgv_json_first_element(sgv_json_element_value(el)) == 0);
+    el = sgv_json_next_element(el);
+    assert(sgv_json_first_pair(sgv_json_element_value(el)) == 0);
+    el = sgv_json_next_element(el);
+    assert(sgv_json_value_int(sgv_json_arr_value(sgv_json_element_value(el), 0), &b) == 0 && b == 2);
+    assert(sgv_json_next_element(el) == 0);
+    v = sgv_json_next_pair(v);
+    assert(sgv_json_value_int(sgv_json_pair_value(v), &b) == 0 && b == 3);
+    assert(sgv_json_next_pair(v) == 0);
+    v = sgv_json_obj_value(sgv_json_obj_value(tokens, "a"), "b");
+    assert(sgv_json_value_int(sgv_json_obj_value(v, "c"), &b) == 0 && b == 1);
+    assert(sgv_json_obj_value(tokens, "c") == 0);
+
+    printf("Test 11 ...\n");
+    assert(sgv_json_parse(nums, strlen(nums), tokens, 100) == 0);
+    for(i = 0; i < 2; i++) {
+        assert(sgv_json_value_int64(sgv_json_arr_value(tokens, 0), &i64) == 0);
+        assert(i64 == (sgv_json_i64)9007199254740992.0 + 1);
+        assert(sgv_json_value_double(sgv_json_arr_value(tokens, 0), &d) == 0);
+        assert(d == 9007199254740992.0);
+    }
+    assert(sgv_json_value_int64(sgv_json_arr_value(tokens, 1), &i64) == 0);
+    assert(i64 == -(sgv_json_i64)4611686018427387904.0 * 2);
+    assert(sgv_json_value_uint64(sgv_json_arr_value(tokens, 1), &u64) < 0);
+    assert(sgv_json_value_int64(sgv_json_arr_value(tokens, 2), &i64) < 0);
+    assert(sgv_json_value_uint64(sgv_json_arr_value(tokens, 2), &u64) == 0);
+    assert(u64 == ~(sgv_json_u64)0);
+    assert(sgv_json_value_double(sgv_json_arr_value(tokens, 3), &d) == 0 && d > 1e308);
+    assert(sgv_json_value_double(sgv_json_arr_value(tokens, 4), &d) == 0);
+    assert(d == 2.2250738585072011e-308);
+    assert(sgv_json_value_double(sgv_json_arr_value(tokens, 5), &d) == 0 && d == 0.1);
+    assert(sgv_json_value_int(sgv_json_arr_value(tokens, 6), &b) == 0 && b == -1500);
+    assert(sgv_json_value_int(sgv_json_arr_value(tokens, 7), &b) < 0);
+    assert(sgv_json_value_int64(sgv_json_arr_value(tokens, 7), &i64) == 0);
+    assert(i64 == 3000000000.0);
+    assert(sgv_json_value_int64(sgv_json_arr_value(tokens, 8), &i64) == 0);
+    assert(i64 == -(sgv_json_i64)4611686018427387904.0 * 2);
+    assert(sgv_json_value_int64(sgv_json_arr_value(tokens, 9), &i64) < 0);
+
+    printf("Test 12 ...\n");
+    sgv_json_write_init(&wr, out, sizeof(out), 0, 0);
+    assert(sgv_json_write_obj_begin(&wr) == 0);
+    assert(sgv_json_write_key(&wr, "a\"b", 3) == 0);
+    assert(sgv_json_write_arr_begin(&wr) == 0);
+    assert(sgv_json_write_int64(&wr, -(sgv_json_i64)4611686018427387904.0 * 2) == 0);
+    assert(sgv_json_write_double(&wr, 0.1) == 0);
+    assert(sgv_json_write_double(&wr, 1e21) == 0);
+    assert(sgv_json_write_double(&wr, -2.5e-7) == 0);
+    assert(sgv_json_write_double(&wr, 100) == 0);
+    assert(sgv_json_write_bool(&wr, 1) == 0);
+    assert(sgv_json_write_null(&wr) == 0);
+    assert(sgv_json_write_arr_end(&wr) == 0);
+    assert(sgv_json_write_key(&wr, "s", 1) == 0);
+    str = "tab\there \x01 \\ is long enough to skip";
+    assert(sgv_json_write_string(&wr, str, strlen(str)) == 0);
+    assert(sgv_json_write_obj_end(&wr) == 0);
+    len = sgv_json_write_end(&wr);
+    assert(len == (int)strlen(expect) && memcmp(out, expect, len) == 0);
+    sgv_json_write_init(&wr, out, sizeof(out), 0, 0);
+    sgv_json_write_obj_begin(&wr);
+    assert(sgv_json_write_string(&wr, "x", 1) == SGV_JSON_ERROR_INVALID);
+    assert(sgv_json_write_obj_end(&wr) == SGV_JSON_ERROR_INVALID);
+    assert(sgv_json_write_end(&wr) == SGV_JSON_ERROR_INVALID);
+    sgv_json_write_init(&wr, out, sizeof(out), 0, 0);
+    sgv_json_write_arr_begin(&wr);
+    assert(sgv_json_write_end(&wr) == SGV_JSON_ERROR_INVALID);
+
+    assert(parse(json_str2, tokens, 100) == 0);
+    sgv_json_write_init(&wr, small, sizeof(small), 0, 0);
+    assert(sgv_json_write_token(&wr, tokens) == 0);
+    assert(sgv_json_write_end(&wr) == 44);
+    memset(&ev1, 0, sizeof(ev1));
+    sgv_json_write_init(&wr, small, sizeof(small), collect, &ev1);
+    assert(sgv_json_write_token(&wr, tokens) == 0);
+    assert(sgv_json_write_end(&wr) == 44 && ev1.len == 44);
+    assert(memcmp(ev1.text, "{\"a\":[1,-2.5e1,true,null],\"b\":\"x\\\"y\",\"c\":{}}", 44) == 0);
+    num = 1;
+    sgv_json_write_init(&wr, small, sizeof(small), refuse, &num);
+    assert(sgv_json_write_token(&wr, tokens) == 0);
+    assert(sgv_json_write_end(&wr) == 44);
+    num = -7;
+    sgv_json_write_init(&wr, small, sizeof(small), refuse, &num);
+    assert(sgv_json_write_token(&wr, tokens) == -7);
+    assert(sgv_json_write_end(&wr) == -7);
+
+    printf("Test 13 ...\n");
+    assert(sgv_json_query_compile(&qry, ptrs, 5) == 0);
+    assert(sgv_json_query_run(&qry, doc, strlen(doc), tokens, 100, found) == 0);
+    assert(sgv_json_value_string(found[0], &str, &len) == 0 && len == 1 && *str == 'q');
+    assert(sgv_json_value_string(found[1], &str, &len) == 0 && len == 1 && *str == 'x');
+    assert(sgv_json_value_int(sgv_json_obj_value(found[2], "n"), &num) == 0 && num == 2);
+    assert(found[3] == NULL && found[4] == NULL);
+    assert(sgv_json_query_run(&qry, doc, strlen(doc), tokens, 4, found) == 12);
+    assert(found[1] != NULL && found[2] == NULL);
+    assert(sgv_json_query_compile(&qry, ptrs + 5, 1) == 0);
+    assert(sgv_json_query_run(&qry, json_str2, strlen(json_str2), tokens, 100, found) == 0);
+    assert(found[0] == tokens && sgv_json_type(found[0]) == SGV_JSON_TOKEN_OBJ);
+    assert(sgv_json_value_string(sgv_json_obj_value(found[0], "b"), &str, &len) == 0 && len == 4);
+    assert(sgv_json_query_compile(&qry, ptrs + 6, 1) == 0);
+    str = "{\"a\": [1, {]}, \"b\": 1}";
+    assert(sgv_json_query_run(&qry, str, strlen(str), tokens, 100, found) == SGV_JSON_ERROR_INVALID);
+    assert(sgv_json_query_compile(&qry, ptrs + 7, 1) == SGV_JSON_ERROR_INVALID);
+    assert(sgv_json_query_compile(&qry, ptrs + 8, 1) == SGV_JSON_ERROR_INVALID);
+
+    printf("Test 14 ...\n");
+    assert(sgv_json_schema_init(&schema, conf_fields) == 0);
+    memset(&c, 0, sizeof(c));
+    assert(sgv_json_decode_struct(&schema, cfg, strlen(cfg), &c) == 0);
+    assert(c.id == 8 && c.on == 1 && c.scale == 2500 && c.at.x == -2 && c.at.y == 0.5f);
+    assert(c.big == -(sgv_json_i64)9007199254740992.0 - 1);
+    assert(c.name.len == 4 && memcmp(c.name.str, "n\\\"m", 4) == 0);
+    assert(c.extra.len == 6 && memcmp(c.extra.str, "[1, 2]", 6) == 0);
+    for(i = 0; i < 5; i++) {
+        assert(sgv_json_decode_struct(&schema, cfg_bad[i], strlen(cfg_bad[i]), &c) == SGV_JSON_ERROR_TYPE);
+    }
+    str = "{\"at\": {\"x\": 1}";
+    assert(sgv_json_decode_struct(&schema, str, strlen(str), &c) == SGV_JSON_ERROR_INVALID);
+    str = "{\"id\": 1,}";
+    assert(sgv_json_decode_struct(&schema, str, strlen(str), &c) == SGV_JSON_ERROR_INVALID);
+
+    printf("Test 15 ...\n");
+    f = fopen("test_snapshot.json", "wb");
+    fputs(json_str2, f);
+    fclose(f);
+    assert(sgv_json_parse_file("test_snapshot.json", &map, tokens, 100, 0) == 0);
+    assert(sgv_json_save_snapshot("test_snapshot.bin", &map, tokens) == 0);
+    sgv_json_unmap(&map);
+    /* read-only: the accessors must not write to the tokens */
+    assert(sgv_json_load_snapshot("test_snapshot.bin", "test_snapshot.json", &map, &v) == 0);
+    assert(sgv_json_value_double(sgv_json_arr_value(sgv_json_obj_value(v, "a"), 1), &dbl) == 0);
+    assert(dbl == -25);
+    assert(sgv_json_value_string(sgv_json_obj_value(v, "b"), &str, &len) == 0);
+    assert(len == 4 && memcmp(str, "x\\\"y", 4) == 0 && str >= map.data && str < map.data + map.len);
+    sgv_json_unmap(&map);
+    assert(sgv_json_load_snapshot("test_snapshot.json", NULL, &map, &v) == SGV_JSON_ERROR_FILE);
+    f = fopen("test_snapshot.json", "ab");
+    fputs("\n", f);
+    fclose(f);
+    assert(sgv_json_load_snapshot("test_snapshot.bin", "test_snapshot.json", &map, &v) == SGV_JSON_ERROR_FILE);
+    remove("test_snapshot.json");
+    remove("test_snapshot.bin");
+    assert(sgv_json_parse_file("test_snapshot.json", &map, tokens, 100, 0) == SGV_JSON_ERROR_FILE);
+
+    printf("Test 16 ...\n");
+    /* counting tokens leaves the text alone */
+    assert(sgv_json_parse_ex(esc, strlen(esc), tokens, 0, SGV_JSON_PARSE_UNESCAPE) == 4);
+    assert(strstr(esc, "\\u00e9") != NULL);
+    assert(sgv_json_parse_ex(esc, strlen(esc), tokens, 100,
+                             SGV_JSON_PARSE_SIMD | SGV_JSON_PARSE_UNESCAPE |
+                             SGV_JSON_PARSE_UTF8) == 0);
+    assert(sgv_json_value_string(sgv_json_obj_value(tokens, "k\xc3\xa9y"), &str, &len) == 0);
+    assert(len == 39 && memcmp(str, "a long run of plain text\n\xf0\x9f\x98\x80 \\ \xef\xbf\xbd end", 39) == 0);
+    sgv_json_write_init(&wr, out, sizeof(out), 0, 0);
+    assert(sgv_json_write_token(&wr, tokens) == 0);
+    len = sgv_json_write_end(&wr);
+    assert(len == 52 && memcmp(out, "{\"k\xc3\xa9y\":\"a long run of plain text\\n"
+                               "\xf0\x9f\x98\x80 \\\\ \xef\xbf\xbd end\"}", 52) == 0);
+    for(i = 0; i < (int)(sizeof(utf8_bad)/sizeof(utf8_bad[0])); i++) {
+        assert(sgv_json_parse_ex(utf8_bad[i], strlen(utf8_bad[i]), tokens, 100, 0) == 0);
+        assert(sgv_json_parse_ex(utf8_bad[i], strlen(utf8_bad[i]), tokens, 100,
+                                 SGV_JSON_PARSE_UTF8) == SGV_JSON_ERROR_INVALID);
+    }
 
     printf("All tests done.\n");
     return 0;
@@ -1,3 +1,5 @@
 #!/bin/bash
 
 gcc -std=c89 -Wall -Wpedantic -Wextra -O2 test.c -I../../ -o out && ./out
+gcc -std=c89 -Wall -Wpedantic -Wextra -O2 -DSGV_JSON_THREADS -pthread test.c -I../../ -o out && ./out
+rm -f out
@@ -0,0 +1,274 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#define SGV_JSON_IMPLEMENTATION
+#define SGV_IMGP_IMPLEMENTATION
+#define SGV_NNET_IMPLEMENTATION
+#define SGV_NNET_MMAP
+#include "sgv_nnet.h"
+
+#define N_WEIGHTS (336 + 1744 + 1440 + 52)
+
+static char model[] =
+    "{\"input\": [20, 18, 3], \"batch\": 3, \"layers\": ["
+    "{\"op\": \"conv2d_valid\", \"filter\": [3, 3], \"outd\": 12},"
+    "{\"op\": \"relu\"},"
+    "{\"name\": \"p1\", \"op\": \"maxpool2\"},"
+    "{\"op\": \"conv2d_bias_relu_maxpool2\", \"filter\": [3, 3], \"outd\": 16},"
+    "{\"op\": \"conv2d_valid\", \"filter\": [3, 3], \"outd\": 10, \"bias\": false},"
+    "{\"name\": \"probs\", \"op\": \"softmax\"},"
+    "{\"name\": \"side\", \"input\": \"p1\", \"op\": \"conv2d_valid\","
+    " \"filter\": [1, 1], \"outd\": 4}"
+    "], \"outputs\": [\"probs\", \"side\"]}";
+
+/* One big image, streamed */
+#define N_BIG_WEIGHTS (224 + 584 + 36)
+
+static char big_model[] =
+    "{\"input\": [40, 120, 3], \"layers\": ["
+    "{\"op\": \"conv2d_valid\", \"filter\": [3, 3], \"outd\": 8},"
+    "{\"op\": \"relu\"},"
+    "{\"name\": \"p1\", \"op\": \"maxpool2\"},"
+    "{\"op\": \"conv2d_bias_relu_maxpool2\", \"filter\": [3, 3], \"outd\": 8},"
+    "{\"name\": \"probs\", \"op\": \"softmax\"},"
+    "{\"name\": \"side\", \"input\": \"p1\", \"op\": \"conv2d_valid\","
+    " \"filter\": [1, 1], \"outd\": 4}"
+    "], \"outputs\": [\"probs\", \"side\"]}";
+
+typedef struct {
+    sgv_img src;
+    sgv_fimg outs[2];
+    int next[2];        /* rows of each output written so far */
+} stream_io;
+
+static void read_rows(void* user, int y, sgv_fimg rows)
+{
+    stream_io* io = (stream_io*)user;
+    sgv_img strip = io->src;
+
+    strip.data += y*io->src.w*io->src.d;
+    strip.h = rows.h;
+    sgv_make_fimg(strip, rows);
+}
+
+static void write_rows(void* user, int i, int y, sgv_fimg rows)
+{
+    stream_io* io = (stream_io*)user;
+    sgv_fimg o = io->outs[i];
+
+    assert(y == io->next[i] && rows.w == o.w && rows.d == o.d);
+    assert(y + rows.h <= o.h);
+    memcpy(o.data + y*o.w*o.d, rows.data, sizeof(float)*rows.h*o.w*o.d);
+    io->next[i] = y + rows.h;
+}
+
+static void fill(float* p, long n)
+{
+    long i;
+    for(i = 0; i < n; i++) {
+        p[i] = rand() / (float)RAND_MAX - 0.5f;
+    }
+}
+
+static int same(float* a, float* b, long n, float tol)
+{
+    long i;
+    for(i = 0; i < n; i++) {
+        if(a[i] - b[i] > tol || b[i] - a[i] > tol) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static sgv_fimg make(int w, int h, int d)
+{
+    sgv_fimg img = {0};
+    img.w = w; img.h = h; img.d = d;
+    img.data = (float*)malloc(sizeof(float)*w*h*d);
+    return img;
+}
+
+/* The model glued together by hand, a buffer per tensor, on one image */
+static void run_ref(sgv_fimg in, float* wt, float* probs, float* side)
+{
+    sgv_fimg c1 = make(18, 16, 12), p1 = make(9, 8, 12), c2 = make(3, 3, 16);
+    sgv_fimg c3 = make(1, 1, 10), s = make(9, 8, 4);
+    sgv_filt f;
+
+    f.w = f.h = 3; f.ind = 3; f.outd = 12; f.data = wt;
+    sgv_conv2d_valid(in, f, c1);
+    sgv_add_bias(c1, wt + 324);
+    sgv_relu(c1, c1);
+    sgv_maxpool2(c1, p1);
+    f.ind = 12; f.outd = 16; f.data = wt + 336;
+    sgv_conv2d_bias_relu_maxpool2(p1, f, wt + 336 + 1728, c2);
+    f.ind = 16; f.outd = 10; f.data = wt + 336 + 1744;
+    sgv_conv2d_valid(c2, f, c3);
+    sgv_softmax(c3.data, 10, probs);
+    f.w = f.h = 1; f.ind = 12; f.outd = 4; f.data = wt + 336 + 1744 + 1440;
+    sgv_conv2d_valid(p1, f, s);
+    sgv_add_bias(s, wt + 336 + 1744 + 1440 + 48);
+    memcpy(side, s.data, sizeof(float)*9*8*4);
+    free(c1.data); free(p1.data); free(c2.data); free(c3.data); free(s.data);
+}
+
+static void check_run(sgv_nnet* net, sgv_fimg in, float* wt)
+{
+    sgv_fimg one = in, probs, side;
+    float* arena = (float*)malloc(sizeof(float)*net->arena_size);
+    float rp[10], rs[9*8*4];
+    int b;
+
+    probs = sgv_nnet_run(net, in, arena);
+    side = sgv_nnet_output(net, arena, 1);
+    assert(probs.w == 1 && probs.h == 1 && probs.d == 10);
+    assert(side.w == 9 && side.h == 8 && side.d == 4);
+    for(b = 0; b < net->batch; b++) {
+        one.data = in.data + b*in.w*in.h*in.d;
+        run_ref(one, wt, rp, rs);
+        assert(same(probs.data + b*10, rp, 10, 1e-5f));
+        assert(same(side.data + b*9*8*4, rs, 9*8*4, 1e-5f));
+    }
+    free(arena);
+}
+
+static int load(sgv_nnet* net, const char* text, float* wt, long n)
+{
+    static char buf[2048];
+    sgv_json_token tokens[256];
+    strcpy(buf, text);
+    return sgv_nnet_load(net, buf, (int)strlen(buf), tokens, 256, wt, n);
+}
+
+int main()
+{
+    static sgv_nnet net;
+    sgv_json_token few[8];
+    sgv_nnet_tensor* t;
+    sgv_nnet_weights mapped;
+    sgv_fimg in = make(20, 18*3, 3);
+    float* wt = (float*)malloc(sizeof(float)*N_WEIGHTS);
+    char bad[2048];
+    static unsigned char pixels[40*120*3];
+    static float big_wt[N_BIG_WEIGHTS];
+    static int strips[] = {1, 2, 5, 8};
+    stream_io io;
+    sgv_fimg ref[2], big;
+    float* arena;
+    long full_size;
+    FILE* fp;
+    int i, j;
+
+    in.h = 18;
+    fill(in.data, 20*18*3*3);
+    fill(wt, N_WEIGHTS);
+    for(i = 0; i < 40*120*3; i++) {
+        pixels[i] = (unsigned char)(rand() % 256);
+    }
+
+    printf("Test 1 ...\n");
+    assert(load(&net, model, wt, N_WEIGHTS) == 0);
+    assert(net.n_layers == 7 && net.n_outputs == 2 && net.batch == 3);
+    check_run(&net, in, wt);
+
+    printf("Test 2 ...\n");
+    /* relu and softmax in place, the rest apart while alive together */
+    t = net.tensors;
+    assert(t[2].offset == t[1].offset && t[6].offset == t[5].offset);
+    for(i = 1; i <= net.n_layers; i++) {
+        assert(t[i].offset % 16 == 0 && t[i].offset + t[i].size <= net.arena_size);
+        for(j = 1; j < i; j++) {
+            if(t[i].home == i && t[j].home == j &&
+               t[i].first <= t[j].last && t[j].first <= t[i].last) {
+                assert(t[i].offset >= t[j].offset + t[j].size ||
+                       t[j].offset >= t[i].offset + t[i].size);
+            }
+        }
+    }
+    assert(t[3].last == 6 && t[6].last == 7);
+    assert(net.arena_size < net.naive_size);
+
+    printf("Test 3 ...\n");
+    strcpy(bad, model);
+    assert(sgv_nnet_load(&net, bad, (int)strlen(bad), few, 8, wt, N_WEIGHTS) > 8);
+    assert(load(&net, model, wt, N_WEIGHTS - 1) == SGV_NNET_ERROR_WEIGHTS);
+    assert(load(&net, model, wt, N_WEIGHTS + 1) == SGV_NNET_ERROR_WEIGHTS);
+    assert(load(&net, "{\"input\": [4, 4, 1], \"layers\": [{\"op\": \"tanh\"}]}",
+                wt, 0) == SGV_NNET_ERROR_MODEL);
+    assert(load(&net, "{\"input\": [4, 4, 1], \"layers\": [{\"op\": \"relu\","
+                "\"input\": \"x\"}]}", wt, 0) == SGV_NNET_ERROR_MODEL);
+    assert(load(&net, "{\"input\": [4, 4, 1], \"layers\": [{\"op\": \"relu\"}],"
+                "\"outputs\": [\"input\"]}", wt, 0) == SGV_NNET_ERROR_MODEL);
+    assert(load(&net, "{\"input\": [3, 3, 1], \"layers\": [{\"op\": \"maxpool2\"},"
+                "{\"op\": \"maxpool2\"}]}", wt, 0) == SGV_NNET_ERROR_MODEL);
+    assert(load(&net, "{\"input\": [4, 4], \"layers\": [{\"op\": \"relu\"}]}",
+                wt, 0) == SGV_NNET_ERROR_MODEL);
+    assert(load(&net, "{\"input\": [4, 4, 1], \"layers\": [{\"op\": \"relu\"}",
+                wt, 0) == SGV_NNET_ERROR_JSON);
+    assert(load(&net, "{\"input\": [4, 4, 1], \"layers\": [{\"op\": \"relu\"}]}",
+                wt, 0) == 0);
+
+    printf("Test 4 ...\n");
+    fp = fopen("test_weights.bin", "wb");
+    assert(fp && fwrite(wt, sizeof(float), N_WEIGHTS, fp) == N_WEIGHTS);
+    fclose(fp);
+    assert(sgv_nnet_map_weights("test_weights.bin", &mapped) == 0);
+    assert(mapped.n == N_WEIGHTS);
+    assert(load(&net, model, mapped.data, mapped.n) == 0);
+    check_run(&net, in, mapped.data);
+    sgv_nnet_unmap_weights(&mapped);
+    remove("test_weights.bin");
+    assert(sgv_nnet_map_weights("test_weights.bin", &mapped) == SGV_NNET_ERROR_FILE);
+
+    printf("Test 5 ...\n");
+    /* Strips against the whole image at once */
+    fill(big_wt, N_BIG_WEIGHTS);
+    io.src.data = pixels;
+    io.src.w = 40; io.src.h = 120; io.src.d = 3;
+    big = make(40, 120, 3);
+    sgv_make_fimg(io.src, big);
+    assert(load(&net, big_model, big_wt, N_BIG_WEIGHTS) == 0);
+    full_size = net.arena_size;
+    arena = (float*)malloc(sizeof(float)*full_size);
+    sgv_nnet_run(&net, big, arena);
+    ref[0] = make(8, 28, 8);
+    ref[1] = make(19, 59, 4);
+    io.outs[0] = make(8, 28, 8);
+    io.outs[1] = make(19, 59, 4);
+    for(i = 0; i < 2; i++) {
+        memcpy(ref[i].data, sgv_nnet_output(&net, arena, i).data,
+               sizeof(float)*ref[i].w*ref[i].h*ref[i].d);
+    }
+    free(arena);
+    for(j = 0; j < (int)(sizeof(strips)/sizeof(strips[0])); j++) {
+        assert(load(&net, big_model, big_wt, N_BIG_WEIGHTS) == 0);
+        assert(sgv_nnet_plan_stream(&net, strips[j]) == 0);
+        assert(net.arena_size < full_size);
+        arena = (float*)malloc(sizeof(float)*net.arena_size);
+        io.next[0] = io.next[1] = 0;
+        sgv_nnet_stream(&net, read_rows, write_rows, &io, arena);
+        assert(io.next[0] == 28 && io.next[1] == 59);
+        for(i = 0; i < 2; i++) {
+            assert(same(io.outs[i].data, ref[i].data,
+                        (long)ref[i].w*ref[i].h*ref[i].d, 1e-4f));
+        }
+        free(arena);
+    }
+    assert(sgv_nnet_plan_stream(&net, 0) == SGV_NNET_ERROR_MODEL);
+    assert(load(&net, model, wt, N_WEIGHTS) == 0);
+    assert(sgv_nnet_plan_stream(&net, 4) == SGV_NNET_ERROR_MODEL);
+    for(i = 0; i < 2; i++) {
+        free(ref[i].data);
+        free(io.outs[i].data);
+    }
+    free(big.data);
+
+    free(in.data);
+    free(wt);
+    printf("All tests done.\n");
+    return 0;
+}